@@ -134,4 +134,59 @@ task<ByteArray> Utility::ReadFileAsync(const wstring& fileName)
 {
 	shared_ptr<wstring> SharedPtr = make_shared<wstring>(fileName);
 	return create_task([=] { return ReadFileHelperEx(SharedPtr); });
+}
+
+MappedFile::MappedFile() :
+	m_File(INVALID_HANDLE_VALUE),
+	m_Mapping(nullptr),
+	m_Data(nullptr),
+	m_Size(0)
+{
+}
+
+bool MappedFile::Open(const wstring& fileName)
+{
+	Close();
+
+	m_File = CreateFileW(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+	if (m_File == INVALID_HANDLE_VALUE)
+		return false;
+
+	// Empty files cannot be mapped
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(m_File, &fileSize) || fileSize.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+
+	m_Mapping = CreateFileMappingW(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_Mapping != nullptr)
+		m_Data = (const byte*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+
+	if (m_Data == nullptr)
+	{
+		Utility::Printf(L"Could not map %s\n", fileName.c_str());
+		Close();
+		return false;
+	}
+
+	m_Size = (size_t)fileSize.QuadPart;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_Data != nullptr)
+		UnmapViewOfFile(m_Data);
+	if (m_Mapping != nullptr)
+		CloseHandle(m_Mapping);
+	if (m_File != INVALID_HANDLE_VALUE)
+		CloseHandle(m_File);
+
+	m_File = INVALID_HANDLE_VALUE;
+	m_Mapping = nullptr;
+	m_Data = nullptr;
+	m_Size = 0;
 }
\ No newline at end of file
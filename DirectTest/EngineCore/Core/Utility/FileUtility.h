@@ -21,4 +21,28 @@ namespace Utility
 	// Same as previous except that it does not block but instead returns a task.
 	task<ByteArray> ReadFileAsync(const wstring& fileName);
 
+	// A whole file mapped read-only into memory.  Pages are read from disk as they are touched.
+	class MappedFile
+	{
+	public:
+		MappedFile();
+		~MappedFile() { Close(); }
+
+		bool Open(const wstring& fileName);
+		void Close();
+
+		bool IsOpen() const { return m_Data != nullptr; }
+		const byte* GetData() const { return m_Data; }
+		size_t GetSize() const { return m_Size; }
+
+	private:
+		MappedFile(const MappedFile&);
+		MappedFile& operator=(const MappedFile&);
+
+		HANDLE m_File;
+		HANDLE m_Mapping;
+		const byte* m_Data;
+		size_t m_Size;
+	};
+
 } // namespace Utility
\ No newline at end of file
@@ -0,0 +1,306 @@
+#include "Hash.h"
+#include <cstring>
+
+// The SSE4.2 and AVX2 paths are built for x64 with any compiler.  GCC and Clang only allow their
+// intrinsics in functions marked for those instruction sets, Visual C++ in any function.
+#if defined(_M_X64)
+#define ENABLE_X64_PATHS 1
+#define X64_TARGET(Features)
+#include <intrin.h>
+#include <immintrin.h>
+#elif defined(__x86_64__)
+#define ENABLE_X64_PATHS 1
+#define X64_TARGET(Features) __attribute__((target(Features)))
+#include <cpuid.h>
+#include <immintrin.h>
+#else
+#define ENABLE_X64_PATHS 0
+#endif
+
+using namespace Utility;
+
+namespace
+{
+#if ENABLE_X64_PATHS
+	void cpuid(int Info[4], int Leaf)
+	{
+#ifdef _MSC_VER
+		__cpuidex(Info, Leaf, 0);
+#else
+		__cpuid_count(Leaf, 0, Info[0], Info[1], Info[2], Info[3]);
+#endif
+	}
+
+	uint64_t xgetbv(uint32_t Register)
+	{
+#ifdef _MSC_VER
+		return _xgetbv(Register);
+#else
+		uint32_t Low, High;
+		__asm__ volatile("xgetbv" : "=a"(Low), "=d"(High) : "c"(Register));
+		return ((uint64_t)High << 32) | Low;
+#endif
+	}
+#endif
+
+	CpuFeatures DetectCpuFeatures()
+	{
+		CpuFeatures Features = {};
+
+#if ENABLE_X64_PATHS
+		int Info[4];
+		cpuid(Info, 0);
+		const int MaxLeaf = Info[0];
+		if (MaxLeaf < 1)
+			return Features;
+
+		cpuid(Info, 1);
+		Features.SSE42 = (Info[2] & (1 << 20)) != 0;
+
+		// AVX needs the OS to save the upper halves of the registers on a context switch
+		const bool OSXSAVE = (Info[2] & (1 << 27)) != 0;
+		const bool AVX = (Info[2] & (1 << 28)) != 0;
+		if (MaxLeaf >= 7 && OSXSAVE && AVX && (xgetbv(0) & 6) == 6)
+		{
+			cpuid(Info, 7);
+			Features.AVX2 = (Info[1] & (1 << 5)) != 0;
+		}
+#endif
+
+		return Features;
+	}
+
+	struct Crc32CTable
+	{
+		uint32_t Entries[256];
+
+		Crc32CTable()
+		{
+			for (uint32_t i = 0; i < 256; ++i)
+			{
+				uint32_t Crc = i;
+				for (int Bit = 0; Bit < 8; ++Bit)
+					Crc = (Crc >> 1) ^ (0x82F63B78 & (0u - (Crc & 1)));
+				Entries[i] = Crc;
+			}
+		}
+	};
+
+	const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+	const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+	const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+	const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+	const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+	const uint32_t PRIME32_1 = 0x9E3779B1U;
+
+	// Data is consumed in stripes of four 64-bit lanes, the accumulators are scrambled every block
+	const size_t STRIPE_SIZE = 32;
+	const size_t STRIPES_PER_BLOCK = 16;
+	// Shorter keys are hashed faster without switching to the AVX registers
+	const size_t MIN_AVX2_STRIPES = 8;
+
+	const uint64_t LANE_KEYS[4] = { 0xBE4BA423396CFEB8ULL, 0x1CAD21F72C81017CULL, 0xDB979083E96DD4DEULL, 0x1F67B3B7A4A44072ULL };
+	const uint64_t SCRAMBLE_KEYS[4] = { 0x78E5C0CC4EE679CBULL, 0x2172FFCC7DD05A82ULL, 0x8E2443F7744608B8ULL, 0x4C263A81E69035E0ULL };
+
+	inline uint64_t Read64(const uint8_t* Data)
+	{
+		uint64_t Value;
+		memcpy(&Value, Data, sizeof(Value));
+		return Value;
+	}
+
+	inline uint32_t Read32(const uint8_t* Data)
+	{
+		uint32_t Value;
+		memcpy(&Value, Data, sizeof(Value));
+		return Value;
+	}
+
+	inline uint64_t RotateLeft(uint64_t Value, int Bits)
+	{
+		return (Value << Bits) | (Value >> (64 - Bits));
+	}
+
+	// 64x64 multiply with the halves of the 128-bit product folded together
+	inline uint64_t MultiplyFold(uint64_t A, uint64_t B)
+	{
+#if defined(_M_X64)
+		uint64_t High;
+		const uint64_t Low = _umul128(A, B, &High);
+		return Low ^ High;
+#elif defined(__SIZEOF_INT128__)
+		const unsigned __int128 Product = (unsigned __int128)A * B;
+		return (uint64_t)Product ^ (uint64_t)(Product >> 64);
+#else
+		const uint64_t LoLo = (A & 0xFFFFFFFF) * (B & 0xFFFFFFFF);
+		const uint64_t HiLo = (A >> 32) * (B & 0xFFFFFFFF);
+		const uint64_t LoHi = (A & 0xFFFFFFFF) * (B >> 32);
+		const uint64_t HiHi = (A >> 32) * (B >> 32);
+		const uint64_t Cross = (LoLo >> 32) + (HiLo & 0xFFFFFFFF) + LoHi;
+		const uint64_t High = HiHi + (HiLo >> 32) + (Cross >> 32);
+		const uint64_t Low = (Cross << 32) | (LoLo & 0xFFFFFFFF);
+		return Low ^ High;
+#endif
+	}
+
+	void AccumulateScalar(uint64_t Acc[4], const uint8_t* Data, size_t NumStripes, const uint64_t Keys[4])
+	{
+		for (size_t Stripe = 0; Stripe < NumStripes; ++Stripe, Data += STRIPE_SIZE)
+		{
+			uint64_t Lanes[4];
+			for (int i = 0; i < 4; ++i)
+				Lanes[i] = Read64(Data + i * 8);
+
+			for (int i = 0; i < 4; ++i)
+			{
+				const uint64_t Keyed = Lanes[i] ^ Keys[i];
+				Acc[i] += Lanes[i ^ 1];
+				Acc[i] += (Keyed & 0xFFFFFFFF) * (Keyed >> 32);
+			}
+
+			if ((Stripe + 1) % STRIPES_PER_BLOCK == 0)
+			{
+				for (int i = 0; i < 4; ++i)
+					Acc[i] = (Acc[i] ^ (Acc[i] >> 47) ^ SCRAMBLE_KEYS[i]) * PRIME32_1;
+			}
+		}
+	}
+
+#if ENABLE_X64_PATHS
+	// The same steps as AccumulateScalar, the four lanes in one register
+	X64_TARGET("avx2") void AccumulateAVX2(uint64_t Acc[4], const uint8_t* Data, size_t NumStripes, const uint64_t Keys[4])
+	{
+		__m256i Accumulator = _mm256_loadu_si256((const __m256i*)Acc);
+		const __m256i KeyVector = _mm256_loadu_si256((const __m256i*)Keys);
+		const __m256i ScrambleVector = _mm256_loadu_si256((const __m256i*)SCRAMBLE_KEYS);
+		const __m256i Prime = _mm256_set1_epi32((int)PRIME32_1);
+
+		for (size_t Stripe = 0; Stripe < NumStripes; ++Stripe, Data += STRIPE_SIZE)
+		{
+			const __m256i Lanes = _mm256_loadu_si256((const __m256i*)Data);
+			const __m256i Keyed = _mm256_xor_si256(Lanes, KeyVector);
+			const __m256i Product = _mm256_mul_epu32(Keyed, _mm256_srli_epi64(Keyed, 32));
+			// Lane i ^ 1
+			const __m256i Swapped = _mm256_shuffle_epi32(Lanes, _MM_SHUFFLE(1, 0, 3, 2));
+			Accumulator = _mm256_add_epi64(Accumulator, _mm256_add_epi64(Swapped, Product));
+
+			if ((Stripe + 1) % STRIPES_PER_BLOCK == 0)
+			{
+				__m256i Mixed = _mm256_xor_si256(Accumulator, _mm256_srli_epi64(Accumulator, 47));
+				Mixed = _mm256_xor_si256(Mixed, ScrambleVector);
+				// 64-bit multiply by a 32-bit constant, from the two 32x32 products
+				const __m256i Low = _mm256_mul_epu32(Mixed, Prime);
+				const __m256i High = _mm256_mul_epu32(_mm256_srli_epi64(Mixed, 32), Prime);
+				Accumulator = _mm256_add_epi64(Low, _mm256_slli_epi64(High, 32));
+			}
+		}
+
+		_mm256_storeu_si256((__m256i*)Acc, Accumulator);
+	}
+
+	X64_TARGET("sse4.2") uint32_t Crc32CSSE42(const uint8_t* Bytes, const uint8_t* End, uint32_t Crc)
+	{
+		uint64_t Crc64 = Crc;
+		for (; Bytes + 8 <= End; Bytes += 8)
+			Crc64 = _mm_crc32_u64(Crc64, Read64(Bytes));
+		Crc = (uint32_t)Crc64;
+		for (; Bytes < End; ++Bytes)
+			Crc = _mm_crc32_u8(Crc, *Bytes);
+		return Crc;
+	}
+#endif
+
+	uint32_t Crc32CTableDriven(const uint8_t* Bytes, const uint8_t* End, uint32_t Crc)
+	{
+		static const Crc32CTable s_Table;
+
+		for (; Bytes < End; ++Bytes)
+			Crc = s_Table.Entries[(Crc ^ *Bytes) & 0xFF] ^ (Crc >> 8);
+		return Crc;
+	}
+
+	uint64_t HashBytes(const void* Data, size_t Size, uint64_t Seed, bool UseAVX2)
+	{
+		const uint8_t* Bytes = (const uint8_t*)Data;
+
+		uint64_t Keys[4];
+		for (int i = 0; i < 4; ++i)
+			Keys[i] = LANE_KEYS[i] + Seed;
+
+		uint64_t Acc[4] = { PRIME64_3, PRIME64_1, PRIME64_2, PRIME32_1 };
+
+		const size_t NumStripes = Size / STRIPE_SIZE;
+#if ENABLE_X64_PATHS
+		if (UseAVX2 && NumStripes >= MIN_AVX2_STRIPES)
+			AccumulateAVX2(Acc, Bytes, NumStripes, Keys);
+		else
+#endif
+			AccumulateScalar(Acc, Bytes, NumStripes, Keys);
+
+		uint64_t Hash = Size * PRIME64_1 + Seed;
+		Hash += MultiplyFold(Acc[0] ^ SCRAMBLE_KEYS[0], Acc[1] ^ SCRAMBLE_KEYS[1]);
+		Hash += MultiplyFold(Acc[2] ^ SCRAMBLE_KEYS[2], Acc[3] ^ SCRAMBLE_KEYS[3]);
+
+		// Less than a stripe left
+		Bytes += NumStripes * STRIPE_SIZE;
+		const uint8_t* const End = (const uint8_t*)Data + Size;
+
+		for (; Bytes + 8 <= End; Bytes += 8)
+		{
+			Hash ^= RotateLeft(Read64(Bytes) * PRIME64_2, 31) * PRIME64_1;
+			Hash = RotateLeft(Hash, 27) * PRIME64_1 + PRIME64_4;
+		}
+
+		if (Bytes + 4 <= End)
+		{
+			Hash ^= Read32(Bytes) * PRIME64_1;
+			Hash = RotateLeft(Hash, 23) * PRIME64_2 + PRIME64_3;
+			Bytes += 4;
+		}
+
+		for (; Bytes < End; ++Bytes)
+		{
+			Hash ^= *Bytes * PRIME64_5;
+			Hash = RotateLeft(Hash, 11) * PRIME64_1;
+		}
+
+		Hash ^= Hash >> 37;
+		Hash *= 0x165667919E3779F9ULL;
+		Hash ^= Hash >> 32;
+		return Hash;
+	}
+}
+
+const CpuFeatures& Utility::GetCpuFeatures()
+{
+	static const CpuFeatures s_Features = DetectCpuFeatures();
+	return s_Features;
+}
+
+uint32_t Utility::Crc32C(const void* Data, size_t Size, uint32_t Crc)
+{
+	const uint8_t* Bytes = (const uint8_t*)Data;
+
+#if ENABLE_X64_PATHS
+	if (GetCpuFeatures().SSE42)
+		return Crc32CSSE42(Bytes, Bytes + Size, Crc);
+#endif
+
+	return Crc32CTableDriven(Bytes, Bytes + Size, Crc);
+}
+
+uint32_t Utility::Crc32CScalar(const void* Data, size_t Size, uint32_t Crc)
+{
+	const uint8_t* Bytes = (const uint8_t*)Data;
+	return Crc32CTableDriven(Bytes, Bytes + Size, Crc);
+}
+
+uint64_t Utility::Hash64(const void* Data, size_t Size, uint64_t Seed)
+{
+	return HashBytes(Data, Size, Seed, GetCpuFeatures().AVX2);
+}
+
+uint64_t Utility::Hash64Scalar(const void* Data, size_t Size, uint64_t Seed)
+{
+	return HashBytes(Data, Size, Seed, false);
+}
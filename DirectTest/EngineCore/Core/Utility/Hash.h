@@ -1,11 +1,13 @@
 #pragma once
 
-#include "../Maths/Common.h"
-
-// This requires SSE4.2 which is present on Intel Nehalem (Nov. 2008)
-// and AMD Bulldozer (Oct. 2011) processors.  I could put a runtime
-// check for this, but I'm just going to assume people playing with
-// DirectX 12 on Windows 10 have fairly recent machines.
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// The CRC32 instruction needs SSE4.2, which is present on Intel Nehalem (Nov. 2008) and AMD
+// Bulldozer (Oct. 2011) processors.  The CPU is checked once, older ones get a table-driven CRC
+// that produces the same values.
 #ifdef _M_X64
 #define ENABLE_SSE_CRC32 1
 #else
@@ -13,44 +15,81 @@
 #endif
 
 #if ENABLE_SSE_CRC32
+#include <intrin.h>
 #pragma intrinsic(_mm_crc32_u32)
 #pragma intrinsic(_mm_crc32_u64)
 #endif
 
-#ifdef _WIN32
-
-//  Windows
-#define cpuid(info, x)    __cpuidex(info, x, 0)
-
-#else
-
-//  GCC Intrinsics
-#include <cpuid.h>
-void cpuid(int info[4], int InfoType) {
-	__cpuid_count(InfoType, 0, info[0], info[1], info[2], info[3]);
-}
-
-#endif
-
 namespace Utility
 {
-	inline size_t HashRange(const uint32_t* const Begin, const uint32_t* const End, size_t Hash)
+	struct CpuFeatures
 	{
+		bool SSE42;
+		bool AVX2;		// Also checks that the OS saves the YMM registers
+	};
+
+	// Detected on the first call
+	const CpuFeatures& GetCpuFeatures();
+
+	// CRC32C (Castagnoli) without the initial and final inversion, as the SSE4.2 instruction computes it
+	uint32_t Crc32C(const void* Data, size_t Size, uint32_t Crc);
+
+	// 64-bit hash for keys that must not collide in practice.  Uses AVX2 when available; every code
+	// path returns the same value, so the result can be stored on disk.
+	uint64_t Hash64(const void* Data, size_t Size, uint64_t Seed = 0);
+
+	// The same two without the SSE4.2 and AVX2 paths, to check those against
+	uint32_t Crc32CScalar(const void* Data, size_t Size, uint32_t Crc);
+	uint64_t Hash64Scalar(const void* Data, size_t Size, uint64_t Seed = 0);
+
+	// Lookup in a map from 64-bit hashes to shared entries that keep the bytes they were hashed from in
+	// a Description member.  A different key with the same hash moves on to the next hash value, so
+	// colliding keys still get entries of their own.  Safe with a concurrent map: when two threads
+	// insert the same key, the one that loses gets the entry of the other.
+	//
+	// Returns the entry found, or the one Create(Key) made and inserted, in which case Inserted is set.
+	// Create() may take the contents of Key.
+	template <typename MapType, typename CreateFunction>
+	typename MapType::mapped_type FindOrInsertProbed(MapType& Map, uint64_t Hash, std::vector<uint8_t>& Key,
+		CreateFunction Create, bool& Inserted)
+	{
+		typename MapType::mapped_type Entry;
+		Inserted = false;
+
+		for (;; ++Hash)
+		{
+			auto Iter = Map.find(Hash);
+			if (Iter == Map.end())
+			{
+				if (Entry == nullptr)
+					Entry = Create(Key);
+
+				// Someone may get here first between the find and the insert, theirs wins if it is the same key
+				auto Result = Map.insert(std::make_pair(Hash, Entry));
+				if (Result.second)
+				{
+					Inserted = true;
+					return Entry;
+				}
+				Iter = Result.first;
+			}
+
+			const std::vector<uint8_t>& Wanted = Entry != nullptr ? Entry->Description : Key;
+			if (Iter->second->Description == Wanted)
+				return Iter->second;
+		}
+	}
 
-		int info[4];
-		cpuid(info, 0);
-		int nIds = info[0];
-
-		cpuid(info, 0x80000000);
-		unsigned nExIds = info[0];
-
-		bool HW_SSE42 = (info[2] & ((int)1 << 20)) != 0;
-		if (HW_SSE42) {
-			const uint64_t* Iter64 = (const uint64_t*)Math::AlignUp(Begin, 8);
-			const uint64_t* const End64 = (const uint64_t* const)Math::AlignDown(End, 8);
+	inline size_t HashRange(const uint32_t* const Begin, const uint32_t* const End, size_t Hash)
+	{
+#if ENABLE_SSE_CRC32
+		if (GetCpuFeatures().SSE42)
+		{
+			const uint64_t* Iter64 = (const uint64_t*)(((uintptr_t)Begin + 7) & ~(uintptr_t)7);
+			const uint64_t* const End64 = (const uint64_t* const)((uintptr_t)End & ~(uintptr_t)7);
 
 			// If not 64-bit aligned, start with a single u32
-			if ((uint32_t*)Iter64 > Begin)
+			if ((uint32_t*)Iter64 > Begin && Begin < End)
 				Hash = _mm_crc32_u32((uint32_t)Hash, *Begin);
 
 			// Iterate over consecutive u64 values
@@ -60,15 +99,12 @@ namespace Utility
 			// If there is a 32-bit remainder, accumulate that
 			if ((uint32_t*)Iter64 < End)
 				Hash = _mm_crc32_u32((uint32_t)Hash, *(uint32_t*)Iter64);
-		}
-		else {
 
-			// An inexpensive hash for CPUs lacking SSE4.2
-			for (const uint32_t* Iter = Begin; Iter < End; ++Iter)
-				Hash = 16777619U * Hash ^ *Iter;
+			return Hash;
 		}
+#endif
 
-		return Hash;
+		return Crc32C(Begin, (End - Begin) * sizeof(uint32_t), (uint32_t)Hash);
 	}
 
 	template <typename T> inline size_t HashState(const T* StateDesc, size_t Count = 1, size_t Hash = 2166136261U)
@@ -77,4 +113,4 @@ namespace Utility
 		return HashRange((uint32_t*)StateDesc, (uint32_t*)(StateDesc + Count), Hash);
 	}
 
-} // namespace Utility
\ No newline at end of file
+} // namespace Utility
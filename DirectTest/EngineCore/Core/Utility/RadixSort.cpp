@@ -0,0 +1,123 @@
+#include "RadixSort.h"
+#include <ppl.h>
+#include <utility>
+#include <vector>
+#include <cstring>
+
+namespace Utility
+{
+	static const uint32_t RADIX_BITS = 8;
+	static const uint32_t RADIX_SIZE = 1 << RADIX_BITS;
+	static const uint32_t NUM_PASSES = 64 / RADIX_BITS;
+
+	// Below this it is not worth waking up other threads
+	static const size_t PARALLEL_THRESHOLD = 1 << 16;
+	static const uint32_t MAX_BLOCKS = 16;
+
+	void RadixSort64(uint64_t* Keys, uint32_t* Values, size_t Count, uint64_t* KeysScratch, uint32_t* ValuesScratch)
+	{
+		if (Count < 2)
+			return;
+
+		const uint32_t NumBlocks = Count < PARALLEL_THRESHOLD ? 1 :
+			(uint32_t)(Count / PARALLEL_THRESHOLD < MAX_BLOCKS ? Count / PARALLEL_THRESHOLD : MAX_BLOCKS);
+		const size_t BlockSize = (Count + NumBlocks - 1) / NumBlocks;
+
+		// One histogram per block and pass, all built in a single read of the keys
+		struct BlockHistogram { uint32_t Digits[NUM_PASSES][RADIX_SIZE]; };
+		struct BlockOffsets { size_t Digits[RADIX_SIZE]; };
+		std::vector<BlockHistogram> Histograms(NumBlocks);
+		std::vector<BlockOffsets> Offsets(NumBlocks);
+
+		auto CountBlock = [&](uint32_t Block)
+		{
+			const size_t Begin = Block * BlockSize;
+			const size_t End = Begin + BlockSize < Count ? Begin + BlockSize : Count;
+			for (size_t i = Begin; i < End; ++i)
+			{
+				const uint64_t Key = Keys[i];
+				for (uint32_t Pass = 0; Pass < NUM_PASSES; ++Pass)
+					++Histograms[Block].Digits[Pass][(Key >> (Pass * RADIX_BITS)) & (RADIX_SIZE - 1)];
+			}
+		};
+
+		if (NumBlocks == 1)
+			CountBlock(0);
+		else
+			concurrency::parallel_for(0u, NumBlocks, CountBlock);
+
+		uint64_t* SrcKeys = Keys;
+		uint32_t* SrcValues = Values;
+		uint64_t* DstKeys = KeysScratch;
+		uint32_t* DstValues = ValuesScratch;
+
+		for (uint32_t Pass = 0; Pass < NUM_PASSES; ++Pass)
+		{
+			const uint32_t Shift = Pass * RADIX_BITS;
+
+			// Every key has the same digit, the order would not change
+			const uint32_t FirstDigit = (uint32_t)(SrcKeys[0] >> Shift) & (RADIX_SIZE - 1);
+			size_t SameDigit = 0;
+			for (uint32_t Block = 0; Block < NumBlocks; ++Block)
+				SameDigit += Histograms[Block].Digits[Pass][FirstDigit];
+			if (SameDigit == Count)
+				continue;
+
+			// Keys moved between blocks in the previous passes, the per block counts of this digit
+			// have to be taken again.  The totals, used above, do not change.
+			if (NumBlocks > 1 && Pass > 0)
+			{
+				concurrency::parallel_for(0u, NumBlocks, [&](uint32_t Block)
+				{
+					uint32_t* Digits = Histograms[Block].Digits[Pass];
+					memset(Digits, 0, RADIX_SIZE * sizeof(uint32_t));
+
+					const size_t Begin = Block * BlockSize;
+					const size_t End = Begin + BlockSize < Count ? Begin + BlockSize : Count;
+					for (size_t i = Begin; i < End; ++i)
+						++Digits[(SrcKeys[i] >> Shift) & (RADIX_SIZE - 1)];
+				});
+			}
+
+			// Turn the counts into where each block writes each digit.  Digits first and blocks second
+			// keeps the sort stable.
+			size_t Sum = 0;
+			for (uint32_t Digit = 0; Digit < RADIX_SIZE; ++Digit)
+			{
+				for (uint32_t Block = 0; Block < NumBlocks; ++Block)
+				{
+					Offsets[Block].Digits[Digit] = Sum;
+					Sum += Histograms[Block].Digits[Pass][Digit];
+				}
+			}
+
+			auto ScatterBlock = [&](uint32_t Block)
+			{
+				size_t* BlockOffsets = Offsets[Block].Digits;
+				const size_t Begin = Block * BlockSize;
+				const size_t End = Begin + BlockSize < Count ? Begin + BlockSize : Count;
+				for (size_t i = Begin; i < End; ++i)
+				{
+					const size_t Dest = BlockOffsets[(SrcKeys[i] >> Shift) & (RADIX_SIZE - 1)]++;
+					DstKeys[Dest] = SrcKeys[i];
+					DstValues[Dest] = SrcValues[i];
+				}
+			};
+
+			if (NumBlocks == 1)
+				ScatterBlock(0);
+			else
+				concurrency::parallel_for(0u, NumBlocks, ScatterBlock);
+
+			std::swap(SrcKeys, DstKeys);
+			std::swap(SrcValues, DstValues);
+		}
+
+		// An odd number of passes leaves the result in the scratch arrays
+		if (SrcKeys != Keys)
+		{
+			memcpy(Keys, SrcKeys, Count * sizeof(uint64_t));
+			memcpy(Values, SrcValues, Count * sizeof(uint32_t));
+		}
+	}
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace Utility
+{
+	// Stable least significant digit radix sort of 64-bit keys, carrying a 32-bit value along with
+	// each key.  One pass per byte, passes where every key has the same byte are skipped, so keys
+	// that only use a few bits sort in a few passes.  Large arrays are split in blocks that build
+	// their histograms and scatter in parallel.
+	//
+	// The scratch arrays must hold Count elements.  The result ends up in Keys and Values.
+	void RadixSort64(uint64_t* Keys, uint32_t* Values, size_t Count, uint64_t* KeysScratch, uint32_t* ValuesScratch);
+}
@@ -1,18 +1,19 @@
 #include "Mesh.h"
+#include "..\Materials\Material.h"
 
 using namespace Renderer;
 using namespace Microsoft::WRL;
 
 Mesh::Mesh(GraphicContext* context, Material* material) :
-	vertexBuffer(nullptr),
-	indexBuffer(nullptr),
 	numVertices(0),
 	numIndices(0),
 	instanciated(false),
 	context(context),
-	material(material)
+	material(material),
+	geometry(this)
 {
 	ZeroMemory(&constBuffer, sizeof(AppBuffer));
+	ZeroMemory(&positionBufferView, sizeof(positionBufferView));
 	scale = XMFLOAT3(1.f, 1.f, 1.f);
 }
 
@@ -26,7 +27,7 @@ void Mesh::SetIndices(DWORD* indicesList, UINT numIndices) {
 	this->numIndices = numIndices;
 }
 
-void Mesh::Initialize(ID3D12Device* device, ID3D12GraphicsCommandList* commandList)
+void Mesh::Initialize(bool positionStream)
 {
 	instanciated = true;
 
@@ -34,124 +35,67 @@ void Mesh::Initialize(ID3D12Device* device, ID3D12GraphicsCommandList* commandLi
 	int vBufferSize = sizeof(Vertex) * numVertices;
 	int iBufferSize = sizeof(DWORD) * numIndices;
 
-	// Crear el index buffer
-	device->CreateCommittedResource(
-		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-		D3D12_HEAP_FLAG_NONE,
-		&CD3DX12_RESOURCE_DESC::Buffer(iBufferSize),
-		D3D12_RESOURCE_STATE_COPY_DEST,
-		nullptr,
-		IID_PPV_ARGS(&indexBuffer));
-
-	// Podemos ponerle un nombre al buffer y as debugear mejor
-	indexBuffer->SetName(L"Index Buffer Resource Heap");
-
-	// Crear un upload heap para cargar el index buffer
-	ID3D12Resource* iBufferUploadHeap;
-	device->CreateCommittedResource(
-		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-		D3D12_HEAP_FLAG_NONE,
-		&CD3DX12_RESOURCE_DESC::Buffer(iBufferSize),
-		D3D12_RESOURCE_STATE_GENERIC_READ, // La GPU leera de este buffer y copiara los datos al otro buffer
-		nullptr,
-		IID_PPV_ARGS(&iBufferUploadHeap));
-
-	iBufferUploadHeap->SetName(L"Index Buffer Upload Resource Heap");
-
-	// Almacenar los datos del index buffer
-	D3D12_SUBRESOURCE_DATA indexData = {};
-	indexData.pData = reinterpret_cast<BYTE*>(indicesList); // puntero a nuestro array
-	indexData.RowPitch = iBufferSize; // tamao de nuestro array
-	indexData.SlicePitch = iBufferSize; // tamao de nuestro array
-
-										// Ahora creamo el command command list para copiar los datos desde
-										// el upload heap al default heap
-	UpdateSubresources<1>(commandList, indexBuffer.Get(), iBufferUploadHeap, 0, 0, 1, &indexData);
-
-	// Transicin del index buffer desde copia a index buffer state
-	commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(indexBuffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_INDEX_BUFFER));
+	UploadManager& uploader = context->GetUploadManager();
+	GpuHeapAllocator& heapAllocator = context->GetHeapAllocator();
+
+	// Crear el index buffer. Se crea en estado COMMON porque la copia la hace la copy queue, que lo
+	// promociona a COPY_DEST implicitamente. Podemos ponerle un nombre al buffer y as debugear mejor
+	// Los buffers se colocan dentro de un heap compartido en vez de crear un heap por recurso
+	heapAllocator.CreateResource(indexBuffer, L"Index Buffer Resource Heap",
+		CD3DX12_RESOURCE_DESC::Buffer(iBufferSize), D3D12_RESOURCE_STATE_COMMON);
+
+	// Copiamos los indices al upload ring; la copia al default heap se hace en el siguiente Flush()
+	uploader.UploadBuffer(indexBuffer, 0, indicesList, iBufferSize);
 
 	// Crear el index buffer view. Obtenemos la posicion de memoria del index buffer mediante el GetGPUVirtualAddress()
-	indexBufferView.BufferLocation = indexBuffer->GetGPUVirtualAddress();
+	indexBufferView.BufferLocation = indexBuffer.GetGpuVirtualAddress();
 	indexBufferView.Format = DXGI_FORMAT_R32_UINT;
 	indexBufferView.SizeInBytes = iBufferSize;
 
 	// Crear el default heap para el vertex buffer
-	device->CreateCommittedResource(
-		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-		D3D12_HEAP_FLAG_NONE,
-		&CD3DX12_RESOURCE_DESC::Buffer(vBufferSize),
-		D3D12_RESOURCE_STATE_COPY_DEST,
-		nullptr,
-		IID_PPV_ARGS(&vertexBuffer));
-
-	vertexBuffer->SetName(L"Vertex Buffer Resource Heap");
-
-	// Crear el upload heap para el vertex buffer
-	ID3D12Resource* vBufferUploadHeap;
-	device->CreateCommittedResource(
-		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-		D3D12_HEAP_FLAG_NONE, // no flags
-		&CD3DX12_RESOURCE_DESC::Buffer(vBufferSize),
-		D3D12_RESOURCE_STATE_GENERIC_READ,
-		nullptr,
-		IID_PPV_ARGS(&vBufferUploadHeap));
-
-	vBufferUploadHeap->SetName(L"Vertex Buffer Upload Resource Heap");
-
-	// Guardamos el vertex buffer en el upload heap
-	D3D12_SUBRESOURCE_DATA vertexData = {};
-	vertexData.pData = reinterpret_cast<BYTE*>(vertexList);
-	vertexData.RowPitch = vBufferSize;
-	vertexData.SlicePitch = vBufferSize;
-
-	//Copiamos los datos desde el upload heap al default heap
-	UpdateSubresources<1>(commandList, vertexBuffer.Get(), vBufferUploadHeap, 0, 0, 1, &vertexData);
-
-	// Transicin del vertex buffer desde copia a vertex buffer state
-	commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(vertexBuffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER));
+	heapAllocator.CreateResource(vertexBuffer, L"Vertex Buffer Resource Heap",
+		CD3DX12_RESOURCE_DESC::Buffer(vBufferSize), D3D12_RESOURCE_STATE_COMMON);
+
+	uploader.UploadBuffer(vertexBuffer, 0, vertexList, vBufferSize);
 
 	// Crear el vertex buffer view. Obtenemos la posicion de memoria del index buffer mediante el GetGPUVirtualAddress()
-	vertexBufferView.BufferLocation = vertexBuffer->GetGPUVirtualAddress();
+	vertexBufferView.BufferLocation = vertexBuffer.GetGpuVirtualAddress();
 	vertexBufferView.StrideInBytes = sizeof(Vertex);
 	vertexBufferView.SizeInBytes = vBufferSize;
 
-	// Describir y crear el constant buffer view (CBV) descriptor heap.
-	D3D12_DESCRIPTOR_HEAP_DESC cbvHeapDesc = {};
-	cbvHeapDesc.NumDescriptors = 1;
-	cbvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-	cbvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-	ThrowIfFailed(device->CreateDescriptorHeap(&cbvHeapDesc, IID_PPV_ARGS(&cbvHeap)));
-
-	//Creamos el constant buffer
+	if (positionStream)
 	{
+		// 12 bytes por vertice en vez de sizeof(Vertex), es todo lo que lee el pass de profundidad
+		std::vector<XMFLOAT3> positions(numVertices);
+		for (UINT i = 0; i < numVertices; ++i)
+			positions[i] = vertexList[i].position;
 
-		//Como es un dato que se actualiza constantemente, solo creamos un upload heap
-		device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-			D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer(1024 * 64), // Tamao del buffer.Tiene que ser un multiplo de 64KB para una textura o constant buffer
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr,
-			IID_PPV_ARGS(&constBufferUploadHeap));
-
-		constBufferUploadHeap->SetName(L"Constant Buffer Upload Resource Heap");
+		int pBufferSize = POSITION_STRIDE * numVertices;
+		heapAllocator.CreateResource(positionBuffer, L"Position Buffer Resource Heap",
+			CD3DX12_RESOURCE_DESC::Buffer(pBufferSize), D3D12_RESOURCE_STATE_COMMON);
 
-		ZeroMemory(&constBuffer, sizeof(AppBuffer));
+		uploader.UploadBuffer(positionBuffer, 0, positions.data(), pBufferSize);
 
-		//Asignamos los datos
-		XMStoreFloat4x4(&constBuffer.wvpMat, XMMatrixTranspose(XMMatrixIdentity()));
-		XMStoreFloat4x4(&constBuffer.worldMat, XMMatrixTranspose(XMMatrixIdentity()));
-
-		CD3DX12_RANGE readRange(0, 0);    // No tenemos intencion de leer estos datos desde la CPU.
+		positionBufferView.BufferLocation = positionBuffer.GetGpuVirtualAddress();
+		positionBufferView.StrideInBytes = POSITION_STRIDE;
+		positionBufferView.SizeInBytes = pBufferSize;
+	}
+}
 
-										  //Mapeamos para obtener la direccin de memoria del buffer en la GPU
-		ThrowIfFailed(constBufferUploadHeap->Map(0, &readRange, reinterpret_cast<void**>(&constBufferGPUAddress)));
+void Mesh::ShareGeometry(Mesh* source)
+{
+	ASSERT(source->instanciated, "El mesh compartido no esta inicializado");
 
-		//Copiamos los datos a esa direccin de memoria
-		memcpy(constBufferGPUAddress, &constBuffer, sizeof(constBuffer));
-		constBufferUploadHeap->Unmap(0, nullptr);
-	}
+	instanciated = true;
+	geometry = source->geometry;
+
+	vertexList = source->vertexList;
+	indicesList = source->indicesList;
+	numVertices = source->numVertices;
+	numIndices = source->numIndices;
+	vertexBufferView = source->vertexBufferView;
+	indexBufferView = source->indexBufferView;
+	positionBufferView = source->positionBufferView;
 }
 
 void Mesh::Update(XMMATRIX viewMat, XMMATRIX projectionMat)
@@ -177,21 +121,72 @@ void Mesh::Update(XMMATRIX viewMat, XMMATRIX projectionMat)
 															 //Guardamos el world matrix en el constant buffer
 	XMStoreFloat4x4(&constBuffer.worldMat, XMMatrixTranspose(worldMat));
 
-	//copiamos los datos a la GPU
-	memcpy(constBufferGPUAddress, &constBuffer, sizeof(constBuffer));
+	// El pixel shader busca la textura del material con este indice
+	constBuffer.materialIndex = material->GetMaterialIndex();
 }
 
 void Mesh::Begin()
 {
+	BindGeometry();
+	BindConstants();
+}
+
+void Mesh::TransitionGeometry()
+{
+	context->TransitionResource(geometry->vertexBuffer, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+	context->TransitionResource(geometry->indexBuffer, D3D12_RESOURCE_STATE_INDEX_BUFFER);
+}
+
+void Mesh::BindGeometry()
+{
+	TransitionGeometry();
 	context->SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 	context->SetVertexBuffer(0, vertexBufferView);
 	context->SetIndexBuffer(indexBufferView);
-	context->SetConstantBuffer(0, constBufferUploadHeap->GetGPUVirtualAddress());
+}
+
+void Mesh::TransitionPositions()
+{
+	ASSERT(HasPositionStream(), "El mesh no tiene buffer de posiciones");
+
+	context->TransitionResource(geometry->positionBuffer, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+	context->TransitionResource(geometry->indexBuffer, D3D12_RESOURCE_STATE_INDEX_BUFFER);
+}
+
+void Mesh::BindPositions()
+{
+	TransitionPositions();
+	context->SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	context->SetVertexBuffer(0, positionBufferView);
+	context->SetIndexBuffer(indexBufferView);
+}
+
+void Mesh::BindConstants()
+{
+	// El constant buffer se copia a la memoria del frame actual, asi no pisamos datos que la GPU
+	// puede estar leyendo todavia
+	context->SetDynamicSRV(INSTANCE_DATA_ROOT_INDEX, sizeof(constBuffer), &constBuffer);
+	SetFirstInstance(0);
+}
+
+void Mesh::BindInstanceData(D3D12_GPU_VIRTUAL_ADDRESS instanceData)
+{
+	context->SetBufferSRV(INSTANCE_DATA_ROOT_INDEX, instanceData, 0);
+}
+
+void Mesh::SetFirstInstance(UINT firstInstance)
+{
+	context->SetConstant(FIRST_INSTANCE_ROOT_INDEX, firstInstance);
 }
 
 void Mesh::Draw()
 {
-	context->DrawIndexedInstanced(numIndices, 1, 0, 0, 0);
+	DrawInstanced(1);
+}
+
+void Mesh::DrawInstanced(UINT instanceCount)
+{
+	context->DrawIndexedInstanced(numIndices, instanceCount, 0, 0, 0);
 }
 
 void Mesh::End()
@@ -15,13 +15,39 @@ using namespace DirectX;
 
 class Mesh {
 public:
+	// Parametros del root signature de los materiales donde van los datos de instancia
+	static const UINT FIRST_INSTANCE_ROOT_INDEX = 0;
+	static const UINT INSTANCE_DATA_ROOT_INDEX = 1;
+	// Solo la posicion de cada vertice, sin el resto de atributos
+	static const UINT POSITION_STRIDE = sizeof(XMFLOAT3);
+
 	Mesh(GraphicContext* context, Material* material);
 	void SetVertices(Vertex* vertList, UINT numVertices);
 	void SetIndices(DWORD* indicesList, UINT numIndices);
-	void Initialize(ID3D12Device* device, ID3D12GraphicsCommandList* commandList);
+	// Con positionStream se crea tambien un buffer solo con las posiciones, para los passes de
+	// profundidad que no necesitan el resto del vertice
+	void Initialize(bool positionStream = false);
+	// Usa los buffers de source en vez de crear unos propios, asi los meshes con la misma geometria
+	// se pueden dibujar en una sola llamada instanciada
+	void ShareGeometry(Mesh* source);
 	void Update(XMMATRIX viewMat, XMMATRIX projectionMat);
 	void Begin();
+	// Begin() en dos partes, para que la RenderQueue no vuelva a enlazar la geometria entre meshes que la comparten
+	void BindGeometry();
+	// Como BindGeometry() pero con el buffer de posiciones en vez de los vertices completos
+	void BindPositions();
+	bool HasPositionStream() const { return positionBufferView.SizeInBytes > 0; }
+	void BindConstants();
+	// Enlaza un structured buffer con un AppBuffer por instancia
+	void BindInstanceData(D3D12_GPU_VIRTUAL_ADDRESS instanceData);
+	// Posicion de la primera instancia del draw en ese buffer
+	void SetFirstInstance(UINT firstInstance);
+	// Solo las transiciones de BindGeometry, para los draws indirectos que ponen sus propios buffers
+	void TransitionGeometry();
+	// Lo mismo para BindPositions, para los bundles de profundidad
+	void TransitionPositions();
 	void Draw();
+	void DrawInstanced(UINT instanceCount);
 	void End();
 
 public:
@@ -35,15 +61,14 @@ public:
 
 	AppBuffer constBuffer;
 	Material* material;
-	int constBufferAlignedSize = (sizeof(constBuffer) + 255) & ~255; // Necesitamos que el buffer sea de bloques alineados de 256 bytes
 
-	ComPtr<ID3D12Resource> vertexBuffer; //El buffer encargado de cargar los vertices en la GPU
+	GpuResource vertexBuffer; //El buffer encargado de cargar los vertices en la GPU
 	D3D12_VERTEX_BUFFER_VIEW vertexBufferView; //Una estructura que almacena la informacin de los vertices
-	ComPtr<ID3D12Resource> indexBuffer; // El buffer encargado de cargar los indices en la GPU
+	GpuResource indexBuffer; // El buffer encargado de cargar los indices en la GPU
 	D3D12_INDEX_BUFFER_VIEW indexBufferView; //Una estructura que almacena la informacin de los indices
+	GpuResource positionBuffer; // Las posiciones de los vertices seguidas, vacio si no se pidio
+	D3D12_VERTEX_BUFFER_VIEW positionBufferView;
 	GraphicContext* context;
-	ComPtr<ID3D12DescriptorHeap> cbvHeap; //almacena la posicin de nuestro constant buffer view
-	ComPtr<ID3D12Resource> constBufferUploadHeap;  //El buffer encargado de cargar el constant buffer a la GPU
-	UINT8* constBufferGPUAddress; //Posicin de memoria de nuestro Constant Buffer
+	Mesh* geometry; // El mesh que tiene los buffers, el mismo salvo que se comparta la geometria
 	bool instanciated;
 };
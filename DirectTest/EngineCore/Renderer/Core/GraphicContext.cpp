@@ -3,6 +3,9 @@
 
 #include "../Components/Mesh.h"
 #include "../Materials/StandardMaterial.h"
+#include "../Graphics/PipelineCache.h"
+#include "../Graphics/PipelineState.h"
+#include "../Graphics/ShaderLibrary.h"
 
 Mesh* newMesh;
 Mesh* newMesh2;
@@ -12,15 +15,41 @@ namespace Renderer {
 	ComPtr<ID3D12Device> device;
 	GraphicContext* renderer;
 
-	GraphicContext::GraphicContext(UINT width, UINT height) :
+	// Errors the user has to fix before the engine can start, shown in a message box as well
+	static void FailToStart(const wchar_t* message)
+	{
+		Utility::Printf(L"%s\n", message);
+		MessageBoxW(WinApplication::GetHwnd(), message, L"DirectTest cannot start", MB_OK | MB_ICONERROR);
+		throw std::exception();
+	}
+
+	DescriptorAllocator descriptorAllocators[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES] =
+	{
+		D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
+		D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER,
+		D3D12_DESCRIPTOR_HEAP_TYPE_RTV,
+		D3D12_DESCRIPTOR_HEAP_TYPE_DSV
+	};
+
+	GraphicContext::GraphicContext(UINT width, UINT height, UINT framesInFlight) :
+		framesInFlight(framesInFlight < 1 ? 1 : (framesInFlight > MAX_FRAMES_IN_FLIGHT ? MAX_FRAMES_IN_FLIGHT : framesInFlight)),
 		frameIndex(0),
+		backBufferIndex(0),
+		nextFenceValue(1),
+		frameFenceValues{},
+		frameTelemetry{},
 		viewport(0.0f, 0.0f, static_cast<float>(width), static_cast<float>(height)),
 		scissorRect(0, 0, static_cast<LONG>(width), static_cast<LONG>(height)),
 		aspectRatio(static_cast<float>(width) / static_cast<float>(height)),
 		width(width),
 		height(height),
-		fenceValues{},
-		rtvDescriptorSize(0)
+		rtvDescriptorSize(0),
+		currRootSignature(nullptr),
+		m_CurGraphicsPipelineState(nullptr),
+		m_NumBarriersToFlush(0),
+		dynamicViewDescriptorHeap(viewDescriptorHeap),
+		dynamicSamplerDescriptorHeap(samplerDescriptorHeap),
+		materialBuffer(D3D12_GPU_VIRTUAL_ADDRESS_NULL)
 	{
 	}
 
@@ -70,6 +99,11 @@ namespace Renderer {
 			));
 		}
 
+		CheckDeviceCapabilities();
+
+		pipelineCache.Open(L"PipelineCache.bin", GetDeviceVersion(factory.Get()));
+		if (!shaderLibrary.Open(L"Resources\\ShaderLib\\Shaders.shlib"))
+			FailToStart(L"Resources\\ShaderLib\\Shaders.shlib is missing or out of date, build it with Tools/build_shader_library.py.");
 
 		D3D12_COMMAND_QUEUE_DESC queueDesc = {};
 		queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
@@ -77,8 +111,17 @@ namespace Renderer {
 
 		ThrowIfFailed(device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&commandQueue)));
 
+		uploadManager.Create();
+
+		viewDescriptorHeap.Create(L"Global CBV_SRV_UAV Descriptor Heap", D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
+			NUM_STATIC_VIEW_DESCRIPTORS, NUM_DYNAMIC_VIEW_DESCRIPTORS);
+		samplerDescriptorHeap.Create(L"Global Sampler Descriptor Heap", D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER,
+			NUM_STATIC_SAMPLER_DESCRIPTORS, NUM_DYNAMIC_SAMPLER_DESCRIPTORS);
+		bindlessTextures.Create(viewDescriptorHeap);
+		textureLoader.Create(*this);
+
 		DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
-		swapChainDesc.BufferCount = FRAME_COUNT;
+		swapChainDesc.BufferCount = BACK_BUFFER_COUNT;
 		swapChainDesc.Width = width;
 		swapChainDesc.Height = height;
 		swapChainDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
@@ -100,11 +143,11 @@ namespace Renderer {
 
 		ThrowIfFailed(swapChainTmp.As(&swapChain));
 
-		frameIndex = swapChain->GetCurrentBackBufferIndex();
+		backBufferIndex = swapChain->GetCurrentBackBufferIndex();
 
 		{
 			D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc = {};
-			rtvHeapDesc.NumDescriptors = FRAME_COUNT;
+			rtvHeapDesc.NumDescriptors = BACK_BUFFER_COUNT;
 			rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
 			rtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
 			ThrowIfFailed(device->CreateDescriptorHeap(&rtvHeapDesc, IID_PPV_ARGS(&rtvHeap)));
@@ -115,16 +158,22 @@ namespace Renderer {
 		{
 			CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(rtvHeap->GetCPUDescriptorHandleForHeapStart());
 
-			for (UINT n = 0; n < FRAME_COUNT; n++)
+			for (UINT n = 0; n < BACK_BUFFER_COUNT; n++)
 			{
-				ThrowIfFailed(swapChain->GetBuffer(n, IID_PPV_ARGS(&renderTargets[n])));
+				ComPtr<ID3D12Resource> backBuffer;
+				ThrowIfFailed(swapChain->GetBuffer(n, IID_PPV_ARGS(&backBuffer)));
+				renderTargets[n].Attach(backBuffer.Get(), D3D12_RESOURCE_STATE_PRESENT);
 
-				device->CreateRenderTargetView(renderTargets[n].Get(), nullptr, rtvHandle);
+				device->CreateRenderTargetView(renderTargets[n].GetResource(), nullptr, rtvHandle);
 				rtvHandle.Offset(1, rtvDescriptorSize);
-
-				ThrowIfFailed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&commandAllocators[n])));
 			}
 		}
+
+		// One allocator per frame in flight, reset only once the GPU has finished the frame that used it
+		for (UINT n = 0; n < framesInFlight; n++)
+		{
+			ThrowIfFailed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&commandAllocators[n])));
+		}
 	}
 
 	void GraphicContext::LoadAssets()
@@ -132,8 +181,7 @@ namespace Renderer {
 		ThrowIfFailed(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, commandAllocators[frameIndex].Get(), nullptr, IID_PPV_ARGS(&commandList)));
 
 		{
-			ThrowIfFailed(device->CreateFence(fenceValues[frameIndex], D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence)));
-			fenceValues[frameIndex]++;
+			ThrowIfFailed(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence)));
 
 			fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
 			if (fenceEvent == nullptr)
@@ -142,6 +190,9 @@ namespace Renderer {
 			}
 		}
 
+		// The meshes keep the material they are drawn with
+		mat = new StandardMaterial(this);
+
 		{
 			std::vector<Vertex> vecVList;
 			Vertex* vList;
@@ -218,56 +269,28 @@ namespace Renderer {
 			
 			numCubeIndices = sizeof(iList) / sizeof(DWORD);
 
-			newMesh = new Mesh(this, nullptr);
+			newMesh = new Mesh(this, mat);
 			newMesh->SetVertices(vList, vecVList.size());
 			newMesh->SetIndices(iList, sizeof(iList) / sizeof(DWORD));
 
-			newMesh->Initialize(device.Get(), commandList.Get());
+			// With the position stream, so it takes part in the depth prepass
+			newMesh->Initialize(true);
 
 			newMesh->pos = XMFLOAT3(0.0f, 0.0f, -2.f);
 
-			newMesh2 = new Mesh(this, nullptr);
-			newMesh2->SetVertices(vList, vecVList.size());
-			newMesh2->SetIndices(iList, sizeof(iList) / sizeof(DWORD));
-
-			newMesh2->Initialize(device.Get(), commandList.Get());
+			// Same cube, both get drawn in one instanced draw
+			newMesh2 = new Mesh(this, mat);
+			newMesh2->ShareGeometry(newMesh);
 
 			newMesh2->pos = XMFLOAT3(2.0f, 0.0f, -2.f);
 			newMesh2->scale = XMFLOAT3(.5f, 0.5f, 0.5f);
-		}
 
-		{
-			D3D12_DESCRIPTOR_HEAP_DESC dsvHeapDesc = {};
-			dsvHeapDesc.NumDescriptors = 1;
-			dsvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
-			dsvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-			ThrowIfFailed(device->CreateDescriptorHeap(&dsvHeapDesc, IID_PPV_ARGS(&dsDescriptorHeap)));
-
-			D3D12_DEPTH_STENCIL_VIEW_DESC depthStencilDesc = {};
-			depthStencilDesc.Format = DXGI_FORMAT_D32_FLOAT;
-			depthStencilDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
-			depthStencilDesc.Flags = D3D12_DSV_FLAG_NONE;
-
-			D3D12_CLEAR_VALUE depthOptimizedClearValue = {};
-			depthOptimizedClearValue.Format = DXGI_FORMAT_D32_FLOAT;
-			depthOptimizedClearValue.DepthStencil.Depth = 1.0f;
-			depthOptimizedClearValue.DepthStencil.Stencil = 0;
-
-			device->CreateCommittedResource(
-				&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-				D3D12_HEAP_FLAG_NONE,
-				&CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_D32_FLOAT, width, height, 1, 0, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL),
-				D3D12_RESOURCE_STATE_DEPTH_WRITE,
-				&depthOptimizedClearValue,
-				IID_PPV_ARGS(&depthStencilBuffer)
-			);
-			dsDescriptorHeap->SetName(L"Depth/Stencil Resource Heap");
-
-			device->CreateDepthStencilView(depthStencilBuffer.Get(), &depthStencilDesc, dsDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+			// The cubes never leave the scene, their draws are recorded once in bundles and only
+			// their transforms are copied every frame
+			staticGeometry.Add(newMesh);
+			staticGeometry.Add(newMesh2);
 		}
 
-		mat = new StandardMaterial(this);
-
 		{
 			XMMATRIX tmpMat = XMMatrixPerspectiveFovLH(60.0f*(3.14f / 180.0f), (float)width / (float)height, 0.1f, 1000.0f);
 
@@ -286,12 +309,17 @@ namespace Renderer {
 			XMStoreFloat4x4(&cameraViewMat, tmpMat);
 		}
 
-		commandList->Close();
-		ID3D12CommandList* ppCommandLists[] = { commandList.Get() };
-		commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
+		// The textures decode on the worker threads while the meshes load, the first frame shows them
+		// all.  Every mesh and texture queued its copies on the upload manager, submit them as one batch.
+		textureLoader.WaitForAll();
+		uploadManager.Flush();
 
-		WaitForGpu();
+		CloseCommandList();
+		ExecuteCommandList();
 
+		// No need to wait for the loading work, the first frame will only block if it needs this
+		// frame's allocator back.
+		MoveToNextFrame();
 	}
 
 	void GraphicContext::OnUpdate()
@@ -314,8 +342,7 @@ namespace Renderer {
 	{
 		PopulateCommandList();
 
-		ID3D12CommandList* ppCommandLists[] = { commandList.Get() };
-		commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
+		ExecuteCommandList();
 
 		ThrowIfFailed(swapChain->Present(1, 0));
 
@@ -327,6 +354,22 @@ namespace Renderer {
 	void GraphicContext::Release()
 	{
 		MoveToNextFrame();
+		WaitForGpu();
+
+		// Compiles still running read the shader bytecode and the cached blobs, both are mapped files
+		PSO::WaitForAll();
+		PSO::DestroyAll();
+
+		// Blobs compiled during this run are there for the next one
+		pipelineCache.Save();
+		shaderLibrary.Close();
+
+		dynamicConstantAllocator.Destroy();
+		textureLoader.Destroy();
+		bindlessTextures.Destroy();
+		viewDescriptorHeap.Destroy();
+		samplerDescriptorHeap.Destroy();
+		DescriptorAllocator::DestroyAll();
 
 		CloseHandle(fenceEvent);
 	}
@@ -336,12 +379,201 @@ namespace Renderer {
 		aspectRatio = static_cast<float>(width) / static_cast<float>(height);
 	}
 
+	void GraphicContext::TransitionResource(GpuResource & Resource, D3D12_RESOURCE_STATES NewState, bool FlushImmediate)
+	{
+		// A split barrier towards some other state has to be closed before we can move on from it.
+		if (Resource.m_TransitioningState != (D3D12_RESOURCE_STATES)-1 && Resource.m_TransitioningState != NewState)
+			TransitionResource(Resource, Resource.m_TransitioningState);
+
+		D3D12_RESOURCE_STATES OldState = Resource.m_UsageState;
+
+		if (OldState == NewState || IsCoveredReadState(OldState, NewState))
+		{
+			if (NewState == D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+				InsertUAVBarrier(Resource, FlushImmediate);
+			else if (FlushImmediate)
+				FlushResourceBarriers();
+			return;
+		}
+
+		if (NewState == Resource.m_TransitioningState)
+		{
+			ASSERT(m_NumBarriersToFlush < MAX_PENDING_BARRIERS, "Exceeded arbitrary limit on buffered barriers");
+			D3D12_RESOURCE_BARRIER& BarrierDesc = m_ResourceBarrierBuffer[m_NumBarriersToFlush++];
+			BarrierDesc = CD3DX12_RESOURCE_BARRIER::Transition(Resource.GetResource(), OldState, NewState,
+				D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_BARRIER_FLAG_END_ONLY);
+
+			Resource.m_TransitioningState = (D3D12_RESOURCE_STATES)-1;
+			for (auto iter = m_PendingSplitTransitions.begin(); iter != m_PendingSplitTransitions.end(); ++iter)
+			{
+				if (*iter == &Resource)
+				{
+					m_PendingSplitTransitions.erase(iter);
+					break;
+				}
+			}
+		}
+		else
+		{
+			// Fold this transition into one that is still waiting to be flushed for the same resource.
+			UINT Merged = MAX_PENDING_BARRIERS;
+			for (UINT i = 0; i < m_NumBarriersToFlush; ++i)
+			{
+				D3D12_RESOURCE_BARRIER& Pending = m_ResourceBarrierBuffer[i];
+				if (Pending.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION &&
+					Pending.Flags == D3D12_RESOURCE_BARRIER_FLAG_NONE &&
+					Pending.Transition.pResource == Resource.GetResource())
+				{
+					Merged = i;
+					break;
+				}
+			}
+
+			if (Merged != MAX_PENDING_BARRIERS)
+			{
+				D3D12_RESOURCE_BARRIER& Pending = m_ResourceBarrierBuffer[Merged];
+				if (Pending.Transition.StateBefore == NewState)
+				{
+					// A round trip back to where we started, drop the barrier altogether.
+					for (UINT i = Merged + 1; i < m_NumBarriersToFlush; ++i)
+						m_ResourceBarrierBuffer[i - 1] = m_ResourceBarrierBuffer[i];
+					--m_NumBarriersToFlush;
+				}
+				else
+					Pending.Transition.StateAfter = NewState;
+			}
+			else
+			{
+				ASSERT(m_NumBarriersToFlush < MAX_PENDING_BARRIERS, "Exceeded arbitrary limit on buffered barriers");
+				m_ResourceBarrierBuffer[m_NumBarriersToFlush++] =
+					CD3DX12_RESOURCE_BARRIER::Transition(Resource.GetResource(), OldState, NewState);
+			}
+		}
+
+		Resource.m_UsageState = NewState;
+
+		if (FlushImmediate || m_NumBarriersToFlush == MAX_PENDING_BARRIERS)
+			FlushResourceBarriers();
+	}
+
+	void GraphicContext::BeginResourceTransition(GpuResource & Resource, D3D12_RESOURCE_STATES NewState, bool FlushImmediate)
+	{
+		// If it's already transitioning, finish that transition
+		if (Resource.m_TransitioningState != (D3D12_RESOURCE_STATES)-1)
+			TransitionResource(Resource, Resource.m_TransitioningState);
+
+		D3D12_RESOURCE_STATES OldState = Resource.m_UsageState;
+
+		if (OldState != NewState && !IsCoveredReadState(OldState, NewState))
+		{
+			ASSERT(m_NumBarriersToFlush < MAX_PENDING_BARRIERS, "Exceeded arbitrary limit on buffered barriers");
+			m_ResourceBarrierBuffer[m_NumBarriersToFlush++] = CD3DX12_RESOURCE_BARRIER::Transition(Resource.GetResource(),
+				OldState, NewState, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY);
+
+			Resource.m_TransitioningState = NewState;
+			m_PendingSplitTransitions.push_back(&Resource);
+		}
+
+		if (FlushImmediate || m_NumBarriersToFlush == MAX_PENDING_BARRIERS)
+			FlushResourceBarriers();
+	}
+
+	void GraphicContext::InsertUAVBarrier(GpuResource & Resource, bool FlushImmediate)
+	{
+		ASSERT(m_NumBarriersToFlush < MAX_PENDING_BARRIERS, "Exceeded arbitrary limit on buffered barriers");
+		m_ResourceBarrierBuffer[m_NumBarriersToFlush++] = CD3DX12_RESOURCE_BARRIER::UAV(Resource.GetResource());
+
+		if (FlushImmediate || m_NumBarriersToFlush == MAX_PENDING_BARRIERS)
+			FlushResourceBarriers();
+	}
+
+	void GraphicContext::InsertAliasBarrier(GpuResource & Before, GpuResource & After, bool FlushImmediate)
+	{
+		ASSERT(m_NumBarriersToFlush < MAX_PENDING_BARRIERS, "Exceeded arbitrary limit on buffered barriers");
+		m_ResourceBarrierBuffer[m_NumBarriersToFlush++] = CD3DX12_RESOURCE_BARRIER::Aliasing(Before.GetResource(), After.GetResource());
+
+		if (FlushImmediate || m_NumBarriersToFlush == MAX_PENDING_BARRIERS)
+			FlushResourceBarriers();
+	}
+
+	void GraphicContext::FlushResourceBarriers()
+	{
+		if (m_NumBarriersToFlush > 0)
+		{
+			commandList->ResourceBarrier(m_NumBarriersToFlush, m_ResourceBarrierBuffer);
+			m_NumBarriersToFlush = 0;
+		}
+	}
+
+	void GraphicContext::CopyBuffer(GpuResource & Dest, GpuResource & Src)
+	{
+		TransitionResource(Dest, D3D12_RESOURCE_STATE_COPY_DEST);
+		TransitionResource(Src, D3D12_RESOURCE_STATE_COPY_SOURCE);
+		FlushResourceBarriers();
+		commandList->CopyResource(Dest.GetResource(), Src.GetResource());
+	}
+
+	void GraphicContext::CopyBufferRegion(GpuResource & Dest, size_t DestOffset, GpuResource & Src, size_t SrcOffset, size_t NumBytes)
+	{
+		TransitionResource(Dest, D3D12_RESOURCE_STATE_COPY_DEST);
+		FlushResourceBarriers();
+		commandList->CopyBufferRegion(Dest.GetResource(), DestOffset, Src.GetResource(), SrcOffset, NumBytes);
+	}
+
+	void GraphicContext::ClearColor(D3D12_CPU_DESCRIPTOR_HANDLE RTV, const float Colour[4])
+	{
+		FlushResourceBarriers();
+		commandList->ClearRenderTargetView(RTV, Colour, 0, nullptr);
+	}
+
+	void GraphicContext::ClearDepth(D3D12_CPU_DESCRIPTOR_HANDLE DSV, float Depth)
+	{
+		FlushResourceBarriers();
+		commandList->ClearDepthStencilView(DSV, D3D12_CLEAR_FLAG_DEPTH, Depth, 0, 0, nullptr);
+	}
+
+	void GraphicContext::CloseCommandList()
+	{
+		// Split barriers cannot outlive the command list that began them.
+		while (!m_PendingSplitTransitions.empty())
+		{
+			GpuResource* Resource = m_PendingSplitTransitions.back();
+			TransitionResource(*Resource, Resource->m_TransitioningState);
+		}
+
+		FlushResourceBarriers();
+		ThrowIfFailed(commandList->Close());
+	}
+
+	void GraphicContext::ExecuteCommandList()
+	{
+		// Resources written by the copy queue may be referenced by this command list.  The wait is
+		// on the GPU timeline, the CPU carries on.
+		uploadManager.InsertWait(commandQueue.Get(), uploadManager.GetLastSubmittedToken());
+
+		ID3D12CommandList* ppCommandLists[] = { commandList.Get() };
+		commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
+	}
+
+	void GraphicContext::BindDescriptorHeaps()
+	{
+		// Every table lives in one of these two heaps, so this is the only heap switch of the frame
+		ID3D12DescriptorHeap* descriptorHeaps[] = { viewDescriptorHeap.GetHeapPointer(), samplerDescriptorHeap.GetHeapPointer() };
+		commandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+
+		dynamicViewDescriptorHeap.Reset();
+		dynamicSamplerDescriptorHeap.Reset();
+	}
+
 	void GraphicContext::SetRootSignature(const RootSignature & RootSig)
 	{
 		if (RootSig.GetSignature() == currRootSignature)
 			return;
 
 		commandList->SetGraphicsRootSignature(currRootSignature = RootSig.GetSignature());
+
+		dynamicViewDescriptorHeap.ParseGraphicsRootSignature(RootSig);
+		dynamicSamplerDescriptorHeap.ParseGraphicsRootSignature(RootSig);
 	}
 
 	void GraphicContext::SetRenderTargets(UINT NumRTVs, const D3D12_CPU_DESCRIPTOR_HANDLE RTVs[])
@@ -408,6 +640,10 @@ namespace Renderer {
 
 	void GraphicContext::SetPipelineState(const GraphicsPSO & PSO)
 	{
+		// The draw paths skip pipeline states that are still compiling, anything else has to wait
+		if (!PSO.IsReady())
+			PSO.WaitUntilReady();
+
 		ID3D12PipelineState* PipelineState = PSO.GetPipelineStateObject();
 		if (PipelineState == m_CurGraphicsPipelineState)
 			return;
@@ -421,9 +657,64 @@ namespace Renderer {
 		commandList->SetGraphicsRootConstantBufferView(RootIndex, CBV + Offset);
 	}
 
+	void GraphicContext::SetConstants(UINT RootIndex, UINT NumConstants, const void * pConstants, UINT Offset)
+	{
+		commandList->SetGraphicsRoot32BitConstants(RootIndex, NumConstants, pConstants, Offset);
+	}
+
+	void GraphicContext::SetConstant(UINT RootIndex, UINT Val, UINT Offset)
+	{
+		commandList->SetGraphicsRoot32BitConstant(RootIndex, Val, Offset);
+	}
+
 	void GraphicContext::SetDynamicConstantBufferView(UINT RootIndex, size_t BufferSize, const void * BufferData)
 	{
-		//TODO
+		ASSERT(BufferData != nullptr && BufferSize > 0, "Empty constant buffer");
+
+		DynAlloc cb = dynamicConstantAllocator.Allocate(BufferSize);
+		memcpy(cb.DataPtr, BufferData, BufferSize);
+		commandList->SetGraphicsRootConstantBufferView(RootIndex, cb.GpuAddress);
+	}
+
+	void GraphicContext::SetDynamicSRV(UINT RootIndex, size_t BufferSize, const void * BufferData)
+	{
+		ASSERT(BufferData != nullptr && BufferSize > 0, "Empty structured buffer");
+
+		DynAlloc sb = dynamicConstantAllocator.Allocate(BufferSize);
+		memcpy(sb.DataPtr, BufferData, BufferSize);
+		commandList->SetGraphicsRootShaderResourceView(RootIndex, sb.GpuAddress);
+	}
+
+	DynAlloc GraphicContext::ReserveUploadMemory(size_t SizeInBytes, size_t Alignment)
+	{
+		return dynamicConstantAllocator.Allocate(SizeInBytes, Alignment);
+	}
+
+	UINT GraphicContext::AddMaterial(const MaterialData& Data)
+	{
+		if (!freeMaterials.empty())
+		{
+			const UINT index = freeMaterials.back();
+			freeMaterials.pop_back();
+			materialTable[index] = Data;
+			return index;
+		}
+
+		materialTable.push_back(Data);
+		return (UINT)materialTable.size() - 1;
+	}
+
+	void GraphicContext::UpdateMaterial(UINT Index, const MaterialData& Data)
+	{
+		ASSERT(Index < materialTable.size(), "Material index out of range");
+		materialTable[Index] = Data;
+	}
+
+	void GraphicContext::RemoveMaterial(UINT Index)
+	{
+		// Frames in flight read their own copy of the table, the index can be reused right away
+		ASSERT(Index < materialTable.size(), "Material index out of range");
+		freeMaterials.push_back(Index);
 	}
 
 	void GraphicContext::SetBufferSRV(UINT RootIndex, const D3D12_GPU_VIRTUAL_ADDRESS vAddress, UINT Offset)
@@ -441,6 +732,26 @@ namespace Renderer {
 		commandList->SetGraphicsRootDescriptorTable(RootIndex, FirstHandle);
 	}
 
+	void GraphicContext::SetDynamicDescriptor(UINT RootIndex, UINT Offset, D3D12_CPU_DESCRIPTOR_HANDLE Handle)
+	{
+		SetDynamicDescriptors(RootIndex, Offset, 1, &Handle);
+	}
+
+	void GraphicContext::SetDynamicDescriptors(UINT RootIndex, UINT Offset, UINT Count, const D3D12_CPU_DESCRIPTOR_HANDLE Handles[])
+	{
+		dynamicViewDescriptorHeap.SetGraphicsDescriptorHandles(RootIndex, Offset, Count, Handles);
+	}
+
+	void GraphicContext::SetDynamicSampler(UINT RootIndex, UINT Offset, D3D12_CPU_DESCRIPTOR_HANDLE Handle)
+	{
+		SetDynamicSamplers(RootIndex, Offset, 1, &Handle);
+	}
+
+	void GraphicContext::SetDynamicSamplers(UINT RootIndex, UINT Offset, UINT Count, const D3D12_CPU_DESCRIPTOR_HANDLE Handles[])
+	{
+		dynamicSamplerDescriptorHeap.SetGraphicsDescriptorHandles(RootIndex, Offset, Count, Handles);
+	}
+
 	void GraphicContext::SetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW & IBView)
 	{
 		commandList->IASetIndexBuffer(&IBView);
@@ -468,47 +779,123 @@ namespace Renderer {
 
 	void GraphicContext::DrawInstanced(UINT VertexCountPerInstance, UINT InstanceCount, UINT StartVertexLocation, UINT StartInstanceLocation)
 	{
+		FlushResourceBarriers();
+		dynamicViewDescriptorHeap.CommitGraphicsRootDescriptorTables(commandList.Get());
+		dynamicSamplerDescriptorHeap.CommitGraphicsRootDescriptorTables(commandList.Get());
 		commandList->DrawInstanced(VertexCountPerInstance, InstanceCount, StartVertexLocation, StartInstanceLocation);
 	}
 
 	void GraphicContext::DrawIndexedInstanced(UINT IndexCountPerInstance, UINT InstanceCount, UINT StartIndexLocation, INT BaseVertexLocation, UINT StartInstanceLocation)
 	{
+		FlushResourceBarriers();
+		dynamicViewDescriptorHeap.CommitGraphicsRootDescriptorTables(commandList.Get());
+		dynamicSamplerDescriptorHeap.CommitGraphicsRootDescriptorTables(commandList.Get());
 		commandList->DrawIndexedInstanced(IndexCountPerInstance, InstanceCount, StartIndexLocation, BaseVertexLocation, StartInstanceLocation);
 	}
 
+	void GraphicContext::ExecuteIndirect(CommandSignature& Signature, GpuResource& ArgumentBuffer, uint64_t ArgumentStartOffset,
+		uint32_t MaxCommands, GpuResource* CommandCounterBuffer, uint64_t CounterOffset)
+	{
+		FlushResourceBarriers();
+		dynamicViewDescriptorHeap.CommitGraphicsRootDescriptorTables(commandList.Get());
+		dynamicSamplerDescriptorHeap.CommitGraphicsRootDescriptorTables(commandList.Get());
+		commandList->ExecuteIndirect(Signature.GetSignature(), MaxCommands,
+			ArgumentBuffer.GetResource(), ArgumentStartOffset,
+			CommandCounterBuffer == nullptr ? nullptr : CommandCounterBuffer->GetResource(), CounterOffset);
+	}
+
+	void GraphicContext::ExecuteBundle(ID3D12GraphicsCommandList* Bundle)
+	{
+		FlushResourceBarriers();
+		dynamicViewDescriptorHeap.CommitGraphicsRootDescriptorTables(commandList.Get());
+		dynamicSamplerDescriptorHeap.CommitGraphicsRootDescriptorTables(commandList.Get());
+		commandList->ExecuteBundle(Bundle);
+	}
+
 	void GraphicContext::PopulateCommandList()
 	{
 		ThrowIfFailed(commandAllocators[frameIndex]->Reset());
 
 		ThrowIfFailed(commandList->Reset(commandAllocators[frameIndex].Get(), nullptr));
 
-		mat->BeginRender();
+		BindDescriptorHeaps();
 
-		SetViewportAndScissor(viewport, scissorRect);
+		// Textures loaded since the last frame become readable through the bindless table, and the
+		// frame gets its copy of the material buffer
+		textureLoader.Update();
+		bindlessTextures.TransitionNewResources(*this);
+		{
+			const size_t materialBytes = (materialTable.empty() ? 1 : materialTable.size()) * sizeof(MaterialData);
+			DynAlloc materials = dynamicConstantAllocator.Allocate(materialBytes);
+			if (!materialTable.empty())
+				memcpy(materials.DataPtr, materialTable.data(), materialTable.size() * sizeof(MaterialData));
+			materialBuffer = materials.GpuAddress;
+		}
 
-		commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(renderTargets[frameIndex].Get(), D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
+		frameGraph.Reset();
 
-		CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(rtvHeap->GetCPUDescriptorHandleForHeapStart(), frameIndex, rtvDescriptorSize);
-		CD3DX12_CPU_DESCRIPTOR_HANDLE dsvHandle(dsDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+		RenderGraphViews backBufferViews = {};
+		backBufferViews.RTV = CD3DX12_CPU_DESCRIPTOR_HANDLE(rtvHeap->GetCPUDescriptorHandleForHeapStart(), backBufferIndex, rtvDescriptorSize);
+		const uint32_t backBuffer = frameGraph.ImportResource(L"Back Buffer", renderTargets[backBufferIndex], D3D12_RESOURCE_STATE_PRESENT, &backBufferViews);
 
-		SetRenderTargets(1, &rtvHandle, dsvHandle);
+		D3D12_CLEAR_VALUE depthOptimizedClearValue = {};
+		depthOptimizedClearValue.Format = DXGI_FORMAT_D32_FLOAT;
+		depthOptimizedClearValue.DepthStencil.Depth = 1.0f;
+		depthOptimizedClearValue.DepthStencil.Stencil = 0;
 
-		commandList->ClearRenderTargetView(rtvHandle, reinterpret_cast<float*>(&clearColor), 0, nullptr); //Limpiamos el canvas
+		const uint32_t depthBuffer = frameGraph.CreateTransient(L"Depth/Stencil Buffer",
+			CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_D32_FLOAT, width, height, 1, 1, 1, 0,
+				D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL | D3D12_RESOURCE_FLAG_DENY_SHADER_RESOURCE),
+			&depthOptimizedClearValue);
 
-		commandList->ClearDepthStencilView(dsDescriptorHeap->GetCPUDescriptorHandleForHeapStart(), D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
-		
-		newMesh->Begin();
+		// Draws queued for this frame are sorted by state and depth before the passes record them.  The
+		// static scene is not queued, staticGeometry replays its bundles in both passes.
+		renderQueue.Reset();
+		renderQueue.Sort();
+
+		// Only depth, from the position streams of the meshes.  The scene pass then tests LESS_EQUAL
+		// against it and shades each covered pixel of these meshes once.
+		const uint32_t depthPass = frameGraph.AddPass(L"Depth Prepass", [this, depthBuffer](GraphicContext& context, RenderGraph& graph)
+		{
+			context.SetViewportAndScissor(viewport, scissorRect);
+
+			D3D12_CPU_DESCRIPTOR_HANDLE dsvHandle = graph.GetDSV(depthBuffer);
+			context.SetDepthStencilTarget(dsvHandle);
+
+			// The depth buffer lives in aliased memory, the clear is what initializes it
+			context.ClearDepth(dsvHandle);
+
+			staticGeometry.SubmitDepthPrepass(context);
+			renderQueue.SubmitDepthPrepass(context);
+		});
+		frameGraph.Write(depthPass, depthBuffer, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+
+		const uint32_t scenePass = frameGraph.AddPass(L"Scene", [this, backBuffer, depthBuffer](GraphicContext& context, RenderGraph& graph)
+		{
+			context.SetViewportAndScissor(viewport, scissorRect);
+
+			D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle = graph.GetRTV(backBuffer);
+			D3D12_CPU_DESCRIPTOR_HANDLE dsvHandle = graph.GetDSV(depthBuffer);
+
+			context.SetRenderTargets(1, &rtvHandle, dsvHandle);
 
-		newMesh->Draw();
+			context.ClearColor(rtvHandle, reinterpret_cast<float*>(&clearColor)); //Limpiamos el canvas
 
-		newMesh2->Begin();
-		newMesh2->Draw();
+			staticGeometry.Submit(context);
+			renderQueue.Submit(context);
+		});
+		frameGraph.Write(scenePass, backBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+		// Keeps the prepass depth
+		frameGraph.Read(scenePass, depthBuffer, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+		frameGraph.Write(scenePass, depthBuffer, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+
+		frameGraph.Compile();
+		frameGraph.Execute(*this);
 
-		commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(renderTargets[frameIndex].Get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
 		currRootSignature = nullptr;
 		m_CurGraphicsPipelineState = nullptr;
 
-		ThrowIfFailed(commandList->Close());
+		CloseCommandList();
 	}
 
 	std::vector<UINT8> GraphicContext::GenerateTextureData()
@@ -571,31 +958,102 @@ namespace Renderer {
 		*ppAdapter = adapter.Detach();
 	}
 
-	void GraphicContext::MoveToNextFrame()
+	void GraphicContext::CheckDeviceCapabilities()
 	{
-		const UINT64 currentFenceValue = fenceValues[frameIndex];
-		ThrowIfFailed(commandQueue->Signal(fence.Get(), currentFenceValue));
+		// Tier 1 caps a shader stage at 128 SRVs, the bindless table is much larger
+		D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+		ThrowIfFailed(device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options)));
+
+		// Tools/build_shader_library.py compiles every stage as shader model 6.0.  Runtimes too old to
+		// know the query fail it, they only run 5.1.
+		D3D12_FEATURE_DATA_SHADER_MODEL shaderModel = { D3D_SHADER_MODEL_6_0 };
+		if (FAILED(device->CheckFeatureSupport(D3D12_FEATURE_SHADER_MODEL, &shaderModel, sizeof(shaderModel))))
+			shaderModel.HighestShaderModel = D3D_SHADER_MODEL_5_1;
+
+		wchar_t message[256] = L"";
+		if (options.ResourceBindingTier < D3D12_RESOURCE_BINDING_TIER_2)
+		{
+			swprintf_s(message, L"The GPU supports resource binding tier %d, tier 2 is needed for bindless textures.",
+				(int)options.ResourceBindingTier);
+		}
+		else if (shaderModel.HighestShaderModel < D3D_SHADER_MODEL_6_0)
+		{
+			swprintf_s(message, L"The GPU or its driver supports shader model %d.%d, the shaders need 6.0.",
+				shaderModel.HighestShaderModel >> 4, shaderModel.HighestShaderModel & 0xF);
+		}
+		else
+			return;
 
-		frameIndex = swapChain->GetCurrentBackBufferIndex();
+		FailToStart(message);
+	}
 
-		UINT64 compValue = fence->GetCompletedValue();
+	uint64_t GraphicContext::GetDeviceVersion(IDXGIFactory4 * pFactory)
+	{
+		ComPtr<IDXGIAdapter1> adapter;
+		if (FAILED(pFactory->EnumAdapterByLuid(device->GetAdapterLuid(), IID_PPV_ARGS(&adapter))))
+			return 0;
+
+		DXGI_ADAPTER_DESC1 desc;
+		adapter->GetDesc1(&desc);
+
+		LARGE_INTEGER driverVersion = {};
+		adapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &driverVersion);
 
-		if (compValue < fenceValues[frameIndex])
+		uint64_t version = PipelineCache::Fingerprint(&driverVersion, sizeof(driverVersion));
+		version = PipelineCache::Fingerprint(&desc.VendorId, sizeof(desc.VendorId), version);
+		version = PipelineCache::Fingerprint(&desc.DeviceId, sizeof(desc.DeviceId), version);
+		version = PipelineCache::Fingerprint(&desc.SubSysId, sizeof(desc.SubSysId), version);
+		return PipelineCache::Fingerprint(&desc.Revision, sizeof(desc.Revision), version);
+	}
+
+	void GraphicContext::MoveToNextFrame()
+	{
+		const UINT64 currentFenceValue = nextFenceValue++;
+		ThrowIfFailed(commandQueue->Signal(fence.Get(), currentFenceValue));
+		frameFenceValues[frameIndex] = currentFenceValue;
+
+		// Constant buffer pages, descriptor tables, heap memory and bundles released during this frame are
+		// reused once the GPU gets past it
+		dynamicConstantAllocator.CleanupUsedPages(fence.Get(), currentFenceValue);
+		viewDescriptorHeap.RetireFrame(fence.Get(), currentFenceValue);
+		samplerDescriptorHeap.RetireFrame(fence.Get(), currentFenceValue);
+		heapAllocator.RetireFrame(fence.Get(), currentFenceValue);
+		staticGeometry.RetireFrame(fence.Get(), currentFenceValue);
+		bindlessTextures.RetireFrame(fence.Get(), currentFenceValue);
+
+		frameIndex = (frameIndex + 1) % framesInFlight;
+		backBufferIndex = swapChain->GetCurrentBackBufferIndex();
+
+		// The next slot is free once the GPU has finished the frame recorded in it framesInFlight
+		// frames ago.  This is the only place the CPU waits on the GPU during normal rendering.
+		double waitMs = 0.0;
+		if (fence->GetCompletedValue() < frameFenceValues[frameIndex])
 		{
-			ThrowIfFailed(fence->SetEventOnCompletion(fenceValues[frameIndex], fenceEvent));
+			LARGE_INTEGER frequency, waitStart, waitEnd;
+			QueryPerformanceFrequency(&frequency);
+			QueryPerformanceCounter(&waitStart);
+
+			ThrowIfFailed(fence->SetEventOnCompletion(frameFenceValues[frameIndex], fenceEvent));
 			WaitForSingleObjectEx(fenceEvent, INFINITE, FALSE);
+
+			QueryPerformanceCounter(&waitEnd);
+			waitMs = (double)(waitEnd.QuadPart - waitStart.QuadPart) * 1000.0 / (double)frequency.QuadPart;
+			++frameTelemetry.StalledFrames;
 		}
 
-		fenceValues[frameIndex] = currentFenceValue + 1;
+		++frameTelemetry.FrameCount;
+		frameTelemetry.LastWaitMs = waitMs;
+		frameTelemetry.TotalWaitMs += waitMs;
+		if (waitMs > frameTelemetry.MaxWaitMs)
+			frameTelemetry.MaxWaitMs = waitMs;
 	}
 
 	void GraphicContext::WaitForGpu()
 	{
-		ThrowIfFailed(commandQueue->Signal(fence.Get(), fenceValues[frameIndex]));
+		const UINT64 waitValue = nextFenceValue++;
+		ThrowIfFailed(commandQueue->Signal(fence.Get(), waitValue));
 
-		ThrowIfFailed(fence->SetEventOnCompletion(fenceValues[frameIndex], fenceEvent));
+		ThrowIfFailed(fence->SetEventOnCompletion(waitValue, fenceEvent));
 		WaitForSingleObjectEx(fenceEvent, INFINITE, FALSE);
-
-		fenceValues[frameIndex]++;
 	}
 }
\ No newline at end of file
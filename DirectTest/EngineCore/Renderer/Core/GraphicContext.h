@@ -2,6 +2,18 @@
 #include <dxgi1_4.h>
 #include "../Graphics/PipelineState.h"
 #include "../Graphics/RootSignature.h"
+#include "../Graphics/CommandSignature.h"
+#include "../Graphics/GpuResource.h"
+#include "../Graphics/UploadManager.h"
+#include "../Graphics/GpuHeapAllocator.h"
+#include "../Graphics/LinearAllocator.h"
+#include "../Graphics/DescriptorHeap.h"
+#include "../Graphics/DynamicDescriptorHeap.h"
+#include "../Graphics/BindlessTable.h"
+#include "../Graphics/TextureLoader.h"
+#include "../Graphics/RenderGraph.h"
+#include "RenderQueue.h"
+#include "StaticGeometry.h"
 
 using namespace DirectX;
 using namespace Microsoft::WRL;
@@ -23,20 +35,95 @@ struct AppBuffer
 {
 	XMFLOAT4X4 wvpMat;
 	XMFLOAT4X4 worldMat;
+	UINT materialIndex;
+	UINT padding[3];
+};
+
+// An entry of the material buffer the shaders index with AppBuffer::materialIndex
+struct MaterialData
+{
+	UINT diffuseTexture;	// Index in the bindless texture table
+	UINT padding[3];
 };
 
 namespace Renderer {
 
+	// How long the CPU was blocked in MoveToNextFrame waiting for the GPU to hand back a frame slot
+	struct FrameTelemetry
+	{
+		UINT64 FrameCount;
+		UINT64 StalledFrames;		// Frames that had to wait at all
+		double LastWaitMs;
+		double MaxWaitMs;
+		double TotalWaitMs;
+
+		double AverageWaitMs() const { return FrameCount == 0 ? 0.0 : TotalWaitMs / FrameCount; }
+	};
+
 	extern ComPtr<ID3D12Device> device;
+
+	// CPU-only descriptors that views are created into
+	extern DescriptorAllocator descriptorAllocators[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES];
+	inline D3D12_CPU_DESCRIPTOR_HANDLE AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE Type, UINT Count = 1)
+	{
+		return descriptorAllocators[Type].Allocate(Count);
+	}
+
 	class GraphicContext {
 	public:
-		GraphicContext(UINT width, UINT height);
+		static const UINT BACK_BUFFER_COUNT = 3;
+		static const UINT MAX_FRAMES_IN_FLIGHT = 4;
+
+		// framesInFlight is how many frames the CPU may record ahead of the GPU, clamped to
+		// [1, MAX_FRAMES_IN_FLIGHT].  It is independent of the number of swap chain buffers.
+		GraphicContext(UINT width, UINT height, UINT framesInFlight = 2);
 		void Initialize();
 		void OnUpdate();
 		bool OnRender();
 		void Release();
 		void OnResize(UINT width, UINT height);
 
+		// Transitions are queued and merged, then submitted as a single ResourceBarrier call right
+		// before the next draw, clear or copy.
+		void TransitionResource(GpuResource& Resource, D3D12_RESOURCE_STATES NewState, bool FlushImmediate = false);
+		// Starts a split barrier.  The matching end is emitted by the next TransitionResource call for
+		// the same resource, or when the command list is closed.
+		void BeginResourceTransition(GpuResource& Resource, D3D12_RESOURCE_STATES NewState, bool FlushImmediate = false);
+		void InsertUAVBarrier(GpuResource& Resource, bool FlushImmediate = false);
+		// Before and After share memory, After takes it over from here on
+		void InsertAliasBarrier(GpuResource& Before, GpuResource& After, bool FlushImmediate = false);
+		void FlushResourceBarriers();
+
+		void CopyBuffer(GpuResource& Dest, GpuResource& Src);
+		void CopyBufferRegion(GpuResource& Dest, size_t DestOffset, GpuResource& Src, size_t SrcOffset, size_t NumBytes);
+		void ClearColor(D3D12_CPU_DESCRIPTOR_HANDLE RTV, const float Colour[4]);
+		void ClearDepth(D3D12_CPU_DESCRIPTOR_HANDLE DSV, float Depth = 1.0f);
+
+		UINT GetFramesInFlight() const { return framesInFlight; }
+		const FrameTelemetry& GetFrameTelemetry() const { return frameTelemetry; }
+
+		UploadManager& GetUploadManager() { return uploadManager; }
+		GpuHeapAllocator& GetHeapAllocator() { return heapAllocator; }
+		// Rebuilt every frame, the schedule and aliasing statistics of the last frame stay readable
+		const RenderGraph& GetRenderGraph() const { return frameGraph; }
+		const RenderQueue& GetRenderQueue() const { return renderQueue; }
+		// Meshes added here are drawn every frame from pre-recorded bundles, before the render queue
+		StaticGeometry& GetStaticGeometry() { return staticGeometry; }
+
+		// The shader-visible heaps, bound once per command list.  Persistent descriptor tables are
+		// allocated from their static range.
+		GpuDescriptorHeap& GetViewDescriptorHeap() { return viewDescriptorHeap; }
+		GpuDescriptorHeap& GetSamplerDescriptorHeap() { return samplerDescriptorHeap; }
+		BindlessTable& GetBindlessTextures() { return bindlessTextures; }
+		// Textures it finishes loading join the bindless table at the start of the next frame
+		TextureLoader& GetTextureLoader() { return textureLoader; }
+
+		// Materials are entries of a buffer uploaded once per frame
+		UINT AddMaterial(const MaterialData& Data);
+		void UpdateMaterial(UINT Index, const MaterialData& Data);
+		void RemoveMaterial(UINT Index);
+		D3D12_GPU_VIRTUAL_ADDRESS GetMaterialBuffer() const { return materialBuffer; }
+
 		void SetRootSignature(const RootSignature& RootSig);
 
 		void SetRenderTargets(UINT NumRTVs, const D3D12_CPU_DESCRIPTOR_HANDLE RTVs[]);
@@ -55,12 +142,28 @@ namespace Renderer {
 		void SetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY Topology);
 
 		void SetPipelineState(const GraphicsPSO& PSO);
+		void SetConstants(UINT RootIndex, UINT NumConstants, const void* pConstants, UINT Offset = 0);
+		void SetConstant(UINT RootIndex, UINT Val, UINT Offset = 0);
 		void SetConstantBuffer(UINT RootIndex, D3D12_GPU_VIRTUAL_ADDRESS CBV, UINT Offset = 0);
+		// Copies the data into this frame's constant buffer memory and binds it as a root CBV.  Valid
+		// for the current frame only.
 		void SetDynamicConstantBufferView(UINT RootIndex, size_t BufferSize, const void* BufferData);
+		// The same for a structured buffer bound as a root SRV
+		void SetDynamicSRV(UINT RootIndex, size_t BufferSize, const void* BufferData);
+		// Room in this frame's upload memory for the caller to fill, e.g. a buffer gathered from
+		// several objects.  Valid for the current frame only.
+		DynAlloc ReserveUploadMemory(size_t SizeInBytes, size_t Alignment = DEFAULT_ALIGN);
 		void SetBufferSRV(UINT RootIndex, const D3D12_GPU_VIRTUAL_ADDRESS vAddress, UINT Offset);
 		void SetBufferUAV(UINT RootIndex, const D3D12_GPU_VIRTUAL_ADDRESS vAddress, UINT Offset);
 		void SetDescriptorTable(UINT RootIndex, D3D12_GPU_DESCRIPTOR_HANDLE FirstHandle);
 
+		// Stages CPU descriptors into a table of the current root signature.  Dirty tables are copied
+		// to the shader-visible heap right before the next draw.
+		void SetDynamicDescriptor(UINT RootIndex, UINT Offset, D3D12_CPU_DESCRIPTOR_HANDLE Handle);
+		void SetDynamicDescriptors(UINT RootIndex, UINT Offset, UINT Count, const D3D12_CPU_DESCRIPTOR_HANDLE Handles[]);
+		void SetDynamicSampler(UINT RootIndex, UINT Offset, D3D12_CPU_DESCRIPTOR_HANDLE Handle);
+		void SetDynamicSamplers(UINT RootIndex, UINT Offset, UINT Count, const D3D12_CPU_DESCRIPTOR_HANDLE Handles[]);
+
 		void SetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW& IBView);
 		void SetVertexBuffer(UINT Slot, const D3D12_VERTEX_BUFFER_VIEW& VBView);
 		void SetVertexBuffers(UINT StartSlot, UINT Count, const D3D12_VERTEX_BUFFER_VIEW VBViews[]);
@@ -71,6 +174,11 @@ namespace Renderer {
 			UINT StartVertexLocation = 0, UINT StartInstanceLocation = 0);
 		void DrawIndexedInstanced(UINT IndexCountPerInstance, UINT InstanceCount, UINT StartIndexLocation,
 			INT BaseVertexLocation, UINT StartInstanceLocation);
+		// Runs MaxCommands commands laid out as the signature describes, or as many as the counter
+		// buffer says if it is given
+		void ExecuteIndirect(CommandSignature& Signature, GpuResource& ArgumentBuffer, uint64_t ArgumentStartOffset = 0,
+			uint32_t MaxCommands = 1, GpuResource* CommandCounterBuffer = nullptr, uint64_t CounterOffset = 0);
+		void ExecuteBundle(ID3D12GraphicsCommandList* Bundle);
 
 	private:
 		void LoadPipeline();
@@ -78,36 +186,67 @@ namespace Renderer {
 		void PopulateCommandList();
 		void MoveToNextFrame();
 		void WaitForGpu();
+		void CloseCommandList();
+		void ExecuteCommandList();
+		void BindDescriptorHeaps();
 		std::vector<UINT8> GenerateTextureData();
 
 		void GetHardwareAdapter(IDXGIFactory4* pFactory, IDXGIAdapter1** ppAdapter);
+		// Throws with a message box if the device lacks what the shaders and the bindless table need
+		void CheckDeviceCapabilities();
+		// Adapter and driver of the device, the pipeline cache is only valid for the same one
+		uint64_t GetDeviceVersion(IDXGIFactory4* pFactory);
 
 		float aspectRatio;
 	public:
 		bool useWarpDevice;
 		ComPtr<ID3D12GraphicsCommandList> commandList; 
 	private:
-		static const UINT FRAME_COUNT = 2;
-
 		CD3DX12_VIEWPORT viewport;
 		CD3DX12_RECT scissorRect;
 		ComPtr<IDXGISwapChain3> swapChain;
-		ComPtr<ID3D12Resource> renderTargets[FRAME_COUNT];
-		ComPtr<ID3D12CommandAllocator> commandAllocators[FRAME_COUNT];
+		GpuResource renderTargets[BACK_BUFFER_COUNT];
+		ComPtr<ID3D12CommandAllocator> commandAllocators[MAX_FRAMES_IN_FLIGHT];
 		ComPtr<ID3D12CommandQueue> commandQueue;
+		UploadManager uploadManager;
+		GpuHeapAllocator heapAllocator;
+		LinearAllocator dynamicConstantAllocator;
+
+		static const uint32_t NUM_STATIC_VIEW_DESCRIPTORS = 16384;
+		static const uint32_t NUM_DYNAMIC_VIEW_DESCRIPTORS = 16384;
+		static const uint32_t NUM_STATIC_SAMPLER_DESCRIPTORS = 1024;
+		static const uint32_t NUM_DYNAMIC_SAMPLER_DESCRIPTORS = 1024;
+		GpuDescriptorHeap viewDescriptorHeap;
+		GpuDescriptorHeap samplerDescriptorHeap;
+		DynamicDescriptorHeap dynamicViewDescriptorHeap;
+		DynamicDescriptorHeap dynamicSamplerDescriptorHeap;
+		BindlessTable bindlessTextures;
+		TextureLoader textureLoader;
+		std::vector<MaterialData> materialTable;
+		std::vector<UINT> freeMaterials;
+		D3D12_GPU_VIRTUAL_ADDRESS materialBuffer;
 		ID3D12RootSignature* currRootSignature;
 		ID3D12PipelineState* m_CurGraphicsPipelineState;
 		ComPtr<ID3D12DescriptorHeap> rtvHeap;
 		UINT rtvDescriptorSize;
 
-		ComPtr<ID3D12Resource> depthStencilBuffer;
-		ID3D12DescriptorHeap* dsDescriptorHeap;
+		static const UINT MAX_PENDING_BARRIERS = 16;
+		D3D12_RESOURCE_BARRIER m_ResourceBarrierBuffer[MAX_PENDING_BARRIERS];
+		UINT m_NumBarriersToFlush;
+		std::vector<GpuResource*> m_PendingSplitTransitions;	// Split barriers begun but not yet ended
+
+		RenderGraph frameGraph;
+		RenderQueue renderQueue;
+		StaticGeometry staticGeometry;
 		
-		UINT frameIndex; 
+		UINT framesInFlight;
+		UINT frameIndex;		// Frame-in-flight slot, selects the command allocator
+		UINT backBufferIndex;
 		HANDLE fenceEvent; 
 		ComPtr<ID3D12Fence> fence; 
-		UINT64 fenceValue;
-		UINT64 fenceValues[FRAME_COUNT]; 
+		UINT64 nextFenceValue;
+		UINT64 frameFenceValues[MAX_FRAMES_IN_FLIGHT];	// Fence signalled by the last frame recorded in each slot
+		FrameTelemetry frameTelemetry;
 
 		XMFLOAT4X4 cameraProjMat; 
 		XMFLOAT4X4 cameraViewMat; 
@@ -0,0 +1,389 @@
+#include "RenderQueue.h"
+#include "GraphicContext.h"
+#include "../Components/Mesh.h"
+#include "../Materials/Material.h"
+#include "../../Core/Utility/RadixSort.h"
+#include <ppl.h>
+
+using namespace Renderer;
+
+static const uint32_t PASS_SHIFT = 64 - RenderQueue::PASS_BITS;
+static const uint32_t TRANSPARENT_SHIFT = PASS_SHIFT - 1;
+
+// Below this many draws the buffers are written on the calling thread
+static const uint32_t PARALLEL_PACK_THRESHOLD = 1024;
+static const uint32_t PACK_CHUNK_SIZE = 256;
+
+static inline uint64_t Field(uint32_t Value, uint32_t Bits, uint32_t Shift)
+{
+	return (uint64_t)(Value & ((1u << Bits) - 1)) << Shift;
+}
+
+RenderQueue::RenderQueue() :
+	m_Sorted(false),
+	m_Prepared(false),
+	m_InstanceData(0)
+{
+	SetDepthRange(SCREEN_NEAR, SCREEN_DEPTH);
+	Reset();
+}
+
+void RenderQueue::SetDepthRange(float NearZ, float FarZ)
+{
+	m_NearZ = NearZ;
+	m_InvDepthRange = 1.0f / (FarZ - NearZ);
+}
+
+void RenderQueue::Reset()
+{
+	m_Items.clear();
+	m_Keys.clear();
+	m_PSOIds.clear();
+	m_MaterialIds.clear();
+	m_MeshIds.clear();
+	m_Sorted = false;
+	m_Prepared = false;
+	m_Stats = RenderQueueStats();
+}
+
+uint64_t RenderQueue::MakeOpaqueKey(uint32_t Pass, uint32_t PSO, uint32_t Material, uint32_t Mesh, uint32_t Depth)
+{
+	return Field(Pass, PASS_BITS, PASS_SHIFT) |
+		Field(PSO, PSO_BITS, TRANSPARENT_SHIFT - PSO_BITS) |
+		Field(Mesh, MESH_BITS, TRANSPARENT_SHIFT - PSO_BITS - MESH_BITS) |
+		Field(Material, MATERIAL_BITS, DEPTH_BITS) |
+		Field(Depth, DEPTH_BITS, 0);
+}
+
+uint64_t RenderQueue::MakeTransparentKey(uint32_t Pass, uint32_t PSO, uint32_t Material, uint32_t Mesh, uint32_t Depth)
+{
+	// Farther first
+	return Field(Pass, PASS_BITS, PASS_SHIFT) |
+		(1ull << TRANSPARENT_SHIFT) |
+		Field(~Depth, DEPTH_BITS, TRANSPARENT_SHIFT - DEPTH_BITS) |
+		Field(PSO, PSO_BITS, MESH_BITS + MATERIAL_BITS) |
+		Field(Mesh, MESH_BITS, MATERIAL_BITS) |
+		Field(Material, MATERIAL_BITS, 0);
+}
+
+uint32_t RenderQueue::QuantizeDepth(float ViewDepth) const
+{
+	float Normalized = (ViewDepth - m_NearZ) * m_InvDepthRange;
+	Normalized = Normalized < 0.0f ? 0.0f : (Normalized > 1.0f ? 1.0f : Normalized);
+	return (uint32_t)(Normalized * (float)((1u << DEPTH_BITS) - 1));
+}
+
+uint32_t RenderQueue::GetId(IdMap& Ids, const void* Object, uint32_t Bits)
+{
+	auto Iter = Ids.find(Object);
+	if (Iter != Ids.end())
+		return Iter->second;
+
+	const uint32_t Id = (uint32_t)Ids.size() & ((1u << Bits) - 1);
+	Ids.emplace(Object, Id);
+	return Id;
+}
+
+void RenderQueue::AddMesh(Mesh* pMesh, float ViewDepth, uint32_t Pass)
+{
+	ASSERT(pMesh->material != nullptr, "Queued mesh has no material");
+
+	DrawItem Item;
+	Item.pMesh = pMesh;
+	Item.PSOId = GetId(m_PSOIds, pMesh->material->GetPipelineState(), PSO_BITS);
+	Item.MaterialId = GetId(m_MaterialIds, pMesh->material, MATERIAL_BITS);
+	Item.MeshId = GetId(m_MeshIds, pMesh->geometry, MESH_BITS);
+	m_Items.push_back(Item);
+
+	const uint32_t Depth = QuantizeDepth(ViewDepth);
+	m_Keys.push_back(pMesh->material->IsTransparent() ?
+		MakeTransparentKey(Pass, Item.PSOId, Item.MaterialId, Item.MeshId, Depth) :
+		MakeOpaqueKey(Pass, Item.PSOId, Item.MaterialId, Item.MeshId, Depth));
+
+	m_Sorted = false;
+	m_Prepared = false;
+}
+
+void RenderQueue::Sort()
+{
+	const size_t Count = m_Items.size();
+
+	m_Order.resize(Count);
+	for (uint32_t i = 0; i < Count; ++i)
+		m_Order[i] = i;
+
+	m_Stats.NumDraws = (uint32_t)Count;
+	CountStateChanges(m_Order.data(), m_Stats.UnsortedPSOChanges, m_Stats.UnsortedMaterialChanges, m_Stats.UnsortedMeshChanges);
+
+	LARGE_INTEGER Frequency, SortStart, SortEnd;
+	QueryPerformanceFrequency(&Frequency);
+	QueryPerformanceCounter(&SortStart);
+
+	if (m_KeysScratch.size() < Count)
+	{
+		m_KeysScratch.resize(Count);
+		m_OrderScratch.resize(Count);
+	}
+
+	Utility::RadixSort64(m_Keys.data(), m_Order.data(), Count, m_KeysScratch.data(), m_OrderScratch.data());
+
+	QueryPerformanceCounter(&SortEnd);
+	m_Stats.SortMs = (double)(SortEnd.QuadPart - SortStart.QuadPart) * 1000.0 / (double)Frequency.QuadPart;
+
+	CountStateChanges(m_Order.data(), m_Stats.SortedPSOChanges, m_Stats.SortedMaterialChanges, m_Stats.SortedMeshChanges);
+	BuildGroups();
+	m_Sorted = true;
+	m_Prepared = false;
+}
+
+void RenderQueue::Prepare(GraphicContext& Context)
+{
+	if (!m_Sorted)
+		Sort();
+
+	if (m_Prepared)
+		return;
+
+	m_Prepared = true;
+	m_Stats.PackMs = 0.0;
+
+	if (m_Order.empty())
+		return;
+
+	LARGE_INTEGER Frequency, PackStart, PackEnd;
+	QueryPerformanceFrequency(&Frequency);
+	QueryPerformanceCounter(&PackStart);
+
+	// Every instance of the frame in one buffer, the draws index into it
+	DynAlloc Instances = Context.ReserveUploadMemory(m_Order.size() * sizeof(AppBuffer));
+	PackInstanceData((AppBuffer*)Instances.DataPtr);
+	m_InstanceData = Instances.GpuAddress;
+
+	QueryPerformanceCounter(&PackEnd);
+	m_Stats.PackMs = (double)(PackEnd.QuadPart - PackStart.QuadPart) * 1000.0 / (double)Frequency.QuadPart;
+}
+
+void RenderQueue::SubmitDepthPrepass(GraphicContext& Context)
+{
+	Prepare(Context);
+
+	m_Stats.NumDepthDrawCalls = 0;
+
+	const GraphicsPSO* pLastPSO = nullptr;
+	uint32_t LastMesh = 0xFFFFFFFF;
+
+	for (const DrawGroup& Group : m_Groups)
+	{
+		const DrawItem& Item = m_Items[m_Order[Group.First]];
+		Material* pMaterial = Item.pMesh->material;
+		const GraphicsPSO* pPSO = pMaterial->GetDepthPipelineState();
+
+		// Transparent draws must not occlude what is behind them
+		if (pPSO == nullptr || pMaterial->IsTransparent() || !Item.pMesh->HasPositionStream() || !pPSO->IsReady())
+			continue;
+
+		if (pPSO != pLastPSO)
+		{
+			pMaterial->BeginDepthRender();
+			Item.pMesh->BindInstanceData(m_InstanceData);
+			pLastPSO = pPSO;
+		}
+
+		if (Item.MeshId != LastMesh)
+		{
+			Item.pMesh->BindPositions();
+			LastMesh = Item.MeshId;
+		}
+
+		Item.pMesh->SetFirstInstance(Group.First);
+		Item.pMesh->DrawInstanced(Group.Count);
+		++m_Stats.NumDepthDrawCalls;
+	}
+}
+
+void RenderQueue::Submit(GraphicContext& Context)
+{
+	Prepare(Context);
+
+	m_Stats.NumDrawCalls = 0;
+	m_Stats.NumIndirectCommands = 0;
+	m_Stats.NumExecuteIndirects = 0;
+	m_Stats.NumSkippedDraws = 0;
+
+	if (m_Order.empty())
+		return;
+
+	LARGE_INTEGER Frequency, PackStart, PackEnd;
+	QueryPerformanceFrequency(&Frequency);
+	LONGLONG PackTicks = 0;
+
+	uint32_t LastMesh = 0xFFFFFFFF;
+
+	const uint32_t NumGroups = (uint32_t)m_Groups.size();
+	for (uint32_t FirstGroup = 0; FirstGroup < NumGroups;)
+	{
+		Mesh* pFirstMesh = m_Items[m_Order[m_Groups[FirstGroup].First]].pMesh;
+		Material* pMaterial = pFirstMesh->material;
+		const GraphicsPSO* pPSO = pMaterial->GetPipelineState();
+
+		uint32_t EndGroup = FirstGroup + 1;
+		while (EndGroup < NumGroups && m_Items[m_Order[m_Groups[EndGroup].First]].pMesh->material->GetPipelineState() == pPSO)
+			++EndGroup;
+
+		// Drawn from the first frame its compile is done, waiting would stall the frame
+		if (!pPSO->IsReady())
+		{
+			for (uint32_t Group = FirstGroup; Group < EndGroup; ++Group)
+				m_Stats.NumSkippedDraws += m_Groups[Group].Count;
+			FirstGroup = EndGroup;
+			continue;
+		}
+
+		// Sets the pipeline state, the root signature and the tables every material of it shares
+		pMaterial->BeginRender();
+		pFirstMesh->BindInstanceData(m_InstanceData);
+
+		CommandSignature* Signature = pMaterial->GetDrawSignature();
+		if (Signature != nullptr)
+		{
+			const uint32_t NumCommands = EndGroup - FirstGroup;
+
+			QueryPerformanceCounter(&PackStart);
+			DynAlloc Arguments = Context.ReserveUploadMemory(NumCommands * sizeof(IndirectDrawArguments));
+			PackIndirectArguments(&m_Groups[FirstGroup], NumCommands, (IndirectDrawArguments*)Arguments.DataPtr);
+			QueryPerformanceCounter(&PackEnd);
+			PackTicks += PackEnd.QuadPart - PackStart.QuadPart;
+
+			// The commands bind their own buffers, but these still have to be readable.  Binding the
+			// first one sets the topology.
+			for (uint32_t Group = FirstGroup; Group < EndGroup; ++Group)
+				m_Items[m_Order[m_Groups[Group].First]].pMesh->TransitionGeometry();
+			pFirstMesh->BindGeometry();
+
+			// The upload pages stay in GENERIC_READ, which includes INDIRECT_ARGUMENT
+			Context.ExecuteIndirect(*Signature, Arguments.Buffer, Arguments.Offset, NumCommands);
+
+			m_Stats.NumDrawCalls += NumCommands;
+			m_Stats.NumIndirectCommands += NumCommands;
+			++m_Stats.NumExecuteIndirects;
+			LastMesh = 0xFFFFFFFF;
+		}
+		else
+		{
+			for (uint32_t Group = FirstGroup; Group < EndGroup; ++Group)
+			{
+				const DrawItem& Item = m_Items[m_Order[m_Groups[Group].First]];
+
+				if (Item.MeshId != LastMesh)
+				{
+					Item.pMesh->BindGeometry();
+					LastMesh = Item.MeshId;
+				}
+
+				Item.pMesh->SetFirstInstance(m_Groups[Group].First);
+				Item.pMesh->DrawInstanced(m_Groups[Group].Count);
+				++m_Stats.NumDrawCalls;
+			}
+		}
+
+		FirstGroup = EndGroup;
+	}
+
+	m_Stats.PackMs += (double)PackTicks * 1000.0 / (double)Frequency.QuadPart;
+}
+
+void RenderQueue::BuildGroups()
+{
+	m_Groups.clear();
+
+	const uint32_t Count = (uint32_t)m_Order.size();
+	for (uint32_t First = 0; First < Count;)
+	{
+		const Mesh* pMesh = m_Items[m_Order[First]].pMesh;
+
+		// Ids can wrap around, the instances are matched by the objects themselves.  Each instance
+		// carries its material index, only the pipeline state has to be the same.
+		const GraphicsPSO* pPSO = pMesh->material->GetPipelineState();
+		uint32_t End = First + 1;
+		while (End < Count &&
+			m_Items[m_Order[End]].pMesh->geometry == pMesh->geometry &&
+			m_Items[m_Order[End]].pMesh->material->GetPipelineState() == pPSO)
+			++End;
+
+		DrawGroup Group;
+		Group.First = First;
+		Group.Count = End - First;
+		m_Groups.push_back(Group);
+
+		First = End;
+	}
+}
+
+// Splits [0, Count) in chunks written by different threads.  Few items are done on this thread.
+template <typename Function>
+static void ForEachChunk(uint32_t Count, const Function& Func)
+{
+	if (Count < PARALLEL_PACK_THRESHOLD)
+	{
+		Func(0u, Count);
+		return;
+	}
+
+	const uint32_t NumChunks = (Count + PACK_CHUNK_SIZE - 1) / PACK_CHUNK_SIZE;
+	concurrency::parallel_for(0u, NumChunks, [&](uint32_t Chunk)
+	{
+		const uint32_t Begin = Chunk * PACK_CHUNK_SIZE;
+		const uint32_t End = Begin + PACK_CHUNK_SIZE < Count ? Begin + PACK_CHUNK_SIZE : Count;
+		Func(Begin, End);
+	});
+}
+
+void RenderQueue::PackInstanceData(AppBuffer* Dest) const
+{
+	ForEachChunk((uint32_t)m_Order.size(), [&](uint32_t Begin, uint32_t End)
+	{
+		for (uint32_t i = Begin; i < End; ++i)
+			Dest[i] = m_Items[m_Order[i]].pMesh->constBuffer;
+	});
+}
+
+void RenderQueue::PackIndirectArguments(const DrawGroup* Groups, uint32_t NumGroups, IndirectDrawArguments* Dest) const
+{
+	ForEachChunk(NumGroups, [&](uint32_t Begin, uint32_t End)
+	{
+		for (uint32_t i = Begin; i < End; ++i)
+		{
+			const Mesh* pMesh = m_Items[m_Order[Groups[i].First]].pMesh;
+
+			IndirectDrawArguments& Args = Dest[i];
+			Args.VertexBuffer = pMesh->vertexBufferView;
+			Args.IndexBuffer = pMesh->indexBufferView;
+			Args.FirstInstance = Groups[i].First;
+			Args.Draw.IndexCountPerInstance = pMesh->numIndices;
+			Args.Draw.InstanceCount = Groups[i].Count;
+			Args.Draw.StartIndexLocation = 0;
+			Args.Draw.BaseVertexLocation = 0;
+			Args.Draw.StartInstanceLocation = 0;
+		}
+	});
+}
+
+void RenderQueue::PackIndirectArguments(IndirectDrawArguments* Dest) const
+{
+	PackIndirectArguments(m_Groups.data(), (uint32_t)m_Groups.size(), Dest);
+}
+
+void RenderQueue::CountStateChanges(const uint32_t* Order, uint32_t& PSOChanges, uint32_t& MaterialChanges, uint32_t& MeshChanges) const
+{
+	PSOChanges = MaterialChanges = MeshChanges = 0;
+
+	const DrawItem* Last = nullptr;
+	for (size_t i = 0; i < m_Items.size(); ++i)
+	{
+		const DrawItem& Item = m_Items[Order[i]];
+		PSOChanges += (Last == nullptr || Last->PSOId != Item.PSOId) ? 1 : 0;
+		MaterialChanges += (Last == nullptr || Last->MaterialId != Item.MaterialId) ? 1 : 0;
+		MeshChanges += (Last == nullptr || Last->MeshId != Item.MeshId) ? 1 : 0;
+		Last = &Item;
+	}
+}
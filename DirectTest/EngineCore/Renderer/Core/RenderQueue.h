@@ -0,0 +1,151 @@
+#pragma once
+#include "../../Core/Common.h"
+#include <unordered_map>
+
+class Mesh;
+class Material;
+struct AppBuffer;
+
+namespace Renderer {
+	class GraphicContext;
+}
+
+struct RenderQueueStats
+{
+	uint32_t NumDraws;
+	// Instanced draws issued after merging the draws that share geometry and pipeline state
+	uint32_t NumDrawCalls;
+	// How many of them went through ExecuteIndirect, and in how many calls
+	uint32_t NumIndirectCommands;
+	uint32_t NumExecuteIndirects;
+	// Draws left out because their pipeline state is still compiling
+	uint32_t NumSkippedDraws;
+	// Instanced draws of the depth prepass
+	uint32_t NumDepthDrawCalls;
+
+	// State changes the draws cause in the order they were added and in the order they are submitted
+	uint32_t UnsortedPSOChanges;
+	uint32_t UnsortedMaterialChanges;
+	uint32_t UnsortedMeshChanges;
+	uint32_t SortedPSOChanges;
+	uint32_t SortedMaterialChanges;
+	uint32_t SortedMeshChanges;
+
+	double SortMs;
+	// Writing the instance data and the indirect arguments
+	double PackMs;
+};
+
+// Collects the draws of a frame and submits them in the order of a 64-bit key, sorted with a radix
+// sort.  From the most to the least significant bits:
+//
+//   Opaque       pass:4 | 0 | PSO:11 | mesh:12 | material:12 | depth:24
+//   Transparent  pass:4 | 1 | ~depth:24 | PSO:11 | mesh:12 | material:12
+//
+// Opaque draws are grouped by state and go front to back inside each group, transparent draws come
+// after them back to front.  Materials are bindless and switching them costs nothing, so the mesh
+// comes before the material to put the draws of the same geometry together.  PSO, material and mesh
+// ids are handed out per frame in the order the objects are first seen; meshes sharing vertex
+// buffers get the same id.
+//
+// Consecutive draws with the same geometry and pipeline state end up as a single instanced draw.  The
+// per object constants of every draw go in one structured buffer in the frame's upload memory, and
+// each instanced draw gets the index of its first instance as a root constant.  When the material
+// has a draw signature, all the draws of its pipeline state are written to an argument buffer and
+// submitted with a single ExecuteIndirect.  Both buffers are packed in parallel when there are
+// enough draws.
+//
+// SubmitDepthPrepass() draws the same groups before Submit(), only depth, with the depth-only pipeline
+// state of each material and the position stream of each mesh.  Both passes read the same instance
+// buffer, packed by whichever of them runs first in the frame.
+class RenderQueue
+{
+public:
+	static const uint32_t PASS_BITS = 4;
+	static const uint32_t PSO_BITS = 11;
+	static const uint32_t MATERIAL_BITS = 12;
+	static const uint32_t MESH_BITS = 12;
+	static const uint32_t DEPTH_BITS = 24;
+
+	// One indirect command: the geometry, the first instance as a root constant and the draw.  The
+	// buffer views go first so every field is naturally aligned without padding.
+	struct IndirectDrawArguments
+	{
+		D3D12_VERTEX_BUFFER_VIEW VertexBuffer;
+		D3D12_INDEX_BUFFER_VIEW IndexBuffer;
+		UINT FirstInstance;
+		D3D12_DRAW_INDEXED_ARGUMENTS Draw;
+	};
+
+	RenderQueue();
+
+	// View space depth range mapped onto the depth bits
+	void SetDepthRange(float NearZ, float FarZ);
+
+	void Reset();
+	void AddMesh(Mesh* pMesh, float ViewDepth, uint32_t Pass = 0);
+	void Sort();
+	void Submit(Renderer::GraphicContext& Context);
+	// Opaque draws of meshes with a position stream and materials with a depth pipeline state.  Needs
+	// the depth buffer set.
+	void SubmitDepthPrepass(Renderer::GraphicContext& Context);
+
+	uint32_t GetDrawCount() const { return (uint32_t)m_Items.size(); }
+	// Instanced draws the sorted queue makes, valid after Sort()
+	uint32_t GetGroupCount() const { return (uint32_t)m_Groups.size(); }
+	// The arguments of every group, as Submit() writes them for the materials with a draw signature.
+	// Dest must hold GetGroupCount() commands.
+	void PackIndirectArguments(IndirectDrawArguments* Dest) const;
+	const RenderQueueStats& GetStats() const { return m_Stats; }
+
+	static uint64_t MakeOpaqueKey(uint32_t Pass, uint32_t PSO, uint32_t Material, uint32_t Mesh, uint32_t Depth);
+	static uint64_t MakeTransparentKey(uint32_t Pass, uint32_t PSO, uint32_t Material, uint32_t Mesh, uint32_t Depth);
+	uint32_t QuantizeDepth(float ViewDepth) const;
+
+private:
+	struct DrawItem
+	{
+		Mesh* pMesh;
+		uint32_t PSOId;
+		uint32_t MaterialId;
+		uint32_t MeshId;
+	};
+
+	typedef std::unordered_map<const void*, uint32_t> IdMap;
+
+	// Ids past the number of bits wrap around, which only costs some state changes
+	static uint32_t GetId(IdMap& Ids, const void* Object, uint32_t Bits);
+	void CountStateChanges(const uint32_t* Order, uint32_t& PSOChanges, uint32_t& MaterialChanges, uint32_t& MeshChanges) const;
+
+	// A run of sorted draws with the same geometry and pipeline state, drawn as one instanced draw
+	struct DrawGroup
+	{
+		uint32_t First;		// In m_Order, also the first instance in the instance buffer
+		uint32_t Count;
+	};
+
+	// Sorts if needed and packs the instance buffer once per frame
+	void Prepare(Renderer::GraphicContext& Context);
+	void BuildGroups();
+	void PackInstanceData(AppBuffer* Dest) const;
+	void PackIndirectArguments(const DrawGroup* Groups, uint32_t NumGroups, IndirectDrawArguments* Dest) const;
+
+	float m_NearZ;
+	float m_InvDepthRange;
+
+	std::vector<DrawItem> m_Items;
+	std::vector<uint64_t> m_Keys;
+	std::vector<uint32_t> m_Order;
+	std::vector<uint64_t> m_KeysScratch;
+	std::vector<uint32_t> m_OrderScratch;
+	std::vector<DrawGroup> m_Groups;
+	bool m_Sorted;
+	bool m_Prepared;
+	D3D12_GPU_VIRTUAL_ADDRESS m_InstanceData;
+
+	IdMap m_PSOIds;
+	IdMap m_MaterialIds;
+	IdMap m_MeshIds;
+
+	RenderQueueStats m_Stats;
+};
@@ -0,0 +1,251 @@
+#include "StaticGeometry.h"
+#include "GraphicContext.h"
+#include "../Components/Mesh.h"
+#include "../Materials/Material.h"
+#include "../Graphics/PipelineState.h"
+#include <algorithm>
+#include <functional>
+
+using namespace Renderer;
+
+StaticGeometry::StaticGeometry() :
+	m_Dirty(false),
+	m_InstanceData(0)
+{
+	ZeroMemory(&m_Stats, sizeof(m_Stats));
+}
+
+void StaticGeometry::Add(Mesh* pMesh)
+{
+	ASSERT(pMesh->material != nullptr, "Static mesh has no material");
+
+	m_Meshes.push_back(pMesh);
+	m_Dirty = true;
+}
+
+void StaticGeometry::Remove(Mesh* pMesh)
+{
+	auto Iter = std::find(m_Meshes.begin(), m_Meshes.end(), pMesh);
+	if (Iter == m_Meshes.end())
+		return;
+
+	m_Meshes.erase(Iter);
+	m_Dirty = true;
+}
+
+void StaticGeometry::Clear()
+{
+	m_Meshes.clear();
+	m_Dirty = true;
+}
+
+bool StaticGeometry::HasDepthPass(const Material* pMaterial)
+{
+	// Transparent draws must not occlude what is behind them
+	return pMaterial->GetDepthPipelineState() != nullptr && !pMaterial->IsTransparent();
+}
+
+bool StaticGeometry::Prepare(GraphicContext& Context)
+{
+	// Recording needs every pipeline state compiled.  Until then the set is not drawn and the old
+	// bundles, which could reference meshes that are gone, are not used either.
+	if (m_Dirty)
+	{
+		for (Mesh* pMesh : m_Meshes)
+		{
+			const Material* pMaterial = pMesh->material;
+			if (!pMaterial->GetPipelineState()->IsReady())
+				return false;
+			if (HasDepthPass(pMaterial) && !pMaterial->GetDepthPipelineState()->IsReady())
+				return false;
+		}
+		Record();
+	}
+
+	if (m_Meshes.empty() || m_InstanceData != 0)
+		return true;
+
+	// The transforms of the whole set, in the order the bundles number the instances
+	DynAlloc Instances = Context.ReserveUploadMemory(m_Meshes.size() * sizeof(AppBuffer));
+	AppBuffer* InstanceData = (AppBuffer*)Instances.DataPtr;
+	for (size_t i = 0; i < m_Meshes.size(); ++i)
+		InstanceData[i] = m_Meshes[i]->constBuffer;
+	m_InstanceData = Instances.GpuAddress;
+	return true;
+}
+
+void StaticGeometry::SubmitDepthPrepass(GraphicContext& Context)
+{
+	if (!Prepare(Context))
+		return;
+
+	for (Bundle& Target : m_Bundles)
+	{
+		if (Target.DepthCommandList == nullptr)
+			continue;
+
+		Target.pMaterial->BeginDepthRender();
+		for (Mesh* pGeometry : Target.Geometry)
+		{
+			if (pGeometry->HasPositionStream())
+				pGeometry->TransitionPositions();
+		}
+		m_Meshes[Target.FirstMesh]->BindInstanceData(m_InstanceData);
+
+		Context.ExecuteBundle(Target.DepthCommandList.Get());
+	}
+}
+
+void StaticGeometry::Submit(GraphicContext& Context)
+{
+	if (!Prepare(Context))
+		return;
+
+	for (Bundle& Target : m_Bundles)
+	{
+		// The bundle inherits the root signature, the material's tables and the instance buffer from
+		// here.  Barriers are not allowed in a bundle, the geometry is transitioned here too.
+		Target.pMaterial->BeginRender();
+		for (Mesh* pGeometry : Target.Geometry)
+			pGeometry->TransitionGeometry();
+		m_Meshes[Target.FirstMesh]->BindInstanceData(m_InstanceData);
+
+		Context.ExecuteBundle(Target.CommandList.Get());
+	}
+}
+
+void StaticGeometry::RetireFrame(ID3D12Fence* pFence, uint64_t FenceValue)
+{
+	// The next frame copies the transforms again
+	m_InstanceData = 0;
+
+	for (RetiredBundle& Pending : m_PendingRelease)
+	{
+		Pending.Fence = FenceValue;
+		m_RetiredBundles.push_back(Pending);
+	}
+	m_PendingRelease.clear();
+
+	const uint64_t CompletedValue = pFence->GetCompletedValue();
+	while (!m_RetiredBundles.empty() && m_RetiredBundles.front().Fence <= CompletedValue)
+		m_RetiredBundles.pop_front();
+}
+
+void StaticGeometry::Record()
+{
+	ReleaseBundles();
+
+	// Pipeline state first and geometry second, so every bundle is a run of the array and the meshes
+	// sharing geometry end up next to each other.  Materials are bindless, the instances of a draw
+	// can use different ones.
+	std::less<const void*> Less;
+	std::stable_sort(m_Meshes.begin(), m_Meshes.end(), [&](const Mesh* A, const Mesh* B)
+	{
+		const GraphicsPSO* PSOA = A->material->GetPipelineState();
+		const GraphicsPSO* PSOB = B->material->GetPipelineState();
+		if (PSOA != PSOB)
+			return Less(PSOA, PSOB);
+		return Less(A->geometry, B->geometry);
+	});
+
+	m_Stats.NumDrawCalls = 0;
+	m_Stats.NumDepthDrawCalls = 0;
+	m_InstanceData = 0;
+
+	const uint32_t Count = (uint32_t)m_Meshes.size();
+	for (uint32_t First = 0; First < Count;)
+	{
+		Bundle Target;
+		Target.pMaterial = m_Meshes[First]->material;
+		Target.FirstMesh = First;
+
+		const GraphicsPSO* pPSO = Target.pMaterial->GetPipelineState();
+		uint32_t End = First;
+		while (End < Count && m_Meshes[End]->material->GetPipelineState() == pPSO)
+		{
+			if (End == First || m_Meshes[End]->geometry != m_Meshes[End - 1]->geometry)
+				Target.Geometry.push_back(m_Meshes[End]);
+			++End;
+		}
+		Target.NumMeshes = End - First;
+
+		RecordBundle(Target, false);
+		if (HasDepthPass(Target.pMaterial))
+			RecordBundle(Target, true);
+		m_Bundles.push_back(Target);
+
+		First = End;
+	}
+
+	m_Stats.NumMeshes = Count;
+	m_Stats.NumBundles = (uint32_t)m_Bundles.size();
+	++m_Stats.NumRecords;
+	m_Dirty = false;
+}
+
+void StaticGeometry::RecordBundle(Bundle& Target, bool DepthOnly)
+{
+	const GraphicsPSO* pPSO = DepthOnly ? Target.pMaterial->GetDepthPipelineState() : Target.pMaterial->GetPipelineState();
+	Microsoft::WRL::ComPtr<ID3D12CommandAllocator>& Allocator = DepthOnly ? Target.DepthAllocator : Target.Allocator;
+	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>& CommandList = DepthOnly ? Target.DepthCommandList : Target.CommandList;
+
+	ThrowIfFailed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_BUNDLE, IID_PPV_ARGS(&Allocator)));
+	ThrowIfFailed(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_BUNDLE, Allocator.Get(),
+		pPSO->GetPipelineStateObject(), IID_PPV_ARGS(&CommandList)));
+
+	ID3D12GraphicsCommandList* pBundle = CommandList.Get();
+
+	// Setting the same root signature as the calling list keeps the bindings the bundle inherits
+	pBundle->SetGraphicsRootSignature(pPSO->GetRootSignature().GetSignature());
+	pBundle->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	const uint32_t End = Target.FirstMesh + Target.NumMeshes;
+	for (uint32_t First = Target.FirstMesh; First < End;)
+	{
+		Mesh* pMesh = m_Meshes[First];
+
+		uint32_t GroupEnd = First + 1;
+		while (GroupEnd < End && m_Meshes[GroupEnd]->geometry == pMesh->geometry)
+			++GroupEnd;
+
+		// Geometry without a position stream is only drawn in the scene pass
+		if (!DepthOnly || pMesh->HasPositionStream())
+		{
+			pBundle->IASetVertexBuffers(0, 1, DepthOnly ? &pMesh->positionBufferView : &pMesh->vertexBufferView);
+			pBundle->IASetIndexBuffer(&pMesh->indexBufferView);
+			pBundle->SetGraphicsRoot32BitConstant(Mesh::FIRST_INSTANCE_ROOT_INDEX, First, 0);
+			pBundle->DrawIndexedInstanced(pMesh->numIndices, GroupEnd - First, 0, 0, 0);
+			if (DepthOnly)
+				++m_Stats.NumDepthDrawCalls;
+			else
+				++m_Stats.NumDrawCalls;
+		}
+
+		First = GroupEnd;
+	}
+
+	ThrowIfFailed(pBundle->Close());
+}
+
+void StaticGeometry::Retire(Microsoft::WRL::ComPtr<ID3D12CommandAllocator>& Allocator, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>& CommandList)
+{
+	if (CommandList == nullptr)
+		return;
+
+	RetiredBundle Retired;
+	Retired.Fence = 0;
+	Retired.Allocator = Allocator;
+	Retired.CommandList = CommandList;
+	m_PendingRelease.push_back(Retired);
+}
+
+void StaticGeometry::ReleaseBundles()
+{
+	// Frames in flight may still execute them
+	for (Bundle& Old : m_Bundles)
+	{
+		Retire(Old.Allocator, Old.CommandList);
+		Retire(Old.DepthAllocator, Old.DepthCommandList);
+	}
+	m_Bundles.clear();
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "../../Core/Common.h"
+#include <deque>
+
+class Mesh;
+class Material;
+
+namespace Renderer {
+	class GraphicContext;
+}
+
+struct StaticGeometryStats
+{
+	uint32_t NumMeshes;
+	uint32_t NumBundles;
+	uint32_t NumDrawCalls;		// Instanced draws recorded in the bundles
+	uint32_t NumDepthDrawCalls;	// Of those, the ones recorded again for the depth prepass
+	uint32_t NumRecords;		// Times the bundles were recorded since the start
+};
+
+// Meshes that stay in the scene from frame to frame, drawn from D3D12 bundles.  The draws are recorded
+// once, one bundle per pipeline state with the meshes sharing geometry instanced together, and every
+// frame only replays them.  Adding or removing meshes records the bundles again on the next Submit,
+// as must Invalidate() after changing the geometry or material of a mesh in the set.  Recording waits
+// until the pipeline states of every mesh have finished compiling.
+//
+// The transforms are not part of the bundles.  Each frame they are copied to a structured buffer that
+// is bound before the bundle runs, so the meshes and the camera can still move.
+//
+// Opaque materials with a depth pipeline state also get a depth-only bundle, drawing the position
+// streams for SubmitDepthPrepass().  Both passes read the same instance buffer, copied by whichever of
+// them runs first in the frame.
+class StaticGeometry
+{
+public:
+	StaticGeometry();
+
+	void Add(Mesh* pMesh);
+	void Remove(Mesh* pMesh);
+	void Clear();
+	void Invalidate() { m_Dirty = true; }
+
+	// Records the bundles if the set changed and executes them.  Needs the render targets set.
+	void Submit(Renderer::GraphicContext& Context);
+	// Same with the depth-only bundles.  Needs the depth buffer set.
+	void SubmitDepthPrepass(Renderer::GraphicContext& Context);
+
+	// Ends the frame.  Bundles replaced during it are released once pFence reaches FenceValue.
+	void RetireFrame(ID3D12Fence* pFence, uint64_t FenceValue);
+
+	const StaticGeometryStats& GetStats() const { return m_Stats; }
+
+private:
+	struct Bundle
+	{
+		Material* pMaterial;		// The first one, binds what every material of the pipeline state shares
+		uint32_t FirstMesh;			// In m_Meshes
+		uint32_t NumMeshes;
+		std::vector<Mesh*> Geometry;	// One mesh per distinct geometry, to transition its buffers
+		Microsoft::WRL::ComPtr<ID3D12CommandAllocator> Allocator;
+		Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList;
+		// Null when the material has no depth pipeline state or is transparent
+		Microsoft::WRL::ComPtr<ID3D12CommandAllocator> DepthAllocator;
+		Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> DepthCommandList;
+	};
+
+	struct RetiredBundle
+	{
+		uint64_t Fence;
+		Microsoft::WRL::ComPtr<ID3D12CommandAllocator> Allocator;
+		Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList;
+	};
+
+	static bool HasDepthPass(const Material* pMaterial);
+
+	// False while some pipeline state of the set is still compiling
+	bool Prepare(Renderer::GraphicContext& Context);
+	void Record();
+	void RecordBundle(Bundle& Target, bool DepthOnly);
+	void ReleaseBundles();
+	void Retire(Microsoft::WRL::ComPtr<ID3D12CommandAllocator>& Allocator, Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>& CommandList);
+
+	std::vector<Mesh*> m_Meshes;
+	std::vector<Bundle> m_Bundles;
+	bool m_Dirty;
+	D3D12_GPU_VIRTUAL_ADDRESS m_InstanceData;		// 0 until copied this frame
+
+	std::vector<RetiredBundle> m_PendingRelease;		// Replaced this frame
+	std::deque<RetiredBundle> m_RetiredBundles;
+
+	StaticGeometryStats m_Stats;
+};
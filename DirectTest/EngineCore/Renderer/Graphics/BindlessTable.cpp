@@ -0,0 +1,129 @@
+#include "BindlessTable.h"
+#include "GpuResource.h"
+#include "../Core/GraphicContext.h"
+
+using namespace std;
+using namespace Renderer;
+
+BindlessTable::BindlessTable() :
+	m_Heap(nullptr),
+	m_NumDescriptors(0),
+	m_NumUsed(0)
+{
+	m_NullSRV.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+}
+
+void BindlessTable::Create(GpuDescriptorHeap& Heap, uint32_t NumDescriptors)
+{
+	ASSERT(Heap.GetType() == D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, "Bindless textures need a view heap");
+
+	m_Heap = &Heap;
+	m_NumDescriptors = NumDescriptors;
+	m_NumUsed = 0;
+	m_FirstHandle = Heap.AllocateStatic(NumDescriptors);
+
+	// Reading an unused slot returns zero instead of faulting
+	D3D12_SHADER_RESOURCE_VIEW_DESC NullDesc = {};
+	NullDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	NullDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	NullDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	NullDesc.Texture2D.MipLevels = 1;
+	m_NullSRV = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	device->CreateShaderResourceView(nullptr, &NullDesc, m_NullSRV);
+
+	// Handed out from the front
+	m_FreeSlots.resize(NumDescriptors);
+	for (uint32_t i = 0; i < NumDescriptors; ++i)
+	{
+		m_FreeSlots[i] = NumDescriptors - 1 - i;
+		SetNull(i);
+	}
+}
+
+void BindlessTable::Destroy()
+{
+	if (m_Heap == nullptr)
+		return;
+
+	m_Heap->FreeStatic(m_FirstHandle, m_NumDescriptors);
+	m_Heap = nullptr;
+
+	m_FreeSlots.clear();
+	m_NewResources.clear();
+	m_PendingRemoval.clear();
+	m_RetiredSlots.clear();
+	m_NumUsed = 0;
+}
+
+uint32_t BindlessTable::Add(GpuResource& Resource, D3D12_CPU_DESCRIPTOR_HANDLE SRV)
+{
+	lock_guard<mutex> LockGuard(m_Mutex);
+
+	ASSERT(!m_FreeSlots.empty(), "Out of bindless descriptors");
+
+	const uint32_t Index = m_FreeSlots.back();
+	m_FreeSlots.pop_back();
+	++m_NumUsed;
+
+	DescriptorHandle Slot = m_FirstHandle + Index * m_Heap->GetDescriptorSize();
+	device->CopyDescriptorsSimple(1, Slot.GetCpuHandle(), SRV, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+	m_NewResources.push_back(make_pair(Index, &Resource));
+	return Index;
+}
+
+void BindlessTable::Remove(uint32_t Index)
+{
+	lock_guard<mutex> LockGuard(m_Mutex);
+
+	ASSERT(Index < m_NumDescriptors, "Bindless index out of range");
+
+	for (size_t i = 0; i < m_NewResources.size(); ++i)
+	{
+		if (m_NewResources[i].first == Index)
+		{
+			m_NewResources.erase(m_NewResources.begin() + i);
+			break;
+		}
+	}
+
+	m_PendingRemoval.push_back(Index);
+	--m_NumUsed;
+}
+
+void BindlessTable::TransitionNewResources(GraphicContext& Context)
+{
+	lock_guard<mutex> LockGuard(m_Mutex);
+
+	for (auto& Entry : m_NewResources)
+		Context.TransitionResource(*Entry.second, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	m_NewResources.clear();
+}
+
+void BindlessTable::RetireFrame(ID3D12Fence* pFence, uint64_t FenceValue)
+{
+	lock_guard<mutex> LockGuard(m_Mutex);
+
+	for (uint32_t Index : m_PendingRemoval)
+	{
+		RetiredSlot Retired;
+		Retired.Fence = FenceValue;
+		Retired.Index = Index;
+		m_RetiredSlots.push_back(Retired);
+	}
+	m_PendingRemoval.clear();
+
+	const uint64_t CompletedValue = pFence->GetCompletedValue();
+	while (!m_RetiredSlots.empty() && m_RetiredSlots.front().Fence <= CompletedValue)
+	{
+		SetNull(m_RetiredSlots.front().Index);
+		m_FreeSlots.push_back(m_RetiredSlots.front().Index);
+		m_RetiredSlots.pop_front();
+	}
+}
+
+void BindlessTable::SetNull(uint32_t Index)
+{
+	DescriptorHandle Slot = m_FirstHandle + Index * m_Heap->GetDescriptorSize();
+	device->CopyDescriptorsSimple(1, Slot.GetCpuHandle(), m_NullSRV, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+}
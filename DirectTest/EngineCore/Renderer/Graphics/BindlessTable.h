@@ -0,0 +1,64 @@
+#pragma once
+
+#include "../../Core/Common.h"
+#include "DescriptorHeap.h"
+#include <deque>
+#include <mutex>
+
+class GpuResource;
+
+namespace Renderer {
+	class GraphicContext;
+}
+
+// One large range of SRVs in the static part of the global view heap, bound as a single descriptor
+// table that shaders index into.  Every texture of the scene gets a slot, so binding a texture is
+// writing its index into a buffer and switching materials changes no tables.
+//
+// Unused slots hold a null SRV.  A removed slot is only handed out again once the GPU has finished
+// the frames that could still read it.
+class BindlessTable
+{
+public:
+	// Must match the size of the texture array in the shaders
+	static const uint32_t MAX_DESCRIPTORS = 4096;
+
+	BindlessTable();
+
+	void Create(GpuDescriptorHeap& Heap, uint32_t NumDescriptors = MAX_DESCRIPTORS);
+	void Destroy();
+
+	// Copies SRV into a free slot and returns its index.  The resource is moved to a shader resource
+	// state at the start of the next frame and must stay there while it is in the table.
+	uint32_t Add(GpuResource& Resource, D3D12_CPU_DESCRIPTOR_HANDLE SRV);
+	void Remove(uint32_t Index);
+
+	// Transitions the resources added since the last call
+	void TransitionNewResources(Renderer::GraphicContext& Context);
+	void RetireFrame(ID3D12Fence* pFence, uint64_t FenceValue);
+
+	D3D12_GPU_DESCRIPTOR_HANDLE GetGpuHandle() const { return m_FirstHandle.GetGpuHandle(); }
+	uint32_t GetNumDescriptors() const { return m_NumDescriptors; }
+	uint32_t GetNumUsed() const { return m_NumUsed; }
+
+private:
+	struct RetiredSlot
+	{
+		uint64_t Fence;
+		uint32_t Index;
+	};
+
+	void SetNull(uint32_t Index);
+
+	GpuDescriptorHeap* m_Heap;
+	DescriptorHandle m_FirstHandle;
+	uint32_t m_NumDescriptors;
+	uint32_t m_NumUsed;
+	D3D12_CPU_DESCRIPTOR_HANDLE m_NullSRV;
+
+	std::mutex m_Mutex;
+	std::vector<uint32_t> m_FreeSlots;
+	std::vector<std::pair<uint32_t, GpuResource*>> m_NewResources;
+	std::vector<uint32_t> m_PendingRemoval;		// Removed this frame
+	std::deque<RetiredSlot> m_RetiredSlots;
+};
@@ -0,0 +1,76 @@
+#include "CommandSignature.h"
+#include "RootSignature.h"
+#include "../Core/GraphicContext.h"
+
+using namespace Renderer;
+
+void CommandSignature::Destroy(void)
+{
+	if (m_Signature != nullptr)
+	{
+		m_Signature->Release();
+		m_Signature = nullptr;
+	}
+	m_Finalized = FALSE;
+}
+
+void CommandSignature::Finalize(const RootSignature* RootSignature)
+{
+	if (m_Finalized)
+		return;
+
+	UINT ByteStride = 0;
+	bool RequiresRootSignature = false;
+
+	for (UINT i = 0; i < m_NumParameters; ++i)
+	{
+		switch (m_ParamArray[i].GetDesc().Type)
+		{
+		case D3D12_INDIRECT_ARGUMENT_TYPE_DRAW:
+			ByteStride += sizeof(D3D12_DRAW_ARGUMENTS);
+			break;
+		case D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED:
+			ByteStride += sizeof(D3D12_DRAW_INDEXED_ARGUMENTS);
+			break;
+		case D3D12_INDIRECT_ARGUMENT_TYPE_DISPATCH:
+			ByteStride += sizeof(D3D12_DISPATCH_ARGUMENTS);
+			break;
+		case D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT:
+			ByteStride += m_ParamArray[i].GetDesc().Constant.Num32BitValuesToSet * 4;
+			RequiresRootSignature = true;
+			break;
+		case D3D12_INDIRECT_ARGUMENT_TYPE_VERTEX_BUFFER_VIEW:
+			ByteStride += sizeof(D3D12_VERTEX_BUFFER_VIEW);
+			break;
+		case D3D12_INDIRECT_ARGUMENT_TYPE_INDEX_BUFFER_VIEW:
+			ByteStride += sizeof(D3D12_INDEX_BUFFER_VIEW);
+			break;
+		case D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT_BUFFER_VIEW:
+		case D3D12_INDIRECT_ARGUMENT_TYPE_SHADER_RESOURCE_VIEW:
+		case D3D12_INDIRECT_ARGUMENT_TYPE_UNORDERED_ACCESS_VIEW:
+			ByteStride += 8;
+			RequiresRootSignature = true;
+			break;
+		default:
+			ASSERT(false, "Indirect parameter was not initialized");
+			break;
+		}
+	}
+
+	ASSERT(!RequiresRootSignature || RootSignature != nullptr, "Indirect arguments that change root parameters need a root signature");
+
+	D3D12_COMMAND_SIGNATURE_DESC CommandSignatureDesc;
+	CommandSignatureDesc.ByteStride = ByteStride;
+	CommandSignatureDesc.NumArgumentDescs = m_NumParameters;
+	CommandSignatureDesc.pArgumentDescs = (const D3D12_INDIRECT_ARGUMENT_DESC*)m_ParamArray.get();
+	CommandSignatureDesc.NodeMask = 1;
+
+	ID3D12RootSignature* pRootSig = RequiresRootSignature ? RootSignature->GetSignature() : nullptr;
+
+	ASSERT_SUCCEEDED(device->CreateCommandSignature(&CommandSignatureDesc, pRootSig, MY_IID_PPV_ARGS(&m_Signature)));
+
+	m_Signature->SetName(L"CommandSignature");
+
+	m_ByteStride = ByteStride;
+	m_Finalized = TRUE;
+}
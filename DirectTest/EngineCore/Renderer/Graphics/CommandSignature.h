@@ -0,0 +1,132 @@
+#pragma once
+
+#include "../../Core/Common.h"
+
+class RootSignature;
+
+// One argument of an indirect command.  The arguments are laid out in the argument buffer in the
+// order they are given, with no padding between them.
+class IndirectParameter
+{
+	friend class CommandSignature;
+public:
+
+	IndirectParameter()
+	{
+		m_IndirectParam.Type = (D3D12_INDIRECT_ARGUMENT_TYPE)0xFFFFFFFF;
+	}
+
+	void Draw(void)
+	{
+		m_IndirectParam.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW;
+	}
+
+	void DrawIndexed(void)
+	{
+		m_IndirectParam.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+	}
+
+	void Dispatch(void)
+	{
+		m_IndirectParam.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DISPATCH;
+	}
+
+	void VertexBufferView(UINT Slot)
+	{
+		m_IndirectParam.Type = D3D12_INDIRECT_ARGUMENT_TYPE_VERTEX_BUFFER_VIEW;
+		m_IndirectParam.VertexBuffer.Slot = Slot;
+	}
+
+	void IndexBufferView(void)
+	{
+		m_IndirectParam.Type = D3D12_INDIRECT_ARGUMENT_TYPE_INDEX_BUFFER_VIEW;
+	}
+
+	void Constant(UINT RootParameterIndex, UINT DestOffsetIn32BitValues, UINT Num32BitValuesToSet)
+	{
+		m_IndirectParam.Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT;
+		m_IndirectParam.Constant.RootParameterIndex = RootParameterIndex;
+		m_IndirectParam.Constant.DestOffsetIn32BitValues = DestOffsetIn32BitValues;
+		m_IndirectParam.Constant.Num32BitValuesToSet = Num32BitValuesToSet;
+	}
+
+	void ConstantBufferView(UINT RootParameterIndex)
+	{
+		m_IndirectParam.Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT_BUFFER_VIEW;
+		m_IndirectParam.ConstantBufferView.RootParameterIndex = RootParameterIndex;
+	}
+
+	void ShaderResourceView(UINT RootParameterIndex)
+	{
+		m_IndirectParam.Type = D3D12_INDIRECT_ARGUMENT_TYPE_SHADER_RESOURCE_VIEW;
+		m_IndirectParam.ShaderResourceView.RootParameterIndex = RootParameterIndex;
+	}
+
+	void UnorderedAccessView(UINT RootParameterIndex)
+	{
+		m_IndirectParam.Type = D3D12_INDIRECT_ARGUMENT_TYPE_UNORDERED_ACCESS_VIEW;
+		m_IndirectParam.UnorderedAccessView.RootParameterIndex = RootParameterIndex;
+	}
+
+	const D3D12_INDIRECT_ARGUMENT_DESC& GetDesc(void) const { return m_IndirectParam; }
+
+protected:
+
+	D3D12_INDIRECT_ARGUMENT_DESC m_IndirectParam;
+};
+
+// Describes the commands ExecuteIndirect reads from an argument buffer.  Arguments that change root
+// parameters need the root signature they apply to, and the draw, draw indexed or dispatch argument
+// has to be the last one.
+class CommandSignature
+{
+public:
+
+	CommandSignature(UINT NumParams = 0) : m_Finalized(FALSE), m_NumParameters(NumParams), m_Signature(nullptr)
+	{
+		Reset(NumParams);
+	}
+
+	~CommandSignature()
+	{
+		Destroy();
+	}
+
+	void Destroy(void);
+
+	void Reset(UINT NumParams)
+	{
+		if (NumParams > 0)
+			m_ParamArray.reset(new IndirectParameter[NumParams]);
+		else
+			m_ParamArray = nullptr;
+
+		m_NumParameters = NumParams;
+	}
+
+	IndirectParameter& operator[](size_t EntryIndex)
+	{
+		ASSERT(EntryIndex < m_NumParameters);
+		return m_ParamArray.get()[EntryIndex];
+	}
+
+	const IndirectParameter& operator[](size_t EntryIndex) const
+	{
+		ASSERT(EntryIndex < m_NumParameters);
+		return m_ParamArray.get()[EntryIndex];
+	}
+
+	void Finalize(const RootSignature* RootSignature = nullptr);
+
+	ID3D12CommandSignature* GetSignature() const { return m_Signature; }
+	// Size of one command in the argument buffer
+	UINT GetByteStride() const { return m_ByteStride; }
+
+protected:
+
+	BOOL m_Finalized;
+	UINT m_NumParameters;
+	UINT m_ByteStride;
+	std::unique_ptr<IndirectParameter[]> m_ParamArray;
+	ID3D12CommandSignature* m_Signature;
+};
@@ -0,0 +1,187 @@
+#include "DdsReader.h"
+#include <cstring>
+
+namespace
+{
+	const uint32_t DDS_MAGIC = 0x20534444;			// "DDS "
+	const uint32_t DDS_HEADER_SIZE = 124;
+	const uint32_t DDS_DX10_HEADER_SIZE = 20;
+
+	// DDS_HEADER.dwFlags
+	const uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+	// DDS_HEADER.dwCaps2
+	const uint32_t DDSCAPS2_CUBEMAP = 0x200;
+	const uint32_t DDSCAPS2_CUBEMAP_ALLFACES = 0xFC00;
+	const uint32_t DDSCAPS2_VOLUME = 0x200000;
+
+	// DDS_PIXELFORMAT.dwFlags
+	const uint32_t DDPF_ALPHAPIXELS = 0x1;
+	const uint32_t DDPF_FOURCC = 0x4;
+	const uint32_t DDPF_RGB = 0x40;
+	const uint32_t DDPF_LUMINANCE = 0x20000;
+
+	// DDS_HEADER_DXT10
+	const uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+	const uint32_t DDS_RESOURCE_MISC_TEXTURECUBE = 0x4;
+
+	// D3D12_REQ_TEXTURE2D_U_OR_V_DIMENSION
+	const uint32_t MAX_SIZE = 16384;
+
+	uint32_t MakeFourCC(char A, char B, char C, char D)
+	{
+		return (uint32_t)(uint8_t)A | (uint32_t)(uint8_t)B << 8 | (uint32_t)(uint8_t)C << 16 | (uint32_t)(uint8_t)D << 24;
+	}
+
+	uint32_t ReadU32(const uint8_t* Data)
+	{
+		uint32_t Value;
+		memcpy(&Value, Data, 4);
+		return Value;
+	}
+}
+
+DdsReader::DdsReader() :
+	m_Width(0),
+	m_Height(0),
+	m_MipLevels(0),
+	m_ArraySize(0),
+	m_Cubemap(false),
+	m_Format(DXGI_FORMAT_UNKNOWN)
+{
+}
+
+bool DdsReader::ReadHeader(const uint8_t* Data, size_t Size)
+{
+	m_Subresources.clear();
+
+	if (Size < 4 + DDS_HEADER_SIZE || ReadU32(Data) != DDS_MAGIC || ReadU32(Data + 4) != DDS_HEADER_SIZE)
+		return false;
+
+	const uint8_t* Header = Data + 4;
+	const uint32_t Flags = ReadU32(Header + 4);
+	m_Height = ReadU32(Header + 8);
+	m_Width = ReadU32(Header + 12);
+	const uint32_t MipMapCount = ReadU32(Header + 24);
+	const uint32_t Caps2 = ReadU32(Header + 108);
+
+	PixelFormat Pixels;
+	Pixels.Flags = ReadU32(Header + 76);
+	Pixels.FourCC = ReadU32(Header + 80);
+	Pixels.RGBBitCount = ReadU32(Header + 84);
+	Pixels.RBitMask = ReadU32(Header + 88);
+	Pixels.GBitMask = ReadU32(Header + 92);
+	Pixels.BBitMask = ReadU32(Header + 96);
+	Pixels.ABitMask = ReadU32(Header + 100);
+
+	m_MipLevels = (Flags & DDSD_MIPMAPCOUNT) != 0 && MipMapCount > 0 ? MipMapCount : 1;
+	size_t Offset = 4 + DDS_HEADER_SIZE;
+
+	if ((Pixels.Flags & DDPF_FOURCC) != 0 && Pixels.FourCC == MakeFourCC('D', 'X', '1', '0'))
+	{
+		if (Size < Offset + DDS_DX10_HEADER_SIZE)
+			return false;
+
+		const uint8_t* Extension = Data + Offset;
+		m_Format = (DXGI_FORMAT)ReadU32(Extension);
+		const uint32_t Dimension = ReadU32(Extension + 4);
+		const uint32_t MiscFlag = ReadU32(Extension + 8);
+		m_ArraySize = ReadU32(Extension + 12);
+		Offset += DDS_DX10_HEADER_SIZE;
+
+		if (Dimension != DDS_DIMENSION_TEXTURE2D || m_ArraySize == 0 || m_ArraySize > D3D12_REQ_TEXTURE2D_ARRAY_AXIS_DIMENSION)
+			return false;
+
+		m_Cubemap = (MiscFlag & DDS_RESOURCE_MISC_TEXTURECUBE) != 0;
+		if (m_Cubemap)
+			m_ArraySize *= 6;
+	}
+	else
+	{
+		if ((Caps2 & DDSCAPS2_VOLUME) != 0)
+			return false;
+
+		m_Format = GetLegacyFormat(Pixels);
+		m_Cubemap = (Caps2 & DDSCAPS2_CUBEMAP) != 0;
+		// D3D has no cube maps with faces missing
+		if (m_Cubemap && (Caps2 & DDSCAPS2_CUBEMAP_ALLFACES) != DDSCAPS2_CUBEMAP_ALLFACES)
+			return false;
+		m_ArraySize = m_Cubemap ? 6 : 1;
+	}
+
+	if (m_Width == 0 || m_Height == 0 || m_Width > MAX_SIZE || m_Height > MAX_SIZE ||
+		m_ArraySize > D3D12_REQ_TEXTURE2D_ARRAY_AXIS_DIMENSION)
+		return false;
+
+	// A mip per halving of the larger side, down to 1x1
+	uint32_t FullChain = 1;
+	for (uint32_t Side = m_Width > m_Height ? m_Width : m_Height; Side > 1; Side >>= 1)
+		++FullChain;
+	if (m_MipLevels > FullChain)
+		return false;
+
+	// Formats whose size is unknown, and BC textures the GPU cannot take: their top level has to be
+	// whole blocks
+	if (ImageLoader::GetDXGIFormatBitsPerPixel(m_Format) == 0 ||
+		(ImageLoader::IsBlockCompressed(m_Format) && (m_Width % 4 != 0 || m_Height % 4 != 0)))
+		return false;
+
+	// Every mip of the first slice, then every mip of the next
+	m_Subresources.reserve((size_t)m_ArraySize * m_MipLevels);
+	for (uint32_t Slice = 0; Slice < m_ArraySize; ++Slice)
+	{
+		uint32_t Width = m_Width;
+		uint32_t Height = m_Height;
+		for (uint32_t Mip = 0; Mip < m_MipLevels; ++Mip)
+		{
+			Subresource Level;
+			Level.RowBytes = ImageLoader::GetRowPitch(m_Format, Width);
+			Level.NumRows = ImageLoader::GetNumRows(m_Format, Height);
+
+			const size_t Bytes = Level.RowBytes * Level.NumRows;
+			if (Bytes > Size - Offset)
+			{
+				m_Subresources.clear();
+				return false;
+			}
+			Level.Data = Data + Offset;
+			Offset += Bytes;
+			m_Subresources.push_back(Level);
+
+			Width = Width > 1 ? Width / 2 : 1;
+			Height = Height > 1 ? Height / 2 : 1;
+		}
+	}
+
+	return true;
+}
+
+DXGI_FORMAT DdsReader::GetLegacyFormat(const PixelFormat& Format)
+{
+	if ((Format.Flags & DDPF_FOURCC) != 0)
+	{
+		if (Format.FourCC == MakeFourCC('D', 'X', 'T', '1')) return DXGI_FORMAT_BC1_UNORM;
+		if (Format.FourCC == MakeFourCC('D', 'X', 'T', '2')) return DXGI_FORMAT_BC2_UNORM;
+		if (Format.FourCC == MakeFourCC('D', 'X', 'T', '3')) return DXGI_FORMAT_BC2_UNORM;
+		if (Format.FourCC == MakeFourCC('D', 'X', 'T', '4')) return DXGI_FORMAT_BC3_UNORM;
+		if (Format.FourCC == MakeFourCC('D', 'X', 'T', '5')) return DXGI_FORMAT_BC3_UNORM;
+		if (Format.FourCC == MakeFourCC('A', 'T', 'I', '1')) return DXGI_FORMAT_BC4_UNORM;
+		if (Format.FourCC == MakeFourCC('B', 'C', '4', 'U')) return DXGI_FORMAT_BC4_UNORM;
+		if (Format.FourCC == MakeFourCC('A', 'T', 'I', '2')) return DXGI_FORMAT_BC5_UNORM;
+		if (Format.FourCC == MakeFourCC('B', 'C', '5', 'U')) return DXGI_FORMAT_BC5_UNORM;
+		return DXGI_FORMAT_UNKNOWN;
+	}
+
+	if ((Format.Flags & DDPF_RGB) != 0 && Format.RGBBitCount == 32)
+	{
+		const bool HasAlpha = (Format.Flags & DDPF_ALPHAPIXELS) != 0;
+		if (Format.RBitMask == 0x000000FF && Format.GBitMask == 0x0000FF00 && Format.BBitMask == 0x00FF0000)
+			return DXGI_FORMAT_R8G8B8A8_UNORM;
+		if (Format.RBitMask == 0x00FF0000 && Format.GBitMask == 0x0000FF00 && Format.BBitMask == 0x000000FF)
+			return HasAlpha ? DXGI_FORMAT_B8G8R8A8_UNORM : DXGI_FORMAT_B8G8R8X8_UNORM;
+	}
+
+	if ((Format.Flags & DDPF_LUMINANCE) != 0 && Format.RGBBitCount == 8 && Format.RBitMask == 0xFF)
+		return DXGI_FORMAT_R8_UNORM;
+
+	return DXGI_FORMAT_UNKNOWN;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "ImageLoader.h"
+
+// Reader for DDS files, with or without the DX10 header: 2D textures, texture arrays and cube maps,
+// with their mips, in any format ImageLoader knows the size of.  Legacy headers are read for DXT1 to
+// DXT5, ATI1 and ATI2 (BC4 and BC5) and the 32-bit RGBA and BGRA layouts.  Volume textures are not
+// supported.
+//
+// Nothing is decoded or copied: the subresources point into the file, in the order of D3D12
+// subresource indices, so they can be copied straight into the footprints of a texture upload.
+class DdsReader
+{
+public:
+	struct Subresource
+	{
+		const uint8_t* Data;
+		size_t RowBytes;		// Of a row of texels, or of blocks in BC formats
+		uint32_t NumRows;		// Back to back, RowBytes apart
+	};
+
+	DdsReader();
+
+	// Reads the headers and lays out the subresources.  Data is not copied and must stay valid while
+	// they are read.  Returns false if it is not a DDS file this reader supports or it is truncated.
+	bool ReadHeader(const uint8_t* Data, size_t Size);
+
+	uint32_t GetWidth() const { return m_Width; }
+	uint32_t GetHeight() const { return m_Height; }
+	uint32_t GetMipLevels() const { return m_MipLevels; }
+	// Faces of cube maps count, six per cube
+	uint32_t GetArraySize() const { return m_ArraySize; }
+	bool IsCubemap() const { return m_Cubemap; }
+	DXGI_FORMAT GetFormat() const { return m_Format; }
+
+	// Mip + Slice * GetMipLevels()
+	uint32_t GetNumSubresources() const { return (uint32_t)m_Subresources.size(); }
+	const Subresource& GetSubresource(uint32_t Index) const { return m_Subresources[Index]; }
+
+private:
+	struct PixelFormat
+	{
+		uint32_t Flags;
+		uint32_t FourCC;
+		uint32_t RGBBitCount;
+		uint32_t RBitMask, GBitMask, BBitMask, ABitMask;
+	};
+
+	static DXGI_FORMAT GetLegacyFormat(const PixelFormat& Format);
+
+	uint32_t m_Width;
+	uint32_t m_Height;
+	uint32_t m_MipLevels;
+	uint32_t m_ArraySize;
+	bool m_Cubemap;
+	DXGI_FORMAT m_Format;
+	std::vector<Subresource> m_Subresources;
+};
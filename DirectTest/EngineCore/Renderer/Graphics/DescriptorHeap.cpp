@@ -0,0 +1,236 @@
+#include "DescriptorHeap.h"
+#include "../Core/GraphicContext.h"
+
+using namespace std;
+using namespace Renderer;
+using Microsoft::WRL::ComPtr;
+
+//
+// DescriptorAllocator
+//
+
+mutex DescriptorAllocator::sm_AllocationMutex;
+vector<ComPtr<ID3D12DescriptorHeap>> DescriptorAllocator::sm_DescriptorHeapPool;
+
+void DescriptorAllocator::DestroyAll(void)
+{
+	sm_DescriptorHeapPool.clear();
+}
+
+ID3D12DescriptorHeap* DescriptorAllocator::RequestNewHeap(D3D12_DESCRIPTOR_HEAP_TYPE Type)
+{
+	lock_guard<mutex> LockGuard(sm_AllocationMutex);
+
+	D3D12_DESCRIPTOR_HEAP_DESC Desc;
+	Desc.Type = Type;
+	Desc.NumDescriptors = sm_NumDescriptorsPerHeap;
+	Desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+	Desc.NodeMask = 1;
+
+	ComPtr<ID3D12DescriptorHeap> pHeap;
+	ThrowIfFailed(device->CreateDescriptorHeap(&Desc, MY_IID_PPV_ARGS(&pHeap)));
+	sm_DescriptorHeapPool.emplace_back(pHeap);
+	return pHeap.Get();
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE DescriptorAllocator::Allocate(uint32_t Count)
+{
+	if (m_CurrentHeap == nullptr || m_RemainingFreeHandles < Count)
+	{
+		m_CurrentHeap = RequestNewHeap(m_Type);
+		m_CurrentHandle = m_CurrentHeap->GetCPUDescriptorHandleForHeapStart();
+		m_RemainingFreeHandles = sm_NumDescriptorsPerHeap;
+
+		if (m_DescriptorSize == 0)
+			m_DescriptorSize = device->GetDescriptorHandleIncrementSize(m_Type);
+	}
+
+	D3D12_CPU_DESCRIPTOR_HANDLE ret = m_CurrentHandle;
+	m_CurrentHandle.ptr += Count * m_DescriptorSize;
+	m_RemainingFreeHandles -= Count;
+	return ret;
+}
+
+//
+// GpuDescriptorHeap
+//
+
+GpuDescriptorHeap::GpuDescriptorHeap() :
+	m_Type(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV),
+	m_DescriptorSize(0),
+	m_NumStaticDescriptors(0),
+	m_StaticHead(0),
+	m_NumDynamicDescriptors(0),
+	m_RingHead(0),
+	m_RingTail(0),
+	m_FenceEvent(nullptr)
+{
+}
+
+void GpuDescriptorHeap::Create(const std::wstring& DebugHeapName, D3D12_DESCRIPTOR_HEAP_TYPE Type,
+	uint32_t NumStaticDescriptors, uint32_t NumDynamicDescriptors)
+{
+	ASSERT(Type == D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV || Type == D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER,
+		"Only CBV_SRV_UAV and sampler heaps can be shader visible");
+
+	D3D12_DESCRIPTOR_HEAP_DESC Desc = {};
+	Desc.Type = Type;
+	Desc.NumDescriptors = NumStaticDescriptors + NumDynamicDescriptors;
+	Desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+	Desc.NodeMask = 1;
+	ThrowIfFailed(device->CreateDescriptorHeap(&Desc, MY_IID_PPV_ARGS(&m_Heap)));
+	m_Heap->SetName(DebugHeapName.c_str());
+
+	m_Type = Type;
+	m_DescriptorSize = device->GetDescriptorHandleIncrementSize(Type);
+	m_FirstHandle = DescriptorHandle(m_Heap->GetCPUDescriptorHandleForHeapStart(), m_Heap->GetGPUDescriptorHandleForHeapStart());
+
+	m_NumStaticDescriptors = NumStaticDescriptors;
+	m_StaticHead = 0;
+	m_StaticFreeList.clear();
+
+	m_NumDynamicDescriptors = NumDynamicDescriptors;
+	m_RingHead = m_RingTail = 0;
+	m_RetiredFrames.clear();
+
+	m_FenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	if (m_FenceEvent == nullptr)
+	{
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+	}
+}
+
+void GpuDescriptorHeap::Destroy()
+{
+	if (m_FenceEvent != nullptr)
+	{
+		CloseHandle(m_FenceEvent);
+		m_FenceEvent = nullptr;
+	}
+
+	m_RetiredFrames.clear();
+	m_StaticFreeList.clear();
+	m_Fence = nullptr;
+	m_Heap = nullptr;
+}
+
+DescriptorHandle GpuDescriptorHeap::AllocateStatic(uint32_t Count)
+{
+	lock_guard<mutex> LockGuard(m_StaticMutex);
+
+	// First fit among the freed ranges
+	for (size_t i = 0; i < m_StaticFreeList.size(); ++i)
+	{
+		FreeRange& Range = m_StaticFreeList[i];
+		if (Range.Count < Count)
+			continue;
+
+		uint32_t Offset = Range.Offset;
+		Range.Offset += Count;
+		Range.Count -= Count;
+		if (Range.Count == 0)
+			m_StaticFreeList.erase(m_StaticFreeList.begin() + i);
+
+		return GetHandleAtOffset(Offset);
+	}
+
+	if (m_StaticHead + Count > m_NumStaticDescriptors)
+	{
+		ASSERT(false, "Out of static descriptors");
+		ThrowIfFailed(E_OUTOFMEMORY);
+	}
+
+	uint32_t Offset = m_StaticHead;
+	m_StaticHead += Count;
+	return GetHandleAtOffset(Offset);
+}
+
+void GpuDescriptorHeap::FreeStatic(const DescriptorHandle& Handle, uint32_t Count)
+{
+	if (Handle.IsNull() || Count == 0)
+		return;
+
+	lock_guard<mutex> LockGuard(m_StaticMutex);
+
+	uint32_t Offset = (uint32_t)((Handle.GetCpuHandle().ptr - m_FirstHandle.GetCpuHandle().ptr) / m_DescriptorSize);
+	ASSERT(Offset + Count <= m_StaticHead, "Handle does not belong to the static range");
+
+	// Keep the list sorted and merge neighbours so it stays short
+	auto Iter = m_StaticFreeList.begin();
+	while (Iter != m_StaticFreeList.end() && Iter->Offset < Offset)
+		++Iter;
+
+	Iter = m_StaticFreeList.insert(Iter, FreeRange{ Offset, Count });
+
+	if (Iter + 1 != m_StaticFreeList.end() && Iter->Offset + Iter->Count == (Iter + 1)->Offset)
+	{
+		Iter->Count += (Iter + 1)->Count;
+		m_StaticFreeList.erase(Iter + 1);
+	}
+
+	if (Iter != m_StaticFreeList.begin() && (Iter - 1)->Offset + (Iter - 1)->Count == Iter->Offset)
+	{
+		(Iter - 1)->Count += Iter->Count;
+		m_StaticFreeList.erase(Iter);
+	}
+}
+
+DescriptorHandle GpuDescriptorHeap::AllocateDynamic(uint32_t Count)
+{
+	ASSERT(Count <= m_NumDynamicDescriptors, "Descriptor table larger than the dynamic ring");
+
+	for (;;)
+	{
+		// Nothing in flight, restart at the beginning of the ring so large tables never have to wrap
+		if (m_RingHead == m_RingTail)
+			m_RingHead = m_RingTail = Math::DivideByMultiple(m_RingHead, m_NumDynamicDescriptors) * m_NumDynamicDescriptors;
+
+		// A table has to be contiguous, skip what is left at the end of the ring if it does not fit
+		uint64_t Offset = m_RingHead % m_NumDynamicDescriptors;
+		uint64_t Padding = (Offset + Count > m_NumDynamicDescriptors) ? m_NumDynamicDescriptors - Offset : 0;
+
+		if (m_RingHead + Padding + Count - m_RingTail <= m_NumDynamicDescriptors)
+		{
+			m_RingHead += Padding;
+			Offset = m_RingHead % m_NumDynamicDescriptors;
+			m_RingHead += Count;
+			return GetHandleAtOffset(m_NumStaticDescriptors + (uint32_t)Offset);
+		}
+
+		if (m_Fence != nullptr)
+			ReclaimCompleted(m_Fence->GetCompletedValue());
+
+		if (m_RingHead + Padding + Count - m_RingTail <= m_NumDynamicDescriptors)
+			continue;
+
+		// The current frame alone filled the ring, nothing to wait on
+		if (m_RetiredFrames.empty())
+		{
+			ASSERT(false, "Dynamic descriptor ring exhausted within a single frame");
+			ThrowIfFailed(E_OUTOFMEMORY);
+		}
+
+		ThrowIfFailed(m_Fence->SetEventOnCompletion(m_RetiredFrames.front().first, m_FenceEvent));
+		WaitForSingleObjectEx(m_FenceEvent, INFINITE, FALSE);
+		ReclaimCompleted(m_Fence->GetCompletedValue());
+	}
+}
+
+void GpuDescriptorHeap::RetireFrame(ID3D12Fence* pFence, uint64_t FenceValue)
+{
+	m_Fence = pFence;
+
+	if (m_RetiredFrames.empty() || m_RetiredFrames.back().second != m_RingHead)
+		m_RetiredFrames.push_back(make_pair(FenceValue, m_RingHead));
+
+	ReclaimCompleted(m_Fence->GetCompletedValue());
+}
+
+void GpuDescriptorHeap::ReclaimCompleted(uint64_t CompletedValue)
+{
+	while (!m_RetiredFrames.empty() && m_RetiredFrames.front().first <= CompletedValue)
+	{
+		m_RingTail = max(m_RingTail, m_RetiredFrames.front().second);
+		m_RetiredFrames.pop_front();
+	}
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "../../Core/Common.h"
+#include <deque>
+#include <mutex>
+
+// A descriptor's CPU handle plus, when it lives in a shader-visible heap, its GPU handle.
+class DescriptorHandle
+{
+public:
+	DescriptorHandle()
+	{
+		m_CpuHandle.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+		m_GpuHandle.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+	}
+
+	DescriptorHandle(D3D12_CPU_DESCRIPTOR_HANDLE CpuHandle, D3D12_GPU_DESCRIPTOR_HANDLE GpuHandle)
+		: m_CpuHandle(CpuHandle), m_GpuHandle(GpuHandle)
+	{
+	}
+
+	DescriptorHandle operator+ (INT OffsetScaledByDescriptorSize) const
+	{
+		DescriptorHandle ret = *this;
+		ret += OffsetScaledByDescriptorSize;
+		return ret;
+	}
+
+	void operator += (INT OffsetScaledByDescriptorSize)
+	{
+		if (m_CpuHandle.ptr != D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
+			m_CpuHandle.ptr += OffsetScaledByDescriptorSize;
+		if (m_GpuHandle.ptr != D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
+			m_GpuHandle.ptr += OffsetScaledByDescriptorSize;
+	}
+
+	D3D12_CPU_DESCRIPTOR_HANDLE GetCpuHandle() const { return m_CpuHandle; }
+	D3D12_GPU_DESCRIPTOR_HANDLE GetGpuHandle() const { return m_GpuHandle; }
+
+	bool IsNull() const { return m_CpuHandle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN; }
+	bool IsShaderVisible() const { return m_GpuHandle.ptr != D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN; }
+
+private:
+	D3D12_CPU_DESCRIPTOR_HANDLE m_CpuHandle;
+	D3D12_GPU_DESCRIPTOR_HANDLE m_GpuHandle;
+};
+
+// Hands out CPU-only descriptors, the kind views are created into and then copied from.  Heaps are
+// created on demand and never freed until DestroyAll().
+class DescriptorAllocator
+{
+public:
+	DescriptorAllocator(D3D12_DESCRIPTOR_HEAP_TYPE Type) : m_Type(Type), m_CurrentHeap(nullptr), m_DescriptorSize(0), m_RemainingFreeHandles(0)
+	{
+		m_CurrentHandle.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+	}
+
+	D3D12_CPU_DESCRIPTOR_HANDLE Allocate(uint32_t Count);
+
+	static void DestroyAll(void);
+
+protected:
+	static const uint32_t sm_NumDescriptorsPerHeap = 256;
+	static std::mutex sm_AllocationMutex;
+	static std::vector<Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>> sm_DescriptorHeapPool;
+	static ID3D12DescriptorHeap* RequestNewHeap(D3D12_DESCRIPTOR_HEAP_TYPE Type);
+
+	D3D12_DESCRIPTOR_HEAP_TYPE m_Type;
+	ID3D12DescriptorHeap* m_CurrentHeap;
+	D3D12_CPU_DESCRIPTOR_HANDLE m_CurrentHandle;
+	uint32_t m_DescriptorSize;
+	uint32_t m_RemainingFreeHandles;
+};
+
+// The single shader-visible heap of a descriptor type.  It is bound once per command list so the
+// GPU never sees a heap switch.  The front of the heap holds persistent descriptors (materials,
+// textures), the rest is a ring that dynamic descriptor tables are staged into every frame and that
+// is recycled as the frame fence advances.
+class GpuDescriptorHeap
+{
+public:
+	GpuDescriptorHeap();
+
+	void Create(const std::wstring& DebugHeapName, D3D12_DESCRIPTOR_HEAP_TYPE Type, uint32_t NumStaticDescriptors, uint32_t NumDynamicDescriptors);
+	void Destroy();
+
+	// Persistent descriptors stay valid until freed.
+	DescriptorHandle AllocateStatic(uint32_t Count);
+	void FreeStatic(const DescriptorHandle& Handle, uint32_t Count);
+
+	// Ring allocation for the frame being recorded.  Blocks on the oldest frame in flight if the
+	// ring is full.
+	DescriptorHandle AllocateDynamic(uint32_t Count);
+
+	// Everything allocated dynamically since the last call is reused once pFence reaches FenceValue.
+	void RetireFrame(ID3D12Fence* pFence, uint64_t FenceValue);
+
+	ID3D12DescriptorHeap* GetHeapPointer() const { return m_Heap.Get(); }
+	D3D12_DESCRIPTOR_HEAP_TYPE GetType() const { return m_Type; }
+	uint32_t GetDescriptorSize() const { return m_DescriptorSize; }
+	DescriptorHandle GetHandleAtOffset(uint32_t Offset) const { return m_FirstHandle + Offset * m_DescriptorSize; }
+
+private:
+	struct FreeRange
+	{
+		uint32_t Offset;
+		uint32_t Count;
+	};
+
+	void ReclaimCompleted(uint64_t CompletedValue);
+
+	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> m_Heap;
+	D3D12_DESCRIPTOR_HEAP_TYPE m_Type;
+	uint32_t m_DescriptorSize;
+	DescriptorHandle m_FirstHandle;
+
+	std::mutex m_StaticMutex;
+	uint32_t m_NumStaticDescriptors;
+	uint32_t m_StaticHead;
+	std::vector<FreeRange> m_StaticFreeList;
+
+	uint32_t m_NumDynamicDescriptors;
+	uint64_t m_RingHead;		// Total descriptors ever allocated, the write position is m_RingHead % m_NumDynamicDescriptors
+	uint64_t m_RingTail;		// Total descriptors ever released
+	std::deque<std::pair<uint64_t, uint64_t>> m_RetiredFrames;	// (fence value, ring head at the end of the frame)
+	Microsoft::WRL::ComPtr<ID3D12Fence> m_Fence;
+	HANDLE m_FenceEvent;
+};
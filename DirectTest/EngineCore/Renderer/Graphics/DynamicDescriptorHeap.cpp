@@ -0,0 +1,177 @@
+#include "DynamicDescriptorHeap.h"
+#include "../Core/GraphicContext.h"
+#include <algorithm>
+
+using namespace std;
+using namespace Renderer;
+
+DynamicDescriptorHeap::DynamicDescriptorHeap(GpuDescriptorHeap& Heap) :
+	m_Heap(Heap),
+	m_RootDescriptorTablesBitMap(0),
+	m_StaleRootParamsBitMap(0),
+	m_MaxCachedDescriptors(0)
+{
+}
+
+void DynamicDescriptorHeap::Reset()
+{
+	m_RootDescriptorTablesBitMap = 0;
+	m_StaleRootParamsBitMap = 0;
+	m_MaxCachedDescriptors = 0;
+
+	for (uint32_t i = 0; i < MAX_NUM_TABLES; ++i)
+		m_RootDescriptorTable[i] = DescriptorTableCache();
+}
+
+void DynamicDescriptorHeap::ParseGraphicsRootSignature(const RootSignature& RootSig)
+{
+	// A new root signature invalidates every table bound so far
+	m_StaleRootParamsBitMap = 0;
+
+	m_RootDescriptorTablesBitMap = (m_Heap.GetType() == D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER ?
+		RootSig.m_SamplerTableBitMap : RootSig.m_DescriptorTableBitMap);
+
+	unsigned long TableParams = m_RootDescriptorTablesBitMap;
+	unsigned long RootIndex;
+	uint32_t CurrentOffset = 0;
+	while (_BitScanForward(&RootIndex, TableParams))
+	{
+		TableParams ^= (1 << RootIndex);
+
+		// Tables larger than what can be tracked (e.g. big static ranges) are only ever bound
+		// through a persistent GPU handle, there is no point caching all of them.
+		UINT TableSize = min(RootSig.m_DescriptorTableSize[RootIndex], (uint32_t)MAX_TABLE_SIZE);
+		ASSERT(TableSize > 0, "Root parameter is an empty descriptor table");
+
+		DescriptorTableCache& RootDescriptorTable = m_RootDescriptorTable[RootIndex];
+		RootDescriptorTable.AssignedHandlesBitMap = 0;
+		RootDescriptorTable.TableStart = m_HandleCache + CurrentOffset;
+		RootDescriptorTable.TableSize = TableSize;
+
+		CurrentOffset += TableSize;
+	}
+
+	m_MaxCachedDescriptors = CurrentOffset;
+
+	ASSERT(m_MaxCachedDescriptors <= MAX_NUM_DESCRIPTORS, "Exceeded user-supplied maximum cache size");
+}
+
+void DynamicDescriptorHeap::SetGraphicsDescriptorHandles(UINT RootIndex, UINT Offset, UINT NumHandles, const D3D12_CPU_DESCRIPTOR_HANDLE Handles[])
+{
+	ASSERT(((1 << RootIndex) & m_RootDescriptorTablesBitMap) != 0, "Root parameter is not a descriptor table of this heap type");
+
+	DescriptorTableCache& TableCache = m_RootDescriptorTable[RootIndex];
+	ASSERT(Offset + NumHandles <= TableCache.TableSize, "Descriptors out of the table range");
+
+	D3D12_CPU_DESCRIPTOR_HANDLE* CopyDest = TableCache.TableStart + Offset;
+	for (UINT i = 0; i < NumHandles; ++i)
+		CopyDest[i] = Handles[i];
+
+	TableCache.AssignedHandlesBitMap |= (uint32_t)(((1ull << NumHandles) - 1) << Offset);
+	m_StaleRootParamsBitMap |= (1 << RootIndex);
+}
+
+void DynamicDescriptorHeap::CommitGraphicsRootDescriptorTables(ID3D12GraphicsCommandList* CmdList)
+{
+	if (m_StaleRootParamsBitMap == 0)
+		return;
+
+	uint32_t TableSize[MAX_NUM_TABLES];
+	uint32_t RootIndices[MAX_NUM_TABLES];
+	uint32_t NeededSpace = 0;
+	uint32_t StaleParamCount = 0;
+
+	unsigned long StaleParams = m_StaleRootParamsBitMap;
+	unsigned long RootIndex;
+	while (_BitScanForward(&RootIndex, StaleParams))
+	{
+		StaleParams ^= (1 << RootIndex);
+
+		unsigned long MaxSetHandle;
+		BOOLEAN HasHandles = _BitScanReverse(&MaxSetHandle, m_RootDescriptorTable[RootIndex].AssignedHandlesBitMap);
+		ASSERT(HasHandles, "Root entry marked as stale but has no stale descriptors");
+		if (!HasHandles)
+			continue;
+
+		RootIndices[StaleParamCount] = RootIndex;
+		TableSize[StaleParamCount] = MaxSetHandle + 1;
+		NeededSpace += MaxSetHandle + 1;
+		++StaleParamCount;
+	}
+
+	m_StaleRootParamsBitMap = 0;
+
+	if (StaleParamCount == 0)
+		return;
+
+	// One contiguous block for every dirty table
+	const uint32_t DescriptorSize = m_Heap.GetDescriptorSize();
+	DescriptorHandle DestHandleStart = m_Heap.AllocateDynamic(NeededSpace);
+
+	UINT NumDestDescriptorRanges = 0;
+	D3D12_CPU_DESCRIPTOR_HANDLE pDestDescriptorRangeStarts[MAX_DESCRIPTORS_PER_COPY];
+	UINT pDestDescriptorRangeSizes[MAX_DESCRIPTORS_PER_COPY];
+
+	UINT NumSrcDescriptorRanges = 0;
+	D3D12_CPU_DESCRIPTOR_HANDLE pSrcDescriptorRangeStarts[MAX_DESCRIPTORS_PER_COPY];
+	UINT pSrcDescriptorRangeSizes[MAX_DESCRIPTORS_PER_COPY];
+
+	for (uint32_t i = 0; i < StaleParamCount; ++i)
+	{
+		RootIndex = RootIndices[i];
+		CmdList->SetGraphicsRootDescriptorTable(RootIndex, DestHandleStart.GetGpuHandle());
+
+		DescriptorTableCache& RootDescTable = m_RootDescriptorTable[RootIndex];
+
+		D3D12_CPU_DESCRIPTOR_HANDLE* SrcHandles = RootDescTable.TableStart;
+		uint64_t SetHandles = (uint64_t)RootDescTable.AssignedHandlesBitMap;
+		D3D12_CPU_DESCRIPTOR_HANDLE CurDest = DestHandleStart.GetCpuHandle();
+		DestHandleStart += TableSize[i] * DescriptorSize;
+
+		// Gather runs of assigned descriptors, holes are left untouched
+		unsigned long SkipCount;
+		while (_BitScanForward64(&SkipCount, SetHandles))
+		{
+			SetHandles >>= SkipCount;
+			SrcHandles += SkipCount;
+			CurDest.ptr += SkipCount * DescriptorSize;
+
+			unsigned long DescriptorCount;
+			_BitScanForward64(&DescriptorCount, ~SetHandles);
+			SetHandles >>= DescriptorCount;
+
+			if (NumSrcDescriptorRanges + DescriptorCount > MAX_DESCRIPTORS_PER_COPY)
+			{
+				device->CopyDescriptors(
+					NumDestDescriptorRanges, pDestDescriptorRangeStarts, pDestDescriptorRangeSizes,
+					NumSrcDescriptorRanges, pSrcDescriptorRangeStarts, pSrcDescriptorRangeSizes,
+					m_Heap.GetType());
+
+				NumSrcDescriptorRanges = 0;
+				NumDestDescriptorRanges = 0;
+			}
+
+			pDestDescriptorRangeStarts[NumDestDescriptorRanges] = CurDest;
+			pDestDescriptorRangeSizes[NumDestDescriptorRanges] = DescriptorCount;
+			++NumDestDescriptorRanges;
+
+			for (uint32_t j = 0; j < DescriptorCount; ++j)
+			{
+				pSrcDescriptorRangeStarts[NumSrcDescriptorRanges] = SrcHandles[j];
+				pSrcDescriptorRangeSizes[NumSrcDescriptorRanges] = 1;
+				++NumSrcDescriptorRanges;
+			}
+
+			SrcHandles += DescriptorCount;
+			CurDest.ptr += DescriptorCount * DescriptorSize;
+		}
+	}
+
+	if (NumSrcDescriptorRanges > 0)
+	{
+		device->CopyDescriptors(
+			NumDestDescriptorRanges, pDestDescriptorRangeStarts, pDestDescriptorRangeSizes,
+			NumSrcDescriptorRanges, pSrcDescriptorRangeStarts, pSrcDescriptorRangeSizes,
+			m_Heap.GetType());
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "../../Core/Common.h"
+#include "DescriptorHeap.h"
+#include "RootSignature.h"
+
+// Stages the CPU descriptors bound to the descriptor tables of the current root signature and, right
+// before a draw, copies the tables that changed into the dynamic ring of the global shader-visible
+// heap.  Tables that were not touched since the last draw keep pointing at their previous copy.
+class DynamicDescriptorHeap
+{
+public:
+	DynamicDescriptorHeap(GpuDescriptorHeap& Heap);
+
+	// Call when a command list starts recording, cached tables refer to descriptors of a previous frame.
+	void Reset();
+
+	void ParseGraphicsRootSignature(const RootSignature& RootSig);
+
+	void SetGraphicsDescriptorHandles(UINT RootIndex, UINT Offset, UINT NumHandles, const D3D12_CPU_DESCRIPTOR_HANDLE Handles[]);
+
+	bool HasStaleTables() const { return m_StaleRootParamsBitMap != 0; }
+	void CommitGraphicsRootDescriptorTables(ID3D12GraphicsCommandList* CmdList);
+
+private:
+	static const uint32_t MAX_NUM_DESCRIPTORS = 256;
+	static const uint32_t MAX_NUM_TABLES = 16;
+	static const uint32_t MAX_TABLE_SIZE = 32;			// Descriptors tracked per table, one bit each
+	static const uint32_t MAX_DESCRIPTORS_PER_COPY = 32;
+
+	struct DescriptorTableCache
+	{
+		DescriptorTableCache() : AssignedHandlesBitMap(0), TableStart(nullptr), TableSize(0) {}
+		uint32_t AssignedHandlesBitMap;
+		D3D12_CPU_DESCRIPTOR_HANDLE* TableStart;
+		uint32_t TableSize;
+	};
+
+	GpuDescriptorHeap& m_Heap;
+
+	DescriptorTableCache m_RootDescriptorTable[MAX_NUM_TABLES];
+	D3D12_CPU_DESCRIPTOR_HANDLE m_HandleCache[MAX_NUM_DESCRIPTORS];
+	uint32_t m_RootDescriptorTablesBitMap;
+	uint32_t m_StaleRootParamsBitMap;
+	uint32_t m_MaxCachedDescriptors;
+};
@@ -0,0 +1,45 @@
+// Generated by Tools/build_shader_library.py from the reflection of the shader variants, do not edit.
+// Included by ShaderLayout.cpp only.
+#pragma once
+
+#include "ShaderLayout.h"
+
+namespace GeneratedShaderLayouts
+{
+	// Standard, permutation 0x08
+	static const ShaderRootParameter Standard_0x08_Parameters[] =
+	{
+		{ "DrawConstants", D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS, D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 0, 0, 1, D3D12_SHADER_VISIBILITY_VERTEX },
+		{ "instances", D3D12_ROOT_PARAMETER_TYPE_SRV, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 1, D3D12_SHADER_VISIBILITY_VERTEX },
+	};
+	static const D3D12_INPUT_ELEMENT_DESC Standard_0x08_InputElements[] =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+	};
+
+	// Standard, permutation 0x11
+	static const ShaderRootParameter Standard_0x11_Parameters[] =
+	{
+		{ "DrawConstants", D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS, D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 0, 0, 1, D3D12_SHADER_VISIBILITY_VERTEX },
+		{ "instances", D3D12_ROOT_PARAMETER_TYPE_SRV, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 1, D3D12_SHADER_VISIBILITY_VERTEX },
+		{ "materials", D3D12_ROOT_PARAMETER_TYPE_SRV, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 2, 0, 1, D3D12_SHADER_VISIBILITY_PIXEL },
+		{ "g_textures", D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 0, 1, 4096, D3D12_SHADER_VISIBILITY_PIXEL },
+	};
+	static const ShaderStaticSampler Standard_0x11_Samplers[] =
+	{
+		{ "g_sampler", 0, 0, D3D12_SHADER_VISIBILITY_PIXEL },
+	};
+	static const D3D12_INPUT_ELEMENT_DESC Standard_0x11_InputElements[] =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 20, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 36, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+	};
+
+	static const ShaderLayout Layouts[] =
+	{
+		{ "Standard", 0x08, Standard_0x08_Parameters, 2, nullptr, 0, Standard_0x08_InputElements, 1, 12 },
+		{ "Standard", 0x11, Standard_0x11_Parameters, 4, Standard_0x11_Samplers, 1, Standard_0x11_InputElements, 4, 48 },
+	};
+}
@@ -0,0 +1,423 @@
+#include "GpuHeapAllocator.h"
+#include "GpuResource.h"
+#include "../Core/GraphicContext.h"
+
+using namespace std;
+using namespace Renderer;
+using Microsoft::WRL::ComPtr;
+
+GpuHeapAllocator::GpuHeapAllocator()
+{
+	for (uint32_t i = 0; i < kNumHeapCategories; ++i)
+		m_CurrentTransient[i] = nullptr;
+}
+
+void GpuHeapAllocator::Destroy()
+{
+	lock_guard<mutex> LockGuard(m_Mutex);
+
+	m_PendingFrees.clear();
+	m_RetiredFrees.clear();
+
+	for (uint32_t i = 0; i < kNumHeapCategories; ++i)
+	{
+		m_Heaps[i].clear();
+		m_CurrentTransient[i] = nullptr;
+	}
+
+	m_UsedTransient.clear();
+	m_RetiredTransient.clear();
+	m_TransientPool.clear();
+	m_Fence = nullptr;
+}
+
+void GpuHeapAllocator::CreateResource(GpuResource& Resource, const std::wstring& Name, const D3D12_RESOURCE_DESC& Desc,
+	D3D12_RESOURCE_STATES InitialState, const D3D12_CLEAR_VALUE* pClearValue)
+{
+	const GpuHeapCategory Category = GetCategory(Desc);
+
+	D3D12_RESOURCE_DESC PlacedDesc = Desc;
+	D3D12_RESOURCE_ALLOCATION_INFO Info = GetAllocationInfo(Category, PlacedDesc);
+
+	// Large resources would leave most of a block unusable, give them their own heap
+	if (Info.SizeInBytes > DEFAULT_HEAP_SIZE / 4)
+	{
+		CreateCommittedResource(Resource, Name, Category, Info.SizeInBytes, Desc, InitialState, pClearValue);
+		return;
+	}
+
+	GpuHeapAllocation Allocation;
+	Allocation.Category = Category;
+	Allocation.Size = Info.SizeInBytes;
+
+	ID3D12Heap* pHeap = nullptr;
+	{
+		lock_guard<mutex> LockGuard(m_Mutex);
+
+		vector<unique_ptr<HeapBlock>>& Heaps = m_Heaps[Category];
+		for (auto& Block : Heaps)
+		{
+			Allocation.Handle = Block->Allocator.Allocate(Info.SizeInBytes, Info.Alignment, Allocation.Offset);
+			if (Allocation.Handle != TlsfAllocator::INVALID_HANDLE)
+			{
+				Allocation.Block = Block.get();
+				pHeap = Block->Heap.Get();
+				break;
+			}
+		}
+
+		if (pHeap == nullptr)
+		{
+			HeapBlock* Block = new HeapBlock;
+			Block->Heap = CreateHeap(Category, DEFAULT_HEAP_SIZE);
+			Block->Allocator.Create(DEFAULT_HEAP_SIZE, Category == kHeapTextures ?
+				D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT : D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+			Heaps.emplace_back(Block);
+
+			Allocation.Handle = Block->Allocator.Allocate(Info.SizeInBytes, Info.Alignment, Allocation.Offset);
+			ASSERT(Allocation.Handle != TlsfAllocator::INVALID_HANDLE, "Empty heap block could not fit the resource");
+			Allocation.Block = Block;
+			pHeap = Block->Heap.Get();
+		}
+	}
+
+	PlaceResource(Resource, Name, pHeap, Allocation, PlacedDesc, InitialState, pClearValue);
+}
+
+void GpuHeapAllocator::CreateTransientResource(GpuResource& Resource, const std::wstring& Name, const D3D12_RESOURCE_DESC& Desc,
+	D3D12_RESOURCE_STATES InitialState, const D3D12_CLEAR_VALUE* pClearValue)
+{
+	const GpuHeapCategory Category = GetCategory(Desc);
+
+	D3D12_RESOURCE_DESC PlacedDesc = Desc;
+	D3D12_RESOURCE_ALLOCATION_INFO Info = GetAllocationInfo(Category, PlacedDesc);
+
+	// Still released through Free(), the command list using it this frame has not even been submitted
+	// when its owner destroys it
+	if (Info.SizeInBytes > TRANSIENT_HEAP_SIZE)
+	{
+		CreateCommittedResource(Resource, Name, Category, Info.SizeInBytes, Desc, InitialState, pClearValue);
+		return;
+	}
+
+	GpuHeapAllocation Allocation;
+	Allocation.Category = Category;
+	Allocation.Size = Info.SizeInBytes;
+	Allocation.Transient = true;
+
+	ID3D12Heap* pHeap = nullptr;
+	{
+		lock_guard<mutex> LockGuard(m_Mutex);
+
+		TransientBlock*& Current = m_CurrentTransient[Category];
+		if (Current == nullptr || !Current->Allocator.Allocate(Info.SizeInBytes, Info.Alignment, Allocation.Offset))
+		{
+			if (Current != nullptr)
+				m_UsedTransient.push_back(Current);
+
+			Current = RequestTransientBlock(Category);
+			Current->Allocator.Allocate(Info.SizeInBytes, Info.Alignment, Allocation.Offset);
+		}
+
+		Allocation.Block = Current;
+		pHeap = Current->Heap.Get();
+	}
+
+	PlaceResource(Resource, Name, pHeap, Allocation, PlacedDesc, InitialState, pClearValue);
+}
+
+bool GpuHeapAllocator::AllocateTransientRange(GpuHeapCategory Category, uint64_t Size, uint64_t Alignment, GpuHeapAllocation& RangeOut)
+{
+	if (Size > TRANSIENT_HEAP_SIZE)
+		return false;
+
+	RangeOut = GpuHeapAllocation();
+	RangeOut.Category = Category;
+	RangeOut.Size = Size;
+	RangeOut.Transient = true;
+
+	lock_guard<mutex> LockGuard(m_Mutex);
+
+	TransientBlock*& Current = m_CurrentTransient[Category];
+	if (Current == nullptr || !Current->Allocator.Allocate(Size, Alignment, RangeOut.Offset))
+	{
+		if (Current != nullptr)
+			m_UsedTransient.push_back(Current);
+
+		Current = RequestTransientBlock(Category);
+		if (!Current->Allocator.Allocate(Size, Alignment, RangeOut.Offset))
+			return false;
+	}
+
+	RangeOut.Block = Current;
+	return true;
+}
+
+void GpuHeapAllocator::CreateAliasedResource(GpuResource& Resource, const std::wstring& Name, const GpuHeapAllocation& Range, uint64_t Offset,
+	const D3D12_RESOURCE_DESC& Desc, D3D12_RESOURCE_STATES InitialState, const D3D12_CLEAR_VALUE* pClearValue)
+{
+	ASSERT(Range.Transient && Range.Block != nullptr, "Aliased resources live in a transient range");
+
+	D3D12_RESOURCE_DESC PlacedDesc = Desc;
+	D3D12_RESOURCE_ALLOCATION_INFO Info = GetAllocationInfo(Range.Category, PlacedDesc);
+	ASSERT(Offset + Info.SizeInBytes <= Range.Size, "Aliased resource runs past the end of its range");
+
+	GpuHeapAllocation Allocation = Range;
+	Allocation.Offset = Range.Offset + Offset;
+	Allocation.Size = Info.SizeInBytes;
+
+	PlaceResource(Resource, Name, static_cast<TransientBlock*>(Range.Block)->Heap.Get(), Allocation, PlacedDesc, InitialState, pClearValue);
+}
+
+void GpuHeapAllocator::Free(ID3D12Resource* pResource, const GpuHeapAllocation& Allocation)
+{
+	lock_guard<mutex> LockGuard(m_Mutex);
+
+	PendingFree Pending;
+	Pending.Fence = 0;
+	Pending.Resource = pResource;
+	Pending.Allocation = Allocation;
+	m_PendingFrees.push_back(Pending);
+}
+
+void GpuHeapAllocator::RetireFrame(ID3D12Fence* pFence, uint64_t FenceValue)
+{
+	lock_guard<mutex> LockGuard(m_Mutex);
+
+	m_Fence = pFence;
+
+	for (PendingFree& Pending : m_PendingFrees)
+	{
+		Pending.Fence = FenceValue;
+		m_RetiredFrees.push_back(Pending);
+	}
+	m_PendingFrees.clear();
+
+	for (uint32_t i = 0; i < kNumHeapCategories; ++i)
+	{
+		if (m_CurrentTransient[i] != nullptr)
+		{
+			m_UsedTransient.push_back(m_CurrentTransient[i]);
+			m_CurrentTransient[i] = nullptr;
+		}
+	}
+
+	for (TransientBlock* Block : m_UsedTransient)
+	{
+		Block->Fence = FenceValue;
+		m_RetiredTransient.push_back(Block);
+	}
+	m_UsedTransient.clear();
+
+	ReclaimCompleted(m_Fence->GetCompletedValue());
+}
+
+OffsetAllocatorStats GpuHeapAllocator::GetStats(GpuHeapCategory Category)
+{
+	lock_guard<mutex> LockGuard(m_Mutex);
+
+	OffsetAllocatorStats Total = {};
+	for (auto& Block : m_Heaps[Category])
+	{
+		OffsetAllocatorStats Stats = Block->Allocator.GetStats();
+		Total.TotalSize += Stats.TotalSize;
+		Total.UsedSize += Stats.UsedSize;
+		Total.FreeSize += Stats.FreeSize;
+		Total.NumAllocations += Stats.NumAllocations;
+		Total.NumFreeBlocks += Stats.NumFreeBlocks;
+		Total.LargestFreeBlock = max(Total.LargestFreeBlock, Stats.LargestFreeBlock);
+	}
+	return Total;
+}
+
+OffsetAllocatorStats GpuHeapAllocator::GetStats()
+{
+	OffsetAllocatorStats Total = {};
+	for (uint32_t i = 0; i < kNumHeapCategories; ++i)
+	{
+		OffsetAllocatorStats Stats = GetStats((GpuHeapCategory)i);
+		Total.TotalSize += Stats.TotalSize;
+		Total.UsedSize += Stats.UsedSize;
+		Total.FreeSize += Stats.FreeSize;
+		Total.NumAllocations += Stats.NumAllocations;
+		Total.NumFreeBlocks += Stats.NumFreeBlocks;
+		Total.LargestFreeBlock = max(Total.LargestFreeBlock, Stats.LargestFreeBlock);
+	}
+	return Total;
+}
+
+OffsetAllocatorStats GpuHeapAllocator::GetTransientStats()
+{
+	lock_guard<mutex> LockGuard(m_Mutex);
+
+	OffsetAllocatorStats Total = {};
+	for (auto& Block : m_TransientPool)
+	{
+		OffsetAllocatorStats Stats = Block->Allocator.GetStats();
+		Total.TotalSize += Stats.TotalSize;
+		Total.UsedSize += Stats.UsedSize;
+		Total.FreeSize += Stats.FreeSize;
+		Total.NumAllocations += Stats.NumAllocations;
+		Total.NumFreeBlocks += Stats.NumFreeBlocks;
+		Total.LargestFreeBlock = max(Total.LargestFreeBlock, Stats.LargestFreeBlock);
+	}
+	return Total;
+}
+
+uint32_t GpuHeapAllocator::GetHeapCount()
+{
+	lock_guard<mutex> LockGuard(m_Mutex);
+
+	size_t Count = m_TransientPool.size();
+	for (uint32_t i = 0; i < kNumHeapCategories; ++i)
+		Count += m_Heaps[i].size();
+	return (uint32_t)Count;
+}
+
+GpuHeapCategory GpuHeapAllocator::GetCategory(const D3D12_RESOURCE_DESC& Desc)
+{
+	if (Desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+		return kHeapBuffers;
+
+	if (Desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL))
+		return kHeapRenderTargets;
+
+	return kHeapTextures;
+}
+
+D3D12_RESOURCE_ALLOCATION_INFO GpuHeapAllocator::GetAllocationInfo(GpuHeapCategory Category, D3D12_RESOURCE_DESC& Desc)
+{
+	// Small textures can use 4KB placement instead of 64KB when the hardware allows it
+	if (Category == kHeapTextures && Desc.SampleDesc.Count <= 1)
+	{
+		Desc.Alignment = D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT;
+		D3D12_RESOURCE_ALLOCATION_INFO Info = device->GetResourceAllocationInfo(0, 1, &Desc);
+		if (Info.Alignment == D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT)
+			return Info;
+	}
+
+	Desc.Alignment = 0;
+	return device->GetResourceAllocationInfo(0, 1, &Desc);
+}
+
+ComPtr<ID3D12Heap> GpuHeapAllocator::CreateHeap(GpuHeapCategory Category, uint64_t Size)
+{
+	static const D3D12_HEAP_FLAGS CategoryFlags[kNumHeapCategories] =
+	{
+		D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS,
+		D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES,
+		D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES
+	};
+
+	static const wchar_t* CategoryNames[kNumHeapCategories] =
+	{
+		L"Buffer Heap",
+		L"Texture Heap",
+		L"Render Target Heap"
+	};
+
+	D3D12_HEAP_DESC HeapDesc = {};
+	HeapDesc.SizeInBytes = Size;
+	HeapDesc.Properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+	HeapDesc.Alignment = (Category == kHeapRenderTargets ?
+		D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT : D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+	HeapDesc.Flags = CategoryFlags[Category];
+
+	ComPtr<ID3D12Heap> pHeap;
+	ThrowIfFailed(device->CreateHeap(&HeapDesc, MY_IID_PPV_ARGS(&pHeap)));
+	pHeap->SetName(CategoryNames[Category]);
+	return pHeap;
+}
+
+void GpuHeapAllocator::CreateCommittedResource(GpuResource& Resource, const std::wstring& Name, GpuHeapCategory Category, uint64_t Size,
+	const D3D12_RESOURCE_DESC& Desc, D3D12_RESOURCE_STATES InitialState, const D3D12_CLEAR_VALUE* pClearValue)
+{
+	Resource.CreateCommitted(Name, D3D12_HEAP_TYPE_DEFAULT, Desc, InitialState, pClearValue);
+
+	// No range to hand back, but the GPU may still be using it when it is destroyed
+	GpuHeapAllocation Allocation;
+	Allocation.Category = Category;
+	Allocation.Size = Size;
+	Resource.m_HeapAllocator = this;
+	Resource.m_HeapAllocation = Allocation;
+}
+
+void GpuHeapAllocator::PlaceResource(GpuResource& Resource, const std::wstring& Name, ID3D12Heap* pHeap, const GpuHeapAllocation& Allocation,
+	const D3D12_RESOURCE_DESC& Desc, D3D12_RESOURCE_STATES InitialState, const D3D12_CLEAR_VALUE* pClearValue)
+{
+	ComPtr<ID3D12Resource> pResource;
+	HRESULT hr = device->CreatePlacedResource(pHeap, Allocation.Offset, &Desc, InitialState, pClearValue, MY_IID_PPV_ARGS(&pResource));
+	if (FAILED(hr))
+	{
+		Free(nullptr, Allocation);
+		ThrowIfFailed(hr);
+	}
+
+	pResource->SetName(Name.c_str());
+
+	Resource.Attach(pResource.Get(), InitialState);
+	Resource.m_HeapAllocator = this;
+	Resource.m_HeapAllocation = Allocation;
+}
+
+GpuHeapAllocator::TransientBlock* GpuHeapAllocator::RequestTransientBlock(GpuHeapCategory Category)
+{
+	if (m_Fence != nullptr)
+	{
+		const uint64_t CompletedValue = m_Fence->GetCompletedValue();
+		for (auto Iter = m_RetiredTransient.begin(); Iter != m_RetiredTransient.end(); ++Iter)
+		{
+			TransientBlock* Block = *Iter;
+			if (Block->Fence > CompletedValue)
+				break;
+
+			if (Block->Category == Category)
+			{
+				m_RetiredTransient.erase(Iter);
+				Block->Allocator.Reset();
+				return Block;
+			}
+		}
+	}
+
+	TransientBlock* Block = new TransientBlock;
+	Block->Heap = CreateHeap(Category, TRANSIENT_HEAP_SIZE);
+	Block->Allocator.Create(TRANSIENT_HEAP_SIZE);
+	Block->Category = Category;
+	Block->Fence = 0;
+	m_TransientPool.emplace_back(Block);
+	return Block;
+}
+
+void GpuHeapAllocator::ReclaimCompleted(uint64_t CompletedValue)
+{
+	while (!m_RetiredFrees.empty() && m_RetiredFrees.front().Fence <= CompletedValue)
+	{
+		PendingFree& Retired = m_RetiredFrees.front();
+		const GpuHeapAllocation& Allocation = Retired.Allocation;
+
+		// A placed resource must be gone before the heap it lives in, which may be released below
+		Retired.Resource.Reset();
+
+		// Transient memory is recycled as a whole with its block, committed resources go with their
+		// last reference
+		if (!Allocation.Transient && Allocation.Block != nullptr)
+		{
+			vector<unique_ptr<HeapBlock>>& Heaps = m_Heaps[Allocation.Category];
+			for (size_t i = 0; i < Heaps.size(); ++i)
+			{
+				if (Heaps[i].get() != Allocation.Block)
+					continue;
+
+				Heaps[i]->Allocator.Free(Allocation.Handle);
+
+				// Keep the first block around, give the memory of the others back once they are empty
+				if (i > 0 && Heaps[i]->Allocator.IsEmpty())
+					Heaps.erase(Heaps.begin() + i);
+				break;
+			}
+		}
+
+		m_RetiredFrees.pop_front();
+	}
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "../../Core/Common.h"
+#include "OffsetAllocator.h"
+#include <deque>
+#include <mutex>
+
+class GpuResource;
+
+// Resource heap tier 1 hardware cannot mix these in one heap
+enum GpuHeapCategory
+{
+	kHeapBuffers = 0,
+	kHeapTextures,
+	kHeapRenderTargets,		// Render target and depth stencil textures
+
+	kNumHeapCategories
+};
+
+// Where a placed resource lives.  Kept by the GpuResource so the range can be handed back.  Block is
+// null for committed resources the allocator fell back to, they only have their release deferred.
+struct GpuHeapAllocation
+{
+	GpuHeapAllocation() : Category(kHeapBuffers), Block(nullptr), Handle(TlsfAllocator::INVALID_HANDLE), Offset(0), Size(0), Transient(false) {}
+
+	GpuHeapCategory Category;
+	void* Block;
+	TlsfAllocator::Handle Handle;
+	uint64_t Offset;
+	uint64_t Size;
+	bool Transient;
+};
+
+// Creates default heap resources as placed resources inside large ID3D12Heap blocks instead of
+// giving each one an implicit heap of its own.  Each category has its own blocks; long-lived
+// resources are sub-allocated with a TLSF allocator and transient ones with a linear allocator whose
+// block is recycled once the frame that used it has finished on the GPU.  Resources too big to share
+// a block fall back to committed resources.
+//
+// Released resources are kept alive, and their range reserved, until the fence of the frame they
+// were released in has completed.  That includes the committed fallbacks.
+class GpuHeapAllocator
+{
+public:
+	static const uint64_t DEFAULT_HEAP_SIZE = 64 * 1024 * 1024;
+	static const uint64_t TRANSIENT_HEAP_SIZE = 32 * 1024 * 1024;
+
+	GpuHeapAllocator();
+	~GpuHeapAllocator() { Destroy(); }
+
+	void Destroy();
+
+	void CreateResource(GpuResource& Resource, const std::wstring& Name, const D3D12_RESOURCE_DESC& Desc,
+		D3D12_RESOURCE_STATES InitialState, const D3D12_CLEAR_VALUE* pClearValue = nullptr);
+
+	// The resource may alias memory used by transient resources of previous frames and has to be
+	// destroyed before the frame ends.  Render targets and depth buffers placed here must be cleared
+	// or discarded before their first use.
+	void CreateTransientResource(GpuResource& Resource, const std::wstring& Name, const D3D12_RESOURCE_DESC& Desc,
+		D3D12_RESOURCE_STATES InitialState, const D3D12_CLEAR_VALUE* pClearValue = nullptr);
+
+	// Reserves Size bytes of this frame's transient memory for the caller to place several resources
+	// in with CreateAliasedResource, e.g. resources whose lifetimes do not overlap sharing the same
+	// bytes.  Returns false when the range cannot fit in a transient block.
+	bool AllocateTransientRange(GpuHeapCategory Category, uint64_t Size, uint64_t Alignment, GpuHeapAllocation& RangeOut);
+
+	// Places a resource Offset bytes into a range from AllocateTransientRange.  Memory shared with
+	// another resource needs an aliasing barrier, and the same initialization as any transient
+	// resource, before use.
+	void CreateAliasedResource(GpuResource& Resource, const std::wstring& Name, const GpuHeapAllocation& Range, uint64_t Offset,
+		const D3D12_RESOURCE_DESC& Desc, D3D12_RESOURCE_STATES InitialState, const D3D12_CLEAR_VALUE* pClearValue = nullptr);
+
+	// Called by GpuResource::Destroy()
+	void Free(ID3D12Resource* pResource, const GpuHeapAllocation& Allocation);
+
+	// Everything released, and every transient block used since the last call, is recycled once
+	// pFence reaches FenceValue.
+	void RetireFrame(ID3D12Fence* pFence, uint64_t FenceValue);
+
+	OffsetAllocatorStats GetStats(GpuHeapCategory Category);
+	OffsetAllocatorStats GetStats();
+	OffsetAllocatorStats GetTransientStats();
+	uint32_t GetHeapCount();
+
+	static GpuHeapCategory GetCategory(const D3D12_RESOURCE_DESC& Desc);
+	// May lower Desc.Alignment to the small placement alignment, the adjusted desc is the one to place
+	static D3D12_RESOURCE_ALLOCATION_INFO GetAllocationInfo(GpuHeapCategory Category, D3D12_RESOURCE_DESC& Desc);
+
+private:
+	struct HeapBlock
+	{
+		Microsoft::WRL::ComPtr<ID3D12Heap> Heap;
+		TlsfAllocator Allocator;
+	};
+
+	struct TransientBlock
+	{
+		Microsoft::WRL::ComPtr<ID3D12Heap> Heap;
+		LinearOffsetAllocator Allocator;
+		GpuHeapCategory Category;
+		uint64_t Fence;
+	};
+
+	struct PendingFree
+	{
+		uint64_t Fence;
+		Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+		GpuHeapAllocation Allocation;
+	};
+
+	static Microsoft::WRL::ComPtr<ID3D12Heap> CreateHeap(GpuHeapCategory Category, uint64_t Size);
+
+	void CreateCommittedResource(GpuResource& Resource, const std::wstring& Name, GpuHeapCategory Category, uint64_t Size,
+		const D3D12_RESOURCE_DESC& Desc, D3D12_RESOURCE_STATES InitialState, const D3D12_CLEAR_VALUE* pClearValue);
+
+	void PlaceResource(GpuResource& Resource, const std::wstring& Name, ID3D12Heap* pHeap, const GpuHeapAllocation& Allocation,
+		const D3D12_RESOURCE_DESC& Desc, D3D12_RESOURCE_STATES InitialState, const D3D12_CLEAR_VALUE* pClearValue);
+	TransientBlock* RequestTransientBlock(GpuHeapCategory Category);
+	void ReclaimCompleted(uint64_t CompletedValue);
+
+	std::mutex m_Mutex;
+
+	std::vector<std::unique_ptr<HeapBlock>> m_Heaps[kNumHeapCategories];
+
+	TransientBlock* m_CurrentTransient[kNumHeapCategories];
+	std::vector<TransientBlock*> m_UsedTransient;
+	std::deque<TransientBlock*> m_RetiredTransient;
+	std::vector<std::unique_ptr<TransientBlock>> m_TransientPool;
+
+	std::vector<PendingFree> m_PendingFrees;		// Released this frame
+	std::deque<PendingFree> m_RetiredFrees;
+
+	Microsoft::WRL::ComPtr<ID3D12Fence> m_Fence;
+};
@@ -0,0 +1,31 @@
+#include "GpuResource.h"
+#include "../Core/GraphicContext.h"
+
+using namespace Renderer;
+
+void GpuResource::Attach(ID3D12Resource* pResource, D3D12_RESOURCE_STATES CurrentState)
+{
+	Destroy();
+
+	m_pResource = pResource;
+	m_UsageState = CurrentState;
+
+	if (pResource->GetDesc().Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+		m_GpuVirtualAddress = pResource->GetGPUVirtualAddress();
+}
+
+void GpuResource::CreateCommitted(const std::wstring& Name, D3D12_HEAP_TYPE HeapType, const D3D12_RESOURCE_DESC& Desc,
+	D3D12_RESOURCE_STATES InitialState, const D3D12_CLEAR_VALUE* pClearValue)
+{
+	Destroy();
+
+	CD3DX12_HEAP_PROPERTIES HeapProps(HeapType);
+	ThrowIfFailed(device->CreateCommittedResource(&HeapProps, D3D12_HEAP_FLAG_NONE, &Desc,
+		InitialState, pClearValue, MY_IID_PPV_ARGS(&m_pResource)));
+
+	m_pResource->SetName(Name.c_str());
+	m_UsageState = InitialState;
+
+	if (Desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+		m_GpuVirtualAddress = m_pResource->GetGPUVirtualAddress();
+}
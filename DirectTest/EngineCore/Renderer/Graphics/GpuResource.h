@@ -0,0 +1,98 @@
+#pragma once
+
+#include "../../Core/Common.h"
+#include "GpuHeapAllocator.h"
+
+namespace Renderer {
+	class GraphicContext;
+}
+
+// Read-only states can be combined into one.  A resource already in such a combination does not
+// need a barrier to be used through any subset of it.
+static const D3D12_RESOURCE_STATES READ_ONLY_RESOURCE_STATES =
+	D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER |
+	D3D12_RESOURCE_STATE_INDEX_BUFFER |
+	D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE |
+	D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE |
+	D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT |
+	D3D12_RESOURCE_STATE_COPY_SOURCE |
+	D3D12_RESOURCE_STATE_DEPTH_READ;
+
+inline bool IsReadOnlyState(D3D12_RESOURCE_STATES State)
+{
+	return State != D3D12_RESOURCE_STATE_COMMON && (State & ~READ_ONLY_RESOURCE_STATES) == 0;
+}
+
+inline bool IsCoveredReadState(D3D12_RESOURCE_STATES Current, D3D12_RESOURCE_STATES Requested)
+{
+	return IsReadOnlyState(Current) && IsReadOnlyState(Requested) && (Current & Requested) == Requested;
+}
+
+// Wraps an ID3D12Resource together with the state it will be in once every barrier recorded so far
+// has executed.  The graphic context uses this to build transitions on demand instead of callers
+// hand-writing the before/after states.
+class GpuResource
+{
+	friend class Renderer::GraphicContext;
+	friend class GpuHeapAllocator;
+
+public:
+	GpuResource() :
+		m_UsageState(D3D12_RESOURCE_STATE_COMMON),
+		m_TransitioningState((D3D12_RESOURCE_STATES)-1),
+		m_GpuVirtualAddress(D3D12_GPU_VIRTUAL_ADDRESS_NULL),
+		m_HeapAllocator(nullptr)
+	{
+	}
+
+	GpuResource(ID3D12Resource* pResource, D3D12_RESOURCE_STATES CurrentState) :
+		m_pResource(pResource),
+		m_UsageState(CurrentState),
+		m_TransitioningState((D3D12_RESOURCE_STATES)-1),
+		m_GpuVirtualAddress(D3D12_GPU_VIRTUAL_ADDRESS_NULL),
+		m_HeapAllocator(nullptr)
+	{
+	}
+
+	virtual ~GpuResource() { Destroy(); }
+
+	virtual void Destroy()
+	{
+		// Resources from a GpuHeapAllocator, and their memory, live until the GPU is done with them
+		if (m_HeapAllocator != nullptr)
+			m_HeapAllocator->Free(m_pResource.Get(), m_HeapAllocation);
+		m_HeapAllocator = nullptr;
+		m_HeapAllocation = GpuHeapAllocation();
+
+		m_pResource = nullptr;
+		m_GpuVirtualAddress = D3D12_GPU_VIRTUAL_ADDRESS_NULL;
+		m_UsageState = D3D12_RESOURCE_STATE_COMMON;
+		m_TransitioningState = (D3D12_RESOURCE_STATES)-1;
+	}
+
+	// Takes a reference on an externally created resource, e.g. a swap chain buffer.
+	void Attach(ID3D12Resource* pResource, D3D12_RESOURCE_STATES CurrentState);
+
+	// Creates a committed resource in a heap of the given type.  Default heap resources should
+	// rather be created through GpuHeapAllocator.
+	void CreateCommitted(const std::wstring& Name, D3D12_HEAP_TYPE HeapType, const D3D12_RESOURCE_DESC& Desc,
+		D3D12_RESOURCE_STATES InitialState, const D3D12_CLEAR_VALUE* pClearValue = nullptr);
+
+	ID3D12Resource* operator->() { return m_pResource.Get(); }
+	const ID3D12Resource* operator->() const { return m_pResource.Get(); }
+
+	ID3D12Resource* GetResource() { return m_pResource.Get(); }
+	const ID3D12Resource* GetResource() const { return m_pResource.Get(); }
+
+	D3D12_GPU_VIRTUAL_ADDRESS GetGpuVirtualAddress() const { return m_GpuVirtualAddress; }
+	D3D12_RESOURCE_STATES GetUsageState() const { return m_UsageState; }
+
+protected:
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> m_pResource;
+	D3D12_RESOURCE_STATES m_UsageState;
+	D3D12_RESOURCE_STATES m_TransitioningState;	// Target of an in-flight split barrier, or -1
+	D3D12_GPU_VIRTUAL_ADDRESS m_GpuVirtualAddress;
+	GpuHeapAllocator* m_HeapAllocator;			// Set for resources created by a GpuHeapAllocator
+	GpuHeapAllocation m_HeapAllocation;
+};
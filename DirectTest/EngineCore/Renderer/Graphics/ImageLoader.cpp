@@ -1,109 +1,148 @@
 #include "ImageLoader.h"
+#include "JpegDecoder.h"
+#include "PngDecoder.h"
+#include "DdsReader.h"
+#include "../../Core/Utility/FileUtility.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <ppl.h>
+
+namespace {
+	enum ImageType {
+		kUnknownImage,
+		kJpegImage,
+		kPngImage,
+		kDdsImage
+	};
+
+	// el tipo se saca de la firma del fichero, no de la extension
+	ImageType GetImageType(const uint8_t* data, size_t size) {
+		if (size >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF) return kJpegImage;
+		if (size >= 8 && memcmp(data, "\x89PNG\r\n\x1A\n", 8) == 0) return kPngImage;
+		if (size >= 4 && memcmp(data, "DDS ", 4) == 0) return kDdsImage;
+		return kUnknownImage;
+	}
 
-IWICImagingFactory* ImageLoader::wicFactory = nullptr;
-
-void ImageLoader::Initialize() {
-	CoInitialize(NULL);
-	HRESULT hr;
-	// create the WIC factory
-	hr = CoCreateInstance(
-		CLSID_WICImagingFactory,
-		NULL,
-		CLSCTX_INPROC_SERVER,
-		IID_PPV_ARGS(&wicFactory)
-	);
-
-	if (FAILED(hr)) return;
+	// filas de cada franja al convertir a RGBA
+	const uint32_t STRIP_ROWS = 32;
+
+	template <typename Decoder>
+	void ConvertInStrips(const Decoder& decoder, uint8_t* dest, size_t rowPitch) {
+		const uint32_t height = decoder.GetHeight();
+		const uint32_t numStrips = (height + STRIP_ROWS - 1) / STRIP_ROWS;
+		concurrency::parallel_for(0u, numStrips, [&](uint32_t strip) {
+			const uint32_t firstRow = strip * STRIP_ROWS;
+			decoder.ConvertRows(dest, rowPitch, firstRow, std::min(STRIP_ROWS, height - firstRow));
+		});
+	}
 }
 
 int ImageLoader::LoadImageFromFile(LPCWSTR filename, int &bytesPerRow, Image* outImage) {
-	HRESULT hr;
-
-	// Creamos un decoder para cada imagen ya que cada imagen va a requerir uno distinto
-	IWICBitmapDecoder *wicDecoder = NULL;
-	IWICBitmapFrameDecode *wicFrame = NULL;
-	IWICFormatConverter *wicConverter = NULL;
-
-	bool imageConverted = false;
-
-	if (wicFactory == nullptr) { Initialize(); }
-
-	hr = wicFactory->CreateDecoderFromFilename(
-		filename,                       
-		NULL,                            // Vendor ID, no queremos especificarlo
-		GENERIC_READ,                    // Queremos leer en esta imagen
-		WICDecodeMetadataCacheOnLoad,    // Queremos cachear la imagen justo al cargarla en lugar de cuando se vaya a usar
-		&wicDecoder                      // puntero al decoder
-	);
-	if (FAILED(hr)) return 0;
-
-	hr = wicDecoder->GetFrame(0, &wicFrame);
-	if (FAILED(hr)) return 0;
+	// mapeamos el fichero en memoria, los decoders leen directamente de la vista
+	Utility::MappedFile file;
+	if (!file.Open(filename)) return 0;
 
-	// obtenemos el pixel format de la imagen
-	WICPixelFormatGUID pixelFormat;
-	hr = wicFrame->GetPixelFormat(&pixelFormat);
-	if (FAILED(hr)) return 0;
+	if (!GetImageInfo(file.GetData(), file.GetSize(), outImage)) return 0;
 
-	// obtenemos el tamao de la imagen
-	UINT textureWidth, textureHeight;
-	hr = wicFrame->GetSize(&textureWidth, &textureHeight);
-	if (FAILED(hr)) return 0;
+	bytesPerRow = GetRowPitch(outImage->dxgiFormat, outImage->textureWidth); // numero de bytes por linea
+	outImage->sizeInBytes = bytesPerRow * GetNumRows(outImage->dxgiFormat, outImage->textureHeight); // tamao total de la imagen en bytes
 
+	// asignamos suficiente memoria para los datos de nuestra imagen
+	outImage->imageData = (BYTE*)malloc(outImage->sizeInBytes);
+	if (outImage->imageData == nullptr) return 0;
 
-	// convertimos pixel format a DXGIFormat
-	DXGI_FORMAT dxgiFormat = GetDXGIFormatFromWICFormat(pixelFormat);
-
-	if (dxgiFormat == DXGI_FORMAT_UNKNOWN)
-	{
-		// obtenemos un DXGIFormat compatible
-		WICPixelFormatGUID convertToPixelFormat = GetConvertToWICFormat(pixelFormat);
-
-		// Terminamos si no encontramos ningun formato compatible
-		if (convertToPixelFormat == GUID_WICPixelFormatDontCare) return 0;
-
-		
-		dxgiFormat = GetDXGIFormatFromWICFormat(convertToPixelFormat);
-
-		// creamos el FormatConverter
-		hr = wicFactory->CreateFormatConverter(&wicConverter);
-		if (FAILED(hr)) return 0;
-
-		// nos aseguramos de que podamos convertir la imagen al formato que se ha elegido
-		BOOL canConvert = FALSE;
-		hr = wicConverter->CanConvert(pixelFormat, convertToPixelFormat, &canConvert);
-		if (FAILED(hr) || !canConvert) return 0;
+	if (!DecodeImage(file.GetData(), file.GetSize(), outImage->imageData, bytesPerRow)) {
+		free(outImage->imageData);
+		outImage->imageData = nullptr;
+		return 0;
+	}
 
-		// hacemos la conversin
-		hr = wicConverter->Initialize(wicFrame, convertToPixelFormat, WICBitmapDitherTypeErrorDiffusion, 0, 0, WICBitmapPaletteTypeCustom);
-		if (FAILED(hr)) return 0;
+	return 1;
+}
 
-		imageConverted = true;
+bool ImageLoader::GetImageInfo(const uint8_t* data, size_t size, Image* outImage) {
+	UINT width = 0, height = 0;
+	DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM;
+
+	switch (GetImageType(data, size)) {
+	case kJpegImage: {
+		JpegDecoder decoder;
+		if (!decoder.ReadHeader(data, size)) return false;
+		width = decoder.GetWidth();
+		height = decoder.GetHeight();
+		break;
+	}
+	case kPngImage: {
+		PngDecoder decoder;
+		if (!decoder.ReadHeader(data, size)) return false;
+		width = decoder.GetWidth();
+		height = decoder.GetHeight();
+		break;
+	}
+	case kDdsImage: {
+		// el DDS ya viene en el formato de la textura
+		DdsReader reader;
+		if (!reader.ReadHeader(data, size)) return false;
+		width = reader.GetWidth();
+		height = reader.GetHeight();
+		format = reader.GetFormat();
+		break;
+	}
+	default:
+		return false;
 	}
 
-	int bitsPerPixel = GetDXGIFormatBitsPerPixel(dxgiFormat); // numero de bits por pixel
-	bytesPerRow = (textureWidth * bitsPerPixel) / 8; // numero de bytes por linea
-	int imageSize = bytesPerRow * textureHeight; // tamao total de la imagen en bytes
-
-	// asignamos suficiente memoria para los datos de nuestra imagen
-	outImage->imageData = (BYTE*)malloc(imageSize);
+	// JPEG y PNG salen siempre en RGBA de 8 bits
+	outImage->textureWidth = width;
+	outImage->textureHeight = height;
+	outImage->dxgiFormat = format;
+	outImage->sizeInBytes = GetRowPitch(format, width) * GetNumRows(format, height);
+	return true;
+}
 
-	// copiar los datos decodificados en la imagen final
-	if (imageConverted)
-	{
-		hr = wicConverter->CopyPixels(0, bytesPerRow, imageSize, outImage->imageData);
-		if (FAILED(hr)) return 0;
+bool ImageLoader::DecodeImage(const uint8_t* data, size_t size, uint8_t* dest, size_t rowPitch, bool parallel) {
+	// cada llamada tiene su propio decoder, no hay estado compartido entre hilos
+	switch (GetImageType(data, size)) {
+	case kJpegImage: {
+		JpegDecoder decoder;
+		if (!decoder.ReadHeader(data, size)) return false;
+		if (!parallel) return decoder.Decode(dest, rowPitch);
+
+		// los intervalos de restart se decodifican por separado, sin ellos los datos van en un solo hilo
+		const uint32_t numParts = decoder.BeginDecode();
+		if (numParts == 0) return false;
+		std::atomic<bool> ok(true);
+		concurrency::parallel_for(0u, numParts, [&](uint32_t part) {
+			if (!decoder.DecodeParts(part, 1)) ok = false;
+		});
+		if (!ok) return false;
+
+		ConvertInStrips(decoder, dest, rowPitch);
+		return true;
 	}
-	else
-	{
-		hr = wicFrame->CopyPixels(0, bytesPerRow, imageSize, outImage->imageData);
-		if (FAILED(hr)) return 0;
+	case kPngImage: {
+		PngDecoder decoder;
+		if (!decoder.ReadHeader(data, size)) return false;
+		if (!parallel) return decoder.Decode(dest, rowPitch);
+
+		// inflate y los filtros van fila a fila, solo la conversion se reparte
+		if (!decoder.Unpack()) return false;
+		ConvertInStrips(decoder, dest, rowPitch);
+		return true;
+	}
+	case kDdsImage: {
+		// solo se copia el primer mip del primer slice, fila a fila por si el pitch es otro
+		DdsReader reader;
+		if (!reader.ReadHeader(data, size)) return false;
+		const DdsReader::Subresource& top = reader.GetSubresource(0);
+		for (uint32_t row = 0; row < top.NumRows; ++row)
+			memcpy(dest + row * rowPitch, top.Data + row * top.RowBytes, top.RowBytes);
+		return true;
+	}
+	default:
+		return false;
 	}
-
-	outImage->dxgiFormat = dxgiFormat;
-	outImage->textureWidth = textureWidth;
-	outImage->textureHeight = textureHeight;
-	outImage->sizeInBytes = imageSize;
 }
 
 int ImageLoader::GetDXGIFormatBitsPerPixel(DXGI_FORMAT& dxgiFormat)
@@ -112,7 +151,9 @@ int ImageLoader::GetDXGIFormatBitsPerPixel(DXGI_FORMAT& dxgiFormat)
 	else if (dxgiFormat == DXGI_FORMAT_R16G16B16A16_FLOAT) return 64;
 	else if (dxgiFormat == DXGI_FORMAT_R16G16B16A16_UNORM) return 64;
 	else if (dxgiFormat == DXGI_FORMAT_R8G8B8A8_UNORM) return 32;
+	else if (dxgiFormat == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB) return 32;
 	else if (dxgiFormat == DXGI_FORMAT_B8G8R8A8_UNORM) return 32;
+	else if (dxgiFormat == DXGI_FORMAT_B8G8R8A8_UNORM_SRGB) return 32;
 	else if (dxgiFormat == DXGI_FORMAT_B8G8R8X8_UNORM) return 32;
 	else if (dxgiFormat == DXGI_FORMAT_R10G10B10_XR_BIAS_A2_UNORM) return 32;
 
@@ -120,78 +161,38 @@ int ImageLoader::GetDXGIFormatBitsPerPixel(DXGI_FORMAT& dxgiFormat)
 	else if (dxgiFormat == DXGI_FORMAT_B5G5R5A1_UNORM) return 16;
 	else if (dxgiFormat == DXGI_FORMAT_B5G6R5_UNORM) return 16;
 	else if (dxgiFormat == DXGI_FORMAT_R32_FLOAT) return 32;
+	else if (dxgiFormat == DXGI_FORMAT_R16G16_FLOAT) return 32;
+	else if (dxgiFormat == DXGI_FORMAT_R11G11B10_FLOAT) return 32;
+	else if (dxgiFormat == DXGI_FORMAT_R8G8_UNORM) return 16;
 	else if (dxgiFormat == DXGI_FORMAT_R16_FLOAT) return 16;
 	else if (dxgiFormat == DXGI_FORMAT_R16_UNORM) return 16;
 	else if (dxgiFormat == DXGI_FORMAT_R8_UNORM) return 8;
 	else if (dxgiFormat == DXGI_FORMAT_A8_UNORM) return 8;
+
+	// bloques de 8 bytes (BC1, BC4) o de 16 (el resto) por cada 16 pixels
+	else if (dxgiFormat == DXGI_FORMAT_BC1_UNORM || dxgiFormat == DXGI_FORMAT_BC1_UNORM_SRGB) return 4;
+	else if (dxgiFormat == DXGI_FORMAT_BC4_UNORM || dxgiFormat == DXGI_FORMAT_BC4_SNORM) return 4;
+	else if (dxgiFormat == DXGI_FORMAT_BC2_UNORM || dxgiFormat == DXGI_FORMAT_BC2_UNORM_SRGB) return 8;
+	else if (dxgiFormat == DXGI_FORMAT_BC3_UNORM || dxgiFormat == DXGI_FORMAT_BC3_UNORM_SRGB) return 8;
+	else if (dxgiFormat == DXGI_FORMAT_BC5_UNORM || dxgiFormat == DXGI_FORMAT_BC5_SNORM) return 8;
+	else if (dxgiFormat == DXGI_FORMAT_BC6H_UF16 || dxgiFormat == DXGI_FORMAT_BC6H_SF16) return 8;
+	else if (dxgiFormat == DXGI_FORMAT_BC7_UNORM || dxgiFormat == DXGI_FORMAT_BC7_UNORM_SRGB) return 8;
+
+	else return 0;
 }
 
-WICPixelFormatGUID ImageLoader::GetConvertToWICFormat(WICPixelFormatGUID& wicFormatGUID)
-{
-	if (wicFormatGUID == GUID_WICPixelFormatBlackWhite) return GUID_WICPixelFormat8bppGray;
-	else if (wicFormatGUID == GUID_WICPixelFormat1bppIndexed) return GUID_WICPixelFormat32bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat2bppIndexed) return GUID_WICPixelFormat32bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat4bppIndexed) return GUID_WICPixelFormat32bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat8bppIndexed) return GUID_WICPixelFormat32bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat2bppGray) return GUID_WICPixelFormat8bppGray;
-	else if (wicFormatGUID == GUID_WICPixelFormat4bppGray) return GUID_WICPixelFormat8bppGray;
-	else if (wicFormatGUID == GUID_WICPixelFormat16bppGrayFixedPoint) return GUID_WICPixelFormat16bppGrayHalf;
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppGrayFixedPoint) return GUID_WICPixelFormat32bppGrayFloat;
-	else if (wicFormatGUID == GUID_WICPixelFormat16bppBGR555) return GUID_WICPixelFormat16bppBGRA5551;
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppBGR101010) return GUID_WICPixelFormat32bppRGBA1010102;
-	else if (wicFormatGUID == GUID_WICPixelFormat24bppBGR) return GUID_WICPixelFormat32bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat24bppRGB) return GUID_WICPixelFormat32bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppPBGRA) return GUID_WICPixelFormat32bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppPRGBA) return GUID_WICPixelFormat32bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat48bppRGB) return GUID_WICPixelFormat64bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat48bppBGR) return GUID_WICPixelFormat64bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat64bppBGRA) return GUID_WICPixelFormat64bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat64bppPRGBA) return GUID_WICPixelFormat64bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat64bppPBGRA) return GUID_WICPixelFormat64bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat48bppRGBFixedPoint) return GUID_WICPixelFormat64bppRGBAHalf;
-	else if (wicFormatGUID == GUID_WICPixelFormat48bppBGRFixedPoint) return GUID_WICPixelFormat64bppRGBAHalf;
-	else if (wicFormatGUID == GUID_WICPixelFormat64bppRGBAFixedPoint) return GUID_WICPixelFormat64bppRGBAHalf;
-	else if (wicFormatGUID == GUID_WICPixelFormat64bppBGRAFixedPoint) return GUID_WICPixelFormat64bppRGBAHalf;
-	else if (wicFormatGUID == GUID_WICPixelFormat64bppRGBFixedPoint) return GUID_WICPixelFormat64bppRGBAHalf;
-	else if (wicFormatGUID == GUID_WICPixelFormat64bppRGBHalf) return GUID_WICPixelFormat64bppRGBAHalf;
-	else if (wicFormatGUID == GUID_WICPixelFormat48bppRGBHalf) return GUID_WICPixelFormat64bppRGBAHalf;
-	else if (wicFormatGUID == GUID_WICPixelFormat128bppPRGBAFloat) return GUID_WICPixelFormat128bppRGBAFloat;
-	else if (wicFormatGUID == GUID_WICPixelFormat128bppRGBFloat) return GUID_WICPixelFormat128bppRGBAFloat;
-	else if (wicFormatGUID == GUID_WICPixelFormat128bppRGBAFixedPoint) return GUID_WICPixelFormat128bppRGBAFloat;
-	else if (wicFormatGUID == GUID_WICPixelFormat128bppRGBFixedPoint) return GUID_WICPixelFormat128bppRGBAFloat;
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppRGBE) return GUID_WICPixelFormat128bppRGBAFloat;
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppCMYK) return GUID_WICPixelFormat32bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat64bppCMYK) return GUID_WICPixelFormat64bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat40bppCMYKAlpha) return GUID_WICPixelFormat64bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat80bppCMYKAlpha) return GUID_WICPixelFormat64bppRGBA;
-
-#if (_WIN32_WINNT >= _WIN32_WINNT_WIN8) || defined(_WIN7_PLATFORM_UPDATE)
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppRGB) return GUID_WICPixelFormat32bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat64bppRGB) return GUID_WICPixelFormat64bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat64bppPRGBAHalf) return GUID_WICPixelFormat64bppRGBAHalf;
-#endif
-
-	else return GUID_WICPixelFormatDontCare;
+bool ImageLoader::IsBlockCompressed(DXGI_FORMAT dxgiFormat) {
+	return (dxgiFormat >= DXGI_FORMAT_BC1_TYPELESS && dxgiFormat <= DXGI_FORMAT_BC5_SNORM) ||
+		(dxgiFormat >= DXGI_FORMAT_BC6H_TYPELESS && dxgiFormat <= DXGI_FORMAT_BC7_UNORM_SRGB);
 }
 
-DXGI_FORMAT ImageLoader::GetDXGIFormatFromWICFormat(WICPixelFormatGUID& wicFormatGUID)
-{
-	if (wicFormatGUID == GUID_WICPixelFormat128bppRGBAFloat) return DXGI_FORMAT_R32G32B32A32_FLOAT;
-	else if (wicFormatGUID == GUID_WICPixelFormat64bppRGBAHalf) return DXGI_FORMAT_R16G16B16A16_FLOAT;
-	else if (wicFormatGUID == GUID_WICPixelFormat64bppRGBA) return DXGI_FORMAT_R16G16B16A16_UNORM;
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppRGBA) return DXGI_FORMAT_R8G8B8A8_UNORM;
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppBGRA) return DXGI_FORMAT_B8G8R8A8_UNORM;
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppBGR) return DXGI_FORMAT_B8G8R8X8_UNORM;
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppRGBA1010102XR) return DXGI_FORMAT_R10G10B10_XR_BIAS_A2_UNORM;
-
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppRGBA1010102) return DXGI_FORMAT_R10G10B10A2_UNORM;
-	else if (wicFormatGUID == GUID_WICPixelFormat16bppBGRA5551) return DXGI_FORMAT_B5G5R5A1_UNORM;
-	else if (wicFormatGUID == GUID_WICPixelFormat16bppBGR565) return DXGI_FORMAT_B5G6R5_UNORM;
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppGrayFloat) return DXGI_FORMAT_R32_FLOAT;
-	else if (wicFormatGUID == GUID_WICPixelFormat16bppGrayHalf) return DXGI_FORMAT_R16_FLOAT;
-	else if (wicFormatGUID == GUID_WICPixelFormat16bppGray) return DXGI_FORMAT_R16_UNORM;
-	else if (wicFormatGUID == GUID_WICPixelFormat8bppGray) return DXGI_FORMAT_R8_UNORM;
-	else if (wicFormatGUID == GUID_WICPixelFormat8bppAlpha) return DXGI_FORMAT_A8_UNORM;
-
-	else return DXGI_FORMAT_UNKNOWN;
-}
\ No newline at end of file
+UINT ImageLoader::GetRowPitch(DXGI_FORMAT dxgiFormat, UINT width) {
+	const UINT bitsPerPixel = GetDXGIFormatBitsPerPixel(dxgiFormat);
+	// un bloque ocupa lo que 16 pixels, aunque la imagen no llegue a 4 de ancho
+	if (IsBlockCompressed(dxgiFormat)) return ((width + 3) / 4) * bitsPerPixel * 2;
+	return (width * bitsPerPixel + 7) / 8;
+}
+
+UINT ImageLoader::GetNumRows(DXGI_FORMAT dxgiFormat, UINT height) {
+	return IsBlockCompressed(dxgiFormat) ? (height + 3) / 4 : height;
+}
@@ -1,5 +1,5 @@
 #pragma once
-#include <wincodec.h>
+#include "../../Core/Common.h"
 
 struct Image {
 	UINT textureWidth;
@@ -9,17 +9,22 @@ struct Image {
 	BYTE* imageData;
 };
 
+// Carga imagenes JPEG y PNG con los decoders del motor, sin WIC ni COM, y texturas DDS ya
+// preparadas, que no se decodifican.  Todas las funciones se pueden llamar desde varios hilos a la vez.
 class ImageLoader {
 
 public:
+	// Lee y decodifica el fichero en memoria reservada con malloc, que libera quien llama
 	static int LoadImageFromFile(LPCWSTR filename, int &bytesPerRow, Image* outImage);
+	// Rellena el tamao y el formato de la imagen sin decodificarla.  imageData no se toca.
+	static bool GetImageInfo(const uint8_t* data, size_t size, Image* outImage);
+	// Decodifica en la memoria de quien llama, por ejemplo un upload buffer, con rowPitch bytes entre filas.
+	// De un DDS copia el primer mip tal cual; TextureLoader sube todos sus subrecursos.
+	// Con parallel la imagen se reparte en franjas entre los hilos del pool de PPL.
+	static bool DecodeImage(const uint8_t* data, size_t size, uint8_t* dest, size_t rowPitch, bool parallel = false);
 	static int GetDXGIFormatBitsPerPixel(DXGI_FORMAT & dxgiFormat);
-private:
-	static void Initialize();
-	static WICPixelFormatGUID GetConvertToWICFormat(WICPixelFormatGUID & wicFormatGUID);
-	static DXGI_FORMAT GetDXGIFormatFromWICFormat(WICPixelFormatGUID & wicFormatGUID);
-
-private:
-	static IWICImagingFactory* wicFactory;
+	// Los formatos BC guardan bloques de 4x4 pixels: una fila del pitch es una fila de bloques
+	static bool IsBlockCompressed(DXGI_FORMAT dxgiFormat);
+	static UINT GetRowPitch(DXGI_FORMAT dxgiFormat, UINT width);
+	static UINT GetNumRows(DXGI_FORMAT dxgiFormat, UINT height);
 };
-
@@ -0,0 +1,1007 @@
+#include "JpegDecoder.h"
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define ENABLE_SSE2_JPEG 1
+#include <emmintrin.h>
+#else
+#define ENABLE_SSE2_JPEG 0
+#endif
+
+namespace
+{
+	// Natural order index of each coefficient in zigzag order
+	const uint8_t ZIGZAG[64] =
+	{
+		0,  1,  8, 16,  9,  2,  3, 10,
+		17, 24, 32, 25, 18, 11,  4,  5,
+		12, 19, 26, 33, 40, 48, 41, 34,
+		27, 20, 13,  6,  7, 14, 21, 28,
+		35, 42, 49, 56, 57, 50, 43, 36,
+		29, 22, 15, 23, 30, 37, 44, 51,
+		58, 59, 52, 45, 38, 31, 39, 46,
+		53, 60, 61, 54, 47, 55, 62, 63
+	};
+
+	// Images larger than this are refused instead of allocating gigabytes for a corrupt header
+	const uint64_t MAX_PIXELS = 1 << 28;
+
+	// YCbCr to RGB, 14-bit fixed point
+	const int16_t CR_TO_R = 22970;		// 1.402
+	const int16_t CB_TO_G = -5638;		// -0.344136
+	const int16_t CR_TO_G = -11700;		// -0.714136
+	const int16_t CB_TO_B = 29032;		// 1.772
+
+	inline uint32_t Read16(const uint8_t* Data)
+	{
+		return ((uint32_t)Data[0] << 8) | Data[1];
+	}
+
+	inline uint8_t Clamp8(int32_t Value)
+	{
+		return (uint8_t)(Value < 0 ? 0 : (Value > 255 ? 255 : Value));
+	}
+
+	inline int32_t Extend(uint32_t Value, uint32_t Num)
+	{
+		return Value < (1u << (Num - 1)) ? (int32_t)Value - (1 << Num) + 1 : (int32_t)Value;
+	}
+
+	// One dimension of the AAN inverse DCT (Arai, Agui and Nakajima, as in libjpeg's jidctflt.c).
+	// The inputs are already multiplied by the scale factors of the transform.
+	inline float Add(float A, float B) { return A + B; }
+	inline float Sub(float A, float B) { return A - B; }
+	inline float Mul(float A, float B) { return A * B; }
+
+#if ENABLE_SSE2_JPEG
+	inline __m128 Add(__m128 A, __m128 B) { return _mm_add_ps(A, B); }
+	inline __m128 Sub(__m128 A, __m128 B) { return _mm_sub_ps(A, B); }
+	inline __m128 Mul(__m128 A, float B) { return _mm_mul_ps(A, _mm_set1_ps(B)); }
+#endif
+
+	template <typename T>
+	void InverseDCT8(T* V, size_t Step)
+	{
+		// Even part
+		const T Tmp10 = Add(V[0], V[4 * Step]);
+		const T Tmp11 = Sub(V[0], V[4 * Step]);
+		const T Tmp13 = Add(V[2 * Step], V[6 * Step]);
+		const T Tmp12 = Sub(Mul(Sub(V[2 * Step], V[6 * Step]), 1.414213562f), Tmp13);
+
+		const T Even0 = Add(Tmp10, Tmp13);
+		const T Even3 = Sub(Tmp10, Tmp13);
+		const T Even1 = Add(Tmp11, Tmp12);
+		const T Even2 = Sub(Tmp11, Tmp12);
+
+		// Odd part
+		const T Z13 = Add(V[5 * Step], V[3 * Step]);
+		const T Z10 = Sub(V[5 * Step], V[3 * Step]);
+		const T Z11 = Add(V[1 * Step], V[7 * Step]);
+		const T Z12 = Sub(V[1 * Step], V[7 * Step]);
+
+		const T Odd7 = Add(Z11, Z13);
+		const T Odd11 = Mul(Sub(Z11, Z13), 1.414213562f);
+		const T Z5 = Mul(Add(Z10, Z12), 1.847759065f);
+		const T Odd10 = Sub(Mul(Z12, 1.082392200f), Z5);
+		const T Odd12 = Add(Mul(Z10, -2.613125930f), Z5);
+
+		const T Odd6 = Sub(Odd12, Odd7);
+		const T Odd5 = Sub(Odd11, Odd6);
+		const T Odd4 = Add(Odd10, Odd5);
+
+		V[0] = Add(Even0, Odd7);
+		V[7 * Step] = Sub(Even0, Odd7);
+		V[1 * Step] = Add(Even1, Odd6);
+		V[6 * Step] = Sub(Even1, Odd6);
+		V[2 * Step] = Add(Even2, Odd5);
+		V[5 * Step] = Sub(Even2, Odd5);
+		V[4 * Step] = Add(Even3, Odd4);
+		V[3 * Step] = Sub(Even3, Odd4);
+	}
+
+	// Dequantizes and transforms one block into 8x8 samples at Out
+	void InverseDCT(const int16_t* Coefs, const float* Quant, uint8_t* Out, size_t Stride)
+	{
+#if ENABLE_SSE2_JPEG
+		__m128 Lo[8], Hi[8];
+		for (int Row = 0; Row < 8; ++Row)
+		{
+			const __m128i Packed = _mm_load_si128((const __m128i*)(Coefs + Row * 8));
+			const __m128i Low = _mm_srai_epi32(_mm_unpacklo_epi16(Packed, Packed), 16);
+			const __m128i High = _mm_srai_epi32(_mm_unpackhi_epi16(Packed, Packed), 16);
+			Lo[Row] = _mm_mul_ps(_mm_cvtepi32_ps(Low), _mm_loadu_ps(Quant + Row * 8));
+			Hi[Row] = _mm_mul_ps(_mm_cvtepi32_ps(High), _mm_loadu_ps(Quant + Row * 8 + 4));
+		}
+
+		// Columns, four at a time
+		InverseDCT8(Lo, 1);
+		InverseDCT8(Hi, 1);
+
+		// Transposed, the rows become columns.  The top right and bottom left quarters swap places.
+		_MM_TRANSPOSE4_PS(Lo[0], Lo[1], Lo[2], Lo[3]);
+		_MM_TRANSPOSE4_PS(Hi[0], Hi[1], Hi[2], Hi[3]);
+		_MM_TRANSPOSE4_PS(Lo[4], Lo[5], Lo[6], Lo[7]);
+		_MM_TRANSPOSE4_PS(Hi[4], Hi[5], Hi[6], Hi[7]);
+		for (int i = 0; i < 4; ++i)
+		{
+			const __m128 Swap = Hi[i];
+			Hi[i] = Lo[i + 4];
+			Lo[i + 4] = Swap;
+		}
+
+		InverseDCT8(Lo, 1);
+		InverseDCT8(Hi, 1);
+
+		_MM_TRANSPOSE4_PS(Lo[0], Lo[1], Lo[2], Lo[3]);
+		_MM_TRANSPOSE4_PS(Hi[0], Hi[1], Hi[2], Hi[3]);
+		_MM_TRANSPOSE4_PS(Lo[4], Lo[5], Lo[6], Lo[7]);
+		_MM_TRANSPOSE4_PS(Hi[4], Hi[5], Hi[6], Hi[7]);
+		for (int i = 0; i < 4; ++i)
+		{
+			const __m128 Swap = Hi[i];
+			Hi[i] = Lo[i + 4];
+			Lo[i + 4] = Swap;
+		}
+
+		const __m128i Bias = _mm_set1_epi16(128);
+		for (int Row = 0; Row < 8; ++Row)
+		{
+			const __m128i Words = _mm_packs_epi32(_mm_cvtps_epi32(Lo[Row]), _mm_cvtps_epi32(Hi[Row]));
+			const __m128i Bytes = _mm_packus_epi16(_mm_add_epi16(Words, Bias), Words);
+			_mm_storel_epi64((__m128i*)(Out + Row * Stride), Bytes);
+		}
+#else
+		float Block[64];
+		for (int i = 0; i < 64; ++i)
+			Block[i] = Coefs[i] * Quant[i];
+
+		for (int Column = 0; Column < 8; ++Column)
+			InverseDCT8(Block + Column, 8);
+		for (int Row = 0; Row < 8; ++Row)
+			InverseDCT8(Block + Row * 8, 1);
+
+		for (int Row = 0; Row < 8; ++Row)
+		{
+			for (int Column = 0; Column < 8; ++Column)
+				Out[Row * Stride + Column] = Clamp8((int32_t)floorf(Block[Row * 8 + Column] + 0.5f) + 128);
+		}
+#endif
+	}
+
+	// Blocks without AC coefficients are flat
+	void InverseDCTFlat(int16_t DC, const float* Quant, uint8_t* Out, size_t Stride)
+	{
+		const uint8_t Value = Clamp8((int32_t)floorf(DC * Quant[0] + 0.5f) + 128);
+		for (int Row = 0; Row < 8; ++Row)
+			memset(Out + Row * Stride, Value, 8);
+	}
+
+#if ENABLE_SSE2_JPEG
+	// Interleaves 8 pixels of each channel with an opaque alpha into 32 bytes of RGBA
+	inline void StoreRGBA(__m128i R, __m128i G, __m128i B, uint8_t* Dest)
+	{
+		const __m128i RG = _mm_unpacklo_epi8(R, G);
+		const __m128i BA = _mm_unpacklo_epi8(B, _mm_set1_epi8(-1));
+		_mm_storeu_si128((__m128i*)Dest, _mm_unpacklo_epi16(RG, BA));
+		_mm_storeu_si128((__m128i*)(Dest + 16), _mm_unpackhi_epi16(RG, BA));
+	}
+
+	inline __m128i Load8(const uint8_t* Src)
+	{
+		return _mm_loadl_epi64((const __m128i*)Src);
+	}
+#endif
+
+	// Sums[x] = Input[x] * 3 + Other[x], or Input[x] without Other.  Sums[-1] and Sums[Width] repeat
+	// the edges so the horizontal filter needs no special cases.
+	void ColumnSums(const uint8_t* Input, const uint8_t* Other, uint32_t Width, int16_t* Sums)
+	{
+		uint32_t x = 0;
+#if ENABLE_SSE2_JPEG
+		const __m128i Zero = _mm_setzero_si128();
+		for (; x + 8 <= Width; x += 8)
+		{
+			__m128i Sum = _mm_unpacklo_epi8(Load8(Input + x), Zero);
+			if (Other)
+				Sum = _mm_add_epi16(_mm_add_epi16(Sum, _mm_add_epi16(Sum, Sum)), _mm_unpacklo_epi8(Load8(Other + x), Zero));
+			_mm_storeu_si128((__m128i*)(Sums + 1 + x), Sum);
+		}
+#endif
+		for (; x < Width; ++x)
+			Sums[1 + x] = (int16_t)(Other ? Input[x] * 3 + Other[x] : Input[x]);
+
+		Sums[0] = Sums[1];
+		Sums[Width + 1] = Sums[Width];
+	}
+
+	// Doubles a row of sums made by ColumnSums(): Out[2x] = (3 * Sums[x] + Sums[x - 1] + EvenBias) >> Shift
+	// and Out[2x + 1] = (3 * Sums[x] + Sums[x + 1] + OddBias) >> Shift
+	void UpsampleH2(const int16_t* Sums, uint32_t Width, int Shift, int EvenBias, int OddBias, uint8_t* Out)
+	{
+		uint32_t x = 0;
+#if ENABLE_SSE2_JPEG
+		const __m128i Even = _mm_set1_epi16((short)EvenBias);
+		const __m128i Odd = _mm_set1_epi16((short)OddBias);
+		const __m128i Count = _mm_cvtsi32_si128(Shift);
+		for (; x + 8 <= Width; x += 8)
+		{
+			const __m128i Center = _mm_loadu_si128((const __m128i*)(Sums + 1 + x));
+			const __m128i Left = _mm_loadu_si128((const __m128i*)(Sums + x));
+			const __m128i Right = _mm_loadu_si128((const __m128i*)(Sums + 2 + x));
+			const __m128i Center3 = _mm_add_epi16(Center, _mm_add_epi16(Center, Center));
+			const __m128i EvenOut = _mm_srl_epi16(_mm_add_epi16(_mm_add_epi16(Center3, Left), Even), Count);
+			const __m128i OddOut = _mm_srl_epi16(_mm_add_epi16(_mm_add_epi16(Center3, Right), Odd), Count);
+			const __m128i Bytes = _mm_unpacklo_epi8(_mm_packus_epi16(EvenOut, EvenOut), _mm_packus_epi16(OddOut, OddOut));
+			_mm_storeu_si128((__m128i*)(Out + x * 2), Bytes);
+		}
+#endif
+		for (; x < Width; ++x)
+		{
+			const int32_t Center3 = Sums[1 + x] * 3;
+			Out[x * 2 + 0] = (uint8_t)((Center3 + Sums[x] + EvenBias) >> Shift);
+			Out[x * 2 + 1] = (uint8_t)((Center3 + Sums[2 + x] + OddBias) >> Shift);
+		}
+	}
+
+	void GrayToRGBA(const uint8_t* Y, uint8_t* Dest, uint32_t Count)
+	{
+		uint32_t i = 0;
+#if ENABLE_SSE2_JPEG
+		for (; i + 8 <= Count; i += 8)
+		{
+			const __m128i Gray = Load8(Y + i);
+			StoreRGBA(Gray, Gray, Gray, Dest + i * 4);
+		}
+#endif
+		for (; i < Count; ++i)
+		{
+			Dest[i * 4 + 0] = Y[i];
+			Dest[i * 4 + 1] = Y[i];
+			Dest[i * 4 + 2] = Y[i];
+			Dest[i * 4 + 3] = 255;
+		}
+	}
+
+	void RGBToRGBA(const uint8_t* R, const uint8_t* G, const uint8_t* B, uint8_t* Dest, uint32_t Count)
+	{
+		uint32_t i = 0;
+#if ENABLE_SSE2_JPEG
+		for (; i + 8 <= Count; i += 8)
+			StoreRGBA(Load8(R + i), Load8(G + i), Load8(B + i), Dest + i * 4);
+#endif
+		for (; i < Count; ++i)
+		{
+			Dest[i * 4 + 0] = R[i];
+			Dest[i * 4 + 1] = G[i];
+			Dest[i * 4 + 2] = B[i];
+			Dest[i * 4 + 3] = 255;
+		}
+	}
+
+	void YCbCrToRGBA(const uint8_t* Y, const uint8_t* Cb, const uint8_t* Cr, uint8_t* Dest, uint32_t Count)
+	{
+		uint32_t i = 0;
+#if ENABLE_SSE2_JPEG
+		const __m128i Zero = _mm_setzero_si128();
+		const __m128i Center = _mm_set1_epi16(128);
+		const __m128i Round = _mm_set1_epi32(1 << 13);
+		// Pairs of (Cb, Cr) weights for _mm_madd_epi16
+		const __m128i ToR = _mm_setr_epi16(0, CR_TO_R, 0, CR_TO_R, 0, CR_TO_R, 0, CR_TO_R);
+		const __m128i ToG = _mm_setr_epi16(CB_TO_G, CR_TO_G, CB_TO_G, CR_TO_G, CB_TO_G, CR_TO_G, CB_TO_G, CR_TO_G);
+		const __m128i ToB = _mm_setr_epi16(CB_TO_B, 0, CB_TO_B, 0, CB_TO_B, 0, CB_TO_B, 0);
+
+		for (; i + 8 <= Count; i += 8)
+		{
+			const __m128i Luma = _mm_unpacklo_epi8(Load8(Y + i), Zero);
+			const __m128i Blue = _mm_sub_epi16(_mm_unpacklo_epi8(Load8(Cb + i), Zero), Center);
+			const __m128i Red = _mm_sub_epi16(_mm_unpacklo_epi8(Load8(Cr + i), Zero), Center);
+			const __m128i ChromaLo = _mm_unpacklo_epi16(Blue, Red);
+			const __m128i ChromaHi = _mm_unpackhi_epi16(Blue, Red);
+
+			__m128i Channels[3];
+			const __m128i Weights[3] = { ToR, ToG, ToB };
+			for (int c = 0; c < 3; ++c)
+			{
+				const __m128i Lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(ChromaLo, Weights[c]), Round), 14);
+				const __m128i Hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(ChromaHi, Weights[c]), Round), 14);
+				const __m128i Sum = _mm_add_epi16(Luma, _mm_packs_epi32(Lo, Hi));
+				Channels[c] = _mm_packus_epi16(Sum, Sum);
+			}
+
+			StoreRGBA(Channels[0], Channels[1], Channels[2], Dest + i * 4);
+		}
+#endif
+		for (; i < Count; ++i)
+		{
+			const int32_t Blue = Cb[i] - 128;
+			const int32_t Red = Cr[i] - 128;
+			Dest[i * 4 + 0] = Clamp8(Y[i] + ((Red * CR_TO_R + (1 << 13)) >> 14));
+			Dest[i * 4 + 1] = Clamp8(Y[i] + ((Blue * CB_TO_G + Red * CR_TO_G + (1 << 13)) >> 14));
+			Dest[i * 4 + 2] = Clamp8(Y[i] + ((Blue * CB_TO_B + (1 << 13)) >> 14));
+			Dest[i * 4 + 3] = 255;
+		}
+	}
+}
+
+void JpegDecoder::BitReader::Fill()
+{
+	while (Count <= 56)
+	{
+		uint32_t Byte = 0;
+		if (!MarkerHit && Ptr < End)
+		{
+			Byte = *Ptr;
+			if (Byte != 0xFF)
+				++Ptr;
+			else if (Ptr + 1 < End && Ptr[1] == 0x00)
+				Ptr += 2;
+			else
+			{
+				// Stopped in front of the marker, the rest of the scan decodes as zeros
+				MarkerHit = true;
+				Byte = 0;
+			}
+		}
+		Bits |= (uint64_t)Byte << (56 - Count);
+		Count += 8;
+	}
+}
+
+uint32_t JpegDecoder::BitReader::GetBits(uint32_t Num)
+{
+	if (Count < (int32_t)Num)
+		Fill();
+	const uint32_t Value = (uint32_t)(Bits >> (64 - Num));
+	Bits <<= Num;
+	Count -= Num;
+	return Value;
+}
+
+int32_t JpegDecoder::BitReader::DecodeSymbol(const HuffmanTable& Table)
+{
+	if (Count < 16)
+		Fill();
+
+	const uint32_t Entry = Table.Fast[Bits >> (64 - FAST_BITS)];
+	if (Entry != 0)
+	{
+		Bits <<= Entry >> 8;
+		Count -= Entry >> 8;
+		return Entry & 0xFF;
+	}
+
+	for (uint32_t Length = FAST_BITS + 1; Length <= 16; ++Length)
+	{
+		const int32_t Code = (int32_t)(Bits >> (64 - Length));
+		if (Code <= Table.MaxCode[Length])
+		{
+			Bits <<= Length;
+			Count -= Length;
+			return Table.Values[(Code + Table.ValueOffset[Length]) & 0xFF];
+		}
+	}
+
+	return -1;
+}
+
+bool JpegDecoder::BitReader::Restart()
+{
+	Bits = 0;
+	Count = 0;
+
+	// The marker is where the data stopped, unless the interval was corrupt and ended early
+	for (; Ptr + 1 < End; ++Ptr)
+	{
+		if (Ptr[0] != 0xFF || Ptr[1] == 0x00 || Ptr[1] == 0xFF)
+			continue;
+		if (Ptr[1] < 0xD0 || Ptr[1] > 0xD7)
+			break;
+
+		Ptr += 2;
+		MarkerHit = false;
+		return true;
+	}
+
+	MarkerHit = true;
+	return false;
+}
+
+JpegDecoder::JpegDecoder() :
+	m_Data(nullptr),
+	m_End(nullptr),
+	m_Ptr(nullptr),
+	m_Width(0),
+	m_Height(0),
+	m_NumComponents(0)
+{
+}
+
+bool JpegDecoder::ReadHeader(const uint8_t* Data, size_t Size)
+{
+	m_Data = Data;
+	m_End = Data + Size;
+	m_Ptr = Data + 2;
+	m_Width = 0;
+	m_Height = 0;
+	m_NumComponents = 0;
+	m_RestartInterval = 0;
+	m_TransformRGB = false;
+	m_NumScanComponents = 0;
+	memset(m_QuantDefined, 0, sizeof(m_QuantDefined));
+	for (auto& Tables : m_HuffmanTables)
+	{
+		for (auto& Table : Tables)
+			Table.Defined = false;
+	}
+
+	if (Size < 4 || Data[0] != 0xFF || Data[1] != 0xD8)
+		return false;
+
+	return ReadMarkers() && m_Width != 0;
+}
+
+bool JpegDecoder::ReadMarkers()
+{
+	for (;;)
+	{
+		// Skips fill bytes and, after a scan, entropy-coded data that was not read
+		while (m_Ptr + 1 < m_End &&
+			(m_Ptr[0] != 0xFF || m_Ptr[1] == 0x00 || m_Ptr[1] == 0xFF || (m_Ptr[1] >= 0xD0 && m_Ptr[1] <= 0xD7)))
+		{
+			++m_Ptr;
+		}
+		if (m_Ptr + 4 > m_End)
+			return false;
+
+		const uint8_t Marker = m_Ptr[1];
+		m_Ptr += 2;
+
+		// End of image
+		if (Marker == 0xD9)
+			return false;
+
+		const uint32_t Length = Read16(m_Ptr);
+		if (Length < 2 || Length > (size_t)(m_End - m_Ptr))
+			return false;
+
+		const uint8_t* Segment = m_Ptr + 2;
+		const uint32_t SegmentLength = Length - 2;
+
+		switch (Marker)
+		{
+		case 0xC0:		// Baseline
+		case 0xC1:		// Extended sequential, Huffman-coded
+			if (m_Width != 0 || !ReadFrame(Segment, SegmentLength))
+				return false;
+			break;
+
+		case 0xC4:
+			if (!ReadHuffmanTables(Segment, SegmentLength))
+				return false;
+			break;
+
+		case 0xDB:
+			if (!ReadQuantTables(Segment, SegmentLength))
+				return false;
+			break;
+
+		case 0xDD:
+			if (SegmentLength < 2)
+				return false;
+			m_RestartInterval = Read16(Segment);
+			break;
+
+		case 0xDA:
+			// Left at the start of the segment, DecodeScan() reads it
+			return m_Width != 0;
+
+		case 0xEE:
+			// Adobe, a transform of 0 means the components are not YCbCr
+			if (SegmentLength >= 12 && memcmp(Segment, "Adobe", 5) == 0)
+				m_TransformRGB = Segment[11] == 0;
+			break;
+
+		default:
+			// Progressive, lossless, hierarchical and arithmetic-coded frames
+			if (Marker >= 0xC2 && Marker <= 0xCF)
+				return false;
+			break;
+		}
+
+		m_Ptr += Length;
+	}
+}
+
+bool JpegDecoder::ReadFrame(const uint8_t* Segment, uint32_t Length)
+{
+	if (Length < 6 || Segment[0] != 8)
+		return false;
+
+	const uint32_t Height = Read16(Segment + 1);
+	const uint32_t Width = Read16(Segment + 3);
+	const uint32_t NumComponents = Segment[5];
+
+	// A height of 0 would come in a DNL marker after the first scan
+	if (Width == 0 || Height == 0 || (uint64_t)Width * Height > MAX_PIXELS)
+		return false;
+	if ((NumComponents != 1 && NumComponents != 3) || Length < 6 + NumComponents * 3)
+		return false;
+
+	m_MaxH = 1;
+	m_MaxV = 1;
+	for (uint32_t i = 0; i < NumComponents; ++i)
+	{
+		Component& Comp = m_Components[i];
+		Comp.Id = Segment[6 + i * 3];
+		Comp.H = Segment[7 + i * 3] >> 4;
+		Comp.V = Segment[7 + i * 3] & 15;
+		Comp.QuantTable = Segment[8 + i * 3];
+		if (Comp.H < 1 || Comp.H > 4 || Comp.V < 1 || Comp.V > 4 || Comp.QuantTable > 3)
+			return false;
+
+		// A single component is never interleaved, its sampling factors do not matter
+		if (NumComponents == 1)
+			Comp.H = Comp.V = 1;
+
+		m_MaxH = Comp.H > m_MaxH ? Comp.H : m_MaxH;
+		m_MaxV = Comp.V > m_MaxV ? Comp.V : m_MaxV;
+	}
+
+	m_MCUsX = (Width + m_MaxH * 8 - 1) / (m_MaxH * 8);
+	m_MCUsY = (Height + m_MaxV * 8 - 1) / (m_MaxV * 8);
+
+	for (uint32_t i = 0; i < NumComponents; ++i)
+	{
+		Component& Comp = m_Components[i];
+		Comp.Width = (Width * Comp.H + m_MaxH - 1) / m_MaxH;
+		Comp.Height = (Height * Comp.V + m_MaxV - 1) / m_MaxV;
+		Comp.BlocksX = m_MCUsX * Comp.H;
+		Comp.BlocksY = m_MCUsY * Comp.V;
+		Comp.Stride = Comp.BlocksX * 8;
+	}
+
+	// Without a JFIF or Adobe marker, component ids 'R', 'G' and 'B' mean an RGB image
+	if (NumComponents == 3 && m_Components[0].Id == 'R' && m_Components[1].Id == 'G' && m_Components[2].Id == 'B')
+		m_TransformRGB = true;
+
+	m_Width = Width;
+	m_Height = Height;
+	m_NumComponents = NumComponents;
+	return true;
+}
+
+bool JpegDecoder::ReadQuantTables(const uint8_t* Segment, uint32_t Length)
+{
+	// Scale factors of the AAN IDCT, cos(k * pi / 16) * sqrt(2) for k > 0
+	float Scales[8];
+	Scales[0] = 1.0f;
+	for (int k = 1; k < 8; ++k)
+		Scales[k] = (float)(cos(k * 3.14159265358979 / 16.0) * 1.41421356237310);
+
+	const uint8_t* const End = Segment + Length;
+	while (Segment < End)
+	{
+		const uint32_t Precision = Segment[0] >> 4;
+		const uint32_t Index = Segment[0] & 15;
+		const uint32_t TableSize = Precision ? 128 : 64;
+		if (Index > 3 || Precision > 1 || (size_t)(End - Segment) < 1 + TableSize)
+			return false;
+		++Segment;
+
+		for (uint32_t k = 0; k < 64; ++k)
+		{
+			const uint32_t Value = Precision ? Read16(Segment + k * 2) : Segment[k];
+			const uint32_t Natural = ZIGZAG[k];
+			// The 1/8 of the two passes is folded in too
+			m_QuantTables[Index][Natural] = Value * Scales[Natural >> 3] * Scales[Natural & 7] * 0.125f;
+		}
+
+		m_QuantDefined[Index] = true;
+		Segment += TableSize;
+	}
+
+	return true;
+}
+
+bool JpegDecoder::ReadHuffmanTables(const uint8_t* Segment, uint32_t Length)
+{
+	const uint8_t* const End = Segment + Length;
+	while (Segment < End)
+	{
+		if (End - Segment < 17)
+			return false;
+
+		const uint32_t Class = Segment[0] >> 4;
+		const uint32_t Index = Segment[0] & 15;
+		if (Class > 1 || Index > 3)
+			return false;
+
+		const uint8_t* Counts = Segment + 1;
+		uint32_t NumSymbols = 0;
+		for (int i = 0; i < 16; ++i)
+			NumSymbols += Counts[i];
+		if (NumSymbols > 256 || (size_t)(End - Segment) < 17 + NumSymbols)
+			return false;
+
+		HuffmanTable& Table = m_HuffmanTables[Class][Index];
+		memcpy(Table.Values, Segment + 17, NumSymbols);
+		memset(Table.Fast, 0, sizeof(Table.Fast));
+
+		// Canonical codes, consecutive within a length
+		uint32_t Code = 0;
+		uint32_t Symbol = 0;
+		for (uint32_t Length = 1; Length <= 16; ++Length)
+		{
+			const uint32_t Count = Counts[Length - 1];
+			Table.ValueOffset[Length] = (int32_t)Symbol - (int32_t)Code;
+
+			for (uint32_t i = 0; i < Count; ++i, ++Code, ++Symbol)
+			{
+				if (Length <= FAST_BITS)
+				{
+					const uint32_t Shift = FAST_BITS - Length;
+					for (uint32_t Fill = 0; Fill < (1u << Shift); ++Fill)
+						Table.Fast[(Code << Shift) | Fill] = (uint16_t)((Length << 8) | Table.Values[Symbol]);
+				}
+			}
+
+			// More codes than the length can hold
+			if (Code > (1u << Length))
+				return false;
+
+			Table.MaxCode[Length] = Count ? (int32_t)Code - 1 : -1;
+			Code <<= 1;
+		}
+		Table.MaxCode[17] = 0x7FFFFFFF;
+		Table.Defined = true;
+
+		// Most AC coefficients are small, their code and value are read with one lookup
+		memset(Table.FastAC, 0, sizeof(Table.FastAC));
+		for (uint32_t Bits = 0; Class == 1 && Bits < (1u << FAST_BITS); ++Bits)
+		{
+			const uint32_t Entry = Table.Fast[Bits];
+			const uint32_t CodeLength = Entry >> 8;
+			const uint32_t Run = (Entry >> 4) & 15;
+			const uint32_t Size = Entry & 15;
+			if (Entry == 0 || Size == 0 || CodeLength + Size > FAST_BITS)
+				continue;
+
+			const uint32_t Value = (Bits >> (FAST_BITS - CodeLength - Size)) & ((1u << Size) - 1);
+			const int32_t Coef = Extend(Value, Size);
+			if (Coef >= -128 && Coef <= 127)
+				Table.FastAC[Bits] = (int16_t)((Coef * 256) | (Run << 4) | (CodeLength + Size));
+		}
+
+		Segment += 17 + NumSymbols;
+	}
+
+	return true;
+}
+
+bool JpegDecoder::Decode(uint8_t* Dest, size_t RowPitch)
+{
+	const uint32_t NumParts = BeginDecode();
+	if (NumParts == 0 || !DecodeParts(0, NumParts))
+		return false;
+
+	ConvertRows(Dest, RowPitch, 0, m_Height);
+	return true;
+}
+
+uint32_t JpegDecoder::BeginDecode()
+{
+	if (m_Width == 0)
+		return 0;
+
+	for (uint32_t i = 0; i < m_NumComponents; ++i)
+	{
+		Component& Comp = m_Components[i];
+		Comp.Plane.resize(Comp.Stride * Comp.BlocksY * 8);
+	}
+
+	if (!ReadScanHeader())
+		return 0;
+
+	m_Intervals.clear();
+	if (m_RestartInterval != 0 && !FindRestartIntervals())
+		m_Intervals.clear();
+
+	return m_Intervals.empty() ? 1 : (uint32_t)m_Intervals.size();
+}
+
+bool JpegDecoder::DecodeParts(uint32_t FirstPart, uint32_t NumParts)
+{
+	const uint8_t* End;
+
+	if (m_Intervals.empty())
+	{
+		// Baseline files can split the components over several scans, with tables in between
+		for (;;)
+		{
+			if (!DecodeMCUs(m_Ptr, 0, m_ScanMCUs, End))
+				return false;
+
+			m_Ptr = End;
+			if (!ReadMarkers())
+				return true;
+			if (!ReadScanHeader())
+				return false;
+		}
+	}
+
+	for (uint32_t Part = FirstPart; Part < FirstPart + NumParts; ++Part)
+	{
+		const uint32_t FirstMCU = Part * m_RestartInterval;
+		const uint32_t NumMCUs = m_ScanMCUs - FirstMCU < m_RestartInterval ? m_ScanMCUs - FirstMCU : m_RestartInterval;
+		if (!DecodeMCUs(m_Intervals[Part], FirstMCU, NumMCUs, End))
+			return false;
+	}
+
+	return true;
+}
+
+bool JpegDecoder::ReadScanHeader()
+{
+	const uint32_t Length = Read16(m_Ptr);
+	const uint8_t* Segment = m_Ptr + 2;
+	if (Length < 3)
+		return false;
+
+	m_NumScanComponents = Segment[0];
+	if (m_NumScanComponents < 1 || m_NumScanComponents > m_NumComponents || Length < 6 + m_NumScanComponents * 2)
+		return false;
+
+	uint32_t BlocksPerMCU = 0;
+	for (uint32_t i = 0; i < m_NumScanComponents; ++i)
+	{
+		const uint32_t Id = Segment[1 + i * 2];
+		const uint32_t Tables = Segment[2 + i * 2];
+
+		uint32_t Index = 0;
+		while (Index < m_NumComponents && m_Components[Index].Id != Id)
+			++Index;
+		if (Index == m_NumComponents)
+			return false;
+
+		Component& Comp = m_Components[Index];
+		Comp.DCTable = Tables >> 4;
+		Comp.ACTable = Tables & 15;
+		if (Comp.DCTable > 3 || Comp.ACTable > 3 || !m_HuffmanTables[0][Comp.DCTable].Defined ||
+			!m_HuffmanTables[1][Comp.ACTable].Defined || !m_QuantDefined[Comp.QuantTable])
+		{
+			return false;
+		}
+
+		m_ScanComponents[i] = Index;
+		BlocksPerMCU += Comp.H * Comp.V;
+	}
+
+	// Sequential scans always cover the whole spectrum
+	const uint8_t* Spectral = Segment + 1 + m_NumScanComponents * 2;
+	if (Spectral[0] != 0 || Spectral[1] != 63 || (m_NumScanComponents > 1 && BlocksPerMCU > 10))
+		return false;
+
+	// A scan of a single component is not interleaved: its MCU is one block and the blocks cover
+	// the component, not the padded MCUs
+	const Component& First = m_Components[m_ScanComponents[0]];
+	m_ScanBlocksX = m_NumScanComponents == 1 ? (First.Width + 7) / 8 : m_MCUsX;
+	m_ScanMCUs = m_ScanBlocksX * (m_NumScanComponents == 1 ? (First.Height + 7) / 8 : m_MCUsY);
+
+	m_Ptr += Length;
+	return true;
+}
+
+bool JpegDecoder::FindRestartIntervals()
+{
+	// Entropy-coded data only has 0xFF in front of a stuffed zero, a fill byte or a marker, so the
+	// intervals are found without decoding anything
+	m_Intervals.push_back(m_Ptr);
+
+	const uint8_t* Ptr = m_Ptr;
+	uint32_t EndMarker = 0xD9;
+	for (;;)
+	{
+		Ptr = (const uint8_t*)memchr(Ptr, 0xFF, m_End - Ptr);
+		if (Ptr == nullptr || Ptr + 1 >= m_End)
+			break;
+
+		if (Ptr[1] == 0xFF)
+			++Ptr;
+		else if (Ptr[1] == 0x00)
+			Ptr += 2;
+		else if (Ptr[1] >= 0xD0 && Ptr[1] <= 0xD7)
+		{
+			Ptr += 2;
+			m_Intervals.push_back(Ptr);
+		}
+		else
+		{
+			EndMarker = Ptr[1];
+			break;
+		}
+	}
+
+	// Only a single scan can be split, and only if no marker is missing
+	const uint32_t Expected = (m_ScanMCUs + m_RestartInterval - 1) / m_RestartInterval;
+	return EndMarker == 0xD9 && m_Intervals.size() == Expected;
+}
+
+bool JpegDecoder::DecodeMCUs(const uint8_t* Data, uint32_t FirstMCU, uint32_t NumMCUs, const uint8_t*& End)
+{
+	BitReader Reader = { Data, m_End, 0, 0, false };
+	int32_t DCPred[MAX_COMPONENTS] = {};
+
+	alignas(16) int16_t Coefs[64];
+	uint32_t LastIndex;
+
+	for (uint32_t MCU = FirstMCU; MCU < FirstMCU + NumMCUs; ++MCU)
+	{
+		if (m_RestartInterval != 0 && MCU != FirstMCU && MCU % m_RestartInterval == 0)
+		{
+			// A missing marker is not fatal, the predictions are reset either way
+			Reader.Restart();
+			for (uint32_t i = 0; i < MAX_COMPONENTS; ++i)
+				DCPred[i] = 0;
+		}
+
+		const uint32_t X = MCU % m_ScanBlocksX;
+		const uint32_t Y = MCU / m_ScanBlocksX;
+
+		for (uint32_t i = 0; i < m_NumScanComponents; ++i)
+		{
+			Component& Comp = m_Components[m_ScanComponents[i]];
+			const uint32_t H = m_NumScanComponents == 1 ? 1 : Comp.H;
+			const uint32_t V = m_NumScanComponents == 1 ? 1 : Comp.V;
+
+			for (uint32_t BlockY = 0; BlockY < V; ++BlockY)
+			{
+				for (uint32_t BlockX = 0; BlockX < H; ++BlockX)
+				{
+					if (!DecodeBlock(Reader, Comp, DCPred[i], Coefs, LastIndex))
+						return false;
+
+					uint8_t* Out = Comp.Plane.data() + ((Y * V + BlockY) * 8) * Comp.Stride + (X * H + BlockX) * 8;
+					if (LastIndex == 0)
+						InverseDCTFlat(Coefs[0], m_QuantTables[Comp.QuantTable], Out, Comp.Stride);
+					else
+						InverseDCT(Coefs, m_QuantTables[Comp.QuantTable], Out, Comp.Stride);
+				}
+			}
+		}
+	}
+
+	End = Reader.Ptr;
+	return true;
+}
+
+bool JpegDecoder::DecodeBlock(BitReader& Reader, const Component& Comp, int32_t& DCPred, int16_t Coefs[64], uint32_t& LastIndex) const
+{
+	memset(Coefs, 0, 64 * sizeof(int16_t));
+
+	const int32_t DCSize = Reader.DecodeSymbol(m_HuffmanTables[0][Comp.DCTable]);
+	if (DCSize < 0 || DCSize > 11)
+		return false;
+	if (DCSize != 0)
+		DCPred += Extend(Reader.GetBits(DCSize), DCSize);
+	Coefs[0] = (int16_t)DCPred;
+
+	const HuffmanTable& AC = m_HuffmanTables[1][Comp.ACTable];
+	LastIndex = 0;
+	for (uint32_t k = 1; k < 64; ++k)
+	{
+		if (Reader.Count < 16)
+			Reader.Fill();
+
+		const int32_t Fast = AC.FastAC[Reader.Bits >> (64 - FAST_BITS)];
+		if (Fast != 0)
+		{
+			k += (Fast >> 4) & 15;
+			if (k > 63)
+				return false;
+
+			Reader.Bits <<= Fast & 15;
+			Reader.Count -= Fast & 15;
+			Coefs[ZIGZAG[k]] = (int16_t)(Fast >> 8);
+			LastIndex = k;
+			continue;
+		}
+
+		const int32_t RunSize = Reader.DecodeSymbol(AC);
+		if (RunSize < 0)
+			return false;
+
+		const uint32_t Run = RunSize >> 4;
+		const uint32_t Size = RunSize & 15;
+		if (Size == 0)
+		{
+			// End of block, unless it is a run of 16 zeros
+			if (Run != 15)
+				break;
+			k += 15;
+			continue;
+		}
+
+		k += Run;
+		if (k > 63)
+			return false;
+
+		Coefs[ZIGZAG[k]] = (int16_t)Extend(Reader.GetBits(Size), Size);
+		LastIndex = k;
+	}
+
+	return true;
+}
+
+const uint8_t* JpegDecoder::UpsampleRow(const Component& Comp, uint32_t Row, uint8_t* Buffer, int16_t* Sums) const
+{
+	const uint32_t ScaleX = m_MaxH / Comp.H;
+	const uint32_t ScaleY = m_MaxV / Comp.V;
+	const bool Integral = ScaleX * Comp.H == m_MaxH && ScaleY * Comp.V == m_MaxV;
+
+	if (Integral && ScaleX == 1 && ScaleY == 1)
+		return Comp.Plane.data() + Row * Comp.Stride;
+
+	const uint32_t Width = Comp.Width;
+	const uint32_t Near = Row * Comp.V / m_MaxV;
+	const uint8_t* Input = Comp.Plane.data() + Near * Comp.Stride;
+
+	// Triangle filters of libjpeg for 2:1 ratios: each output sample is 3/4 of the nearest input
+	// sample and 1/4 of the next nearest, in each upsampled direction
+	if (Integral && ScaleY == 2 && (ScaleX == 1 || ScaleX == 2))
+	{
+		// The row above for the top half of an input row, the row below for the bottom half
+		uint32_t Far = Near;
+		if ((Row & 1) == 0 && Near > 0)
+			Far = Near - 1;
+		else if ((Row & 1) != 0 && Near + 1 < Comp.Height)
+			Far = Near + 1;
+		const uint8_t* Other = Comp.Plane.data() + Far * Comp.Stride;
+
+		if (ScaleX == 1)
+		{
+			const uint32_t Bias = (Row & 1) ? 2 : 1;
+			for (uint32_t x = 0; x < Width; ++x)
+				Buffer[x] = (uint8_t)((Input[x] * 3 + Other[x] + Bias) >> 2);
+			return Buffer;
+		}
+
+		ColumnSums(Input, Other, Width, Sums);
+		UpsampleH2(Sums, Width, 4, 8, 7, Buffer);
+		return Buffer;
+	}
+
+	if (Integral && ScaleX == 2 && ScaleY == 1)
+	{
+		ColumnSums(Input, nullptr, Width, Sums);
+		UpsampleH2(Sums, Width, 2, 1, 2, Buffer);
+		return Buffer;
+	}
+
+	// Other ratios replicate the nearest sample
+	for (uint32_t x = 0; x < m_Width; ++x)
+		Buffer[x] = Input[x * Comp.H / m_MaxH];
+	return Buffer;
+}
+
+void JpegDecoder::ConvertRows(uint8_t* Dest, size_t RowPitch, uint32_t FirstRow, uint32_t NumRows) const
+{
+	// Upsampled rows are up to one sample wider than the image
+	std::vector<uint8_t> Buffers(MAX_COMPONENTS * (m_Width + 16));
+	std::vector<int16_t> Sums(m_Width + 16);
+
+	for (uint32_t Row = FirstRow; Row < FirstRow + NumRows; ++Row)
+	{
+		const uint8_t* Rows[MAX_COMPONENTS];
+		for (uint32_t i = 0; i < m_NumComponents; ++i)
+			Rows[i] = UpsampleRow(m_Components[i], Row, Buffers.data() + i * (m_Width + 16), Sums.data());
+
+		uint8_t* Out = Dest + Row * RowPitch;
+		if (m_NumComponents == 1)
+			GrayToRGBA(Rows[0], Out, m_Width);
+		else if (m_TransformRGB)
+			RGBToRGBA(Rows[0], Rows[1], Rows[2], Out, m_Width);
+		else
+			YCbCrToRGBA(Rows[0], Rows[1], Rows[2], Out, m_Width);
+	}
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Decoder for baseline JPEG: 8-bit Huffman-coded sequential frames (SOF0 and SOF1) with one or three
+// components, any sampling factors and restart intervals.  Progressive and arithmetic-coded files
+// are rejected.  Chroma is upsampled with the same triangle filter as libjpeg; the IDCT and the
+// color conversion use SSE2 when the target has it.
+//
+// A decoder holds the state of one image and nothing is shared between decoders, so images can be
+// decoded on several threads at once.  It does not depend on the platform and builds without the
+// Windows headers.
+class JpegDecoder
+{
+public:
+	JpegDecoder();
+
+	// Reads the markers up to the first scan.  Data is not copied and must stay valid until Decode()
+	// returns.  Returns false if it is not a JPEG this decoder can handle.
+	bool ReadHeader(const uint8_t* Data, size_t Size);
+
+	uint32_t GetWidth() const { return m_Width; }
+	uint32_t GetHeight() const { return m_Height; }
+	uint32_t GetNumComponents() const { return m_NumComponents; }
+
+	// Writes Height rows of Width RGBA8 pixels, the first one at Dest and each RowPitch bytes after
+	// the previous one.  RowPitch can be that of a texture in an upload buffer.  Returns false if the
+	// entropy-coded data is corrupt; rows already written are left as they are.
+	bool Decode(uint8_t* Dest, size_t RowPitch);
+
+	// Decode() in steps, so large images can be spread over several threads.  BeginDecode() returns
+	// the number of parts of the entropy-coded data, or 0 on error: one per restart interval when the
+	// image is a single scan with restart markers, otherwise 1.  Parts are independent and
+	// DecodeParts() can run for different parts at the same time.  Once every part is decoded,
+	// ConvertRows() writes the RGBA8 rows in [FirstRow, FirstRow + NumRows) and can do the same for
+	// different rows.
+	uint32_t BeginDecode();
+	bool DecodeParts(uint32_t FirstPart, uint32_t NumParts);
+	void ConvertRows(uint8_t* Dest, size_t RowPitch, uint32_t FirstRow, uint32_t NumRows) const;
+
+private:
+	static const uint32_t FAST_BITS = 9;
+	static const uint32_t MAX_COMPONENTS = 3;
+
+	struct HuffmanTable
+	{
+		uint16_t Fast[1 << FAST_BITS];	// (Length << 8) | Symbol of the codes up to FAST_BITS long, 0 if longer
+		int16_t FastAC[1 << FAST_BITS];	// AC tables: (Value << 8) | (Run << 4) | Length of the code and value bits
+										// when they fit in FAST_BITS and the value in 8 bits, 0 otherwise
+		int32_t MaxCode[18];			// Largest code of each length, -1 if there is none
+		int32_t ValueOffset[17];		// Index in Values of the first code of each length, minus that code
+		uint8_t Values[256];
+		bool Defined;
+	};
+
+	struct Component
+	{
+		uint32_t Id;
+		uint32_t H, V;					// Sampling factors
+		uint32_t QuantTable;
+		uint32_t DCTable, ACTable;
+		uint32_t Width, Height;			// Of the samples, before upsampling
+		uint32_t BlocksX, BlocksY;		// Of the plane, the image padded to whole MCUs
+		size_t Stride;
+		std::vector<uint8_t> Plane;		// Samples after the IDCT
+	};
+
+	// Entropy-coded data, most significant bit first.  After a marker it returns zeros.
+	struct BitReader
+	{
+		const uint8_t* Ptr;
+		const uint8_t* End;
+		uint64_t Bits;
+		int32_t Count;
+		bool MarkerHit;
+
+		void Fill();
+		uint32_t GetBits(uint32_t Num);
+		int32_t DecodeSymbol(const HuffmanTable& Table);
+		bool Restart();
+	};
+
+	bool ReadMarkers();
+	bool ReadFrame(const uint8_t* Segment, uint32_t Length);
+	bool ReadQuantTables(const uint8_t* Segment, uint32_t Length);
+	bool ReadHuffmanTables(const uint8_t* Segment, uint32_t Length);
+	bool ReadScanHeader();
+	// Also returns where the data stopped, past the last MCU
+	bool DecodeMCUs(const uint8_t* Data, uint32_t FirstMCU, uint32_t NumMCUs, const uint8_t*& End);
+	bool DecodeBlock(BitReader& Reader, const Component& Comp, int32_t& DCPred, int16_t Coefs[64], uint32_t& LastIndex) const;
+	bool FindRestartIntervals();
+	const uint8_t* UpsampleRow(const Component& Comp, uint32_t Row, uint8_t* Buffer, int16_t* Sums) const;
+
+	const uint8_t* m_Data;
+	const uint8_t* m_End;
+	const uint8_t* m_Ptr;				// Next marker to read
+
+	uint32_t m_Width;
+	uint32_t m_Height;
+	uint32_t m_NumComponents;
+	uint32_t m_MaxH, m_MaxV;
+	uint32_t m_MCUsX, m_MCUsY;
+	uint32_t m_RestartInterval;
+	bool m_TransformRGB;				// Adobe marker says the components are RGB, not YCbCr
+
+	Component m_Components[MAX_COMPONENTS];
+	uint32_t m_ScanComponents[MAX_COMPONENTS];
+	uint32_t m_NumScanComponents;
+	uint32_t m_ScanBlocksX;				// MCUs in a row of the scan
+	uint32_t m_ScanMCUs;
+
+	// Start of the entropy-coded data of each restart interval, when they can be decoded apart
+	std::vector<const uint8_t*> m_Intervals;
+
+	// Dequantization folded with the scale factors of the IDCT, natural order
+	float m_QuantTables[4][64];
+	bool m_QuantDefined[4];
+	HuffmanTable m_HuffmanTables[2][4];	// DC and AC
+};
@@ -0,0 +1,160 @@
+#include "LinearAllocator.h"
+#include "../Core/GraphicContext.h"
+
+using namespace std;
+using namespace Renderer;
+using Microsoft::WRL::ComPtr;
+
+LinearAllocationPage::LinearAllocationPage(ID3D12Resource* pResource, size_t Size) :
+	GpuResource(pResource, D3D12_RESOURCE_STATE_GENERIC_READ),
+	m_CpuVirtualAddress(nullptr),
+	m_Size(Size)
+{
+	m_GpuVirtualAddress = m_pResource->GetGPUVirtualAddress();
+
+	// Upload heaps can stay mapped for their whole lifetime
+	CD3DX12_RANGE ReadRange(0, 0);
+	ThrowIfFailed(m_pResource->Map(0, &ReadRange, &m_CpuVirtualAddress));
+}
+
+LinearAllocationPage::~LinearAllocationPage()
+{
+	if (m_pResource != nullptr && m_CpuVirtualAddress != nullptr)
+		m_pResource->Unmap(0, nullptr);
+	m_CpuVirtualAddress = nullptr;
+}
+
+LinearAllocator::LinearAllocator(size_t PageSize) :
+	m_PageSize(PageSize),
+	m_CurOffset(0),
+	m_CurPage(nullptr)
+{
+}
+
+void LinearAllocator::Destroy()
+{
+	m_CurPage = nullptr;
+	m_CurOffset = 0;
+	m_RetiredPages.clear();
+	m_PendingPages.clear();
+	m_AvailablePages = queue<LinearAllocationPage*>();
+
+	for (LinearAllocationPage* Page : m_LargePages)
+		delete Page;
+	m_LargePages.clear();
+
+	while (!m_PendingLargePages.empty())
+	{
+		delete m_PendingLargePages.front().second;
+		m_PendingLargePages.pop_front();
+	}
+
+	m_PagePool.clear();
+	m_Fence = nullptr;
+}
+
+DynAlloc LinearAllocator::Allocate(size_t SizeInBytes, size_t Alignment)
+{
+	ASSERT(Math::IsPowerOfTwo(Alignment), "Alignment must be a power of two");
+
+	const size_t AlignedSize = Math::AlignUp(SizeInBytes, Alignment);
+
+	if (AlignedSize > m_PageSize)
+		return AllocateLargePage(AlignedSize);
+
+	m_CurOffset = Math::AlignUp(m_CurOffset, Alignment);
+
+	if (m_CurPage == nullptr || m_CurOffset + AlignedSize > m_PageSize)
+	{
+		if (m_CurPage != nullptr)
+			m_RetiredPages.push_back(m_CurPage);
+
+		m_CurPage = RequestPage();
+		m_CurOffset = 0;
+	}
+
+	DynAlloc Ret(*m_CurPage, m_CurOffset, AlignedSize);
+	Ret.DataPtr = (uint8_t*)m_CurPage->m_CpuVirtualAddress + m_CurOffset;
+	Ret.GpuAddress = m_CurPage->GetGpuVirtualAddress() + m_CurOffset;
+
+	m_CurOffset += AlignedSize;
+
+	return Ret;
+}
+
+void LinearAllocator::CleanupUsedPages(ID3D12Fence* pFence, uint64_t FenceValue)
+{
+	m_Fence = pFence;
+
+	if (m_CurPage != nullptr)
+	{
+		m_RetiredPages.push_back(m_CurPage);
+		m_CurPage = nullptr;
+		m_CurOffset = 0;
+	}
+
+	for (LinearAllocationPage* Page : m_RetiredPages)
+		m_PendingPages.push_back(make_pair(FenceValue, Page));
+	m_RetiredPages.clear();
+
+	for (LinearAllocationPage* Page : m_LargePages)
+		m_PendingLargePages.push_back(make_pair(FenceValue, Page));
+	m_LargePages.clear();
+
+	// Oversized pages are not worth keeping around, free them as soon as the GPU is done
+	const uint64_t CompletedValue = m_Fence->GetCompletedValue();
+	while (!m_PendingLargePages.empty() && m_PendingLargePages.front().first <= CompletedValue)
+	{
+		delete m_PendingLargePages.front().second;
+		m_PendingLargePages.pop_front();
+	}
+}
+
+LinearAllocationPage* LinearAllocator::RequestPage()
+{
+	if (m_Fence != nullptr)
+	{
+		const uint64_t CompletedValue = m_Fence->GetCompletedValue();
+		while (!m_PendingPages.empty() && m_PendingPages.front().first <= CompletedValue)
+		{
+			m_AvailablePages.push(m_PendingPages.front().second);
+			m_PendingPages.pop_front();
+		}
+	}
+
+	if (!m_AvailablePages.empty())
+	{
+		LinearAllocationPage* Page = m_AvailablePages.front();
+		m_AvailablePages.pop();
+		return Page;
+	}
+
+	LinearAllocationPage* Page = CreateNewPage(m_PageSize);
+	m_PagePool.emplace_back(Page);
+	return Page;
+}
+
+LinearAllocationPage* LinearAllocator::CreateNewPage(size_t PageSize)
+{
+	ComPtr<ID3D12Resource> pBuffer;
+
+	CD3DX12_HEAP_PROPERTIES HeapProps(D3D12_HEAP_TYPE_UPLOAD);
+	CD3DX12_RESOURCE_DESC BufferDesc = CD3DX12_RESOURCE_DESC::Buffer(PageSize);
+	ThrowIfFailed(device->CreateCommittedResource(&HeapProps, D3D12_HEAP_FLAG_NONE, &BufferDesc,
+		D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, MY_IID_PPV_ARGS(&pBuffer)));
+	pBuffer->SetName(L"LinearAllocator Page");
+
+	return new LinearAllocationPage(pBuffer.Get(), PageSize);
+}
+
+DynAlloc LinearAllocator::AllocateLargePage(size_t SizeInBytes)
+{
+	LinearAllocationPage* Page = CreateNewPage(SizeInBytes);
+	m_LargePages.push_back(Page);
+
+	DynAlloc Ret(*Page, 0, SizeInBytes);
+	Ret.DataPtr = Page->m_CpuVirtualAddress;
+	Ret.GpuAddress = Page->GetGpuVirtualAddress();
+
+	return Ret;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "../../Core/Common.h"
+#include "GpuResource.h"
+#include <deque>
+#include <queue>
+
+// Constant buffer views must start on a 256 byte boundary
+#define DEFAULT_ALIGN D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT
+
+// A chunk of upload memory handed out by the linear allocator.  It is only valid until the frame it
+// was allocated in has been retired.
+struct DynAlloc
+{
+	DynAlloc(GpuResource& BaseResource, size_t ThisOffset, size_t ThisSize)
+		: Buffer(BaseResource), Offset(ThisOffset), Size(ThisSize), DataPtr(nullptr), GpuAddress(D3D12_GPU_VIRTUAL_ADDRESS_NULL) {}
+
+	GpuResource& Buffer;					// The page it lives in
+	size_t Offset;							// Offset from the start of the page
+	size_t Size;							// Reserved size, a multiple of the alignment
+	void* DataPtr;							// CPU-writeable address
+	D3D12_GPU_VIRTUAL_ADDRESS GpuAddress;	// GPU-visible address
+};
+
+// A persistently mapped upload heap buffer
+class LinearAllocationPage : public GpuResource
+{
+public:
+	LinearAllocationPage(ID3D12Resource* pResource, size_t Size);
+	~LinearAllocationPage();
+
+	void* m_CpuVirtualAddress;
+	size_t m_Size;
+};
+
+// Hands out short-lived chunks of upload memory by bumping an offset through large mapped pages.  The
+// pages used while recording a frame are handed back with CleanupUsedPages() together with the fence
+// value that frame signals, and are only reused once the GPU has reached it.  Memory written for a
+// frame therefore stays untouched while any frame in flight may still be reading it.
+class LinearAllocator
+{
+public:
+	static const size_t DEFAULT_PAGE_SIZE = 2 * 1024 * 1024;
+
+	LinearAllocator(size_t PageSize = DEFAULT_PAGE_SIZE);
+	~LinearAllocator() { Destroy(); }
+
+	void Destroy();
+
+	DynAlloc Allocate(size_t SizeInBytes, size_t Alignment = DEFAULT_ALIGN);
+
+	// Retires every page used since the last call.  They become available again once pFence has
+	// reached FenceValue.
+	void CleanupUsedPages(ID3D12Fence* pFence, uint64_t FenceValue);
+
+	size_t GetPageCount() const { return m_PagePool.size(); }
+
+private:
+	LinearAllocationPage* RequestPage();
+	LinearAllocationPage* CreateNewPage(size_t PageSize);
+	DynAlloc AllocateLargePage(size_t SizeInBytes);
+
+	size_t m_PageSize;
+	size_t m_CurOffset;
+	LinearAllocationPage* m_CurPage;
+
+	std::vector<std::unique_ptr<LinearAllocationPage>> m_PagePool;
+	std::vector<LinearAllocationPage*> m_RetiredPages;		// Filled this frame
+	std::queue<LinearAllocationPage*> m_AvailablePages;
+	std::deque<std::pair<uint64_t, LinearAllocationPage*>> m_PendingPages;
+
+	// Allocations bigger than a page get a page of their own that is released with its frame
+	std::vector<LinearAllocationPage*> m_LargePages;
+	std::deque<std::pair<uint64_t, LinearAllocationPage*>> m_PendingLargePages;
+
+	Microsoft::WRL::ComPtr<ID3D12Fence> m_Fence;
+};
@@ -0,0 +1,331 @@
+#include "MipGenerator.h"
+#include "../../Core/Graphics/Color.h"
+#include <algorithm>
+#include <cmath>
+#include <ppl.h>
+
+using namespace std;
+
+namespace
+{
+	const float PI = 3.14159265358979f;
+
+	// Radius of the Kaiser filter in texels of the level being made, and the shape of its window
+	const float KAISER_RADIUS = 3.0f;
+	const float KAISER_ALPHA = 4.0f;
+
+	// Rows of a level filtered by one task
+	const uint32_t ROWS_PER_TASK = 16;
+
+	// Alpha scales tried by the coverage search
+	const float MAX_ALPHA_SCALE = 4.0f;
+	const int COVERAGE_ITERATIONS = 10;
+
+	struct ChannelTables
+	{
+		float SRGBToLinear[256];
+		float UnormToFloat[256];
+		uint8_t LinearToSRGB[65536];		// Indexed by the linear value times 65535
+
+		ChannelTables()
+		{
+			for (int i = 0; i < 256; ++i)
+			{
+				UnormToFloat[i] = i / 255.0f;
+				SRGBToLinear[i] = Color(i / 255.0f, 0.0f, 0.0f).FromSRGB().R();
+			}
+
+			// Fine enough steps that the darkest sRGB values still round as the curve does
+			for (int i = 0; i < 65536; ++i)
+				LinearToSRGB[i] = (uint8_t)(Color(i / 65535.0f, 0.0f, 0.0f).ToSRGB().R() * 255.0f + 0.5f);
+		}
+	};
+
+	const ChannelTables& GetTables()
+	{
+		static const ChannelTables Tables;
+		return Tables;
+	}
+
+	// Source texels and weights of each texel of a level along one axis, NumTaps of them per texel
+	struct FilterTaps
+	{
+		uint32_t NumTaps;
+		vector<int32_t> First;		// Before wrapping or clamping, consecutive for the taps of a texel
+		vector<uint32_t> Indices;
+		vector<float> Weights;
+	};
+
+	float Bessel0(float X)
+	{
+		// Power series of the modified Bessel function of the first kind, order 0
+		float Sum = 1.0f;
+		float Term = 1.0f;
+		for (int k = 1; k < 20; ++k)
+		{
+			const float Factor = X / (2.0f * k);
+			Term *= Factor * Factor;
+			Sum += Term;
+		}
+		return Sum;
+	}
+
+	float Kaiser(float T)
+	{
+		const float Window = 1.0f - (T / KAISER_RADIUS) * (T / KAISER_RADIUS);
+		if (Window <= 0.0f)
+			return 0.0f;
+
+		const float Sinc = fabsf(T) < 1e-5f ? 1.0f : sinf(PI * T) / (PI * T);
+		return Sinc * Bessel0(KAISER_ALPHA * sqrtf(Window)) / Bessel0(KAISER_ALPHA);
+	}
+
+	uint32_t AddressTexel(int32_t Texel, uint32_t Size, bool Wrap)
+	{
+		if (Wrap)
+			return (uint32_t)(((Texel % (int32_t)Size) + (int32_t)Size) % (int32_t)Size);
+		return (uint32_t)min(max(Texel, 0), (int32_t)Size - 1);
+	}
+
+	void BuildTaps(MipFilter Filter, bool Wrap, uint32_t SrcSize, uint32_t DestSize, FilterTaps& Taps)
+	{
+		// Source texels per texel of the level, between 2 and 3
+		const float Scale = (float)SrcSize / DestSize;
+		const float Radius = Filter == kMipFilterBox ? Scale * 0.5f : KAISER_RADIUS * Scale;
+
+		Taps.NumTaps = 0;
+		Taps.First.resize(DestSize);
+		for (uint32_t x = 0; x < DestSize; ++x)
+		{
+			const float Center = (x + 0.5f) * Scale;
+			// Texels overlapping (Center - Radius, Center + Radius)
+			const int32_t First = (int32_t)floorf(Center - Radius);
+			const int32_t Last = (int32_t)ceilf(Center + Radius) - 1;
+			Taps.First[x] = First;
+			Taps.NumTaps = max(Taps.NumTaps, (uint32_t)(Last - First + 1));
+		}
+
+		Taps.Indices.resize(DestSize * Taps.NumTaps);
+		Taps.Weights.resize(DestSize * Taps.NumTaps);
+		for (uint32_t x = 0; x < DestSize; ++x)
+		{
+			const float Center = (x + 0.5f) * Scale;
+			uint32_t* Indices = &Taps.Indices[x * Taps.NumTaps];
+			float* Weights = &Taps.Weights[x * Taps.NumTaps];
+
+			float Sum = 0.0f;
+			for (uint32_t t = 0; t < Taps.NumTaps; ++t)
+			{
+				const int32_t Texel = Taps.First[x] + (int32_t)t;
+				if (Filter == kMipFilterBox)
+				{
+					// The part of the texel under the footprint
+					const float Left = max((float)Texel, Center - Radius);
+					const float Right = min(Texel + 1.0f, Center + Radius);
+					Weights[t] = max(Right - Left, 0.0f);
+				}
+				else
+					Weights[t] = Kaiser((Texel + 0.5f - Center) / Scale);
+
+				Indices[t] = AddressTexel(Texel, SrcSize, Wrap);
+				Sum += Weights[t];
+			}
+
+			for (uint32_t t = 0; t < Taps.NumTaps; ++t)
+				Weights[t] /= Sum;
+		}
+	}
+
+	template <typename Function>
+	void ForEachBlock(uint32_t NumRows, bool Parallel, const Function& Body)
+	{
+		const uint32_t NumBlocks = (NumRows + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+		auto Block = [&](uint32_t Index)
+		{
+			Body(Index * ROWS_PER_TASK, min(NumRows, (Index + 1) * ROWS_PER_TASK));
+		};
+
+		if (Parallel && NumBlocks > 1)
+			concurrency::parallel_for(0u, NumBlocks, Block);
+		else
+		{
+			for (uint32_t Index = 0; Index < NumBlocks; ++Index)
+				Block(Index);
+		}
+	}
+
+	// Share of the texels whose alpha, times Scale, passes the test
+	float AlphaCoverage(const XMVECTOR* Texels, size_t Count, float Cutoff, float Scale)
+	{
+		size_t Passed = 0;
+		for (size_t i = 0; i < Count; ++i)
+			Passed += XMVectorGetW(Texels[i]) * Scale > Cutoff ? 1 : 0;
+		return (float)Passed / Count;
+	}
+
+	void EncodeRow(const XMVECTOR* Texels, uint32_t Width, const uint8_t* LinearToSRGB, float AlphaScale, uint8_t* Dest)
+	{
+		for (uint32_t x = 0; x < Width; ++x, Dest += 4)
+		{
+			XMFLOAT4 Texel;
+			XMStoreFloat4(&Texel, Texels[x]);
+
+			if (LinearToSRGB != nullptr)
+			{
+				Dest[0] = LinearToSRGB[(uint32_t)(Texel.x * 65535.0f + 0.5f)];
+				Dest[1] = LinearToSRGB[(uint32_t)(Texel.y * 65535.0f + 0.5f)];
+				Dest[2] = LinearToSRGB[(uint32_t)(Texel.z * 65535.0f + 0.5f)];
+			}
+			else
+			{
+				Dest[0] = (uint8_t)(Texel.x * 255.0f + 0.5f);
+				Dest[1] = (uint8_t)(Texel.y * 255.0f + 0.5f);
+				Dest[2] = (uint8_t)(Texel.z * 255.0f + 0.5f);
+			}
+			Dest[3] = (uint8_t)(min(Texel.w * AlphaScale, 1.0f) * 255.0f + 0.5f);
+		}
+	}
+}
+
+uint32_t MipGenerator::GetNumLevels(uint32_t Width, uint32_t Height, uint32_t MaxLevels)
+{
+	uint32_t NumLevels = 1;
+	for (uint32_t Size = max(Width, Height); Size > 1; Size >>= 1)
+		++NumLevels;
+	return MaxLevels != 0 ? min(NumLevels, MaxLevels) : NumLevels;
+}
+
+void MipGenerator::Generate(const MipChainOptions& Options, uint32_t Width, uint32_t Height, uint32_t NumLevels,
+	const D3D12_MEMCPY_DEST* Levels, bool Parallel)
+{
+	if (NumLevels < 2)
+		return;
+
+	const ChannelTables& Tables = GetTables();
+	const float* ToLinear = Options.SRGB ? Tables.SRGBToLinear : Tables.UnormToFloat;
+	const uint8_t* ToSRGB = Options.SRGB ? Tables.LinearToSRGB : nullptr;
+	const bool KeepCoverage = Options.AlphaCutoff > 0.0f;
+
+	float TargetCoverage = 0.0f;
+	if (KeepCoverage)
+	{
+		const uint32_t Cutoff = (uint32_t)(Options.AlphaCutoff * 255.0f);
+		size_t Passed = 0;
+		for (uint32_t y = 0; y < Height; ++y)
+		{
+			const uint8_t* Row = (const uint8_t*)Levels[0].pData + y * Levels[0].RowPitch;
+			for (uint32_t x = 0; x < Width; ++x)
+				Passed += Row[x * 4 + 3] > Cutoff ? 1 : 0;
+		}
+		TargetCoverage = (float)Passed / ((size_t)Width * Height);
+	}
+
+	// The level above, in float, and the one being made
+	vector<XMVECTOR> Source;
+	vector<XMVECTOR> Dest;
+	uint32_t SrcWidth = Width;
+	uint32_t SrcHeight = Height;
+
+	for (uint32_t Level = 1; Level < NumLevels; ++Level)
+	{
+		const uint32_t DestWidth = max(SrcWidth >> 1, 1u);
+		const uint32_t DestHeight = max(SrcHeight >> 1, 1u);
+
+		FilterTaps Columns, Rows;
+		BuildTaps(Options.Filter, Options.WrapEdges, SrcWidth, DestWidth, Columns);
+		BuildTaps(Options.Filter, Options.WrapEdges, SrcHeight, DestHeight, Rows);
+
+		Dest.resize((size_t)DestWidth * DestHeight);
+
+		ForEachBlock(DestHeight, Parallel, [&](uint32_t FirstRow, uint32_t EndRow)
+		{
+			// Level 0 is only read as RGBA8.  The rows this block needs are converted once, in order
+			// of their taps so the rows before and after the edges are there too.
+			vector<XMVECTOR> Band;
+			const int32_t BandFirst = Rows.First[FirstRow];
+			if (Level == 1)
+			{
+				const uint32_t BandRows = (uint32_t)(Rows.First[EndRow - 1] - BandFirst) + Rows.NumTaps;
+				Band.resize((size_t)BandRows * SrcWidth);
+				for (uint32_t r = 0; r < BandRows; ++r)
+				{
+					const uint32_t y = AddressTexel(BandFirst + (int32_t)r, SrcHeight, Options.WrapEdges);
+					const uint8_t* In = (const uint8_t*)Levels[0].pData + y * Levels[0].RowPitch;
+					XMVECTOR* Out = &Band[(size_t)r * SrcWidth];
+					for (uint32_t x = 0; x < SrcWidth; ++x, In += 4)
+						Out[x] = XMVectorSet(ToLinear[In[0]], ToLinear[In[1]], ToLinear[In[2]], In[3] * (1.0f / 255.0f));
+				}
+			}
+
+			vector<XMVECTOR> Filtered(SrcWidth);
+			for (uint32_t y = FirstRow; y < EndRow; ++y)
+			{
+				// Down the columns into one row of the source width
+				for (uint32_t x = 0; x < SrcWidth; ++x)
+					Filtered[x] = XMVectorZero();
+
+				for (uint32_t t = 0; t < Rows.NumTaps; ++t)
+				{
+					const float Weight = Rows.Weights[y * Rows.NumTaps + t];
+					if (Weight == 0.0f)
+						continue;
+
+					const XMVECTOR* In = Level == 1 ?
+						&Band[(size_t)(Rows.First[y] + (int32_t)t - BandFirst) * SrcWidth] :
+						&Source[(size_t)Rows.Indices[y * Rows.NumTaps + t] * SrcWidth];
+					const XMVECTOR W = XMVectorReplicate(Weight);
+					for (uint32_t x = 0; x < SrcWidth; ++x)
+						Filtered[x] = XMVectorMultiplyAdd(In[x], W, Filtered[x]);
+				}
+
+				// Then along it.  The negative lobes of the Kaiser filter can overshoot.
+				XMVECTOR* Out = &Dest[(size_t)y * DestWidth];
+				for (uint32_t x = 0; x < DestWidth; ++x)
+				{
+					const uint32_t* Indices = &Columns.Indices[x * Columns.NumTaps];
+					const float* Weights = &Columns.Weights[x * Columns.NumTaps];
+
+					XMVECTOR Sum = XMVectorZero();
+					for (uint32_t t = 0; t < Columns.NumTaps; ++t)
+						Sum = XMVectorMultiplyAdd(Filtered[Indices[t]], XMVectorReplicate(Weights[t]), Sum);
+					Out[x] = XMVectorSaturate(Sum);
+				}
+
+				if (!KeepCoverage)
+					EncodeRow(Out, DestWidth, ToSRGB, 1.0f, (uint8_t*)Levels[Level].pData + y * Levels[Level].RowPitch);
+			}
+		});
+
+		if (KeepCoverage)
+		{
+			// Bisection on the scale that gives the coverage of level 0 (Castaño, "Computing alpha
+			// mipmaps").  Filtering blurs alpha-tested edges, without it foliage thins out with distance.
+			float AlphaScale = 1.0f;
+			if (AlphaCoverage(Dest.data(), Dest.size(), Options.AlphaCutoff, 1.0f) != TargetCoverage)
+			{
+				float Low = 0.0f;
+				float High = MAX_ALPHA_SCALE;
+				for (int i = 0; i < COVERAGE_ITERATIONS; ++i)
+				{
+					const float Middle = (Low + High) * 0.5f;
+					if (AlphaCoverage(Dest.data(), Dest.size(), Options.AlphaCutoff, Middle) < TargetCoverage)
+						Low = Middle;
+					else
+						High = Middle;
+				}
+				AlphaScale = (Low + High) * 0.5f;
+			}
+
+			ForEachBlock(DestHeight, Parallel, [&](uint32_t FirstRow, uint32_t EndRow)
+			{
+				for (uint32_t y = FirstRow; y < EndRow; ++y)
+					EncodeRow(&Dest[(size_t)y * DestWidth], DestWidth, ToSRGB, AlphaScale, (uint8_t*)Levels[Level].pData + y * Levels[Level].RowPitch);
+			});
+		}
+
+		// The next level is filtered from this one as it came out, before any alpha scaling
+		Source.swap(Dest);
+		SrcWidth = DestWidth;
+		SrcHeight = DestHeight;
+	}
+}
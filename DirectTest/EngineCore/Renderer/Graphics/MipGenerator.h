@@ -0,0 +1,39 @@
+#pragma once
+
+#include "../../Core/Common.h"
+
+enum MipFilter
+{
+	kMipFilterBox,			// Average of the texels under each texel of the level
+	kMipFilterKaiser		// Kaiser-windowed sinc three texels of the level wide either side, sharper
+};
+
+struct MipChainOptions
+{
+	MipChainOptions() : Filter(kMipFilterKaiser), SRGB(true), WrapEdges(true), AlphaCutoff(0.0f), MaxLevels(0) {}
+
+	MipFilter Filter;
+	bool SRGB;				// Color is sRGB encoded and filtered in linear space.  Alpha is always linear.
+	bool WrapEdges;			// Filters read across the edges, for textures sampled with wrap addressing
+	float AlphaCutoff;		// Of alpha-tested textures, each level keeps the share of texels above it that
+							// level 0 has.  0 leaves alpha as filtered.
+	uint32_t MaxLevels;		// 0 for the whole chain
+};
+
+// Generates the mip chain of an RGBA8 texture on the CPU.  Each level is filtered from the one above
+// in float, a texel per SSE register through DirectXMath, first down the columns and then along the
+// row.  Sizes need not be powers of two: as in D3D a level is half the one above rounded down, and
+// the filters are laid over the texels by the true ratio between the two sizes.
+//
+// sRGB goes through tables built with Color::FromSRGB() and Color::ToSRGB().
+class MipGenerator
+{
+public:
+	static uint32_t GetNumLevels(uint32_t Width, uint32_t Height, uint32_t MaxLevels = 0);
+
+	// Level 0 is read from Levels[0] and levels 1 to NumLevels - 1 are written to the others, e.g.
+	// the footprints of a TextureUpload.  With Parallel the rows of each level are spread over the
+	// PPL pool.
+	static void Generate(const MipChainOptions& Options, uint32_t Width, uint32_t Height, uint32_t NumLevels,
+		const D3D12_MEMCPY_DEST* Levels, bool Parallel = false);
+};
@@ -0,0 +1,304 @@
+#include "OffsetAllocator.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static inline uint32_t LowestSetBit(uint64_t Value)
+{
+#ifdef _MSC_VER
+	unsigned long Index;
+	_BitScanForward64(&Index, Value);
+	return Index;
+#else
+	return (uint32_t)__builtin_ctzll(Value);
+#endif
+}
+
+static inline uint32_t HighestSetBit(uint64_t Value)
+{
+#ifdef _MSC_VER
+	unsigned long Index;
+	_BitScanReverse64(&Index, Value);
+	return Index;
+#else
+	return 63 - (uint32_t)__builtin_clzll(Value);
+#endif
+}
+
+TlsfAllocator::TlsfAllocator() :
+	m_TotalSize(0),
+	m_Granularity(1),
+	m_UsedSize(0),
+	m_NumAllocations(0),
+	m_FirstLevelBitmap(0)
+{
+}
+
+void TlsfAllocator::Create(uint64_t Size, uint64_t Granularity)
+{
+	Destroy();
+
+	m_TotalSize = Size - Size % Granularity;
+	m_Granularity = Granularity;
+
+	uint32_t First = NewBlock();
+	m_Blocks[First].Offset = 0;
+	m_Blocks[First].Size = m_TotalSize;
+	InsertFree(First);
+}
+
+void TlsfAllocator::Destroy()
+{
+	m_Blocks.clear();
+	m_UnusedSlots.clear();
+	m_UsedSize = 0;
+	m_NumAllocations = 0;
+	m_TotalSize = 0;
+
+	m_FirstLevelBitmap = 0;
+	for (uint32_t fl = 0; fl < FL_COUNT; ++fl)
+	{
+		m_SecondLevelBitmap[fl] = 0;
+		for (uint32_t sl = 0; sl < SL_COUNT; ++sl)
+			m_FreeHeads[fl][sl] = NONE;
+	}
+}
+
+TlsfAllocator::Handle TlsfAllocator::Allocate(uint64_t Size, uint64_t Alignment, uint64_t& OffsetOut)
+{
+	if (Alignment < m_Granularity)
+		Alignment = m_Granularity;
+
+	uint64_t Units = (Size + m_Granularity - 1) / m_Granularity;
+	if (Units == 0)
+		Units = 1;
+
+	// Ask for enough room to align the start inside whichever block is found
+	const uint64_t AlignmentUnits = Alignment / m_Granularity;
+	uint32_t Index = FindFreeBlock(Units + AlignmentUnits - 1);
+	if (Index == NONE)
+		return INVALID_HANDLE;
+
+	RemoveFree(Index);
+
+	const uint64_t Offset = m_Blocks[Index].Offset;
+	const uint64_t AlignedOffset = (Offset + Alignment - 1) & ~(Alignment - 1);
+	if (AlignedOffset != Offset)
+	{
+		// The padding in front goes back to the free lists
+		uint32_t Aligned = Split(Index, (AlignedOffset - Offset) / m_Granularity);
+		InsertFree(Index);
+		Index = Aligned;
+	}
+
+	if (m_Blocks[Index].Size > Units * m_Granularity)
+		InsertFree(Split(Index, Units));
+
+	m_Blocks[Index].IsFree = false;
+	m_UsedSize += m_Blocks[Index].Size;
+	++m_NumAllocations;
+
+	OffsetOut = m_Blocks[Index].Offset;
+	return Index;
+}
+
+void TlsfAllocator::Free(Handle Allocation)
+{
+	if (Allocation == INVALID_HANDLE)
+		return;
+
+	uint32_t Index = Allocation;
+	m_Blocks[Index].IsFree = true;
+	m_UsedSize -= m_Blocks[Index].Size;
+	--m_NumAllocations;
+
+	// Merge with the physical neighbours so free memory never sits in adjacent pieces
+	uint32_t Prev = m_Blocks[Index].PrevPhysical;
+	if (Prev != NONE && m_Blocks[Prev].IsFree)
+	{
+		RemoveFree(Prev);
+		m_Blocks[Prev].Size += m_Blocks[Index].Size;
+		m_Blocks[Prev].NextPhysical = m_Blocks[Index].NextPhysical;
+		if (m_Blocks[Index].NextPhysical != NONE)
+			m_Blocks[m_Blocks[Index].NextPhysical].PrevPhysical = Prev;
+		ReleaseBlock(Index);
+		Index = Prev;
+	}
+
+	uint32_t Next = m_Blocks[Index].NextPhysical;
+	if (Next != NONE && m_Blocks[Next].IsFree)
+	{
+		RemoveFree(Next);
+		m_Blocks[Index].Size += m_Blocks[Next].Size;
+		m_Blocks[Index].NextPhysical = m_Blocks[Next].NextPhysical;
+		if (m_Blocks[Next].NextPhysical != NONE)
+			m_Blocks[m_Blocks[Next].NextPhysical].PrevPhysical = Index;
+		ReleaseBlock(Next);
+	}
+
+	InsertFree(Index);
+}
+
+OffsetAllocatorStats TlsfAllocator::GetStats() const
+{
+	OffsetAllocatorStats Stats = {};
+	Stats.TotalSize = m_TotalSize;
+	Stats.UsedSize = m_UsedSize;
+	Stats.FreeSize = m_TotalSize - m_UsedSize;
+	Stats.NumAllocations = m_NumAllocations;
+
+	for (const Block& B : m_Blocks)
+	{
+		if (!B.IsUsed || !B.IsFree)
+			continue;
+
+		++Stats.NumFreeBlocks;
+		if (B.Size > Stats.LargestFreeBlock)
+			Stats.LargestFreeBlock = B.Size;
+	}
+
+	return Stats;
+}
+
+void TlsfAllocator::MappingInsert(uint64_t Units, uint32_t& FirstLevel, uint32_t& SecondLevel) const
+{
+	if (Units < SL_COUNT)
+	{
+		// Small sizes are binned linearly in the first row
+		FirstLevel = 0;
+		SecondLevel = (uint32_t)Units;
+	}
+	else
+	{
+		uint32_t Msb = HighestSetBit(Units);
+		SecondLevel = (uint32_t)(Units >> (Msb - SL_LOG2)) ^ SL_COUNT;
+		FirstLevel = Msb - SL_LOG2 + 1;
+	}
+}
+
+void TlsfAllocator::MappingSearch(uint64_t Units, uint32_t& FirstLevel, uint32_t& SecondLevel) const
+{
+	// Round up to the next bin so any block found there is large enough
+	if (Units >= SL_COUNT)
+		Units += (1ull << (HighestSetBit(Units) - SL_LOG2)) - 1;
+
+	MappingInsert(Units, FirstLevel, SecondLevel);
+}
+
+uint32_t TlsfAllocator::FindFreeBlock(uint64_t Units) const
+{
+	if (Units * m_Granularity > m_TotalSize)
+		return NONE;
+
+	uint32_t FirstLevel, SecondLevel;
+	MappingSearch(Units, FirstLevel, SecondLevel);
+	if (FirstLevel >= FL_COUNT)
+		return NONE;
+
+	uint32_t SecondLevelMap = m_SecondLevelBitmap[FirstLevel] & (~0u << SecondLevel);
+	if (SecondLevelMap == 0)
+	{
+		uint64_t FirstLevelMap = FirstLevel + 1 < 64 ? m_FirstLevelBitmap & (~0ull << (FirstLevel + 1)) : 0;
+		if (FirstLevelMap == 0)
+			return NONE;
+
+		FirstLevel = LowestSetBit(FirstLevelMap);
+		SecondLevelMap = m_SecondLevelBitmap[FirstLevel];
+	}
+
+	SecondLevel = LowestSetBit(SecondLevelMap);
+	return m_FreeHeads[FirstLevel][SecondLevel];
+}
+
+uint32_t TlsfAllocator::NewBlock()
+{
+	uint32_t Index;
+	if (!m_UnusedSlots.empty())
+	{
+		Index = m_UnusedSlots.back();
+		m_UnusedSlots.pop_back();
+	}
+	else
+	{
+		Index = (uint32_t)m_Blocks.size();
+		m_Blocks.emplace_back();
+	}
+
+	Block& B = m_Blocks[Index];
+	B.Offset = 0;
+	B.Size = 0;
+	B.PrevPhysical = B.NextPhysical = NONE;
+	B.PrevFree = B.NextFree = NONE;
+	B.IsFree = false;
+	B.IsUsed = true;
+	return Index;
+}
+
+void TlsfAllocator::ReleaseBlock(uint32_t Index)
+{
+	m_Blocks[Index].IsUsed = false;
+	m_Blocks[Index].IsFree = false;
+	m_UnusedSlots.push_back(Index);
+}
+
+void TlsfAllocator::InsertFree(uint32_t Index)
+{
+	uint32_t FirstLevel, SecondLevel;
+	MappingInsert(m_Blocks[Index].Size / m_Granularity, FirstLevel, SecondLevel);
+
+	uint32_t Head = m_FreeHeads[FirstLevel][SecondLevel];
+	m_Blocks[Index].IsFree = true;
+	m_Blocks[Index].PrevFree = NONE;
+	m_Blocks[Index].NextFree = Head;
+	if (Head != NONE)
+		m_Blocks[Head].PrevFree = Index;
+
+	m_FreeHeads[FirstLevel][SecondLevel] = Index;
+	m_FirstLevelBitmap |= 1ull << FirstLevel;
+	m_SecondLevelBitmap[FirstLevel] |= 1u << SecondLevel;
+}
+
+void TlsfAllocator::RemoveFree(uint32_t Index)
+{
+	uint32_t FirstLevel, SecondLevel;
+	MappingInsert(m_Blocks[Index].Size / m_Granularity, FirstLevel, SecondLevel);
+
+	Block& B = m_Blocks[Index];
+	if (B.PrevFree != NONE)
+		m_Blocks[B.PrevFree].NextFree = B.NextFree;
+	else
+		m_FreeHeads[FirstLevel][SecondLevel] = B.NextFree;
+
+	if (B.NextFree != NONE)
+		m_Blocks[B.NextFree].PrevFree = B.PrevFree;
+
+	B.PrevFree = B.NextFree = NONE;
+	B.IsFree = false;
+
+	if (m_FreeHeads[FirstLevel][SecondLevel] == NONE)
+	{
+		m_SecondLevelBitmap[FirstLevel] &= ~(1u << SecondLevel);
+		if (m_SecondLevelBitmap[FirstLevel] == 0)
+			m_FirstLevelBitmap &= ~(1ull << FirstLevel);
+	}
+}
+
+uint32_t TlsfAllocator::Split(uint32_t Index, uint64_t Units)
+{
+	// NewBlock may grow the vector, so no references are held across it
+	uint32_t Remainder = NewBlock();
+
+	const uint64_t SplitSize = Units * m_Granularity;
+	m_Blocks[Remainder].Offset = m_Blocks[Index].Offset + SplitSize;
+	m_Blocks[Remainder].Size = m_Blocks[Index].Size - SplitSize;
+	m_Blocks[Remainder].PrevPhysical = Index;
+	m_Blocks[Remainder].NextPhysical = m_Blocks[Index].NextPhysical;
+	if (m_Blocks[Index].NextPhysical != NONE)
+		m_Blocks[m_Blocks[Index].NextPhysical].PrevPhysical = Remainder;
+
+	m_Blocks[Index].Size = SplitSize;
+	m_Blocks[Index].NextPhysical = Remainder;
+
+	return Remainder;
+}
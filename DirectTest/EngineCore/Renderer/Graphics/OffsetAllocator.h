@@ -0,0 +1,137 @@
+#pragma once
+
+// Bookkeeping for carving ranges out of a block of memory.  Nothing in here touches the device, the
+// allocators only deal with offsets, so GPU heaps, descriptor ranges or anything else linear can be
+// managed with them and they can be exercised on their own.
+
+#include <cstdint>
+#include <vector>
+
+struct OffsetAllocatorStats
+{
+	uint64_t TotalSize;
+	uint64_t UsedSize;
+	uint64_t FreeSize;
+	uint64_t LargestFreeBlock;
+	uint32_t NumAllocations;
+	uint32_t NumFreeBlocks;
+
+	// Fraction of the memory handed out
+	float Utilization() const { return TotalSize == 0 ? 0.0f : (float)UsedSize / (float)TotalSize; }
+
+	// 0 when all the free memory is a single block, close to 1 when it is scattered in small pieces
+	float Fragmentation() const { return FreeSize == 0 ? 0.0f : 1.0f - (float)LargestFreeBlock / (float)FreeSize; }
+};
+
+// Two-level segregated fit allocator.  Free blocks are binned by the power of two of their size and
+// then linearly into SL_COUNT sub-ranges, with a bitmap per level, so both allocation and release
+// are O(1) and neighbouring free blocks are merged straight away.  Every size and offset is a
+// multiple of the granularity given to Create().
+class TlsfAllocator
+{
+public:
+	typedef uint32_t Handle;
+	static const Handle INVALID_HANDLE = 0xFFFFFFFF;
+
+	TlsfAllocator();
+
+	void Create(uint64_t Size, uint64_t Granularity);
+	void Destroy();
+
+	// Returns INVALID_HANDLE when there is no free range large enough.  Alignment must be a power of
+	// two, anything below the granularity is implied.
+	Handle Allocate(uint64_t Size, uint64_t Alignment, uint64_t& OffsetOut);
+	void Free(Handle Allocation);
+
+	uint64_t GetOffset(Handle Allocation) const { return m_Blocks[Allocation].Offset; }
+	uint64_t GetSize(Handle Allocation) const { return m_Blocks[Allocation].Size; }
+	uint64_t GetTotalSize() const { return m_TotalSize; }
+	bool IsEmpty() const { return m_NumAllocations == 0; }
+
+	OffsetAllocatorStats GetStats() const;
+
+private:
+	static const uint32_t SL_LOG2 = 4;
+	static const uint32_t SL_COUNT = 1 << SL_LOG2;
+	static const uint32_t FL_COUNT = 64 - SL_LOG2 + 1;
+	static const uint32_t NONE = 0xFFFFFFFF;
+
+	struct Block
+	{
+		uint64_t Offset;
+		uint64_t Size;
+		uint32_t PrevPhysical;
+		uint32_t NextPhysical;
+		uint32_t PrevFree;
+		uint32_t NextFree;
+		bool IsFree;
+		bool IsUsed;			// false once the slot itself has been recycled
+	};
+
+	void MappingInsert(uint64_t Units, uint32_t& FirstLevel, uint32_t& SecondLevel) const;
+	void MappingSearch(uint64_t Units, uint32_t& FirstLevel, uint32_t& SecondLevel) const;
+	uint32_t FindFreeBlock(uint64_t Units) const;
+
+	uint32_t NewBlock();
+	void ReleaseBlock(uint32_t Index);
+	void InsertFree(uint32_t Index);
+	void RemoveFree(uint32_t Index);
+	uint32_t Split(uint32_t Index, uint64_t Units);
+
+	uint64_t m_TotalSize;
+	uint64_t m_Granularity;
+	uint64_t m_UsedSize;
+	uint32_t m_NumAllocations;
+
+	uint64_t m_FirstLevelBitmap;
+	uint32_t m_SecondLevelBitmap[FL_COUNT];
+	uint32_t m_FreeHeads[FL_COUNT][SL_COUNT];
+
+	std::vector<Block> m_Blocks;
+	std::vector<uint32_t> m_UnusedSlots;
+};
+
+// Bump allocator for memory whose allocations all die at the same time, e.g. resources that only
+// live for one frame.  Reset() releases everything.
+class LinearOffsetAllocator
+{
+public:
+	LinearOffsetAllocator() : m_TotalSize(0), m_Head(0), m_NumAllocations(0) {}
+
+	void Create(uint64_t Size) { m_TotalSize = Size; Reset(); }
+
+	// Returns false when the block is full
+	bool Allocate(uint64_t Size, uint64_t Alignment, uint64_t& OffsetOut)
+	{
+		uint64_t Offset = (m_Head + Alignment - 1) & ~(Alignment - 1);
+		if (Offset + Size > m_TotalSize)
+			return false;
+
+		OffsetOut = Offset;
+		m_Head = Offset + Size;
+		++m_NumAllocations;
+		return true;
+	}
+
+	void Reset() { m_Head = 0; m_NumAllocations = 0; }
+
+	uint64_t GetTotalSize() const { return m_TotalSize; }
+	bool IsEmpty() const { return m_NumAllocations == 0; }
+
+	OffsetAllocatorStats GetStats() const
+	{
+		OffsetAllocatorStats Stats;
+		Stats.TotalSize = m_TotalSize;
+		Stats.UsedSize = m_Head;
+		Stats.FreeSize = m_TotalSize - m_Head;
+		Stats.LargestFreeBlock = m_TotalSize - m_Head;
+		Stats.NumAllocations = m_NumAllocations;
+		Stats.NumFreeBlocks = m_Head < m_TotalSize ? 1 : 0;
+		return Stats;
+	}
+
+private:
+	uint64_t m_TotalSize;
+	uint64_t m_Head;
+	uint32_t m_NumAllocations;
+};
@@ -0,0 +1,201 @@
+#include "PipelineCache.h"
+#include <fstream>
+
+using namespace std;
+
+namespace Renderer
+{
+	PipelineCache pipelineCache;
+}
+
+PipelineCache::PipelineCache() :
+	m_DeviceVersion(0)
+{
+	ZeroMemory(&m_Stats, sizeof(m_Stats));
+}
+
+void PipelineCache::Open(const wstring& FileName, uint64_t DeviceVersion)
+{
+	Close();
+
+	m_FileName = FileName;
+	m_DeviceVersion = DeviceVersion;
+
+	if (!m_MappedFile.Open(FileName))
+		return;
+
+	if (m_MappedFile.GetSize() < sizeof(FileHeader))
+	{
+		m_Stats.FileDiscarded = true;
+		Close();
+		return;
+	}
+
+	LoadMappedFile();
+}
+
+void PipelineCache::LoadMappedFile()
+{
+	const uint8_t* MappedData = m_MappedFile.GetData();
+	const size_t MappedSize = m_MappedFile.GetSize();
+	const FileHeader& Header = *(const FileHeader*)MappedData;
+
+	const size_t TableSize = (size_t)Header.NumEntries * sizeof(FileEntry);
+	if (Header.Magic != FILE_MAGIC || Header.Version != FORMAT_VERSION || Header.DeviceVersion != m_DeviceVersion ||
+		TableSize > MappedSize - sizeof(FileHeader))
+	{
+		m_Stats.FileDiscarded = true;
+		return;
+	}
+
+	const FileEntry* Table = (const FileEntry*)(MappedData + sizeof(FileHeader));
+	if (Fingerprint(Table, TableSize) != Header.TableChecksum)
+	{
+		m_Stats.FileDiscarded = true;
+		return;
+	}
+
+	for (uint32_t i = 0; i < Header.NumEntries; ++i)
+	{
+		const FileEntry& Entry = Table[i];
+
+		if (Entry.Offset > MappedSize || Entry.Size > MappedSize - Entry.Offset ||
+			Fingerprint(MappedData + Entry.Offset, Entry.Size) != Entry.Checksum)
+		{
+			++m_Stats.NumRejected;
+			continue;
+		}
+
+		Blob& Loaded = m_Blobs[MakeMapKey((EntryType)Entry.Type, Entry.Key, Entry.Fingerprint)];
+		Loaded.Type = (EntryType)Entry.Type;
+		Loaded.Key = Entry.Key;
+		Loaded.Fingerprint = Entry.Fingerprint;
+		Loaded.Data = MappedData + Entry.Offset;
+		Loaded.Size = Entry.Size;
+		Loaded.Stale = false;
+		++m_Stats.NumLoaded;
+	}
+}
+
+bool PipelineCache::Save()
+{
+	if (m_FileName.empty())
+		return false;
+
+	lock_guard<mutex> LockGuard(m_Mutex);
+
+	vector<const Blob*> Blobs;
+	Blobs.reserve(m_Blobs.size());
+	for (auto& Iter : m_Blobs)
+	{
+		if (!Iter.second.Stale)
+			Blobs.push_back(&Iter.second);
+	}
+
+	vector<FileEntry> Table(Blobs.size());
+
+	size_t Offset = Math::AlignUp(sizeof(FileHeader) + Table.size() * sizeof(FileEntry), BLOB_ALIGNMENT);
+	for (size_t i = 0; i < Blobs.size(); ++i)
+	{
+		FileEntry& Entry = Table[i];
+		Entry.Key = Blobs[i]->Key;
+		Entry.Fingerprint = Blobs[i]->Fingerprint;
+		Entry.Offset = Offset;
+		Entry.Size = (uint32_t)Blobs[i]->Size;
+		Entry.Type = (uint32_t)Blobs[i]->Type;
+		Entry.Checksum = Fingerprint(Blobs[i]->Data, Blobs[i]->Size);
+
+		Offset = Math::AlignUp(Offset + Entry.Size, BLOB_ALIGNMENT);
+	}
+
+	FileHeader Header;
+	Header.Magic = FILE_MAGIC;
+	Header.Version = FORMAT_VERSION;
+	Header.DeviceVersion = m_DeviceVersion;
+	Header.NumEntries = (uint32_t)Table.size();
+	Header.Reserved = 0;
+	Header.TableChecksum = Fingerprint(Table.data(), Table.size() * sizeof(FileEntry));
+
+	// Written next to the old file and swapped in, a crash halfway leaves the old one intact
+	const wstring TempName = m_FileName + L".tmp";
+	{
+		ofstream File(TempName, ios::out | ios::binary | ios::trunc);
+		if (!File)
+			return false;
+
+		File.write((const char*)&Header, sizeof(Header));
+		File.write((const char*)Table.data(), Table.size() * sizeof(FileEntry));
+
+		const char Padding[BLOB_ALIGNMENT] = {};
+		size_t Written = sizeof(Header) + Table.size() * sizeof(FileEntry);
+		for (size_t i = 0; i < Blobs.size(); ++i)
+		{
+			File.write(Padding, Table[i].Offset - Written);
+			File.write((const char*)Blobs[i]->Data, Table[i].Size);
+			Written = Table[i].Offset + Table[i].Size;
+		}
+
+		if (!File)
+			return false;
+	}
+
+	// The old file is still mapped, it has to go before it can be replaced
+	Unmap();
+
+	return MoveFileExW(TempName.c_str(), m_FileName.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+}
+
+void PipelineCache::Close()
+{
+	lock_guard<mutex> LockGuard(m_Mutex);
+	Unmap();
+}
+
+void PipelineCache::Unmap()
+{
+	m_Blobs.clear();
+	m_MappedFile.Close();
+}
+
+bool PipelineCache::Find(EntryType Type, uint64_t Key, uint64_t Fingerprint, const void*& Data, size_t& Size)
+{
+	lock_guard<mutex> LockGuard(m_Mutex);
+
+	auto Iter = m_Blobs.find(MakeMapKey(Type, Key, Fingerprint));
+	if (Iter == m_Blobs.end() || Iter->second.Stale || Iter->second.Type != Type || Iter->second.Key != Key ||
+		Iter->second.Fingerprint != Fingerprint)
+	{
+		++m_Stats.NumMisses;
+		return false;
+	}
+
+	Data = Iter->second.Data;
+	Size = Iter->second.Size;
+	++m_Stats.NumHits;
+	return true;
+}
+
+void PipelineCache::Store(EntryType Type, uint64_t Key, uint64_t Fingerprint, const void* Data, size_t Size)
+{
+	lock_guard<mutex> LockGuard(m_Mutex);
+
+	Blob& Stored = m_Blobs[MakeMapKey(Type, Key, Fingerprint)];
+	Stored.Type = Type;
+	Stored.Key = Key;
+	Stored.Fingerprint = Fingerprint;
+	Stored.Storage.assign((const uint8_t*)Data, (const uint8_t*)Data + Size);
+	Stored.Data = Stored.Storage.data();
+	Stored.Size = Size;
+	Stored.Stale = false;
+	++m_Stats.NumStored;
+}
+
+void PipelineCache::MarkStale(EntryType Type, uint64_t Key, uint64_t Fingerprint)
+{
+	lock_guard<mutex> LockGuard(m_Mutex);
+
+	auto Iter = m_Blobs.find(MakeMapKey(Type, Key, Fingerprint));
+	if (Iter != m_Blobs.end())
+		Iter->second.Stale = true;
+	++m_Stats.NumStale;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "../../Core/Common.h"
+#include "../../Core/Utility/Hash.h"
+#include "../../Core/Utility/FileUtility.h"
+#include <mutex>
+#include <unordered_map>
+
+struct PipelineCacheStats
+{
+	uint32_t NumLoaded;			// Valid entries found in the file
+	uint32_t NumRejected;		// Entries dropped because their checksum or bounds were wrong
+	uint32_t NumHits;
+	uint32_t NumMisses;
+	uint32_t NumStale;			// Found, but the driver would not take the blob
+	uint32_t NumStored;
+	bool FileDiscarded;			// Wrong version, other device or corrupt table
+};
+
+// Compiled pipeline states and serialized root signatures kept on disk between runs.  The file is
+// memory mapped when opened and a hit hands out a pointer into the mapping, no copies.  Blobs made
+// during the run are kept in memory and written, together with the loaded ones, by Save().
+//
+// An entry is found by its type, a 64-bit key and a fingerprint of the full description, shader
+// bytecode included.  States that differ only in their shaders share a key and still get entries of
+// their own, and a key collision never returns the blob of a different state.
+// The file is thrown away as a whole when its format version or the device it was made on differ,
+// single entries when their checksum does not match.
+//
+// Nothing here touches D3D, the format and the lookups work without a device.  Find() and Store()
+// can be called from any thread.
+class PipelineCache
+{
+public:
+	enum EntryType
+	{
+		kRootSignature,
+		kGraphicsPSO,
+		kComputePSO
+	};
+
+	PipelineCache();
+	~PipelineCache() { Close(); }
+
+	// DeviceVersion identifies the adapter and driver, cached PSOs only work on the one that made them
+	void Open(const std::wstring& FileName, uint64_t DeviceVersion);
+	// Writes the loaded entries and the new ones to the file and closes the cache.  Returns false if the
+	// file could not be written.
+	bool Save();
+	void Close();
+
+	// Returns true and the blob if an entry with the same type, key and fingerprint was loaded.  The
+	// pointer stays valid until Close() or until the entry is stored again.
+	bool Find(EntryType Type, uint64_t Key, uint64_t Fingerprint, const void*& Data, size_t& Size);
+	// Adds an entry or replaces the one with the same type, key and fingerprint.  The data is copied.
+	void Store(EntryType Type, uint64_t Key, uint64_t Fingerprint, const void* Data, size_t Size);
+	// The driver rejected a blob that Find() returned, it is not written again unless stored anew
+	void MarkStale(EntryType Type, uint64_t Key, uint64_t Fingerprint);
+
+	const PipelineCacheStats& GetStats() const { return m_Stats; }
+
+	// 64-bit hash of a range of bytes, used for the fingerprints and the checksums.  Chained by
+	// passing the previous result as Hash.
+	static uint64_t Fingerprint(const void* Data, size_t Size, uint64_t Hash = 0) { return Utility::Hash64(Data, Size, Hash); }
+
+private:
+	static const uint32_t FILE_MAGIC = 0x43505350;		// "PSPC"
+	static const uint32_t FORMAT_VERSION = 2;
+	static const size_t BLOB_ALIGNMENT = 16;
+
+	// Header, then the table of entries, then the blobs
+	struct FileHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint64_t DeviceVersion;
+		uint32_t NumEntries;
+		uint32_t Reserved;
+		uint64_t TableChecksum;
+	};
+
+	struct FileEntry
+	{
+		uint64_t Key;
+		uint64_t Fingerprint;
+		uint64_t Offset;			// From the start of the file
+		uint32_t Size;
+		uint32_t Type;
+		uint64_t Checksum;			// Of the blob
+	};
+
+	struct Blob
+	{
+		EntryType Type;
+		uint64_t Key;
+		uint64_t Fingerprint;
+		const void* Data;			// Into the mapping or into Storage
+		size_t Size;
+		std::vector<uint8_t> Storage;
+		bool Stale;
+	};
+
+	// Type, key and fingerprint together.  Find() compares all three, two entries colliding here only
+	// replace each other.
+	static uint64_t MakeMapKey(EntryType Type, uint64_t Key, uint64_t Fingerprint)
+	{
+		const uint64_t Values[3] = { Key, Fingerprint, (uint64_t)Type };
+		return Utility::Hash64(Values, sizeof(Values));
+	}
+
+	void LoadMappedFile();
+	void Unmap();
+
+	std::wstring m_FileName;
+	uint64_t m_DeviceVersion;
+	Utility::MappedFile m_MappedFile;
+
+	std::mutex m_Mutex;
+	std::unordered_map<uint64_t, Blob> m_Blobs;
+
+	PipelineCacheStats m_Stats;
+};
+
+namespace Renderer
+{
+	extern PipelineCache pipelineCache;
+}
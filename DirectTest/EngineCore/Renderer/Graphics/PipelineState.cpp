@@ -1,9 +1,9 @@
 #include "PipelineState.h"
 #include "RootSignature.h"
+#include "PipelineCache.h"
 #include "../Core/GraphicContext.h"
-#include <map>
-#include <thread>
-#include <mutex>
+#include <atomic>
+#include <concurrent_unordered_map.h>
 
 using Math::IsAligned;
 
@@ -11,15 +11,181 @@ using Microsoft::WRL::ComPtr;
 using namespace std;
 using namespace Renderer;
 
-static map< size_t, ComPtr<ID3D12PipelineState> > s_GraphicsPSOHashMap;
-static map< size_t, ComPtr<ID3D12PipelineState> > s_ComputePSOHashMap;
+// One compile, shared by every PSO object with the same description.  The completion event exists
+// before the entry is published, so anyone finding it can wait on it.
+struct PipelineStateEntry
+{
+	PipelineStateEntry() : Ready(false), Compiled(concurrency::create_task(Done)) {}
+
+	vector<uint8_t> Description;		// The bytes the hash was computed from, compared on a hit
+	ComPtr<ID3D12PipelineState> Object;
+	std::atomic<bool> Ready;
+	concurrency::task_completion_event<void> Done;
+	concurrency::task<void> Compiled;
+};
+
+typedef concurrency::concurrent_unordered_map< uint64_t, shared_ptr<PipelineStateEntry> > PSOHashMap;
+
+static PSOHashMap s_GraphicsPSOHashMap;
+static PSOHashMap s_ComputePSOHashMap;
+
+static void WaitForEntries(const PSOHashMap& HashMap)
+{
+	for (const auto& Pair : HashMap)
+		Pair.second->Compiled.wait();
+}
+
+void PSO::WaitForAll(void)
+{
+	// Nothing finalizes any more when this is called, the tables do not grow while they are walked
+	WaitForEntries(s_GraphicsPSOHashMap);
+	WaitForEntries(s_ComputePSOHashMap);
+}
 
 void PSO::DestroyAll(void)
 {
+	// Not safe with compiles in flight, call WaitForAll() first
 	s_GraphicsPSOHashMap.clear();
 	s_ComputePSOHashMap.clear();
 }
 
+ID3D12PipelineState* PSO::GetPipelineStateObject(void) const
+{
+	return IsReady() ? m_Entry->Object.Get() : nullptr;
+}
+
+bool PSO::IsReady(void) const
+{
+	return m_Entry != nullptr && m_Entry->Ready.load(memory_order_acquire);
+}
+
+void PSO::WaitUntilReady(void) const
+{
+	ASSERT(m_Entry != nullptr, "PSO was not finalized");
+	m_Entry->Compiled.wait();
+	ASSERT(IsReady(), "PSO failed to compile");
+}
+
+static uint64_t FingerprintShader(const D3D12_SHADER_BYTECODE& Shader, uint64_t Hash)
+{
+	Hash = PipelineCache::Fingerprint(&Shader.BytecodeLength, sizeof(Shader.BytecodeLength), Hash);
+	return PipelineCache::Fingerprint(Shader.pShaderBytecode, Shader.BytecodeLength, Hash);
+}
+
+// Key and fingerprint for the disk cache.  Pointers change from run to run, so the key hashes the
+// description without them and the fingerprint adds what they point to.
+static uint64_t FingerprintDesc(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& Desc, uint64_t RootSignature, uint64_t& Key)
+{
+	// Copied whole, the padding was zeroed with the description
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC Stable;
+	memcpy(&Stable, &Desc, sizeof(Stable));
+	Stable.pRootSignature = nullptr;
+	Stable.VS.pShaderBytecode = nullptr;
+	Stable.PS.pShaderBytecode = nullptr;
+	Stable.DS.pShaderBytecode = nullptr;
+	Stable.HS.pShaderBytecode = nullptr;
+	Stable.GS.pShaderBytecode = nullptr;
+	Stable.StreamOutput.pSODeclaration = nullptr;
+	Stable.StreamOutput.pBufferStrides = nullptr;
+	Stable.InputLayout.pInputElementDescs = nullptr;
+	Stable.CachedPSO.pCachedBlob = nullptr;
+	Stable.CachedPSO.CachedBlobSizeInBytes = 0;
+
+	Key = Utility::Hash64(&Stable, sizeof(Stable));
+
+	uint64_t Hash = PipelineCache::Fingerprint(&Stable, sizeof(Stable), RootSignature);
+	Hash = FingerprintShader(Desc.VS, Hash);
+	Hash = FingerprintShader(Desc.PS, Hash);
+	Hash = FingerprintShader(Desc.DS, Hash);
+	Hash = FingerprintShader(Desc.HS, Hash);
+	Hash = FingerprintShader(Desc.GS, Hash);
+
+	for (UINT i = 0; i < Desc.InputLayout.NumElements; ++i)
+	{
+		D3D12_INPUT_ELEMENT_DESC Element = Desc.InputLayout.pInputElementDescs[i];
+		Hash = PipelineCache::Fingerprint(Element.SemanticName, strlen(Element.SemanticName), Hash);
+		Element.SemanticName = nullptr;
+		Hash = PipelineCache::Fingerprint(&Element, sizeof(Element), Hash);
+	}
+
+	return Hash;
+}
+
+static uint64_t FingerprintDesc(const D3D12_COMPUTE_PIPELINE_STATE_DESC& Desc, uint64_t RootSignature, uint64_t& Key)
+{
+	D3D12_COMPUTE_PIPELINE_STATE_DESC Stable;
+	memcpy(&Stable, &Desc, sizeof(Stable));
+	Stable.pRootSignature = nullptr;
+	Stable.CS.pShaderBytecode = nullptr;
+	Stable.CachedPSO.pCachedBlob = nullptr;
+	Stable.CachedPSO.CachedBlobSizeInBytes = 0;
+
+	Key = Utility::Hash64(&Stable, sizeof(Stable));
+
+	return FingerprintShader(Desc.CS, PipelineCache::Fingerprint(&Stable, sizeof(Stable), RootSignature));
+}
+
+// Creates the pipeline state from the blob of an earlier run when the disk cache has one, and
+// stores the blob of a fresh compile
+template <typename DescType, typename CreateFunction>
+static HRESULT CreateCached(PipelineCache::EntryType Type, DescType Desc, uint64_t RootSignature,
+	ID3D12PipelineState** ppPSO, CreateFunction Create)
+{
+	uint64_t Key;
+	const uint64_t Fingerprint = FingerprintDesc(Desc, RootSignature, Key);
+
+	const void* CachedBlob = nullptr;
+	size_t CachedSize = 0;
+	if (pipelineCache.Find(Type, Key, Fingerprint, CachedBlob, CachedSize))
+	{
+		Desc.CachedPSO.pCachedBlob = CachedBlob;
+		Desc.CachedPSO.CachedBlobSizeInBytes = CachedSize;
+		if (SUCCEEDED(Create(Desc, ppPSO)))
+			return S_OK;
+
+		// D3D12_ERROR_DRIVER_VERSION_MISMATCH and the like, compiled from scratch below
+		pipelineCache.MarkStale(Type, Key, Fingerprint);
+		Desc.CachedPSO.pCachedBlob = nullptr;
+		Desc.CachedPSO.CachedBlobSizeInBytes = 0;
+	}
+
+	HRESULT hr = Create(Desc, ppPSO);
+	if (SUCCEEDED(hr))
+	{
+		ComPtr<ID3DBlob> Blob;
+		if (SUCCEEDED((*ppPSO)->GetCachedBlob(&Blob)))
+			pipelineCache.Store(Type, Key, Fingerprint, Blob->GetBufferPointer(), Blob->GetBufferSize());
+	}
+	return hr;
+}
+
+// Returns the entry for Description, queuing Compile on the thread pool if this is the first request
+template <typename CompileFunction>
+static shared_ptr<PipelineStateEntry> FindOrCompile(PSOHashMap& HashMap, vector<uint8_t>& Description, CompileFunction Compile)
+{
+	bool Inserted;
+	shared_ptr<PipelineStateEntry> Entry = Utility::FindOrInsertProbed(HashMap, Utility::Hash64(Description.data(), Description.size()),
+		Description, [](vector<uint8_t>& Key)
+	{
+		shared_ptr<PipelineStateEntry> NewEntry = make_shared<PipelineStateEntry>();
+		NewEntry->Description.swap(Key);
+		return NewEntry;
+	}, Inserted);
+
+	if (!Inserted)
+		return Entry;
+
+	concurrency::create_task([Entry, Compile]()
+	{
+		HRESULT hr = Compile(Entry->Object.GetAddressOf());
+		ASSERT_SUCCEEDED(hr, "Pipeline state compile failed");
+		Entry->Ready.store(SUCCEEDED(hr), memory_order_release);
+		Entry->Done.set();
+	});
+
+	return Entry;
+}
+
 
 GraphicsPSO::GraphicsPSO()
 {
@@ -93,83 +259,60 @@ void GraphicsPSO::SetInputLayout(UINT NumElements, const D3D12_INPUT_ELEMENT_DES
 		m_InputLayouts = nullptr;
 }
 
-void GraphicsPSO::Finalize()
+concurrency::task<void> GraphicsPSO::Finalize()
 {
 	// Make sure the root signature is finalized first
 	m_PSODesc.pRootSignature = m_RootSignature->GetSignature();
 	ASSERT(m_PSODesc.pRootSignature != nullptr);
 
+	// The input layout is copied per PSO object, it is compared by content
+	const size_t LayoutSize = m_PSODesc.InputLayout.NumElements * sizeof(D3D12_INPUT_ELEMENT_DESC);
+	vector<uint8_t> Description(sizeof(m_PSODesc) + LayoutSize);
 	m_PSODesc.InputLayout.pInputElementDescs = nullptr;
-	size_t HashCode = Utility::HashState(&m_PSODesc);
-	HashCode = Utility::HashState(m_InputLayouts.get(), m_PSODesc.InputLayout.NumElements, HashCode);
+	memcpy(Description.data(), &m_PSODesc, sizeof(m_PSODesc));
+	if (LayoutSize > 0)
+		memcpy(Description.data() + sizeof(m_PSODesc), m_InputLayouts.get(), LayoutSize);
 	m_PSODesc.InputLayout.pInputElementDescs = m_InputLayouts.get();
 
-	ID3D12PipelineState** PSORef = nullptr;
-	bool firstCompile = false;
-	{
-		static mutex s_HashMapMutex;
-		lock_guard<mutex> CS(s_HashMapMutex);
-		auto iter = s_GraphicsPSOHashMap.find(HashCode);
+	// The compile runs after this returns, it gets its own copy of the description.  The input
+	// layout is kept alive by the shared pointer, the shader bytecode must outlive the compile.
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC Desc = m_PSODesc;
+	shared_ptr<const D3D12_INPUT_ELEMENT_DESC> InputLayouts = m_InputLayouts;
+	const uint64_t RootSignature = m_RootSignature->GetFingerprint();
 
-		// Reserve space so the next inquiry will find that someone got here first.
-		if (iter == s_GraphicsPSOHashMap.end())
+	m_Entry = FindOrCompile(s_GraphicsPSOHashMap, Description, [Desc, InputLayouts, RootSignature](ID3D12PipelineState** ppPSO)
+	{
+		return CreateCached(PipelineCache::kGraphicsPSO, Desc, RootSignature, ppPSO,
+			[](const D3D12_GRAPHICS_PIPELINE_STATE_DESC& CompileDesc, ID3D12PipelineState** ppCompiled)
 		{
-			firstCompile = true;
-			PSORef = s_GraphicsPSOHashMap[HashCode].GetAddressOf();
-		}
-		else
-			PSORef = iter->second.GetAddressOf();
-	}
+			return device->CreateGraphicsPipelineState(&CompileDesc, MY_IID_PPV_ARGS(ppCompiled));
+		});
+	});
 
-	if (firstCompile)
-	{
-		ASSERT_SUCCEEDED(device->CreateGraphicsPipelineState(&m_PSODesc, MY_IID_PPV_ARGS(&m_PSO)));
-		s_GraphicsPSOHashMap[HashCode].Attach(m_PSO);
-	}
-	else
-	{
-		while (*PSORef == nullptr)
-			this_thread::yield();
-		m_PSO = *PSORef;
-	}
+	return m_Entry->Compiled;
 }
 
-void ComputePSO::Finalize()
+concurrency::task<void> ComputePSO::Finalize()
 {
 	// Make sure the root signature is finalized first
 	m_PSODesc.pRootSignature = m_RootSignature->GetSignature();
 	ASSERT(m_PSODesc.pRootSignature != nullptr);
 
-	size_t HashCode = Utility::HashState(&m_PSODesc);
+	vector<uint8_t> Description((const uint8_t*)&m_PSODesc, (const uint8_t*)(&m_PSODesc + 1));
 
-	ID3D12PipelineState** PSORef = nullptr;
-	bool firstCompile = false;
-	{
-		static mutex s_HashMapMutex;
-		lock_guard<mutex> CS(s_HashMapMutex);
-		auto iter = s_ComputePSOHashMap.find(HashCode);
+	D3D12_COMPUTE_PIPELINE_STATE_DESC Desc = m_PSODesc;
+	const uint64_t RootSignature = m_RootSignature->GetFingerprint();
 
-		// Reserve space so the next inquiry will find that someone got here first.
-		if (iter == s_ComputePSOHashMap.end())
+	m_Entry = FindOrCompile(s_ComputePSOHashMap, Description, [Desc, RootSignature](ID3D12PipelineState** ppPSO)
+	{
+		return CreateCached(PipelineCache::kComputePSO, Desc, RootSignature, ppPSO,
+			[](const D3D12_COMPUTE_PIPELINE_STATE_DESC& CompileDesc, ID3D12PipelineState** ppCompiled)
 		{
-			firstCompile = true;
-			PSORef = s_ComputePSOHashMap[HashCode].GetAddressOf();
-		}
-		else
-			PSORef = iter->second.GetAddressOf();
-	}
+			return device->CreateComputePipelineState(&CompileDesc, MY_IID_PPV_ARGS(ppCompiled));
+		});
+	});
 
-	if (firstCompile)
-	{
-		ASSERT_SUCCEEDED(device->CreateComputePipelineState(&m_PSODesc, MY_IID_PPV_ARGS(&m_PSO)));
-		s_ComputePSOHashMap[HashCode].Attach(m_PSO);
-	}
-	else
-	{
-		while (*PSORef == nullptr)
-			this_thread::yield();
-		m_PSO = *PSORef;
-	}
+	return m_Entry->Compiled;
 }
 
 ComputePSO::ComputePSO()
@@ -6,6 +6,7 @@
 #endif
 
 class RootSignature;
+struct PipelineStateEntry;
 class VertexShader;
 class GeometryShader;
 class HullShader;
@@ -13,12 +14,18 @@ class DomainShader;
 class PixelShader;
 class ComputeShader;
 
+// Finalize() hands the pipeline state to a background compile and returns at once.  Until the compile
+// is done GetPipelineStateObject() returns null; draws can check IsReady() and skip, or wait for it.
+// Identical descriptions share one compile through a lock-free table.
 class PSO
 {
 public:
 
 	PSO() : m_RootSignature(nullptr) {}
 
+	// Blocks until every compile that was started is done.  They read the shader library and the disk
+	// cache, neither may be closed before.
+	static void WaitForAll(void);
 	static void DestroyAll(void);
 
 	void SetRootSignature(const RootSignature& BindMappings)
@@ -32,13 +39,16 @@ public:
 		return *m_RootSignature;
 	}
 
-	ID3D12PipelineState* GetPipelineStateObject(void) const { return m_PSO; }
+	ID3D12PipelineState* GetPipelineStateObject(void) const;
+	bool IsReady(void) const;
+	// Blocks until the compile is done, for the few places that cannot do without the state
+	void WaitUntilReady(void) const;
 
 protected:
 
 	const RootSignature* m_RootSignature;
 
-	ID3D12PipelineState* m_PSO;
+	std::shared_ptr<PipelineStateEntry> m_Entry;
 };
 
 class GraphicsPSO : public PSO
@@ -72,8 +82,9 @@ public:
 	void SetHullShader(const D3D12_SHADER_BYTECODE& Binary) { m_PSODesc.HS = Binary; }
 	void SetDomainShader(const D3D12_SHADER_BYTECODE& Binary) { m_PSODesc.DS = Binary; }
 
-	// Perform validation and compute a hash value for fast state block comparisons
-	void Finalize();
+	// Perform validation and compute a hash value for fast state block comparisons, then queue the
+	// compile.  The returned task completes when the state is ready.
+	concurrency::task<void> Finalize();
 
 private:
 
@@ -91,7 +102,7 @@ public:
 	void SetComputeShader(const void* Binary, size_t Size) { m_PSODesc.CS = CD3DX12_SHADER_BYTECODE(const_cast<void*>(Binary), Size); }
 	void SetComputeShader(const D3D12_SHADER_BYTECODE& Binary) { m_PSODesc.CS = Binary; }
 
-	void Finalize();
+	concurrency::task<void> Finalize();
 
 private:
 
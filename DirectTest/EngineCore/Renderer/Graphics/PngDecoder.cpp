@@ -0,0 +1,589 @@
+#include "PngDecoder.h"
+#include <cstring>
+#include <zlib.h> // From NuGet package
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define ENABLE_SSE2_PNG 1
+#include <emmintrin.h>
+#else
+#define ENABLE_SSE2_PNG 0
+#endif
+
+namespace
+{
+	const uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+	// Images larger than this are refused instead of allocating gigabytes for a corrupt header
+	const uint64_t MAX_PIXELS = 1 << 28;
+
+	// Origin and spacing of the pixels of each Adam7 pass
+	struct InterlacePass
+	{
+		uint32_t X, Y, StepX, StepY;
+	};
+
+	const InterlacePass ADAM7[7] =
+	{
+		{ 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 }, { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 }
+	};
+
+	enum FilterType
+	{
+		kFilterNone,
+		kFilterSub,
+		kFilterUp,
+		kFilterAverage,
+		kFilterPaeth
+	};
+
+	inline uint32_t Read32(const uint8_t* Data)
+	{
+		return ((uint32_t)Data[0] << 24) | ((uint32_t)Data[1] << 16) | ((uint32_t)Data[2] << 8) | Data[3];
+	}
+
+	inline uint8_t PaethPredictor(int32_t A, int32_t B, int32_t C)
+	{
+		const int32_t P = A + B - C;
+		const int32_t PA = P > A ? P - A : A - P;
+		const int32_t PB = P > B ? P - B : B - P;
+		const int32_t PC = P > C ? P - C : C - P;
+		if (PA <= PB && PA <= PC)
+			return (uint8_t)A;
+		return (uint8_t)(PB <= PC ? B : C);
+	}
+
+	void UnfilterUp(uint8_t* Row, const uint8_t* Prior, size_t RowBytes)
+	{
+		size_t i = 0;
+#if ENABLE_SSE2_PNG
+		for (; i + 16 <= RowBytes; i += 16)
+		{
+			const __m128i Sum = _mm_add_epi8(_mm_loadu_si128((const __m128i*)(Row + i)), _mm_loadu_si128((const __m128i*)(Prior + i)));
+			_mm_storeu_si128((__m128i*)(Row + i), Sum);
+		}
+#endif
+		for (; i < RowBytes; ++i)
+			Row[i] += Prior[i];
+	}
+
+	void UnfilterSub(uint8_t* Row, size_t RowBytes, uint32_t Stride)
+	{
+		for (size_t i = Stride; i < RowBytes; ++i)
+			Row[i] += Row[i - Stride];
+	}
+
+	void UnfilterAverage(uint8_t* Row, const uint8_t* Prior, size_t RowBytes, uint32_t Stride)
+	{
+		for (size_t i = 0; i < Stride; ++i)
+			Row[i] += Prior[i] >> 1;
+		for (size_t i = Stride; i < RowBytes; ++i)
+			Row[i] += (uint8_t)((Row[i - Stride] + Prior[i]) >> 1);
+	}
+
+	void UnfilterPaeth(uint8_t* Row, const uint8_t* Prior, size_t RowBytes, uint32_t Stride)
+	{
+		for (size_t i = 0; i < Stride; ++i)
+			Row[i] += Prior[i];
+		for (size_t i = Stride; i < RowBytes; ++i)
+			Row[i] += PaethPredictor(Row[i - Stride], Prior[i], Prior[i - Stride]);
+	}
+
+#if ENABLE_SSE2_PNG
+	// Sub, Average and Paeth depend on the pixel to the left, so the 3- and 4-byte pixels of 8-bit RGB
+	// and RGBA are done one pixel per register, all channels at once
+
+	template <uint32_t Stride>
+	inline __m128i LoadPixel(const uint8_t* Pixel)
+	{
+		uint32_t Value = 0;
+		memcpy(&Value, Pixel, Stride);
+		return _mm_cvtsi32_si128((int)Value);
+	}
+
+	template <uint32_t Stride>
+	inline void StorePixel(uint8_t* Pixel, __m128i Value)
+	{
+		const uint32_t Bytes = (uint32_t)_mm_cvtsi128_si32(Value);
+		memcpy(Pixel, &Bytes, Stride);
+	}
+
+	template <uint32_t Stride>
+	void UnfilterSubSSE2(uint8_t* Row, size_t RowBytes)
+	{
+		__m128i Left = _mm_setzero_si128();
+		for (size_t i = 0; i + Stride <= RowBytes; i += Stride)
+		{
+			Left = _mm_add_epi8(Left, LoadPixel<Stride>(Row + i));
+			StorePixel<Stride>(Row + i, Left);
+		}
+	}
+
+	template <uint32_t Stride>
+	void UnfilterAverageSSE2(uint8_t* Row, const uint8_t* Prior, size_t RowBytes)
+	{
+		const __m128i One = _mm_set1_epi8(1);
+		__m128i Left = _mm_setzero_si128();
+		for (size_t i = 0; i + Stride <= RowBytes; i += Stride)
+		{
+			const __m128i Above = LoadPixel<Stride>(Prior + i);
+			// _mm_avg_epu8 rounds up, the filter rounds down
+			const __m128i Average = _mm_sub_epi8(_mm_avg_epu8(Left, Above), _mm_and_si128(_mm_xor_si128(Left, Above), One));
+			Left = _mm_add_epi8(LoadPixel<Stride>(Row + i), Average);
+			StorePixel<Stride>(Row + i, Left);
+		}
+	}
+
+	inline __m128i Abs16(__m128i Value)
+	{
+		return _mm_max_epi16(Value, _mm_sub_epi16(_mm_setzero_si128(), Value));
+	}
+
+	template <uint32_t Stride>
+	void UnfilterPaethSSE2(uint8_t* Row, const uint8_t* Prior, size_t RowBytes)
+	{
+		const __m128i Zero = _mm_setzero_si128();
+		__m128i Left = Zero;			// A, 16 bits per channel
+		__m128i UpperLeft = Zero;		// C
+		for (size_t i = 0; i + Stride <= RowBytes; i += Stride)
+		{
+			const __m128i Above = _mm_unpacklo_epi8(LoadPixel<Stride>(Prior + i), Zero);	// B
+
+			// With P = A + B - C: |P - A| = |B - C|, |P - B| = |A - C| and |P - C| = |B - C + A - C|
+			const __m128i FromA = _mm_sub_epi16(Above, UpperLeft);
+			const __m128i FromB = _mm_sub_epi16(Left, UpperLeft);
+			const __m128i DistA = Abs16(FromA);
+			const __m128i DistB = Abs16(FromB);
+			const __m128i DistC = Abs16(_mm_add_epi16(FromA, FromB));
+			const __m128i Smallest = _mm_min_epi16(_mm_min_epi16(DistA, DistB), DistC);
+
+			// Ties go to A, then B
+			const __m128i PickA = _mm_cmpeq_epi16(DistA, Smallest);
+			const __m128i PickB = _mm_cmpeq_epi16(DistB, Smallest);
+			const __m128i BOrC = _mm_or_si128(_mm_and_si128(PickB, Above), _mm_andnot_si128(PickB, UpperLeft));
+			const __m128i Predictor = _mm_or_si128(_mm_and_si128(PickA, Left), _mm_andnot_si128(PickA, BOrC));
+
+			const __m128i Pixel = _mm_add_epi8(LoadPixel<Stride>(Row + i), _mm_packus_epi16(Predictor, Predictor));
+			StorePixel<Stride>(Row + i, Pixel);
+
+			Left = _mm_unpacklo_epi8(Pixel, Zero);
+			UpperLeft = Above;
+		}
+	}
+#endif
+
+	// Sample X of a row of samples of Depth bits
+	inline uint32_t GetSample(const uint8_t* Row, uint32_t X, uint32_t Depth)
+	{
+		switch (Depth)
+		{
+		case 16: return ((uint32_t)Row[X * 2] << 8) | Row[X * 2 + 1];
+		case 8: return Row[X];
+		default:
+		{
+			const uint32_t Bit = X * Depth;
+			return (Row[Bit >> 3] >> (8 - Depth - (Bit & 7))) & ((1u << Depth) - 1);
+		}
+		}
+	}
+}
+
+PngDecoder::PngDecoder() :
+	m_Width(0),
+	m_Height(0)
+{
+}
+
+bool PngDecoder::ReadHeader(const uint8_t* Data, size_t Size)
+{
+	m_Width = 0;
+	m_Height = 0;
+	m_PaletteSize = 0;
+	m_HasTransparency = false;
+	m_DataChunks.clear();
+
+	if (Size < 8 || memcmp(Data, SIGNATURE, 8) != 0)
+		return false;
+
+	const uint8_t* Ptr = Data + 8;
+	const uint8_t* const End = Data + Size;
+	bool HasHeader = false;
+
+	// Length, type, data and CRC of the type and data
+	while ((size_t)(End - Ptr) >= 12)
+	{
+		const uint32_t Length = Read32(Ptr);
+		if (Length > (size_t)(End - Ptr) - 12)
+			return false;
+
+		const uint8_t* Type = Ptr + 4;
+		const uint8_t* ChunkData = Ptr + 8;
+		if ((uint32_t)crc32(0, Type, Length + 4) != Read32(ChunkData + Length))
+			return false;
+		Ptr = ChunkData + Length + 4;
+
+		// The header has to come first
+		if (memcmp(Type, "IHDR", 4) == 0)
+		{
+			if (HasHeader || !ReadImageHeader(ChunkData, Length))
+				return false;
+			HasHeader = true;
+		}
+		else if (!HasHeader)
+			return false;
+		else if (memcmp(Type, "PLTE", 4) == 0)
+		{
+			if (Length % 3 != 0 || Length / 3 > 256)
+				return false;
+			m_PaletteSize = Length / 3;
+			for (uint32_t i = 0; i < m_PaletteSize; ++i)
+			{
+				m_Palette[i][0] = ChunkData[i * 3 + 0];
+				m_Palette[i][1] = ChunkData[i * 3 + 1];
+				m_Palette[i][2] = ChunkData[i * 3 + 2];
+				m_Palette[i][3] = 255;
+			}
+		}
+		else if (memcmp(Type, "tRNS", 4) == 0)
+		{
+			if (!ReadTransparency(ChunkData, Length))
+				return false;
+		}
+		else if (memcmp(Type, "IDAT", 4) == 0)
+		{
+			Chunk Piece = { ChunkData, Length };
+			m_DataChunks.push_back(Piece);
+		}
+		else if (memcmp(Type, "IEND", 4) == 0)
+			break;
+		// Unknown critical chunks (upper case first letter) change how the image is decoded
+		else if ((Type[0] & 0x20) == 0)
+			return false;
+	}
+
+	if (!HasHeader || m_DataChunks.empty() || (m_ColorType == kPalette && m_PaletteSize == 0))
+	{
+		m_Width = m_Height = 0;
+		return false;
+	}
+
+	return true;
+}
+
+bool PngDecoder::ReadImageHeader(const uint8_t* Data, uint32_t Length)
+{
+	if (Length != 13)
+		return false;
+
+	const uint32_t Width = Read32(Data);
+	const uint32_t Height = Read32(Data + 4);
+	m_BitDepth = Data[8];
+	m_ColorType = Data[9];
+	m_Interlaced = Data[12] == 1;
+
+	// Compression and filter methods have only one value defined
+	if (Width == 0 || Height == 0 || (uint64_t)Width * Height > MAX_PIXELS || Data[10] != 0 || Data[11] != 0 || Data[12] > 1)
+		return false;
+
+	switch (m_ColorType)
+	{
+	case kGray:
+		m_Channels = 1;
+		if (m_BitDepth != 1 && m_BitDepth != 2 && m_BitDepth != 4 && m_BitDepth != 8 && m_BitDepth != 16)
+			return false;
+		break;
+	case kPalette:
+		m_Channels = 1;
+		if (m_BitDepth != 1 && m_BitDepth != 2 && m_BitDepth != 4 && m_BitDepth != 8)
+			return false;
+		break;
+	case kRGB:
+	case kGrayAlpha:
+	case kRGBA:
+		m_Channels = m_ColorType == kRGB ? 3 : (m_ColorType == kGrayAlpha ? 2 : 4);
+		if (m_BitDepth != 8 && m_BitDepth != 16)
+			return false;
+		break;
+	default:
+		return false;
+	}
+
+	m_FilterStride = m_Channels * m_BitDepth >= 8 ? m_Channels * m_BitDepth / 8 : 1;
+	m_Width = Width;
+	m_Height = Height;
+	return true;
+}
+
+bool PngDecoder::ReadTransparency(const uint8_t* Data, uint32_t Length)
+{
+	switch (m_ColorType)
+	{
+	case kPalette:
+		// Alpha of the first entries, the others stay opaque
+		if (Length > 256)
+			return false;
+		for (uint32_t i = 0; i < Length; ++i)
+			m_Palette[i][3] = Data[i];
+		break;
+	case kGray:
+		if (Length != 2)
+			return false;
+		m_ColorKey[0] = (uint16_t)((Data[0] << 8) | Data[1]);
+		break;
+	case kRGB:
+		if (Length != 6)
+			return false;
+		for (uint32_t i = 0; i < 3; ++i)
+			m_ColorKey[i] = (uint16_t)((Data[i * 2] << 8) | Data[i * 2 + 1]);
+		break;
+	default:
+		// Not allowed with an alpha channel, ignored
+		return true;
+	}
+
+	m_HasTransparency = true;
+	return true;
+}
+
+bool PngDecoder::Decode(uint8_t* Dest, size_t RowPitch)
+{
+	if (!Unpack())
+		return false;
+
+	ConvertRows(Dest, RowPitch, 0, m_Height);
+	return true;
+}
+
+bool PngDecoder::Unpack()
+{
+	if (m_Width == 0)
+		return false;
+
+	const uint32_t NumPasses = m_Interlaced ? 7 : 1;
+	const InterlacePass Whole = { 0, 0, 1, 1 };
+
+	// Each row starts with its filter type; passes with no pixels have no rows
+	size_t FilteredSize = 0;
+	for (uint32_t Pass = 0; Pass < NumPasses; ++Pass)
+	{
+		const InterlacePass& Layout = m_Interlaced ? ADAM7[Pass] : Whole;
+		const uint32_t Width = (m_Width - Layout.X + Layout.StepX - 1) / Layout.StepX;
+		const uint32_t Height = (m_Height - Layout.Y + Layout.StepY - 1) / Layout.StepY;
+		if (Width != 0 && Height != 0)
+			FilteredSize += (1 + GetRowBytes(Width)) * Height;
+	}
+
+	m_Unpacked.resize(FilteredSize);
+	if (!Inflate(m_Unpacked.data(), FilteredSize))
+		return false;
+
+	// The row above the first one of a pass is all zeros
+	std::vector<uint8_t> ZeroRow(GetRowBytes(m_Width), 0);
+
+	uint8_t* Row = m_Unpacked.data();
+	for (uint32_t Pass = 0; Pass < NumPasses; ++Pass)
+	{
+		const InterlacePass& Layout = m_Interlaced ? ADAM7[Pass] : Whole;
+		const uint32_t Width = (m_Width - Layout.X + Layout.StepX - 1) / Layout.StepX;
+		const uint32_t Height = (m_Height - Layout.Y + Layout.StepY - 1) / Layout.StepY;
+		if (Width == 0 || Height == 0)
+			continue;
+
+		const size_t RowBytes = GetRowBytes(Width);
+		const uint8_t* Prior = ZeroRow.data();
+		for (uint32_t y = 0; y < Height; ++y)
+		{
+			if (!Unfilter(Row + 1, Prior, Row[0], RowBytes))
+				return false;
+
+			Prior = Row + 1;
+			Row += 1 + RowBytes;
+		}
+	}
+
+	return true;
+}
+
+void PngDecoder::ConvertRows(uint8_t* Dest, size_t RowPitch, uint32_t FirstRow, uint32_t NumRows) const
+{
+	const uint32_t NumPasses = m_Interlaced ? 7 : 1;
+	const InterlacePass Whole = { 0, 0, 1, 1 };
+	const uint32_t EndRow = FirstRow + NumRows;
+
+	const uint8_t* PassStart = m_Unpacked.data();
+	for (uint32_t Pass = 0; Pass < NumPasses; ++Pass)
+	{
+		const InterlacePass& Layout = m_Interlaced ? ADAM7[Pass] : Whole;
+		const uint32_t Width = (m_Width - Layout.X + Layout.StepX - 1) / Layout.StepX;
+		const uint32_t Height = (m_Height - Layout.Y + Layout.StepY - 1) / Layout.StepY;
+		if (Width == 0 || Height == 0)
+			continue;
+
+		// Rows of the pass that land in [FirstRow, EndRow) of the image
+		const size_t RowBytes = GetRowBytes(Width);
+		const uint32_t First = FirstRow > Layout.Y ? (FirstRow - Layout.Y + Layout.StepY - 1) / Layout.StepY : 0;
+		const uint32_t End = EndRow > Layout.Y ? (EndRow - Layout.Y + Layout.StepY - 1) / Layout.StepY : 0;
+		for (uint32_t y = First; y < End && y < Height; ++y)
+		{
+			const uint8_t* Row = PassStart + (1 + RowBytes) * y + 1;
+			uint8_t* Out = Dest + (size_t)(Layout.Y + y * Layout.StepY) * RowPitch + Layout.X * 4;
+			ExpandRow(Row, Width, Out, Layout.StepX);
+		}
+
+		PassStart += (1 + RowBytes) * Height;
+	}
+}
+
+bool PngDecoder::Inflate(uint8_t* Out, size_t Size) const
+{
+	z_stream Stream;
+	memset(&Stream, 0, sizeof(Stream));
+	if (inflateInit(&Stream) != Z_OK)
+		return false;
+
+	Stream.next_out = Out;
+	Stream.avail_out = (uInt)Size;
+
+	int Result = Z_OK;
+	for (size_t i = 0; i < m_DataChunks.size() && Result == Z_OK; ++i)
+	{
+		Stream.next_in = (Bytef*)m_DataChunks[i].Data;
+		Stream.avail_in = m_DataChunks[i].Length;
+		Result = inflate(&Stream, Z_NO_FLUSH);
+		// No room left is only an error if the stream goes on
+		if (Result == Z_BUF_ERROR && Stream.avail_out == 0)
+			Result = Z_OK;
+	}
+
+	const bool Complete = Stream.avail_out == 0 && (Result == Z_OK || Result == Z_STREAM_END);
+	inflateEnd(&Stream);
+	return Complete;
+}
+
+bool PngDecoder::Unfilter(uint8_t* Row, const uint8_t* Prior, uint32_t Filter, size_t RowBytes) const
+{
+	switch (Filter)
+	{
+	case kFilterNone:
+		return true;
+
+	case kFilterSub:
+#if ENABLE_SSE2_PNG
+		if (m_FilterStride == 4)
+			UnfilterSubSSE2<4>(Row, RowBytes);
+		else if (m_FilterStride == 3)
+			UnfilterSubSSE2<3>(Row, RowBytes);
+		else
+#endif
+			UnfilterSub(Row, RowBytes, m_FilterStride);
+		return true;
+
+	case kFilterUp:
+		UnfilterUp(Row, Prior, RowBytes);
+		return true;
+
+	case kFilterAverage:
+#if ENABLE_SSE2_PNG
+		if (m_FilterStride == 4)
+			UnfilterAverageSSE2<4>(Row, Prior, RowBytes);
+		else if (m_FilterStride == 3)
+			UnfilterAverageSSE2<3>(Row, Prior, RowBytes);
+		else
+#endif
+			UnfilterAverage(Row, Prior, RowBytes, m_FilterStride);
+		return true;
+
+	case kFilterPaeth:
+#if ENABLE_SSE2_PNG
+		if (m_FilterStride == 4)
+			UnfilterPaethSSE2<4>(Row, Prior, RowBytes);
+		else if (m_FilterStride == 3)
+			UnfilterPaethSSE2<3>(Row, Prior, RowBytes);
+		else
+#endif
+			UnfilterPaeth(Row, Prior, RowBytes, m_FilterStride);
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+void PngDecoder::ExpandRow(const uint8_t* Row, uint32_t Width, uint8_t* Dest, uint32_t Step) const
+{
+	const size_t DestStep = (size_t)Step * 4;
+
+	if (m_ColorType == kRGBA && m_BitDepth == 8 && Step == 1)
+	{
+		memcpy(Dest, Row, (size_t)Width * 4);
+		return;
+	}
+
+	// 16-bit samples keep their high byte, the first one in the file
+	const uint32_t Depth = m_BitDepth;
+	const uint32_t High = Depth == 16 ? 2 : 1;
+
+	switch (m_ColorType)
+	{
+	case kGray:
+	{
+		// Spreads 1, 2 and 4-bit values over 0 to 255
+		const uint32_t Scale = Depth >= 8 ? 1 : 255 / ((1u << Depth) - 1);
+		for (uint32_t x = 0; x < Width; ++x, Dest += DestStep)
+		{
+			const uint32_t Value = GetSample(Row, x, Depth);
+			const uint8_t Gray = (uint8_t)(Depth == 16 ? Value >> 8 : Value * Scale);
+			Dest[0] = Dest[1] = Dest[2] = Gray;
+			Dest[3] = m_HasTransparency && Value == m_ColorKey[0] ? 0 : 255;
+		}
+		break;
+	}
+
+	case kRGB:
+		for (uint32_t x = 0; x < Width; ++x, Dest += DestStep, Row += 3 * High)
+		{
+			Dest[0] = Row[0];
+			Dest[1] = Row[High];
+			Dest[2] = Row[High * 2];
+			Dest[3] = 255;
+			if (m_HasTransparency &&
+				GetSample(Row, 0, Depth) == m_ColorKey[0] && GetSample(Row, 1, Depth) == m_ColorKey[1] && GetSample(Row, 2, Depth) == m_ColorKey[2])
+			{
+				Dest[3] = 0;
+			}
+		}
+		break;
+
+	case kPalette:
+		for (uint32_t x = 0; x < Width; ++x, Dest += DestStep)
+		{
+			// Out of range indices are black, as in libpng
+			const uint32_t Index = GetSample(Row, x, Depth);
+			if (Index < m_PaletteSize)
+				memcpy(Dest, m_Palette[Index], 4);
+			else
+			{
+				Dest[0] = Dest[1] = Dest[2] = 0;
+				Dest[3] = 255;
+			}
+		}
+		break;
+
+	case kGrayAlpha:
+		for (uint32_t x = 0; x < Width; ++x, Dest += DestStep, Row += 2 * High)
+		{
+			Dest[0] = Dest[1] = Dest[2] = Row[0];
+			Dest[3] = Row[High];
+		}
+		break;
+
+	case kRGBA:
+		for (uint32_t x = 0; x < Width; ++x, Dest += DestStep, Row += 4 * High)
+		{
+			Dest[0] = Row[0];
+			Dest[1] = Row[High];
+			Dest[2] = Row[High * 2];
+			Dest[3] = Row[High * 3];
+		}
+		break;
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Decoder for PNG: every color type and bit depth, palettes, tRNS transparency and Adam7
+// interlacing.  16-bit channels keep their high byte and gamma, color profiles and text chunks are
+// ignored.  The image data is inflated with zlib; the row filters are undone with SSE2 when the
+// target has it.
+//
+// A decoder holds the state of one image and nothing is shared between decoders, so images can be
+// decoded on several threads at once.  It does not depend on the platform and builds without the
+// Windows headers.
+class PngDecoder
+{
+public:
+	PngDecoder();
+
+	// Reads the chunks and checks their CRCs, without inflating the image data.  Data is not copied
+	// and must stay valid until Decode() returns.  Returns false if it is not a valid PNG.
+	bool ReadHeader(const uint8_t* Data, size_t Size);
+
+	uint32_t GetWidth() const { return m_Width; }
+	uint32_t GetHeight() const { return m_Height; }
+	bool HasAlpha() const { return (m_ColorType & 4) != 0 || m_HasTransparency; }
+
+	// Writes Height rows of Width RGBA8 pixels, the first one at Dest and each RowPitch bytes after
+	// the previous one.  RowPitch can be that of a texture in an upload buffer.  Returns false if the
+	// compressed data is corrupt.
+	bool Decode(uint8_t* Dest, size_t RowPitch);
+
+	// Decode() in two steps, so large images can be spread over several threads.  Unpack() inflates
+	// the image data and undoes the row filters, which has to be done in order and on one thread.
+	// After it, ConvertRows() writes the RGBA8 rows in [FirstRow, FirstRow + NumRows) and can run for
+	// different rows at the same time.
+	bool Unpack();
+	void ConvertRows(uint8_t* Dest, size_t RowPitch, uint32_t FirstRow, uint32_t NumRows) const;
+
+private:
+	enum ColorType
+	{
+		kGray = 0,
+		kRGB = 2,
+		kPalette = 3,
+		kGrayAlpha = 4,
+		kRGBA = 6
+	};
+
+	struct Chunk
+	{
+		const uint8_t* Data;
+		uint32_t Length;
+	};
+
+	bool ReadImageHeader(const uint8_t* Data, uint32_t Length);
+	bool ReadTransparency(const uint8_t* Data, uint32_t Length);
+	size_t GetRowBytes(uint32_t Width) const { return ((size_t)Width * m_Channels * m_BitDepth + 7) / 8; }
+	bool Inflate(uint8_t* Out, size_t Size) const;
+	bool Unfilter(uint8_t* Row, const uint8_t* Prior, uint32_t Filter, size_t RowBytes) const;
+	// Converts a row of Width pixels to RGBA8, one pixel every Step pixels of Dest
+	void ExpandRow(const uint8_t* Row, uint32_t Width, uint8_t* Dest, uint32_t Step) const;
+
+	uint32_t m_Width;
+	uint32_t m_Height;
+	uint32_t m_BitDepth;
+	uint32_t m_ColorType;
+	uint32_t m_Channels;
+	uint32_t m_FilterStride;			// Bytes per complete pixel, at least 1
+	bool m_Interlaced;
+
+	uint8_t m_Palette[256][4];			// RGBA
+	uint32_t m_PaletteSize;
+	bool m_HasTransparency;
+	uint16_t m_ColorKey[3];				// Gray or RGB value that is transparent, at the bit depth of the image
+
+	std::vector<Chunk> m_DataChunks;	// IDAT, the zlib stream split in pieces
+	std::vector<uint8_t> m_Unpacked;	// Rows after Unpack(), each behind its filter byte, pass after pass
+};
@@ -0,0 +1,605 @@
+#include "RenderGraph.h"
+#include "../Core/GraphicContext.h"
+#include <algorithm>
+
+using namespace std;
+using namespace Renderer;
+
+static const uint32_t NO_PASS = 0xFFFFFFFF;
+static const D3D12_RESOURCE_STATES UNDEFINED_STATE = (D3D12_RESOURCE_STATES)-1;
+
+RenderGraph::RenderGraph() :
+	m_NumTransients(0)
+{
+	Reset();
+}
+
+void RenderGraph::Reset()
+{
+	m_Passes.clear();
+	m_Resources.clear();
+	m_Schedule.clear();
+	m_FinalBarriers.clear();
+	m_SlotOfResource.clear();
+	m_NumTransients = 0;
+	m_Stats = RenderGraphStats();
+	m_Compiled = false;
+
+	for (uint32_t i = 0; i < kNumHeapCategories; ++i)
+	{
+		m_CategorySize[i] = 0;
+		m_CategoryAlignment[i] = 0;
+		m_CategoryAliased[i] = false;
+	}
+}
+
+uint32_t RenderGraph::ImportResource(const std::wstring& Name, GpuResource& Resource, D3D12_RESOURCE_STATES FinalState,
+	const RenderGraphViews* pViews)
+{
+	ResourceNode Node = {};
+	Node.Name = Name;
+	Node.Imported = &Resource;
+	Node.FinalState = FinalState;
+	if (pViews != nullptr)
+		Node.ImportedViews = *pViews;
+	Node.AliasOffset = 0;
+	Node.FirstPass = Node.LastPass = NO_PASS;
+
+	m_Resources.push_back(Node);
+	m_SlotOfResource.push_back((uint32_t)INVALID_RESOURCE);
+	m_Compiled = false;
+	return (uint32_t)m_Resources.size() - 1;
+}
+
+uint32_t RenderGraph::CreateTransient(const std::wstring& Name, const D3D12_RESOURCE_DESC& Desc, const D3D12_CLEAR_VALUE* pClearValue)
+{
+	ResourceNode Node = {};
+	Node.Name = Name;
+	Node.Imported = nullptr;
+	Node.Desc = Desc;
+	Node.HasClearValue = pClearValue != nullptr;
+	if (pClearValue != nullptr)
+		Node.ClearValue = *pClearValue;
+	Node.AliasOffset = 0;
+	Node.FirstPass = Node.LastPass = NO_PASS;
+
+	// Transients get the same slot every frame as long as the graph is declared in the same order
+	if (m_NumTransients == m_Slots.size())
+	{
+		TransientSlot Slot = {};
+		Slot.Resource.reset(new GpuResource);
+		m_Slots.push_back(std::move(Slot));
+	}
+
+	m_Resources.push_back(Node);
+	m_SlotOfResource.push_back(m_NumTransients++);
+	m_Compiled = false;
+	return (uint32_t)m_Resources.size() - 1;
+}
+
+uint32_t RenderGraph::AddPass(const std::wstring& Name, const ExecuteFunction& Execute, bool HasSideEffects)
+{
+	PassNode Node;
+	Node.Name = Name;
+	Node.Execute = Execute;
+	Node.HasSideEffects = HasSideEffects;
+	Node.Alive = false;
+
+	m_Passes.push_back(Node);
+	m_Compiled = false;
+	return (uint32_t)m_Passes.size() - 1;
+}
+
+void RenderGraph::Read(uint32_t Pass, uint32_t Resource, D3D12_RESOURCE_STATES State)
+{
+	AddAccess(Pass, Resource, State, false);
+}
+
+void RenderGraph::Write(uint32_t Pass, uint32_t Resource, D3D12_RESOURCE_STATES State)
+{
+	AddAccess(Pass, Resource, State, true);
+}
+
+void RenderGraph::AddAccess(uint32_t Pass, uint32_t Resource, D3D12_RESOURCE_STATES State, bool IsWrite)
+{
+	ASSERT(Pass < m_Passes.size() && Resource < m_Resources.size(), "Unknown render graph pass or resource");
+
+	std::vector<Access>& Accesses = m_Passes[Pass].Accesses;
+	for (Access& Existing : Accesses)
+	{
+		if (Existing.Resource != Resource)
+			continue;
+
+		// A resource has a single state for the whole pass
+		ASSERT(Existing.State == State, "Resource used in two different states by the same pass");
+		Existing.IsRead |= !IsWrite;
+		Existing.IsWrite |= IsWrite;
+		return;
+	}
+
+	Access NewAccess;
+	NewAccess.Resource = Resource;
+	NewAccess.State = State;
+	NewAccess.IsRead = !IsWrite;
+	NewAccess.IsWrite = IsWrite;
+	NewAccess.Producer = NO_PASS;
+	Accesses.push_back(NewAccess);
+	m_Compiled = false;
+}
+
+void RenderGraph::Compile(AllocationInfoQuery Query)
+{
+	m_Schedule.clear();
+	m_FinalBarriers.clear();
+	m_Stats = RenderGraphStats();
+	m_Stats.NumPasses = (uint32_t)m_Passes.size();
+
+	CullPasses();
+
+	for (uint32_t i = 0; i < m_Passes.size(); ++i)
+	{
+		if (!m_Passes[i].Alive)
+		{
+			++m_Stats.NumCulledPasses;
+			continue;
+		}
+
+		RenderGraphCompiledPass Compiled;
+		Compiled.Pass = i;
+		m_Schedule.push_back(Compiled);
+	}
+
+	// Lifetimes in schedule order
+	for (ResourceNode& Node : m_Resources)
+		Node.FirstPass = Node.LastPass = NO_PASS;
+
+	for (uint32_t s = 0; s < m_Schedule.size(); ++s)
+	{
+		for (const Access& Used : m_Passes[m_Schedule[s].Pass].Accesses)
+		{
+			ResourceNode& Node = m_Resources[Used.Resource];
+			if (Node.FirstPass == NO_PASS)
+				Node.FirstPass = s;
+			Node.LastPass = s;
+		}
+	}
+
+	PlaceTransients(Query != nullptr ? Query : &GpuHeapAllocator::GetAllocationInfo);
+	ComputeBarriers();
+
+	m_Compiled = true;
+}
+
+void RenderGraph::CullPasses()
+{
+	// Link every read to the pass that last wrote the resource before it
+	std::vector<uint32_t> LastWriter(m_Resources.size(), NO_PASS);
+	for (uint32_t p = 0; p < m_Passes.size(); ++p)
+	{
+		for (Access& Used : m_Passes[p].Accesses)
+		{
+			if (Used.IsRead)
+				Used.Producer = LastWriter[Used.Resource];
+		}
+
+		for (const Access& Used : m_Passes[p].Accesses)
+		{
+			if (Used.IsWrite)
+				LastWriter[Used.Resource] = p;
+		}
+	}
+
+	for (PassNode& Node : m_Passes)
+	{
+		Node.Alive = Node.HasSideEffects;
+		for (const Access& Used : Node.Accesses)
+		{
+			if (Used.IsWrite && m_Resources[Used.Resource].Imported != nullptr)
+				Node.Alive = true;
+		}
+	}
+
+	// Producers always come before their consumers, so one walk backwards reaches every pass a
+	// live pass depends on
+	for (uint32_t p = (uint32_t)m_Passes.size(); p-- > 0;)
+	{
+		if (!m_Passes[p].Alive)
+			continue;
+
+		for (const Access& Used : m_Passes[p].Accesses)
+		{
+			if (Used.IsRead && Used.Producer != NO_PASS)
+				m_Passes[Used.Producer].Alive = true;
+		}
+	}
+}
+
+void RenderGraph::PlaceTransients(AllocationInfoQuery Query)
+{
+	std::vector<uint32_t> Transients;
+	for (uint32_t r = 0; r < m_Resources.size(); ++r)
+	{
+		ResourceNode& Node = m_Resources[r];
+		if (Node.Imported != nullptr || Node.FirstPass == NO_PASS)
+			continue;
+
+		Node.Category = GpuHeapAllocator::GetCategory(Node.Desc);
+		D3D12_RESOURCE_ALLOCATION_INFO Info = Query(Node.Category, Node.Desc);
+		Node.Size = Info.SizeInBytes;
+		Node.Alignment = Info.Alignment;
+		Transients.push_back(r);
+
+		m_Stats.TransientMemoryRequested += Node.Size;
+	}
+
+	// Largest first, each one at the lowest offset that does not overlap anything alive at the same
+	// time.  Not optimal but close for the handful of resources a frame has.
+	std::stable_sort(Transients.begin(), Transients.end(), [this](uint32_t A, uint32_t B)
+	{
+		return m_Resources[A].Size > m_Resources[B].Size;
+	});
+
+	std::vector<uint32_t> Placed;
+	std::vector<std::pair<uint64_t, uint64_t>> Occupied;
+	for (uint32_t r : Transients)
+	{
+		ResourceNode& Node = m_Resources[r];
+
+		Occupied.clear();
+		for (uint32_t Other : Placed)
+		{
+			const ResourceNode& OtherNode = m_Resources[Other];
+			if (OtherNode.Category != Node.Category || OtherNode.LastPass < Node.FirstPass || Node.LastPass < OtherNode.FirstPass)
+				continue;
+			Occupied.push_back(std::make_pair(OtherNode.AliasOffset, OtherNode.AliasOffset + OtherNode.Size));
+		}
+		std::sort(Occupied.begin(), Occupied.end());
+
+		uint64_t Offset = 0;
+		for (const auto& Range : Occupied)
+		{
+			if (Math::AlignUp(Offset, Node.Alignment) + Node.Size <= Range.first)
+				break;
+			Offset = std::max(Offset, Range.second);
+		}
+
+		Node.AliasOffset = Math::AlignUp(Offset, Node.Alignment);
+		Placed.push_back(r);
+
+		m_CategorySize[Node.Category] = std::max(m_CategorySize[Node.Category], Node.AliasOffset + Node.Size);
+		m_CategoryAlignment[Node.Category] = std::max(m_CategoryAlignment[Node.Category], Node.Alignment);
+	}
+
+	for (uint32_t i = 0; i < kNumHeapCategories; ++i)
+		m_Stats.TransientMemoryAllocated += m_CategorySize[i];
+}
+
+void RenderGraph::ComputeBarriers()
+{
+	std::vector<D3D12_RESOURCE_STATES> CurrentState(m_Resources.size());
+	for (uint32_t r = 0; r < m_Resources.size(); ++r)
+		CurrentState[r] = m_Resources[r].Imported != nullptr ? m_Resources[r].Imported->GetUsageState() : UNDEFINED_STATE;
+
+	// Pass of the schedule that used each resource last
+	std::vector<uint32_t> LastUse(m_Resources.size(), NO_PASS);
+
+	for (uint32_t s = 0; s < m_Schedule.size(); ++s)
+	{
+		std::vector<RenderGraphBarrier>& Barriers = m_Schedule[s].Barriers;
+
+		for (const Access& Used : m_Passes[m_Schedule[s].Pass].Accesses)
+		{
+			const uint32_t r = Used.Resource;
+			ResourceNode& Node = m_Resources[r];
+			D3D12_RESOURCE_STATES NeededState = Used.State;
+
+			// Move straight to every state the following readers want, so they need no barrier at all
+			if (!Used.IsWrite && IsReadOnlyState(NeededState))
+			{
+				for (uint32_t Next = s + 1; Next < m_Schedule.size(); ++Next)
+				{
+					bool StopHere = false;
+					for (const Access& Later : m_Passes[m_Schedule[Next].Pass].Accesses)
+					{
+						if (Later.Resource != r)
+							continue;
+
+						if (Later.IsWrite || !IsReadOnlyState(Later.State))
+							StopHere = true;
+						else
+							NeededState |= Later.State;
+					}
+
+					if (StopHere)
+						break;
+				}
+			}
+
+			RenderGraphBarrier Barrier;
+			Barrier.Resource = r;
+			Barrier.AliasedResource = INVALID_RESOURCE;
+			Barrier.StateBefore = CurrentState[r];
+			Barrier.StateAfter = NeededState;
+			Barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+
+			const uint32_t PreviousUse = LastUse[r];
+			LastUse[r] = s;
+
+			if (CurrentState[r] == UNDEFINED_STATE)
+			{
+				// First use of a transient resource, it is created in the state it needs.  Find who had
+				// the memory last so the GPU knows it changes hands.
+				Node.InitialState = NeededState;
+				CurrentState[r] = NeededState;
+
+				uint32_t Previous = INVALID_RESOURCE;
+				for (uint32_t Other = 0; Other < m_Resources.size(); ++Other)
+				{
+					const ResourceNode& OtherNode = m_Resources[Other];
+					if (Other == r || OtherNode.Imported != nullptr || OtherNode.FirstPass == NO_PASS ||
+						OtherNode.Category != Node.Category || OtherNode.LastPass >= Node.FirstPass ||
+						OtherNode.AliasOffset >= Node.AliasOffset + Node.Size || Node.AliasOffset >= OtherNode.AliasOffset + OtherNode.Size)
+						continue;
+
+					if (Previous == INVALID_RESOURCE || m_Resources[Previous].LastPass < OtherNode.LastPass)
+						Previous = Other;
+				}
+
+				if (Previous != INVALID_RESOURCE)
+				{
+					Barrier.Type = RenderGraphBarrier::kAliasing;
+					Barrier.AliasedResource = Previous;
+					Barriers.push_back(Barrier);
+					++m_Stats.NumAliasingBarriers;
+				}
+				continue;
+			}
+
+			if (CurrentState[r] == NeededState || IsCoveredReadState(CurrentState[r], NeededState))
+			{
+				// Back to back unordered access still has to wait for the previous writes
+				if (NeededState == D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+				{
+					Barrier.Type = RenderGraphBarrier::kUAV;
+					Barriers.push_back(Barrier);
+					++m_Stats.NumUAVBarriers;
+				}
+				continue;
+			}
+
+			Barrier.Type = RenderGraphBarrier::kTransition;
+			AddTransition(Barrier, PreviousUse, s);
+			CurrentState[r] = NeededState;
+		}
+	}
+
+	for (uint32_t r = 0; r < m_Resources.size(); ++r)
+	{
+		const ResourceNode& Node = m_Resources[r];
+		if (Node.Imported == nullptr || CurrentState[r] == Node.FinalState)
+			continue;
+
+		RenderGraphBarrier Barrier;
+		Barrier.Type = RenderGraphBarrier::kTransition;
+		Barrier.Resource = r;
+		Barrier.AliasedResource = INVALID_RESOURCE;
+		Barrier.StateBefore = CurrentState[r];
+		Barrier.StateAfter = Node.FinalState;
+		Barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+		AddTransition(Barrier, LastUse[r], (uint32_t)m_Schedule.size());
+	}
+}
+
+void RenderGraph::AddTransition(RenderGraphBarrier Barrier, uint32_t PreviousUse, uint32_t Pass)
+{
+	// Pass is the schedule index of the pass that needs the new state, or the schedule size for the
+	// final barriers.  With passes in between that leave the resource alone, the transition begins
+	// after the previous use, or before the first pass for resources the graph has not used yet.
+	const uint32_t BeginAt = PreviousUse == NO_PASS ? 0 : PreviousUse + 1;
+	if (BeginAt < Pass)
+	{
+		Barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY;
+		m_Schedule[BeginAt].Barriers.push_back(Barrier);
+		Barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_END_ONLY;
+		++m_Stats.NumSplitTransitions;
+	}
+
+	if (Pass < m_Schedule.size())
+		m_Schedule[Pass].Barriers.push_back(Barrier);
+	else
+		m_FinalBarriers.push_back(Barrier);
+	++m_Stats.NumTransitions;
+}
+
+void RenderGraph::Execute(GraphicContext& Context)
+{
+	ASSERT(m_Compiled, "Render graph executed without being compiled");
+
+	GpuHeapAllocator& HeapAllocator = Context.GetHeapAllocator();
+
+	GpuHeapAllocation Ranges[kNumHeapCategories];
+	for (uint32_t i = 0; i < kNumHeapCategories; ++i)
+	{
+		m_CategoryAliased[i] = m_CategorySize[i] > 0 &&
+			HeapAllocator.AllocateTransientRange((GpuHeapCategory)i, m_CategorySize[i], m_CategoryAlignment[i], Ranges[i]);
+	}
+
+	for (uint32_t r = 0; r < m_Resources.size(); ++r)
+	{
+		const ResourceNode& Node = m_Resources[r];
+		if (Node.Imported != nullptr || Node.FirstPass == NO_PASS)
+			continue;
+
+		TransientSlot& Slot = GetSlot(r);
+		Slot.HasRTV = Slot.HasDSV = Slot.HasSRV = false;
+
+		const D3D12_CLEAR_VALUE* pClearValue = Node.HasClearValue ? &Node.ClearValue : nullptr;
+		if (m_CategoryAliased[Node.Category])
+			HeapAllocator.CreateAliasedResource(*Slot.Resource, Node.Name, Ranges[Node.Category], Node.AliasOffset, Node.Desc, Node.InitialState, pClearValue);
+		else
+			HeapAllocator.CreateTransientResource(*Slot.Resource, Node.Name, Node.Desc, Node.InitialState, pClearValue);
+	}
+
+	for (const RenderGraphCompiledPass& Compiled : m_Schedule)
+	{
+		RecordBarriers(Context, Compiled.Barriers);
+		m_Passes[Compiled.Pass].Execute(Context, *this);
+	}
+
+	RecordBarriers(Context, m_FinalBarriers);
+
+	// Nothing is submitted yet.  Every transient, placed or committed, goes through the heap
+	// allocator's deferred release and stays alive until the fence of this frame has passed.
+	for (uint32_t r = 0; r < m_Resources.size(); ++r)
+	{
+		if (m_Resources[r].Imported == nullptr && m_Resources[r].FirstPass != NO_PASS)
+			GetSlot(r).Resource->Destroy();
+	}
+}
+
+void RenderGraph::RecordBarriers(GraphicContext& Context, const std::vector<RenderGraphBarrier>& Barriers)
+{
+	for (const RenderGraphBarrier& Barrier : Barriers)
+	{
+		switch (Barrier.Type)
+		{
+		case RenderGraphBarrier::kTransition:
+			// The end of a split barrier is a TransitionResource to the state it began towards
+			if (Barrier.Flags == D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY)
+				Context.BeginResourceTransition(GetResource(Barrier.Resource), Barrier.StateAfter);
+			else
+				Context.TransitionResource(GetResource(Barrier.Resource), Barrier.StateAfter);
+			break;
+
+		case RenderGraphBarrier::kAliasing:
+			// Resources that did not fit in the shared range got memory of their own
+			if (m_CategoryAliased[m_Resources[Barrier.Resource].Category])
+				Context.InsertAliasBarrier(GetResource(Barrier.AliasedResource), GetResource(Barrier.Resource));
+			break;
+
+		case RenderGraphBarrier::kUAV:
+			Context.InsertUAVBarrier(GetResource(Barrier.Resource));
+			break;
+		}
+	}
+}
+
+RenderGraph::TransientSlot& RenderGraph::GetSlot(uint32_t Resource)
+{
+	ASSERT(m_SlotOfResource[Resource] != INVALID_RESOURCE, "Imported resources have no transient slot");
+	return m_Slots[m_SlotOfResource[Resource]];
+}
+
+GpuResource& RenderGraph::GetResource(uint32_t Resource)
+{
+	if (m_Resources[Resource].Imported != nullptr)
+		return *m_Resources[Resource].Imported;
+
+	return *GetSlot(Resource).Resource;
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE RenderGraph::GetRTV(uint32_t Resource)
+{
+	if (m_Resources[Resource].Imported != nullptr)
+		return m_Resources[Resource].ImportedViews.RTV;
+
+	// The descriptor is reused every frame, the view is rebuilt for this frame's resource
+	TransientSlot& Slot = GetSlot(Resource);
+	if (!Slot.HasRTV)
+	{
+		if (Slot.RTV.ptr == 0)
+			Slot.RTV = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+		device->CreateRenderTargetView(Slot.Resource->GetResource(), nullptr, Slot.RTV);
+		Slot.HasRTV = true;
+	}
+	return Slot.RTV;
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE RenderGraph::GetDSV(uint32_t Resource)
+{
+	if (m_Resources[Resource].Imported != nullptr)
+		return m_Resources[Resource].ImportedViews.DSV;
+
+	TransientSlot& Slot = GetSlot(Resource);
+	if (!Slot.HasDSV)
+	{
+		if (Slot.DSV.ptr == 0)
+			Slot.DSV = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_DSV);
+		device->CreateDepthStencilView(Slot.Resource->GetResource(), nullptr, Slot.DSV);
+		Slot.HasDSV = true;
+	}
+	return Slot.DSV;
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE RenderGraph::GetSRV(uint32_t Resource)
+{
+	if (m_Resources[Resource].Imported != nullptr)
+		return m_Resources[Resource].ImportedViews.SRV;
+
+	TransientSlot& Slot = GetSlot(Resource);
+	if (!Slot.HasSRV)
+	{
+		if (Slot.SRV.ptr == 0)
+			Slot.SRV = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		device->CreateShaderResourceView(Slot.Resource->GetResource(), nullptr, Slot.SRV);
+		Slot.HasSRV = true;
+	}
+	return Slot.SRV;
+}
+
+std::wstring RenderGraph::DescribeSchedule() const
+{
+	static const wchar_t* BarrierNames[] = { L"Transition", L"Aliasing", L"UAV" };
+
+	// Split transitions get a prefix for each half
+	auto SplitPrefix = [](const RenderGraphBarrier& Barrier)
+	{
+		if (Barrier.Flags == D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY)
+			return L"Begin ";
+		if (Barrier.Flags == D3D12_RESOURCE_BARRIER_FLAG_END_ONLY)
+			return L"End ";
+		return L"";
+	};
+
+	std::wstring Out;
+	wchar_t Line[512];
+
+	for (const RenderGraphCompiledPass& Compiled : m_Schedule)
+	{
+		for (const RenderGraphBarrier& Barrier : Compiled.Barriers)
+		{
+			swprintf_s(Line, L"    %s%s %s 0x%x -> 0x%x%s%s\n", SplitPrefix(Barrier), BarrierNames[Barrier.Type], m_Resources[Barrier.Resource].Name.c_str(),
+				(UINT)Barrier.StateBefore, (UINT)Barrier.StateAfter,
+				Barrier.AliasedResource != INVALID_RESOURCE ? L" after " : L"",
+				Barrier.AliasedResource != INVALID_RESOURCE ? m_Resources[Barrier.AliasedResource].Name.c_str() : L"");
+			Out += Line;
+		}
+
+		swprintf_s(Line, L"Pass %s\n", m_Passes[Compiled.Pass].Name.c_str());
+		Out += Line;
+	}
+
+	for (const RenderGraphBarrier& Barrier : m_FinalBarriers)
+	{
+		swprintf_s(Line, L"    Final %s%s 0x%x -> 0x%x\n", SplitPrefix(Barrier), m_Resources[Barrier.Resource].Name.c_str(),
+			(UINT)Barrier.StateBefore, (UINT)Barrier.StateAfter);
+		Out += Line;
+	}
+
+	for (const PassNode& Node : m_Passes)
+	{
+		if (!Node.Alive)
+		{
+			swprintf_s(Line, L"Culled %s\n", Node.Name.c_str());
+			Out += Line;
+		}
+	}
+
+	swprintf_s(Line, L"%u passes, %u culled, %u transitions (%u split), %u aliasing, %u UAV barriers\n"
+		L"Transient memory %llu KB aliased into %llu KB, %llu KB saved\n",
+		m_Stats.NumPasses, m_Stats.NumCulledPasses, m_Stats.NumTransitions, m_Stats.NumSplitTransitions, m_Stats.NumAliasingBarriers, m_Stats.NumUAVBarriers,
+		m_Stats.TransientMemoryRequested / 1024, m_Stats.TransientMemoryAllocated / 1024, m_Stats.MemorySaved() / 1024);
+	Out += Line;
+
+	return Out;
+}
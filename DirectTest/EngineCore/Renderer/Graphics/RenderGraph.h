@@ -0,0 +1,195 @@
+#pragma once
+
+#include "../../Core/Common.h"
+#include "GpuResource.h"
+#include "GpuHeapAllocator.h"
+#include <functional>
+
+namespace Renderer {
+	class GraphicContext;
+}
+
+// Views of an imported resource, null handles for the ones it does not have
+struct RenderGraphViews
+{
+	D3D12_CPU_DESCRIPTOR_HANDLE RTV;
+	D3D12_CPU_DESCRIPTOR_HANDLE DSV;
+	D3D12_CPU_DESCRIPTOR_HANDLE SRV;
+};
+
+struct RenderGraphBarrier
+{
+	enum BarrierType { kTransition, kAliasing, kUAV };
+
+	BarrierType Type;
+	uint32_t Resource;
+	uint32_t AliasedResource;		// kAliasing: the resource that used the memory before, or INVALID_RESOURCE
+	D3D12_RESOURCE_STATES StateBefore;
+	D3D12_RESOURCE_STATES StateAfter;
+	D3D12_RESOURCE_BARRIER_FLAGS Flags;		// kTransition: BEGIN_ONLY or END_ONLY for the halves of a split barrier
+};
+
+// A pass that survived culling, in execution order, with the barriers issued right before it
+struct RenderGraphCompiledPass
+{
+	uint32_t Pass;
+	std::vector<RenderGraphBarrier> Barriers;
+};
+
+struct RenderGraphStats
+{
+	uint32_t NumPasses;
+	uint32_t NumCulledPasses;
+	uint32_t NumTransitions;
+	uint32_t NumSplitTransitions;			// Of NumTransitions, the ones begun ahead of the pass that needs them
+	uint32_t NumAliasingBarriers;
+	uint32_t NumUAVBarriers;
+	uint64_t TransientMemoryRequested;		// Sum of every transient resource on its own
+	uint64_t TransientMemoryAllocated;		// What the aliased layout actually needs
+
+	uint64_t MemorySaved() const { return TransientMemoryRequested - TransientMemoryAllocated; }
+};
+
+// Frame graph built from scratch every frame.  Passes declare which resources they read and write
+// and in which state, then Compile() works out the schedule without touching the device:
+//
+//  - Passes are kept in declaration order, so a read always sees the last write declared before it.
+//  - Passes whose results nobody consumes are culled.  A pass is a root when it writes an imported
+//    resource or is flagged as having side effects.
+//  - Each resource gets the fewest transitions possible: consecutive reads are merged into one
+//    combined read state and nothing is emitted when the state already matches.
+//  - A transition with passes in between that do not use the resource is split.  It begins right
+//    after the last pass that used it, e.g. its last writer, and ends before the pass that needs it,
+//    so the GPU can work on it meanwhile.
+//  - Transient resources whose lifetimes do not overlap share memory.  They are packed per heap
+//    category into one range of the frame's transient heap, with aliasing barriers where memory
+//    changes hands.
+//
+// Execute() then creates the transient resources, records the barriers and runs each pass.  The
+// schedule can be inspected after Compile(); passing an allocation query to Compile() lets it run
+// without a device.
+class RenderGraph
+{
+public:
+	static const uint32_t INVALID_RESOURCE = 0xFFFFFFFF;
+
+	typedef std::function<void(Renderer::GraphicContext& Context, RenderGraph& Graph)> ExecuteFunction;
+	typedef D3D12_RESOURCE_ALLOCATION_INFO (*AllocationInfoQuery)(GpuHeapCategory Category, D3D12_RESOURCE_DESC& Desc);
+
+	RenderGraph();
+
+	// Forgets every pass and resource.  Descriptors for transient views are kept for the next frame.
+	void Reset();
+
+	// FinalState is the state the resource is left in at the end of Execute()
+	uint32_t ImportResource(const std::wstring& Name, GpuResource& Resource, D3D12_RESOURCE_STATES FinalState,
+		const RenderGraphViews* pViews = nullptr);
+
+	// Only created if a pass that survives culling uses it.  The first pass writing it must clear or
+	// fully overwrite it, the memory may hold anything.
+	uint32_t CreateTransient(const std::wstring& Name, const D3D12_RESOURCE_DESC& Desc, const D3D12_CLEAR_VALUE* pClearValue = nullptr);
+
+	uint32_t AddPass(const std::wstring& Name, const ExecuteFunction& Execute, bool HasSideEffects = false);
+
+	// A pass that keeps what was in a resource, e.g. depth testing against a prepass, declares it as
+	// both read and written in the same state.
+	void Read(uint32_t Pass, uint32_t Resource, D3D12_RESOURCE_STATES State);
+	void Write(uint32_t Pass, uint32_t Resource, D3D12_RESOURCE_STATES State);
+
+	// Uses GpuHeapAllocator::GetAllocationInfo when no query is given
+	void Compile(AllocationInfoQuery Query = nullptr);
+	void Execute(Renderer::GraphicContext& Context);
+
+	// Valid inside a pass
+	GpuResource& GetResource(uint32_t Resource);
+	D3D12_CPU_DESCRIPTOR_HANDLE GetRTV(uint32_t Resource);
+	D3D12_CPU_DESCRIPTOR_HANDLE GetDSV(uint32_t Resource);
+	D3D12_CPU_DESCRIPTOR_HANDLE GetSRV(uint32_t Resource);
+
+	// Valid after Compile()
+	const std::vector<RenderGraphCompiledPass>& GetSchedule() const { return m_Schedule; }
+	const std::vector<RenderGraphBarrier>& GetFinalBarriers() const { return m_FinalBarriers; }
+	const RenderGraphStats& GetStats() const { return m_Stats; }
+	bool IsPassCulled(uint32_t Pass) const { return !m_Passes[Pass].Alive; }
+	uint64_t GetTransientOffset(uint32_t Resource) const { return m_Resources[Resource].AliasOffset; }
+	const std::wstring& GetPassName(uint32_t Pass) const { return m_Passes[Pass].Name; }
+	const std::wstring& GetResourceName(uint32_t Resource) const { return m_Resources[Resource].Name; }
+
+	// Readable dump of the compiled schedule for the debugger output
+	std::wstring DescribeSchedule() const;
+
+private:
+	struct Access
+	{
+		uint32_t Resource;
+		D3D12_RESOURCE_STATES State;
+		bool IsRead;
+		bool IsWrite;
+		uint32_t Producer;		// Pass that last wrote the resource before this one, for reads
+	};
+
+	struct PassNode
+	{
+		std::wstring Name;
+		ExecuteFunction Execute;
+		std::vector<Access> Accesses;
+		bool HasSideEffects;
+		bool Alive;
+	};
+
+	struct ResourceNode
+	{
+		std::wstring Name;
+		GpuResource* Imported;
+		D3D12_RESOURCE_STATES FinalState;
+		RenderGraphViews ImportedViews;
+
+		D3D12_RESOURCE_DESC Desc;
+		D3D12_CLEAR_VALUE ClearValue;
+		bool HasClearValue;
+
+		// Filled in by Compile()
+		GpuHeapCategory Category;
+		uint64_t Size;
+		uint64_t Alignment;
+		uint64_t AliasOffset;
+		uint32_t FirstPass;		// Indices into m_Schedule
+		uint32_t LastPass;
+		D3D12_RESOURCE_STATES InitialState;
+	};
+
+	// Per transient resource, survives Reset() so descriptors are not allocated every frame
+	struct TransientSlot
+	{
+		std::unique_ptr<GpuResource> Resource;
+		D3D12_CPU_DESCRIPTOR_HANDLE RTV;
+		D3D12_CPU_DESCRIPTOR_HANDLE DSV;
+		D3D12_CPU_DESCRIPTOR_HANDLE SRV;
+		bool HasRTV;
+		bool HasDSV;
+		bool HasSRV;
+	};
+
+	void AddAccess(uint32_t Pass, uint32_t Resource, D3D12_RESOURCE_STATES State, bool IsWrite);
+	void CullPasses();
+	void ComputeBarriers();
+	void AddTransition(RenderGraphBarrier Barrier, uint32_t PreviousUse, uint32_t Pass);
+	void PlaceTransients(AllocationInfoQuery Query);
+	void RecordBarriers(Renderer::GraphicContext& Context, const std::vector<RenderGraphBarrier>& Barriers);
+	TransientSlot& GetSlot(uint32_t Resource);
+
+	std::vector<PassNode> m_Passes;
+	std::vector<ResourceNode> m_Resources;
+	std::vector<RenderGraphCompiledPass> m_Schedule;
+	std::vector<RenderGraphBarrier> m_FinalBarriers;
+	RenderGraphStats m_Stats;
+	bool m_Compiled;
+
+	uint64_t m_CategorySize[kNumHeapCategories];
+	uint64_t m_CategoryAlignment[kNumHeapCategories];
+	bool m_CategoryAliased[kNumHeapCategories];	// False when the range did not fit and resources got memory of their own
+
+	std::vector<TransientSlot> m_Slots;
+	std::vector<uint32_t> m_SlotOfResource;
+	uint32_t m_NumTransients;
+};
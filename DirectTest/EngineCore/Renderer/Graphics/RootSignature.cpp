@@ -1,4 +1,5 @@
 #include "RootSignature.h"
+#include "PipelineCache.h"
 #include "../Core/GraphicContext.h"
 #include <map>
 #include <thread>
@@ -9,13 +10,47 @@ using namespace Renderer;
 using Microsoft::WRL::ComPtr;
 
 
-static std::map< size_t, ComPtr<ID3D12RootSignature> > s_RootSignatureHashMap;
+struct RootSignatureEntry
+{
+	ComPtr<ID3D12RootSignature> Signature;
+	vector<uint8_t> Description;		// The bytes the hash was computed from, compared on a hit
+};
+
+static std::map< uint64_t, RootSignatureEntry > s_RootSignatureHashMap;
 
 void RootSignature::DestroyAll(void)
 {
 	s_RootSignatureHashMap.clear();
 }
 
+static void AppendBytes(vector<uint8_t>& Description, const void* Data, size_t Size)
+{
+	Description.insert(Description.end(), (const uint8_t*)Data, (const uint8_t*)Data + Size);
+}
+
+// Only the members in use, the rest of the union is left uninitialized.  Tables by content, the
+// pointer to the ranges differs between root signatures.
+static void AppendParameter(vector<uint8_t>& Description, const D3D12_ROOT_PARAMETER& RootParam)
+{
+	AppendBytes(Description, &RootParam.ParameterType, sizeof(RootParam.ParameterType));
+	AppendBytes(Description, &RootParam.ShaderVisibility, sizeof(RootParam.ShaderVisibility));
+
+	switch (RootParam.ParameterType)
+	{
+	case D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE:
+		AppendBytes(Description, &RootParam.DescriptorTable.NumDescriptorRanges, sizeof(UINT));
+		AppendBytes(Description, RootParam.DescriptorTable.pDescriptorRanges,
+			RootParam.DescriptorTable.NumDescriptorRanges * sizeof(D3D12_DESCRIPTOR_RANGE));
+		break;
+	case D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS:
+		AppendBytes(Description, &RootParam.Constants, sizeof(RootParam.Constants));
+		break;
+	default:
+		AppendBytes(Description, &RootParam.Descriptor, sizeof(RootParam.Descriptor));
+		break;
+	}
+}
+
 void RootSignature::InitStaticSampler(
 	UINT Register,
 	const D3D12_SAMPLER_DESC& NonStaticSamplerDesc,
@@ -72,6 +107,42 @@ void RootSignature::InitStaticSampler(
 	}
 }
 
+void RootSignature::InitFromLayout(const ShaderLayout& Layout, const D3D12_SAMPLER_DESC& StaticSamplerDesc)
+{
+	Reset(Layout.NumParameters, Layout.NumSamplers);
+
+	for (UINT i = 0; i < Layout.NumParameters; ++i)
+	{
+		const ShaderRootParameter& Source = Layout.Parameters[i];
+		RootParameter& Param = m_ParamArray[i];
+
+		switch (Source.Type)
+		{
+		case D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS:
+			Param.InitAsConstants(Source.Register, Source.Count, Source.Visibility);
+			Param.m_RootParam.Constants.RegisterSpace = Source.Space;
+			break;
+		case D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE:
+			Param.InitAsDescriptorTable(1, Source.Visibility);
+			Param.SetTableRange(0, Source.RangeType, Source.Register, Source.Count, Source.Space);
+			break;
+		default:
+			Param.m_RootParam.ParameterType = Source.Type;
+			Param.m_RootParam.ShaderVisibility = Source.Visibility;
+			Param.m_RootParam.Descriptor.ShaderRegister = Source.Register;
+			Param.m_RootParam.Descriptor.RegisterSpace = Source.Space;
+			break;
+		}
+	}
+
+	for (UINT i = 0; i < Layout.NumSamplers; ++i)
+	{
+		const ShaderStaticSampler& Sampler = Layout.Samplers[i];
+		InitStaticSampler(Sampler.Register, StaticSamplerDesc, Sampler.Visibility);
+		m_SamplerArray[i].RegisterSpace = Sampler.Space;
+	}
+}
+
 void RootSignature::Finalize(const std::wstring& name, D3D12_ROOT_SIGNATURE_FLAGS Flags)
 {
 	if (m_Finalized)
@@ -88,22 +159,41 @@ void RootSignature::Finalize(const std::wstring& name, D3D12_ROOT_SIGNATURE_FLAG
 
 	m_DescriptorTableBitMap = 0;
 	m_SamplerTableBitMap = 0;
+	m_RootDwords = 0;
 
-	size_t HashCode = Utility::HashState(&RootDesc.Flags);
-	HashCode = Utility::HashState(RootDesc.pStaticSamplers, m_NumSamplers, HashCode);
+	// Nothing in it changes between runs, the hash doubles as the key of the disk cache
+	vector<uint8_t> Description;
+	AppendBytes(Description, &RootDesc.Flags, sizeof(RootDesc.Flags));
+	AppendBytes(Description, RootDesc.pStaticSamplers, m_NumSamplers * sizeof(D3D12_STATIC_SAMPLER_DESC));
 
 	for (UINT Param = 0; Param < m_NumParameters; ++Param)
 	{
 		const D3D12_ROOT_PARAMETER& RootParam = RootDesc.pParameters[Param];
 		m_DescriptorTableSize[Param] = 0;
+		AppendParameter(Description, RootParam);
+
+		switch (RootParam.ParameterType)
+		{
+		case D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS:
+			m_RootDwords += RootParam.Constants.Num32BitValues;
+			break;
+		case D3D12_ROOT_PARAMETER_TYPE_CBV:
+		case D3D12_ROOT_PARAMETER_TYPE_SRV:
+		case D3D12_ROOT_PARAMETER_TYPE_UAV:
+			m_RootDwords += 2;
+			break;
+		case D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE:
+			m_RootDwords += 1;
+			break;
+		default:
+			ASSERT(false, "Root parameter %u was not initialized", Param);
+			break;
+		}
 
 		if (RootParam.ParameterType == D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE)
 		{
 			ASSERT(RootParam.DescriptorTable.pDescriptorRanges != nullptr);
 
-			HashCode = Utility::HashState(RootParam.DescriptorTable.pDescriptorRanges,
-				RootParam.DescriptorTable.NumDescriptorRanges, HashCode);
-
 			// We keep track of sampler descriptor tables separately from CBV_SRV_UAV descriptor tables
 			if (RootParam.DescriptorTable.pDescriptorRanges->RangeType == D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER)
 				m_SamplerTableBitMap |= (1 << Param);
@@ -113,47 +203,78 @@ void RootSignature::Finalize(const std::wstring& name, D3D12_ROOT_SIGNATURE_FLAG
 			for (UINT TableRange = 0; TableRange < RootParam.DescriptorTable.NumDescriptorRanges; ++TableRange)
 				m_DescriptorTableSize[Param] += RootParam.DescriptorTable.pDescriptorRanges[TableRange].NumDescriptors;
 		}
-		else
-			HashCode = Utility::HashState(&RootParam, 1, HashCode);
 	}
 
-	ID3D12RootSignature** RSRef = nullptr;
+	ASSERT(m_RootDwords <= MAX_ROOT_DWORDS, "Root signature \"%ls\" needs %u DWORDs, the limit is %u",
+		name.c_str(), m_RootDwords, MAX_ROOT_DWORDS);
+
+	m_Fingerprint = Utility::Hash64(Description.data(), Description.size());
+
+	RootSignatureEntry* Entry = nullptr;
 	bool firstCompile = false;
 	{
 		static mutex s_HashMapMutex;
 		lock_guard<mutex> CS(s_HashMapMutex);
-		auto iter = s_RootSignatureHashMap.find(HashCode);
 
-		// Reserve space so the next inquiry will find that someone got here first.
-		if (iter == s_RootSignatureHashMap.end())
+		// A different description with the same hash moves on to the next slot
+		for (uint64_t HashCode = m_Fingerprint;; ++HashCode)
 		{
-			RSRef = s_RootSignatureHashMap[HashCode].GetAddressOf();
-			firstCompile = true;
+			auto iter = s_RootSignatureHashMap.find(HashCode);
+
+			// Reserve space so the next inquiry will find that someone got here first.
+			if (iter == s_RootSignatureHashMap.end())
+			{
+				Entry = &s_RootSignatureHashMap[HashCode];
+				Entry->Description = Description;
+				firstCompile = true;
+				break;
+			}
+			else if (iter->second.Description == Description)
+			{
+				Entry = &iter->second;
+				break;
+			}
 		}
-		else
-			RSRef = iter->second.GetAddressOf();
 	}
 
 	if (firstCompile)
 	{
-		ComPtr<ID3DBlob> pOutBlob, pErrorBlob;
+		// The serialized blob from an earlier run saves serializing it again.  The fingerprint is a
+		// second hash with another seed, so a colliding key is still caught.
+		const uint64_t Fingerprint = PipelineCache::Fingerprint(Description.data(), Description.size(), m_Fingerprint);
+		const void* CachedBlob = nullptr;
+		size_t CachedSize = 0;
+		bool Cached = pipelineCache.Find(PipelineCache::kRootSignature, m_Fingerprint, Fingerprint, CachedBlob, CachedSize);
+		if (Cached && FAILED(device->CreateRootSignature(1, CachedBlob, CachedSize, MY_IID_PPV_ARGS(&m_Signature))))
+		{
+			pipelineCache.MarkStale(PipelineCache::kRootSignature, m_Fingerprint, Fingerprint);
+			Cached = false;
+		}
 
-		ASSERT_SUCCEEDED(D3D12SerializeRootSignature(&RootDesc, D3D_ROOT_SIGNATURE_VERSION_1,
-			pOutBlob.GetAddressOf(), pErrorBlob.GetAddressOf()));
+		if (!Cached)
+		{
+			ComPtr<ID3DBlob> pOutBlob, pErrorBlob;
+
+			ASSERT_SUCCEEDED(D3D12SerializeRootSignature(&RootDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+				pOutBlob.GetAddressOf(), pErrorBlob.GetAddressOf()));
 
-		ASSERT_SUCCEEDED(device->CreateRootSignature(1, pOutBlob->GetBufferPointer(), pOutBlob->GetBufferSize(),
-			MY_IID_PPV_ARGS(&m_Signature)));
+			ASSERT_SUCCEEDED(device->CreateRootSignature(1, pOutBlob->GetBufferPointer(), pOutBlob->GetBufferSize(),
+				MY_IID_PPV_ARGS(&m_Signature)));
+
+			pipelineCache.Store(PipelineCache::kRootSignature, m_Fingerprint, Fingerprint,
+				pOutBlob->GetBufferPointer(), pOutBlob->GetBufferSize());
+		}
 
 		m_Signature->SetName(name.c_str());
 
-		s_RootSignatureHashMap[HashCode].Attach(m_Signature);
-		ASSERT(*RSRef == m_Signature);
+		// Published through the reserved entry, the map itself is only touched under the lock
+		Entry->Signature.Attach(m_Signature);
 	}
 	else
 	{
-		while (*RSRef == nullptr)
+		while (Entry->Signature == nullptr)
 			this_thread::yield();
-		m_Signature = *RSRef;
+		m_Signature = Entry->Signature.Get();
 	}
 
 	m_Finalized = TRUE;
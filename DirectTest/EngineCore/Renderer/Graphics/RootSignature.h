@@ -4,6 +4,7 @@
 #ifndef HASH_INCLUDED
 #include "../../Core/Utility/Hash.h"
 #endif
+#include "ShaderLayout.h"
 
 
 class RootParameter
@@ -99,12 +100,16 @@ protected:
 // Root descriptor (CBV, SRV, or UAV) = 2 DWORDs each
 // Descriptor table pointer = 1 DWORD
 // Static samplers = 0 DWORDS (compiled into shader)
+// Finalize() checks the total against the limit.  Per-draw values are cheapest as root constants,
+// larger per-object data belongs in a buffer the constants index into.
 class RootSignature
 {
 	friend class DynamicDescriptorHeap;
 
 public:
 
+	static const UINT MAX_ROOT_DWORDS = 64;
+
 	RootSignature(UINT NumRootParams = 0, UINT NumStaticSamplers = 0) : m_Finalized(FALSE), m_NumParameters(NumRootParams)
 	{
 		Reset(NumRootParams, NumStaticSamplers);
@@ -147,9 +152,17 @@ public:
 	void InitStaticSampler(UINT Register, const D3D12_SAMPLER_DESC& NonStaticSamplerDesc,
 		D3D12_SHADER_VISIBILITY Visibility = D3D12_SHADER_VISIBILITY_ALL);
 
+	// Resets to the parameters and static samplers of a generated layout.  Every static sampler gets
+	// the same description, reflection only says where they are.
+	void InitFromLayout(const ShaderLayout& Layout, const D3D12_SAMPLER_DESC& StaticSamplerDesc);
+
 	void Finalize(const std::wstring& name, D3D12_ROOT_SIGNATURE_FLAGS Flags = D3D12_ROOT_SIGNATURE_FLAG_NONE);
 
 	ID3D12RootSignature* GetSignature() const { return m_Signature; }
+	// DWORDs of the 64 available used by the root parameters
+	UINT GetRootDwords() const { return m_RootDwords; }
+	// Hash of the whole description, stable between runs
+	uint64_t GetFingerprint() const { return m_Fingerprint; }
 
 protected:
 
@@ -157,6 +170,8 @@ protected:
 	UINT m_NumParameters;
 	UINT m_NumSamplers;
 	UINT m_NumInitializedStaticSamplers;
+	UINT m_RootDwords;
+	uint64_t m_Fingerprint;
 	uint32_t m_DescriptorTableBitMap;		// One bit is set for root parameters that are non-sampler descriptor tables
 	uint32_t m_SamplerTableBitMap;			// One bit is set for root parameters that are sampler descriptor tables
 	uint32_t m_DescriptorTableSize[16];		// Non-sampler descriptor tables need to know their descriptor count
@@ -0,0 +1,36 @@
+#include "ShaderLayout.h"
+#include "GeneratedShaderLayouts.h"
+#include <stdexcept>
+
+int ShaderLayout::GetRootIndex(const char* Binding) const
+{
+	for (UINT i = 0; i < NumParameters; ++i)
+	{
+		if (strcmp(Parameters[i].Name, Binding) == 0)
+			return (int)i;
+	}
+	return -1;
+}
+
+const ShaderLayout* FindShaderLayout(const char* Name, uint32_t Permutation)
+{
+	for (const ShaderLayout& Layout : GeneratedShaderLayouts::Layouts)
+	{
+		if (Layout.Permutation == Permutation && strcmp(Layout.Name, Name) == 0)
+			return &Layout;
+	}
+	return nullptr;
+}
+
+const ShaderLayout& RequireShaderLayout(const char* Name, uint32_t Permutation)
+{
+	const ShaderLayout* Layout = FindShaderLayout(Name, Permutation);
+	if (Layout == nullptr)
+	{
+		char Message[256];
+		sprintf_s(Message, "Shader %s, permutation 0x%x has no layout, add it to Tools/build_shader_library.py", Name, Permutation);
+		Utility::Printf("%s\n", Message);
+		throw std::runtime_error(Message);
+	}
+	return *Layout;
+}
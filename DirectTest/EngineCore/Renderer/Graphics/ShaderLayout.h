@@ -0,0 +1,49 @@
+#pragma once
+
+#include "../../Core/Common.h"
+
+// Root signatures and input layouts of the shader variants, generated from their reflection by
+// Tools/build_shader_library.py into GeneratedShaderLayouts.h.  Bindings a variant does not use are
+// not in its layout, so root indices can differ between permutations and are looked up by the name
+// of the binding in the HLSL.
+
+struct ShaderRootParameter
+{
+	const char* Name;
+	D3D12_ROOT_PARAMETER_TYPE Type;
+	D3D12_DESCRIPTOR_RANGE_TYPE RangeType;	// Of the single range of a descriptor table
+	UINT Register;
+	UINT Space;
+	UINT Count;								// 32-bit values of root constants, descriptors of a table
+	D3D12_SHADER_VISIBILITY Visibility;
+};
+
+struct ShaderStaticSampler
+{
+	const char* Name;
+	UINT Register;
+	UINT Space;
+	D3D12_SHADER_VISIBILITY Visibility;
+};
+
+struct ShaderLayout
+{
+	const char* Name;
+	uint32_t Permutation;
+	const ShaderRootParameter* Parameters;	// From the most to the least often changed
+	UINT NumParameters;
+	const ShaderStaticSampler* Samplers;
+	UINT NumSamplers;
+	const D3D12_INPUT_ELEMENT_DESC* InputElements;
+	UINT NumInputElements;
+	UINT VertexStride;						// Of the whole vertex, also the elements that are not read
+
+	// Root index of a binding, or -1 if the variant does not use it
+	int GetRootIndex(const char* Binding) const;
+};
+
+// Null if the variant is not in Tools/build_shader_library.py
+const ShaderLayout* FindShaderLayout(const char* Name, uint32_t Permutation);
+// The same for variants the engine cannot run without: a missing one prints and throws
+// std::runtime_error, in release builds too
+const ShaderLayout& RequireShaderLayout(const char* Name, uint32_t Permutation);
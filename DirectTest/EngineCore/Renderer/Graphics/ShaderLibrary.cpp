@@ -0,0 +1,125 @@
+#include "ShaderLibrary.h"
+#include "../../Core/Utility/Hash.h"
+#include <stdexcept>
+
+using namespace std;
+
+namespace Renderer
+{
+	ShaderLibrary shaderLibrary;
+}
+
+ShaderLibrary::ShaderLibrary()
+{
+	Close();
+}
+
+uint64_t ShaderLibrary::MakeKey(const char* Name, ShaderStage Stage, uint32_t Permutation)
+{
+	const uint64_t Variant = (uint64_t)Stage << 32 | Permutation;
+	return Utility::Hash64(Name, strlen(Name), Variant);
+}
+
+bool ShaderLibrary::Open(const wstring& FileName)
+{
+	Close();
+
+	LARGE_INTEGER Frequency, Start, End;
+	QueryPerformanceFrequency(&Frequency);
+	QueryPerformanceCounter(&Start);
+
+	if (!m_MappedFile.Open(FileName))
+		return false;
+
+	const uint8_t* MappedData = m_MappedFile.GetData();
+	const size_t MappedSize = m_MappedFile.GetSize();
+	const FileHeader& Header = *(const FileHeader*)MappedData;
+
+	if (MappedSize < sizeof(FileHeader) || Header.Magic != FILE_MAGIC || Header.Version != FORMAT_VERSION ||
+		(size_t)Header.NumEntries * sizeof(FileEntry) > MappedSize - sizeof(FileHeader))
+	{
+		Utility::Printf(L"%s is not a shader library of version %u\n", FileName.c_str(), FORMAT_VERSION);
+		Close();
+		return false;
+	}
+
+	const FileEntry* Table = (const FileEntry*)(MappedData + sizeof(FileHeader));
+	m_Variants.reserve(Header.NumEntries);
+
+	for (uint32_t i = 0; i < Header.NumEntries; ++i)
+	{
+		const FileEntry& Entry = Table[i];
+		if (Entry.Offset > MappedSize || Entry.Size > MappedSize - Entry.Offset || Entry.Offset % BLOB_ALIGNMENT != 0)
+		{
+			Utility::Printf(L"%s is corrupt\n", FileName.c_str());
+			Close();
+			return false;
+		}
+
+		const string Name(Entry.Name, strnlen(Entry.Name, MAX_NAME_LENGTH));
+
+		Variant& Added = m_Variants[MakeKey(Name.c_str(), (ShaderStage)Entry.Stage, Entry.Permutation)];
+		Added.Name = Name;
+		Added.Bytecode = MappedData + Entry.Offset;
+		Added.Size = (size_t)Entry.Size;
+	}
+
+	QueryPerformanceCounter(&End);
+
+	m_Stats.NumVariants = Header.NumEntries;
+	m_Stats.NumBlobs = Header.NumBlobs;
+	m_Stats.FileSize = MappedSize;
+	m_Stats.OpenMs = (float)((End.QuadPart - Start.QuadPart) * 1000.0 / Frequency.QuadPart);
+
+	Utility::Printf(L"Shader library %s: %u variants in %u blobs, %llu KB, opened in %.2f ms\n", FileName.c_str(),
+		m_Stats.NumVariants, m_Stats.NumBlobs, m_Stats.FileSize / 1024, m_Stats.OpenMs);
+
+	return true;
+}
+
+void ShaderLibrary::Close()
+{
+	m_Variants.clear();
+	m_MappedFile.Close();
+
+	m_Stats.NumVariants = 0;
+	m_Stats.NumBlobs = 0;
+	m_Stats.FileSize = 0;
+	m_Stats.OpenMs = 0.0f;
+	m_Stats.NumRequests = 0;
+	m_Stats.NumMisses = 0;
+}
+
+D3D12_SHADER_BYTECODE ShaderLibrary::GetShader(const char* Name, ShaderStage Stage, uint32_t Permutation)
+{
+	D3D12_SHADER_BYTECODE Bytecode = {};
+	++m_Stats.NumRequests;
+
+	auto Iter = m_Variants.find(MakeKey(Name, Stage, Permutation));
+	if (Iter == m_Variants.end())
+	{
+		++m_Stats.NumMisses;
+		return Bytecode;
+	}
+
+	const Variant& Found = Iter->second;
+	ASSERT(Found.Name == Name, "Shader variant keys of %s and %s collide", Found.Name.c_str(), Name);
+
+	Bytecode.pShaderBytecode = Found.Bytecode;
+	Bytecode.BytecodeLength = Found.Size;
+	return Bytecode;
+}
+
+D3D12_SHADER_BYTECODE ShaderLibrary::RequireShader(const char* Name, ShaderStage Stage, uint32_t Permutation)
+{
+	D3D12_SHADER_BYTECODE Bytecode = GetShader(Name, Stage, Permutation);
+	if (Bytecode.pShaderBytecode == nullptr)
+	{
+		char Message[256];
+		sprintf_s(Message, "Shader %s, stage %u, permutation 0x%x is not in the library, add it to Tools/build_shader_library.py",
+			Name, (uint32_t)Stage, Permutation);
+		Utility::Printf("%s\n", Message);
+		throw std::runtime_error(Message);
+	}
+	return Bytecode;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "../../Core/Common.h"
+#include "../../Core/Utility/FileUtility.h"
+#include <atomic>
+#include <unordered_map>
+
+// Bits of a permutation key, the features a shader variant was compiled with.  They become the
+// defines of Shaders/ShaderFeatures.hlsli and must match Tools/build_shader_library.py.
+enum ShaderFeature : uint32_t
+{
+	kShaderTextured = 1 << 0,
+	kShaderQuantizedVertices = 1 << 1,
+	kShaderSkinning = 1 << 2,
+	kShaderDepthOnly = 1 << 3,
+
+	// Number of directional lights, 0 to 3
+	kShaderLightCountShift = 4,
+	kShaderLightCountMask = 3 << kShaderLightCountShift
+};
+
+inline uint32_t ShaderLightCount(uint32_t Count)
+{
+	ASSERT(Count <= 3, "At most 3 lights");
+	return Count << kShaderLightCountShift;
+}
+
+enum ShaderStage : uint32_t
+{
+	kVertexShader,
+	kPixelShader,
+	kComputeShader
+};
+
+struct ShaderLibraryStats
+{
+	uint32_t NumVariants;
+	uint32_t NumBlobs;			// Variants with the same bytecode share one
+	uint64_t FileSize;
+	float OpenMs;				// Mapping the file and reading the table of contents
+	std::atomic<uint32_t> NumRequests;
+	std::atomic<uint32_t> NumMisses;
+};
+
+// Shader variants compiled offline by Tools/build_shader_library.py and packed into one file.  The
+// file is memory mapped when the library is opened and the bytecode handed out points straight into
+// the mapping, so a variant costs no read and no copy; its pages come from disk the first time the
+// driver touches them.
+//
+// The file is a header, one entry per variant and then the bytecode blobs, each 16-byte aligned.
+// Variants that compile to the same bytecode point to the same blob.
+class ShaderLibrary
+{
+public:
+	ShaderLibrary();
+	~ShaderLibrary() { Close(); }
+
+	// Returns false if the file is missing or not a library of this version
+	bool Open(const std::wstring& FileName);
+	void Close();
+
+	// Bytecode of the variant, or empty bytecode if the library does not have it.  Stays valid until
+	// Close().  Can be called from any thread.
+	D3D12_SHADER_BYTECODE GetShader(const char* Name, ShaderStage Stage, uint32_t Permutation);
+	// For variants the engine cannot run without.  A missing one is an error in release builds too: it
+	// prints which variant and throws std::runtime_error.
+	D3D12_SHADER_BYTECODE RequireShader(const char* Name, ShaderStage Stage, uint32_t Permutation);
+
+	uint32_t GetNumVariants() const { return (uint32_t)m_Variants.size(); }
+	const ShaderLibraryStats& GetStats() const { return m_Stats; }
+
+private:
+	static const uint32_t FILE_MAGIC = 0x424C4853;		// "SHLB"
+	static const uint32_t FORMAT_VERSION = 2;
+	static const size_t MAX_NAME_LENGTH = 32;
+	static const size_t BLOB_ALIGNMENT = 16;
+
+	struct FileHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint32_t NumEntries;
+		uint32_t NumBlobs;
+	};
+
+	struct FileEntry
+	{
+		char Name[MAX_NAME_LENGTH];		// Zero terminated unless it is 32 characters long
+		uint32_t Stage;
+		uint32_t Permutation;
+		uint64_t Offset;				// From the start of the file
+		uint64_t Size;
+		uint64_t ContentHash;			// Of the bytecode, equal blobs are stored once
+	};
+
+	struct Variant
+	{
+		std::string Name;				// Checked on a hit, the key is a hash
+		const void* Bytecode;			// Into the mapping
+		size_t Size;
+	};
+
+	static uint64_t MakeKey(const char* Name, ShaderStage Stage, uint32_t Permutation);
+
+	Utility::MappedFile m_MappedFile;
+
+	// Filled by Open() and not changed until Close(), lookups need no lock
+	std::unordered_map<uint64_t, Variant> m_Variants;
+
+	ShaderLibraryStats m_Stats;
+};
+
+namespace Renderer
+{
+	extern ShaderLibrary shaderLibrary;
+}
@@ -0,0 +1,377 @@
+#include "TextureLoader.h"
+#include "../Core/GraphicContext.h"
+#include "../../Core/Utility/FileUtility.h"
+#include <algorithm>
+
+using namespace std;
+using namespace Renderer;
+
+namespace
+{
+	float ElapsedMs(const LARGE_INTEGER& Start)
+	{
+		LARGE_INTEGER Frequency, End;
+		QueryPerformanceFrequency(&Frequency);
+		QueryPerformanceCounter(&End);
+		return (float)((End.QuadPart - Start.QuadPart) * 1000.0 / Frequency.QuadPart);
+	}
+}
+
+TextureLoader::TextureLoader() :
+	m_Context(nullptr)
+{
+	memset(&m_Stats, 0, sizeof(m_Stats));
+	m_BatchStart.QuadPart = 0;
+}
+
+void TextureLoader::Create(GraphicContext& Context)
+{
+	m_Context = &Context;
+}
+
+void TextureLoader::Destroy()
+{
+	if (m_Context == nullptr)
+		return;
+
+	// Jobs hold ring space and point into the entries
+	WaitForJobs();
+	m_Decoded.clear();
+
+	for (auto& Loaded : m_Textures)
+	{
+		Texture& Tex = Loaded.second->Tex;
+		if (Tex.State == kTextureReady)
+			m_Context->GetBindlessTextures().Remove(Tex.BindlessIndex);
+		Tex.Resource.Destroy();
+	}
+	m_Textures.clear();
+
+	m_Context = nullptr;
+}
+
+Texture* TextureLoader::Load(const wstring& FileName, TextureCallback OnReady, const MipChainOptions& Mips,
+	TextureRequest* Request)
+{
+	ASSERT(m_Context != nullptr, "TextureLoader::Create() was not called");
+
+	auto Found = m_Textures.find(FileName);
+	if (Found != m_Textures.end() && Found->second->Tex.State != kTextureLoading)
+	{
+		if (OnReady)
+			OnReady(Found->second->Tex);
+		return &Found->second->Tex;
+	}
+
+	shared_ptr<TextureCallback> Callback;
+	if (OnReady)
+	{
+		Callback = make_shared<TextureCallback>(move(OnReady));
+		if (Request != nullptr)
+			Request->m_Callback = Callback;
+	}
+
+	if (Found != m_Textures.end())
+	{
+		Entry& Loaded = *Found->second;
+		if (Callback)
+		{
+			Loaded.Callbacks.push_back(Callback);
+			if (Request == nullptr)
+				Loaded.OwnedCallbacks.push_back(Callback);
+		}
+		return &Loaded.Tex;
+	}
+
+	unique_ptr<Entry> Added(new Entry);
+	Added->Tex.FileName = FileName;
+	Added->Tex.SRV.ptr = 0;
+	Added->Tex.BindlessIndex = 0;
+	Added->Tex.Width = Added->Tex.Height = 0;
+	Added->Tex.State = kTextureLoading;
+	Added->Mips = Mips;
+	Added->Cubemap = false;
+	if (Callback)
+	{
+		Added->Callbacks.push_back(Callback);
+		if (Request == nullptr)
+			Added->OwnedCallbacks.push_back(Callback);
+	}
+
+	Entry* pEntry = Added.get();
+	m_Textures[FileName] = move(Added);
+
+	{
+		lock_guard<mutex> LockGuard(m_Mutex);
+		if (m_Stats.NumPending++ == 0)
+			QueryPerformanceCounter(&m_BatchStart);
+	}
+
+	m_Jobs.push_back(concurrency::create_task([this, pEntry]() { DecodeJob(*pEntry); }));
+	return &pEntry->Tex;
+}
+
+void TextureLoader::DecodeJob(Entry& Job)
+{
+	LARGE_INTEGER Start;
+	QueryPerformanceCounter(&Start);
+
+	Texture& Tex = Job.Tex;
+	float MipMs = 0.0f;
+	uint64_t BytesUploaded = 0;
+	Utility::MappedFile File;
+	DdsReader Dds;
+	Image Info;
+	bool Succeeded = File.Open(Tex.FileName);
+
+	const bool Prebaked = Succeeded && Dds.ReadHeader(File.GetData(), File.GetSize());
+	if (Prebaked)
+		BytesUploaded = UploadPrebaked(Job, Dds);
+	else
+		Succeeded = Succeeded && ImageLoader::GetImageInfo(File.GetData(), File.GetSize(), &Info);
+
+	if (Succeeded && !Prebaked)
+	{
+		Tex.Width = Info.textureWidth;
+		Tex.Height = Info.textureHeight;
+
+		const uint32_t NumLevels = MipGenerator::GetNumLevels(Info.textureWidth, Info.textureHeight, Job.Mips.MaxLevels);
+		D3D12_RESOURCE_DESC Desc = CD3DX12_RESOURCE_DESC::Tex2D(Info.dxgiFormat, Info.textureWidth, Info.textureHeight, 1, NumLevels);
+		// Created in COMMON so the copy queue can promote it to COPY_DEST on its own
+		m_Context->GetHeapAllocator().CreateResource(Tex.Resource, Tex.FileName, Desc, D3D12_RESOURCE_STATE_COMMON);
+
+		UploadManager& Uploads = m_Context->GetUploadManager();
+		TextureUpload Upload;
+		Uploads.BeginTextureUpload(Tex.Resource, 0, NumLevels, Upload);
+
+		// The levels are written straight into upload memory.  Upload memory is write-combined and slow
+		// to read back though, so level 0, which the mip generator reads again, is decoded to the heap
+		// and copied from there.
+		vector<uint8_t> Pixels;
+		vector<D3D12_MEMCPY_DEST> Levels(NumLevels);
+		const uint32_t NumOnHeap = NumLevels > 1 ? 1 : 0;
+		size_t HeapSize = 0;
+		for (uint32_t Level = 0; Level < NumLevels; ++Level)
+		{
+			if (Level < NumOnHeap)
+			{
+				Levels[Level].RowPitch = (SIZE_T)max(Tex.Width >> Level, 1u) * 4;
+				Levels[Level].SlicePitch = Levels[Level].RowPitch * max(Tex.Height >> Level, 1u);
+				HeapSize += Levels[Level].SlicePitch;
+			}
+			else
+			{
+				const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& Layout = Upload.Layouts[Level];
+				Levels[Level].pData = Upload.pMapped + Layout.Offset;
+				Levels[Level].RowPitch = Layout.Footprint.RowPitch;
+				Levels[Level].SlicePitch = (SIZE_T)Layout.Footprint.RowPitch * Upload.NumRows[Level];
+			}
+		}
+		Pixels.resize(HeapSize);
+		uint8_t* NextOnHeap = Pixels.data();
+		for (uint32_t Level = 0; Level < NumOnHeap; ++Level)
+		{
+			Levels[Level].pData = NextOnHeap;
+			NextOnHeap += Levels[Level].SlicePitch;
+		}
+
+		const bool Split = (uint64_t)Info.textureWidth * Info.textureHeight >= SPLIT_PIXELS;
+		Succeeded = ImageLoader::DecodeImage(File.GetData(), File.GetSize(), (uint8_t*)Levels[0].pData, Levels[0].RowPitch, Split);
+
+		// The levels are filtered from level 0, the whole chain goes in one copy
+		if (Succeeded && NumLevels > 1)
+		{
+			LARGE_INTEGER MipStart;
+			QueryPerformanceCounter(&MipStart);
+			MipGenerator::Generate(Job.Mips, Info.textureWidth, Info.textureHeight, NumLevels, Levels.data(), Split);
+			MipMs = ElapsedMs(MipStart);
+		}
+
+		if (Succeeded && NumOnHeap > 0)
+		{
+			for (UINT Row = 0; Row < Upload.NumRows[0]; ++Row)
+			{
+				memcpy(Upload.pMapped + Upload.Layouts[0].Offset + (size_t)Row * Upload.Layouts[0].Footprint.RowPitch,
+					Pixels.data() + Row * Levels[0].RowPitch, (size_t)Upload.RowSizes[0]);
+			}
+		}
+
+		for (uint32_t Level = 0; Level < NumLevels; ++Level)
+			BytesUploaded += Upload.RowSizes[Level] * Upload.NumRows[Level];
+
+		// Ended either way, the ring space is held until then.  A failed texture keeps its resource
+		// until Destroy(), its copy may still be in flight.
+		Uploads.EndTextureUpload(Upload);
+	}
+
+	const float DecodeMs = ElapsedMs(Start);
+
+	lock_guard<mutex> LockGuard(m_Mutex);
+
+	Decoded Done = { &Job, Succeeded };
+	m_Decoded.push_back(Done);
+
+	m_Stats.DecodeMs += DecodeMs;
+	m_Stats.MipMs += MipMs;
+	if (Succeeded)
+	{
+		m_Stats.BytesUploaded += BytesUploaded;
+		if (Prebaked)
+			++m_Stats.NumPrebaked;
+
+		// A full chain adds about a third
+		for (uint32_t Level = 0; !Prebaked && Level < Tex.Resource->GetDesc().MipLevels; ++Level)
+			m_Stats.BytesDecoded += (uint64_t)max(Tex.Width >> Level, 1u) * max(Tex.Height >> Level, 1u) * 4;
+	}
+	if (--m_Stats.NumPending == 0)
+		m_Stats.WallMs = ElapsedMs(m_BatchStart);
+}
+
+uint64_t TextureLoader::UploadPrebaked(Entry& Job, const DdsReader& Dds)
+{
+	Texture& Tex = Job.Tex;
+	Tex.Width = Dds.GetWidth();
+	Tex.Height = Dds.GetHeight();
+	Job.Cubemap = Dds.IsCubemap();
+
+	D3D12_RESOURCE_DESC Desc = CD3DX12_RESOURCE_DESC::Tex2D(Dds.GetFormat(), Tex.Width, Tex.Height,
+		(UINT16)Dds.GetArraySize(), (UINT16)Dds.GetMipLevels());
+	m_Context->GetHeapAllocator().CreateResource(Tex.Resource, Tex.FileName, Desc, D3D12_RESOURCE_STATE_COMMON);
+
+	UploadManager& Uploads = m_Context->GetUploadManager();
+	TextureUpload Upload;
+	Uploads.BeginTextureUpload(Tex.Resource, 0, Dds.GetNumSubresources(), Upload);
+
+	// The file is laid out in the order of the subresources, each copied from the mapping to its
+	// footprint.  Only the row pitch differs, the file's is not aligned.
+	uint64_t Bytes = 0;
+	for (uint32_t Index = 0; Index < Dds.GetNumSubresources(); ++Index)
+	{
+		const DdsReader::Subresource& Source = Dds.GetSubresource(Index);
+		const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& Layout = Upload.Layouts[Index];
+		ASSERT(Upload.RowSizes[Index] == Source.RowBytes && Upload.NumRows[Index] == Source.NumRows);
+
+		uint8_t* Dest = Upload.pMapped + Layout.Offset;
+		if (Layout.Footprint.RowPitch == Source.RowBytes)
+			memcpy(Dest, Source.Data, Source.RowBytes * Source.NumRows);
+		else
+		{
+			for (uint32_t Row = 0; Row < Source.NumRows; ++Row)
+				memcpy(Dest + (size_t)Row * Layout.Footprint.RowPitch, Source.Data + Row * Source.RowBytes, Source.RowBytes);
+		}
+		Bytes += Source.RowBytes * Source.NumRows;
+	}
+
+	Uploads.EndTextureUpload(Upload);
+	return Bytes;
+}
+
+uint32_t TextureLoader::Update()
+{
+	vector<Decoded> Finished;
+	{
+		lock_guard<mutex> LockGuard(m_Mutex);
+		Finished.swap(m_Decoded);
+	}
+
+	if (Finished.empty())
+		return 0;
+
+	// Frames wait on the last upload submitted before they run (see GraphicContext::ExecuteCommandList)
+	m_Context->GetUploadManager().Flush();
+
+	for (Decoded& Done : Finished)
+	{
+		Texture& Tex = Done.pEntry->Tex;
+		if (Done.Succeeded)
+		{
+			const D3D12_RESOURCE_DESC Desc = Tex.Resource->GetDesc();
+			D3D12_SHADER_RESOURCE_VIEW_DESC SRVDesc = {};
+			SRVDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+			SRVDesc.Format = Desc.Format;
+			// Arrays and cube maps only come from DDS files
+			if (Done.pEntry->Cubemap && Desc.DepthOrArraySize > 6)
+			{
+				SRVDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURECUBEARRAY;
+				SRVDesc.TextureCubeArray.MipLevels = Desc.MipLevels;
+				SRVDesc.TextureCubeArray.NumCubes = Desc.DepthOrArraySize / 6;
+			}
+			else if (Done.pEntry->Cubemap)
+			{
+				SRVDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURECUBE;
+				SRVDesc.TextureCube.MipLevels = Desc.MipLevels;
+			}
+			else if (Desc.DepthOrArraySize > 1)
+			{
+				SRVDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+				SRVDesc.Texture2DArray.MipLevels = Desc.MipLevels;
+				SRVDesc.Texture2DArray.ArraySize = Desc.DepthOrArraySize;
+			}
+			else
+			{
+				SRVDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+				SRVDesc.Texture2D.MipLevels = Desc.MipLevels;
+			}
+
+			// Descriptor allocation is not thread-safe, which is why this waits for the render thread
+			Tex.SRV = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+			device->CreateShaderResourceView(Tex.Resource.GetResource(), &SRVDesc, Tex.SRV);
+			Tex.BindlessIndex = m_Context->GetBindlessTextures().Add(Tex.Resource, Tex.SRV);
+			Tex.State = kTextureReady;
+		}
+		else
+		{
+			Utility::Printf(L"Could not load texture %s\n", Tex.FileName.c_str());
+			Tex.State = kTextureFailed;
+		}
+
+		// Requests cancelled since Load() have expired
+		for (const weak_ptr<TextureCallback>& Callback : Done.pEntry->Callbacks)
+		{
+			if (shared_ptr<TextureCallback> Live = Callback.lock())
+				(*Live)(Tex);
+		}
+		Done.pEntry->Callbacks.clear();
+		Done.pEntry->OwnedCallbacks.clear();
+	}
+
+	lock_guard<mutex> LockGuard(m_Mutex);
+
+	for (Decoded& Done : Finished)
+	{
+		if (Done.Succeeded)
+			++m_Stats.NumLoaded;
+		else
+			++m_Stats.NumFailed;
+	}
+
+	// Jobs that have finished no longer need their handle
+	m_Jobs.erase(remove_if(m_Jobs.begin(), m_Jobs.end(), [](const concurrency::task<void>& Job) { return Job.is_done(); }), m_Jobs.end());
+
+	return (uint32_t)Finished.size();
+}
+
+void TextureLoader::WaitForAll()
+{
+	WaitForJobs();
+	Update();
+
+	Utility::Printf(L"Textures: %u loaded, %u failed, %llu MB decoded in %.1f ms (%.1f ms on the workers, %.1f ms of it mips), %llu MB in video memory\n",
+		m_Stats.NumLoaded, m_Stats.NumFailed, m_Stats.BytesDecoded >> 20, m_Stats.WallMs, m_Stats.DecodeMs, m_Stats.MipMs,
+		m_Stats.BytesUploaded >> 20);
+	if (m_Stats.NumPrebaked > 0)
+		Utility::Printf(L"Textures: %u from DDS files, copied as they are\n", m_Stats.NumPrebaked);
+}
+
+void TextureLoader::WaitForJobs()
+{
+	if (!m_Jobs.empty())
+		concurrency::when_all(m_Jobs.begin(), m_Jobs.end()).wait();
+	m_Jobs.clear();
+}
+
+TextureLoaderStats TextureLoader::GetStats()
+{
+	lock_guard<mutex> LockGuard(m_Mutex);
+	return m_Stats;
+}
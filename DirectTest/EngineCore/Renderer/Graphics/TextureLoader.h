@@ -0,0 +1,140 @@
+#pragma once
+
+#include "../../Core/Common.h"
+#include "GpuResource.h"
+#include "MipGenerator.h"
+#include "DdsReader.h"
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+namespace Renderer {
+	class GraphicContext;
+}
+
+enum TextureState
+{
+	kTextureLoading,
+	kTextureReady,
+	kTextureFailed
+};
+
+// A texture of TextureLoader.  The resource, the SRV and the bindless slot are only valid once the
+// state is kTextureReady.
+struct Texture
+{
+	std::wstring FileName;
+	GpuResource Resource;
+	D3D12_CPU_DESCRIPTOR_HANDLE SRV;
+	UINT BindlessIndex;
+	uint32_t Width, Height;
+	TextureState State;
+};
+
+typedef std::function<void(const Texture&)> TextureCallback;
+
+// Handle to the OnReady callback of a Load().  The callback only runs while its handle lives:
+// Cancel() or destroying the handle drops it, so an object can capture itself in the callback and
+// still be destroyed before the texture is ready.
+class TextureRequest
+{
+public:
+	TextureRequest() {}
+	TextureRequest(TextureRequest&& Other) : m_Callback(std::move(Other.m_Callback)) {}
+	TextureRequest& operator=(TextureRequest&& Other) { m_Callback = std::move(Other.m_Callback); return *this; }
+
+	void Cancel() { m_Callback.reset(); }
+
+private:
+	TextureRequest(const TextureRequest&);
+	TextureRequest& operator=(const TextureRequest&);
+
+	friend class TextureLoader;
+	std::shared_ptr<TextureCallback> m_Callback;
+};
+
+struct TextureLoaderStats
+{
+	uint32_t NumLoaded;
+	uint32_t NumFailed;
+	uint32_t NumPending;		// Queued or decoding
+	uint64_t BytesDecoded;		// RGBA8 decoded and filtered, mips included
+	float DecodeMs;				// Summed over the workers, from opening the file to recording the copy
+	float MipMs;				// The part of DecodeMs spent generating mips
+	uint64_t BytesUploaded;		// In the formats of the textures, what they take in video memory
+	uint32_t NumPrebaked;		// DDS files, copied as they are
+	float WallMs;				// From the first Load() of a batch until its last texture was decoded
+};
+
+// Loads image files into textures in the background.  Load() only queues a job: workers of the PPL
+// pool open the file, create the resource and decode straight into the upload ring, so as many
+// textures decode at once as there are cores.  Images of SPLIT_PIXELS or more are also split, their
+// strips decoded by several workers.  The mip chain is generated right after, into the same upload.
+// DDS files are already in their final form: their subresources are copied from the mapped file
+// straight into the upload, mips and format as they come.  Block-compressed textures are written to
+// DDS files offline, by Tools/TextureCompressor, nothing is compressed at load time.
+//
+// The rest has to happen on the render thread: Update() gives every texture decoded since the last
+// call its SRV and bindless slot, submits the copies and runs the callbacks.  GraphicContext calls it
+// at the start of each frame.
+//
+// Textures are shared by file name and stay loaded until Destroy().
+class TextureLoader
+{
+public:
+	static const uint32_t SPLIT_PIXELS = 512 * 512;
+
+	TextureLoader();
+	~TextureLoader() { Destroy(); }
+
+	void Create(Renderer::GraphicContext& Context);
+	// Waits for the jobs still running
+	void Destroy();
+
+	// OnReady runs in Update() once the texture is ready or has failed, right away if it is already
+	// loaded.  Without a Request whatever it captures has to live until then; with one, the callback
+	// is owned by the request and dropped with it.  The first Load() of a file decides its mips, DDS
+	// files bring their own.
+	Texture* Load(const std::wstring& FileName, TextureCallback OnReady = nullptr, const MipChainOptions& Mips = MipChainOptions(),
+		TextureRequest* Request = nullptr);
+
+	// Returns the number of textures that finished loading
+	uint32_t Update();
+	// Blocks until every queued texture is decoded, then updates.  For loading screens.
+	void WaitForAll();
+
+	TextureLoaderStats GetStats();
+
+private:
+	struct Entry
+	{
+		Texture Tex;
+		MipChainOptions Mips;
+		bool Cubemap;
+		// Run if they have not expired.  The loader owns the callbacks that came without a request.
+		std::vector<std::weak_ptr<TextureCallback>> Callbacks;
+		std::vector<std::shared_ptr<TextureCallback>> OwnedCallbacks;
+	};
+
+	struct Decoded
+	{
+		Entry* pEntry;
+		bool Succeeded;
+	};
+
+	void DecodeJob(Entry& Job);
+	// Returns the bytes uploaded
+	uint64_t UploadPrebaked(Entry& Job, const DdsReader& Dds);
+	void WaitForJobs();
+
+	Renderer::GraphicContext* m_Context;
+
+	// Only touched by the thread calling Load() and Update()
+	std::unordered_map<std::wstring, std::unique_ptr<Entry>> m_Textures;
+	std::vector<concurrency::task<void>> m_Jobs;
+
+	std::mutex m_Mutex;
+	std::vector<Decoded> m_Decoded;		// Waiting for Update()
+	TextureLoaderStats m_Stats;
+	LARGE_INTEGER m_BatchStart;
+};
@@ -0,0 +1,331 @@
+#include "UploadManager.h"
+#include "../Core/GraphicContext.h"
+
+using namespace std;
+using namespace Renderer;
+using Microsoft::WRL::ComPtr;
+
+UploadManager::UploadManager() :
+	m_FenceEvent(nullptr),
+	m_NextFenceValue(1),
+	m_LastSubmittedFence(0),
+	m_LastCompletedFence(0),
+	m_RingCpuAddress(nullptr),
+	m_RingSize(0),
+	m_RingHead(0),
+	m_RingTail(0),
+	m_HasPendingCopies(false)
+{
+}
+
+void UploadManager::Create(size_t RingSize)
+{
+	ASSERT(Math::IsPowerOfTwo(RingSize), "The ring must wrap on a texture placement boundary");
+
+	D3D12_COMMAND_QUEUE_DESC QueueDesc = {};
+	QueueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+	QueueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+	ThrowIfFailed(device->CreateCommandQueue(&QueueDesc, MY_IID_PPV_ARGS(&m_CopyQueue)));
+	m_CopyQueue->SetName(L"Upload Copy Queue");
+
+	ThrowIfFailed(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, MY_IID_PPV_ARGS(&m_Fence)));
+	m_Fence->SetName(L"Upload Fence");
+
+	m_FenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	if (m_FenceEvent == nullptr)
+	{
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+	}
+
+	m_RingSize = RingSize;
+	m_RingHead = m_RingTail = 0;
+
+	CD3DX12_HEAP_PROPERTIES HeapProps(D3D12_HEAP_TYPE_UPLOAD);
+	CD3DX12_RESOURCE_DESC BufferDesc = CD3DX12_RESOURCE_DESC::Buffer(m_RingSize);
+	ThrowIfFailed(device->CreateCommittedResource(&HeapProps, D3D12_HEAP_FLAG_NONE, &BufferDesc,
+		D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, MY_IID_PPV_ARGS(&m_RingBuffer)));
+	m_RingBuffer->SetName(L"Upload Ring Buffer");
+
+	// Upload heaps can stay mapped for their whole lifetime
+	CD3DX12_RANGE ReadRange(0, 0);
+	ThrowIfFailed(m_RingBuffer->Map(0, &ReadRange, reinterpret_cast<void**>(&m_RingCpuAddress)));
+
+	BeginCommandList();
+}
+
+void UploadManager::Destroy()
+{
+	if (m_CopyQueue == nullptr)
+		return;
+
+	ASSERT(m_OpenUploads.empty(), "Texture uploads were begun and never ended");
+	WaitForUpload(Flush());
+
+	m_CommandList->Close();
+	m_CommandList = nullptr;
+	m_CurrentAllocator = nullptr;
+	m_Submissions.clear();
+	m_FreeAllocators.clear();
+	m_PendingOverflow.clear();
+
+	m_RingBuffer->Unmap(0, nullptr);
+	m_RingBuffer = nullptr;
+	m_RingCpuAddress = nullptr;
+
+	CloseHandle(m_FenceEvent);
+	m_FenceEvent = nullptr;
+	m_Fence = nullptr;
+	m_CopyQueue = nullptr;
+}
+
+void UploadManager::UploadBuffer(GpuResource& Dest, size_t DestOffset, const void* pData, size_t NumBytes)
+{
+	ASSERT(Dest.GetUsageState() == D3D12_RESOURCE_STATE_COMMON, "Copy queue destinations must be in the common state");
+
+	lock_guard<mutex> LockGuard(m_Mutex);
+
+	size_t RingOffset = NumBytes > m_RingSize ? RING_FULL : AllocateRing(NumBytes, 16);
+	if (RingOffset == RING_FULL)
+	{
+		ComPtr<ID3D12Resource> Overflow;
+		memcpy(AllocateOverflow(NumBytes, Overflow), pData, NumBytes);
+		m_CommandList->CopyBufferRegion(Dest.GetResource(), DestOffset, Overflow.Get(), 0, NumBytes);
+		m_PendingOverflow.push_back(Overflow);
+	}
+	else
+	{
+		memcpy(m_RingCpuAddress + RingOffset, pData, NumBytes);
+		m_CommandList->CopyBufferRegion(Dest.GetResource(), DestOffset, m_RingBuffer.Get(), RingOffset, NumBytes);
+	}
+
+	m_HasPendingCopies = true;
+}
+
+void UploadManager::UploadTexture(GpuResource& Dest, UINT FirstSubresource, UINT NumSubresources, const D3D12_SUBRESOURCE_DATA* pSrcData)
+{
+	TextureUpload Upload;
+	BeginTextureUpload(Dest, FirstSubresource, NumSubresources, Upload);
+
+	for (UINT i = 0; i < NumSubresources; ++i)
+	{
+		D3D12_MEMCPY_DEST DestData = { Upload.pMapped + Upload.Layouts[i].Offset, Upload.Layouts[i].Footprint.RowPitch,
+			SIZE_T(Upload.Layouts[i].Footprint.RowPitch) * SIZE_T(Upload.NumRows[i]) };
+		MemcpySubresource(&DestData, &pSrcData[i], (SIZE_T)Upload.RowSizes[i], Upload.NumRows[i], Upload.Layouts[i].Footprint.Depth);
+	}
+
+	EndTextureUpload(Upload);
+}
+
+void UploadManager::BeginTextureUpload(GpuResource& Dest, UINT FirstSubresource, UINT NumSubresources, TextureUpload& Upload)
+{
+	ASSERT(Dest.GetUsageState() == D3D12_RESOURCE_STATE_COMMON, "Copy queue destinations must be in the common state");
+
+	D3D12_RESOURCE_DESC Desc = Dest->GetDesc();
+
+	Upload.Dest = &Dest;
+	Upload.FirstSubresource = FirstSubresource;
+	Upload.Layouts.resize(NumSubresources);
+	Upload.NumRows.resize(NumSubresources);
+	Upload.RowSizes.resize(NumSubresources);
+	UINT64 RequiredSize = 0;
+	device->GetCopyableFootprints(&Desc, FirstSubresource, NumSubresources, 0,
+		Upload.Layouts.data(), Upload.NumRows.data(), Upload.RowSizes.data(), &RequiredSize);
+
+	lock_guard<mutex> LockGuard(m_Mutex);
+
+	size_t RingOffset = RequiredSize > m_RingSize ? RING_FULL : AllocateRing((size_t)RequiredSize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+	if (RingOffset == RING_FULL)
+	{
+		Upload.pMapped = AllocateOverflow((size_t)RequiredSize, Upload.Overflow);
+		Upload.BaseOffset = 0;
+		Upload.RingStart = 0;
+	}
+	else
+	{
+		Upload.pMapped = m_RingCpuAddress + RingOffset;
+		Upload.BaseOffset = RingOffset;
+		// Submissions stop releasing ring space here until the upload is ended
+		Upload.RingStart = m_RingHead - RequiredSize;
+		m_OpenUploads.insert(Upload.RingStart);
+	}
+}
+
+void UploadManager::EndTextureUpload(TextureUpload& Upload)
+{
+	lock_guard<mutex> LockGuard(m_Mutex);
+
+	ID3D12Resource* pUpload = Upload.Overflow != nullptr ? Upload.Overflow.Get() : m_RingBuffer.Get();
+	for (UINT i = 0; i < (UINT)Upload.Layouts.size(); ++i)
+	{
+		D3D12_PLACED_SUBRESOURCE_FOOTPRINT Layout = Upload.Layouts[i];
+		Layout.Offset += Upload.BaseOffset;
+		CD3DX12_TEXTURE_COPY_LOCATION Dst(Upload.Dest->GetResource(), Upload.FirstSubresource + i);
+		CD3DX12_TEXTURE_COPY_LOCATION Src(pUpload, Layout);
+		m_CommandList->CopyTextureRegion(&Dst, 0, 0, 0, &Src, nullptr);
+	}
+
+	if (Upload.Overflow != nullptr)
+		m_PendingOverflow.push_back(std::move(Upload.Overflow));
+	else
+		m_OpenUploads.erase(m_OpenUploads.find(Upload.RingStart));
+
+	m_HasPendingCopies = true;
+}
+
+UploadToken UploadManager::Flush()
+{
+	lock_guard<mutex> LockGuard(m_Mutex);
+
+	if (m_HasPendingCopies)
+		SubmitCommandList();
+
+	return m_LastSubmittedFence;
+}
+
+bool UploadManager::IsComplete(UploadToken Token)
+{
+	return Token <= m_Fence->GetCompletedValue();
+}
+
+void UploadManager::WaitForUpload(UploadToken Token)
+{
+	lock_guard<mutex> LockGuard(m_Mutex);
+	WaitForFence(Token);
+	ReclaimCompleted();
+}
+
+void UploadManager::InsertWait(ID3D12CommandQueue* pQueue, UploadToken Token)
+{
+	if (!IsComplete(Token))
+		ThrowIfFailed(pQueue->Wait(m_Fence.Get(), Token));
+}
+
+size_t UploadManager::AllocateRing(size_t NumBytes, size_t Alignment)
+{
+	ASSERT(NumBytes <= m_RingSize);
+
+	for (;;)
+	{
+		// Nothing in flight, rewind to the start of the ring so a full-size request always fits.
+		if (m_RingHead == m_RingTail && m_RingHead % m_RingSize != 0)
+			m_RingHead = m_RingTail = m_RingHead + m_RingSize - m_RingHead % m_RingSize;
+
+		uint64_t Offset = (m_RingHead + Alignment - 1) & ~(uint64_t)(Alignment - 1);
+		size_t RingOffset = (size_t)(Offset % m_RingSize);
+
+		// Never split an allocation across the end of the ring
+		if (RingOffset + NumBytes > m_RingSize)
+		{
+			Offset += m_RingSize - RingOffset;
+			RingOffset = 0;
+		}
+
+		if (Offset + NumBytes - m_RingTail <= m_RingSize)
+		{
+			m_RingHead = Offset + NumBytes;
+			return RingOffset;
+		}
+
+		ReclaimCompleted();
+		if (Offset + NumBytes - m_RingTail <= m_RingSize)
+			continue;
+
+		// Still full.  Kick whatever we have recorded so it can retire, then block on the oldest batch.
+		if (m_HasPendingCopies)
+			SubmitCommandList();
+
+		// Nothing left to wait for, the rest is held by open texture uploads
+		if (m_Submissions.empty())
+			return RING_FULL;
+
+		WaitForFence(m_Submissions.front().Fence);
+		ReclaimCompleted();
+	}
+}
+
+uint8_t* UploadManager::AllocateOverflow(size_t NumBytes, ComPtr<ID3D12Resource>& Buffer)
+{
+	CD3DX12_HEAP_PROPERTIES HeapProps(D3D12_HEAP_TYPE_UPLOAD);
+	CD3DX12_RESOURCE_DESC BufferDesc = CD3DX12_RESOURCE_DESC::Buffer(NumBytes);
+	ThrowIfFailed(device->CreateCommittedResource(&HeapProps, D3D12_HEAP_FLAG_NONE, &BufferDesc,
+		D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, MY_IID_PPV_ARGS(&Buffer)));
+	Buffer->SetName(L"Upload Overflow Buffer");
+
+	uint8_t* pMapped = nullptr;
+	CD3DX12_RANGE ReadRange(0, 0);
+	ThrowIfFailed(Buffer->Map(0, &ReadRange, reinterpret_cast<void**>(&pMapped)));
+	return pMapped;
+}
+
+void UploadManager::BeginCommandList()
+{
+	if (!m_FreeAllocators.empty())
+	{
+		m_CurrentAllocator = m_FreeAllocators.back();
+		m_FreeAllocators.pop_back();
+	}
+	else
+	{
+		ThrowIfFailed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, MY_IID_PPV_ARGS(&m_CurrentAllocator)));
+		m_CurrentAllocator->SetName(L"Upload Command Allocator");
+	}
+
+	if (m_CommandList == nullptr)
+	{
+		ThrowIfFailed(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, m_CurrentAllocator.Get(),
+			nullptr, MY_IID_PPV_ARGS(&m_CommandList)));
+		m_CommandList->SetName(L"Upload Command List");
+	}
+	else
+		ThrowIfFailed(m_CommandList->Reset(m_CurrentAllocator.Get(), nullptr));
+
+	m_HasPendingCopies = false;
+}
+
+UploadToken UploadManager::SubmitCommandList()
+{
+	ThrowIfFailed(m_CommandList->Close());
+
+	ID3D12CommandList* ppCommandLists[] = { m_CommandList.Get() };
+	m_CopyQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
+
+	UploadToken Fence = m_NextFenceValue++;
+	ThrowIfFailed(m_CopyQueue->Signal(m_Fence.Get(), Fence));
+	m_LastSubmittedFence = Fence;
+
+	Submission Batch;
+	Batch.Fence = Fence;
+	// Ring space of open texture uploads is not in this batch, their copies come in a later one
+	Batch.RingEnd = m_OpenUploads.empty() ? m_RingHead : *m_OpenUploads.begin();
+	Batch.Allocator = m_CurrentAllocator;
+	Batch.Overflow.swap(m_PendingOverflow);
+	m_Submissions.push_back(Batch);
+
+	BeginCommandList();
+
+	return Fence;
+}
+
+void UploadManager::ReclaimCompleted()
+{
+	m_LastCompletedFence = max(m_LastCompletedFence, m_Fence->GetCompletedValue());
+
+	while (!m_Submissions.empty() && m_Submissions.front().Fence <= m_LastCompletedFence)
+	{
+		Submission& Batch = m_Submissions.front();
+		m_RingTail = max(m_RingTail, Batch.RingEnd);
+		ThrowIfFailed(Batch.Allocator->Reset());
+		m_FreeAllocators.push_back(Batch.Allocator);
+		m_Submissions.pop_front();
+	}
+}
+
+void UploadManager::WaitForFence(UploadToken Fence)
+{
+	if (IsComplete(Fence))
+		return;
+
+	ThrowIfFailed(m_Fence->SetEventOnCompletion(Fence, m_FenceEvent));
+	WaitForSingleObjectEx(m_FenceEvent, INFINITE, FALSE);
+	m_LastCompletedFence = max(m_LastCompletedFence, Fence);
+}
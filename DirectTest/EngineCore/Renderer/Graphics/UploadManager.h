@@ -0,0 +1,115 @@
+#pragma once
+
+#include "../../Core/Common.h"
+#include "GpuResource.h"
+#include <deque>
+#include <mutex>
+#include <set>
+
+// Fence value on the copy queue.  An upload is complete once the fence has reached its token.
+typedef uint64_t UploadToken;
+
+// Upload memory laid out for the subresources of a texture by UploadManager::BeginTextureUpload().
+// Subresource i goes at pMapped + Layouts[i].Offset, NumRows[i] rows of RowSizes[i] bytes each
+// Layouts[i].Footprint.RowPitch bytes apart.
+struct TextureUpload
+{
+	GpuResource* Dest;
+	UINT FirstSubresource;
+	uint8_t* pMapped;
+	std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> Layouts;
+	std::vector<UINT> NumRows;
+	std::vector<UINT64> RowSizes;
+
+	// Where the memory comes from, for EndTextureUpload()
+	UINT64 BaseOffset;
+	uint64_t RingStart;
+	Microsoft::WRL::ComPtr<ID3D12Resource> Overflow;
+};
+
+// Streams data into default heap resources through a persistently mapped upload ring and a
+// dedicated copy queue.  Copies are recorded into one command list and only submitted on Flush(),
+// so loading a batch of assets ends up as a handful of large submissions.  Ring space is reclaimed
+// as the copy fence advances.
+//
+// Destination resources must be created in D3D12_RESOURCE_STATE_COMMON.  They are implicitly
+// promoted to COPY_DEST on the copy queue and decay back to COMMON once the copy has executed, so
+// the graphics queue only needs to wait on the token (see InsertWait) before using them.
+class UploadManager
+{
+public:
+	static const size_t DEFAULT_RING_SIZE = 32 * 1024 * 1024;
+
+	UploadManager();
+	~UploadManager() { Destroy(); }
+
+	void Create(size_t RingSize = DEFAULT_RING_SIZE);
+	void Destroy();
+
+	void UploadBuffer(GpuResource& Dest, size_t DestOffset, const void* pData, size_t NumBytes);
+	void UploadTexture(GpuResource& Dest, UINT FirstSubresource, UINT NumSubresources, const D3D12_SUBRESOURCE_DATA* pSrcData);
+
+	// UploadTexture() in two steps, for data produced straight into upload memory, e.g. a decoder
+	// writing its rows.  Filling the memory takes no lock, so several threads can write textures at
+	// once.  Every begun upload must be ended: its ring space is held until then and is not
+	// reclaimed by Flush() in between.
+	void BeginTextureUpload(GpuResource& Dest, UINT FirstSubresource, UINT NumSubresources, TextureUpload& Upload);
+	void EndTextureUpload(TextureUpload& Upload);
+
+	// Submits every copy recorded since the last flush.  Returns the token of the last submission
+	// if there was nothing new to submit.
+	UploadToken Flush();
+
+	bool IsComplete(UploadToken Token);
+	void WaitForUpload(UploadToken Token);
+
+	// Makes a queue wait on the GPU timeline, without blocking the CPU, until Token has completed.
+	void InsertWait(ID3D12CommandQueue* pQueue, UploadToken Token);
+
+	UploadToken GetLastSubmittedToken() const { return m_LastSubmittedFence; }
+
+private:
+	struct Submission
+	{
+		UploadToken Fence;
+		uint64_t RingEnd;
+		Microsoft::WRL::ComPtr<ID3D12CommandAllocator> Allocator;
+		std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> Overflow;	// One-off buffers for uploads larger than the ring
+	};
+
+	static const size_t RING_FULL = ~(size_t)0;
+
+	// Returns the ring offset of NumBytes of free space, flushing and waiting on the copy queue when
+	// the ring is full.  Returns RING_FULL if what holds the ring are texture uploads not ended yet,
+	// they may be waiting on this thread.
+	size_t AllocateRing(size_t NumBytes, size_t Alignment);
+	// The buffer has to go to m_PendingOverflow once its copy is recorded
+	uint8_t* AllocateOverflow(size_t NumBytes, Microsoft::WRL::ComPtr<ID3D12Resource>& Buffer);
+	void BeginCommandList();
+	UploadToken SubmitCommandList();
+	void ReclaimCompleted();
+	void WaitForFence(UploadToken Fence);
+
+	std::mutex m_Mutex;
+
+	Microsoft::WRL::ComPtr<ID3D12CommandQueue> m_CopyQueue;
+	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> m_CommandList;
+	Microsoft::WRL::ComPtr<ID3D12CommandAllocator> m_CurrentAllocator;
+	std::deque<Submission> m_Submissions;
+	std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> m_FreeAllocators;
+	std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> m_PendingOverflow;
+
+	Microsoft::WRL::ComPtr<ID3D12Fence> m_Fence;
+	HANDLE m_FenceEvent;
+	UploadToken m_NextFenceValue;
+	UploadToken m_LastSubmittedFence;
+	UploadToken m_LastCompletedFence;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> m_RingBuffer;
+	uint8_t* m_RingCpuAddress;
+	size_t m_RingSize;
+	uint64_t m_RingHead;		// Total bytes ever allocated, the write position is m_RingHead % m_RingSize
+	uint64_t m_RingTail;		// Total bytes ever released
+	std::multiset<uint64_t> m_OpenUploads;	// Ring position of the texture uploads begun and not ended
+	bool m_HasPendingCopies;
+};
@@ -5,12 +5,16 @@ namespace Renderer {
 	class GraphicContext;
 }
 
+class GraphicsPSO;
+class CommandSignature;
+
 using namespace Renderer;
 
 class Material {
 public:
 	Material(GraphicContext* context) : 
-		context(context) 
+		context(context),
+		materialIndex(0)
 	{
 
 	}
@@ -18,6 +22,25 @@ public:
 	virtual void OnRender() = 0;
 	virtual void OnEndRender() = 0;
 
+	// Draws are sorted on these, see RenderQueue.  Materials sharing a pipeline state are drawn
+	// together after a single BeginRender(), so BeginRender() may only bind what they all share and
+	// anything else has to be reached through the material index.
+	virtual const GraphicsPSO* GetPipelineState() const = 0;
+	virtual bool IsTransparent() const { return false; }
+	// Materials that return a signature for RenderQueue::IndirectDrawArguments get their draws
+	// submitted with ExecuteIndirect
+	virtual CommandSignature* GetDrawSignature() { return nullptr; }
+
+	// Depth-only pipeline state reading the position stream of the mesh, null when the material
+	// cannot be drawn in the depth prepass.  BeginDepthRender() binds it the way BeginRender() binds
+	// the main one.
+	virtual const GraphicsPSO* GetDepthPipelineState() const { return nullptr; }
+	virtual void BeginDepthRender() {}
+
+	// Entry in the context's material buffer, copied into the instance data of every mesh using it
+	UINT GetMaterialIndex() const { return materialIndex; }
+
 protected:
 	GraphicContext* context;
+	UINT materialIndex;
 };
\ No newline at end of file
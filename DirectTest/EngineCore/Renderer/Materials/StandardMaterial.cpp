@@ -2,26 +2,33 @@
 #include "../Core/GraphicContext.h"
 #include "../Graphics/PipelineState.h"
 #include "../Graphics/RootSignature.h"
-
-UINT8* StandardMaterial::pVertexShaderData = nullptr;
-UINT StandardMaterial::vertexShaderDataLength = 0;
-UINT8* StandardMaterial::pPixelShaderData = nullptr;
-UINT StandardMaterial::pixelShaderDataLength = 0;
+#include "../Core/RenderQueue.h"
+#include "../Components/Mesh.h"
 
 using namespace Renderer;
 
-StandardMaterial::StandardMaterial(GraphicContext * context) : Material(context)
+StandardMaterial::StandardMaterial(GraphicContext * context, uint32_t permutation) :
+	Material(context),
+	diffuseTexture(nullptr),
+	permutation(permutation)
 {
-	D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc = {};
-	srvHeapDesc.NumDescriptors = 1;
-	srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-	srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-	ThrowIfFailed(device->CreateDescriptorHeap(&srvHeapDesc, IID_PPV_ARGS(&srvHeap)));
+	ASSERT((permutation & (kShaderQuantizedVertices | kShaderSkinning | kShaderDepthOnly)) == 0,
+		"Meshes have no vertex format for shader permutation 0x%x", permutation);
+
+	// Variants missing from the library throw, in release builds as well
+	const ShaderLayout& layout = RequireShaderLayout("Standard", permutation);
+	ASSERT(layout.VertexStride == sizeof(Vertex), "The Standard vertex stream does not match struct Vertex");
+	// Meshes and StaticGeometry write these without knowing the material
+	ASSERT(layout.GetRootIndex("DrawConstants") == Mesh::FIRST_INSTANCE_ROOT_INDEX &&
+		layout.GetRootIndex("instances") == Mesh::INSTANCE_DATA_ROOT_INDEX);
 
-	rootSignature.Reset(2, 1);
+	materialDataRootIndex = layout.GetRootIndex("materials");
+	texturesRootIndex = layout.GetRootIndex("g_textures");
+	ASSERT(texturesRootIndex < 0 || layout.Parameters[texturesRootIndex].Count == BindlessTable::MAX_DESCRIPTORS);
 
 	D3D12_SAMPLER_DESC sampler = {};
-	sampler.Filter = D3D12_FILTER_MIN_MAG_MIP_POINT;
+	// Textures come with their whole mip chain (see MipGenerator)
+	sampler.Filter = D3D12_FILTER_MIN_MAG_MIP_LINEAR;
 	sampler.AddressU = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
 	sampler.AddressV = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
 	sampler.AddressW = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
@@ -31,37 +38,27 @@ StandardMaterial::StandardMaterial(GraphicContext * context) : Material(context)
 	sampler.MinLOD = 0.0f;
 	sampler.MaxLOD = D3D12_FLOAT32_MAX;
 
-	rootSignature.InitStaticSampler(0, sampler, D3D12_SHADER_VISIBILITY_PIXEL);
-	rootSignature[0].InitAsConstantBuffer(0, D3D12_SHADER_VISIBILITY_VERTEX);
-	rootSignature[1].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 0, 1, D3D12_SHADER_VISIBILITY_PIXEL);
-
+	// Each draw only writes the index of its first instance in the per-instance transforms, a structured
+	// buffer bound once per material.  The bindless textures are the same for all materials, so
+	// switching between them binds nothing.
+	rootSignature.InitFromLayout(layout, sampler);
 	rootSignature.Finalize(L"Standard diffuse", D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
 
-	D3D12_INPUT_ELEMENT_DESC inputLayout[] =
-	{
-		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12 + 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "NORMAL", 0,  DXGI_FORMAT_R32G32B32_FLOAT, 0, 12 + 8 + 16, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
-	};
-
-	if (vertexShaderDataLength <= 0) {
-		ThrowIfFailed(ReadDataFromFile(L"Resources\\ShaderLib\\VertexShader.cso", &pVertexShaderData, &vertexShaderDataLength));
-	}
-	if (pixelShaderDataLength <= 0) {
-		ThrowIfFailed(ReadDataFromFile(L"Resources\\ShaderLib\\PixelShader.cso", &pPixelShaderData, &pixelShaderDataLength));
-	}
+	D3D12_SHADER_BYTECODE vertexShader = shaderLibrary.RequireShader("Standard", kVertexShader, permutation);
+	D3D12_SHADER_BYTECODE pixelShader = shaderLibrary.RequireShader("Standard", kPixelShader, permutation);
 
 	CD3DX12_RASTERIZER_DESC rasterDesc(D3D12_DEFAULT);
 	CD3DX12_DEPTH_STENCIL_DESC depthStencilDesc(D3D12_DEFAULT);
+	// Meshes drawn in the depth prepass have already written the same depth
+	depthStencilDesc.DepthFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL;
 	CD3DX12_BLEND_DESC blendDesc(D3D12_DEFAULT);
 	blendDesc.AlphaToCoverageEnable = FALSE;
 
-	graphicPSO.SetInputLayout(4, inputLayout);
+	graphicPSO.SetInputLayout(layout.NumInputElements, layout.InputElements);
 	graphicPSO.SetRootSignature(rootSignature);
-	graphicPSO.SetVertexShader(CD3DX12_SHADER_BYTECODE(pVertexShaderData, vertexShaderDataLength));
-	graphicPSO.SetPixelShader(CD3DX12_SHADER_BYTECODE(pPixelShaderData, pixelShaderDataLength));
+	graphicPSO.SetVertexShader(vertexShader);
+	graphicPSO.SetPixelShader(pixelShader);
 	graphicPSO.SetPrimitiveTopologyType(D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE);
 	graphicPSO.SetRenderTargetFormat(DXGI_FORMAT_R8G8B8A8_UNORM, DXGI_FORMAT_D32_FLOAT);
 	graphicPSO.SetRasterizerState(rasterDesc);
@@ -69,78 +66,75 @@ StandardMaterial::StandardMaterial(GraphicContext * context) : Material(context)
 	graphicPSO.SetDepthStencilState(depthStencilDesc);
 	graphicPSO.Finalize();
 
-
+	const ShaderLayout& depthLayout = RequireShaderLayout("Standard", kShaderDepthOnly);
+	ASSERT(depthLayout.VertexStride == Mesh::POSITION_STRIDE,
+		"The depth-only Standard variant does not read Mesh::positionBuffer");
+	ASSERT(depthLayout.GetRootIndex("DrawConstants") == Mesh::FIRST_INSTANCE_ROOT_INDEX &&
+		depthLayout.GetRootIndex("instances") == Mesh::INSTANCE_DATA_ROOT_INDEX);
+
+	depthRootSignature.InitFromLayout(depthLayout, sampler);
+	depthRootSignature.Finalize(L"Standard depth only", D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+
+	D3D12_SHADER_BYTECODE depthVertexShader = shaderLibrary.RequireShader("Standard", kVertexShader, kShaderDepthOnly);
+
+	depthPSO.SetInputLayout(depthLayout.NumInputElements, depthLayout.InputElements);
+	depthPSO.SetRootSignature(depthRootSignature);
+	depthPSO.SetVertexShader(depthVertexShader);
+	depthPSO.SetPrimitiveTopologyType(D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE);
+	depthPSO.SetRenderTargetFormats(0, nullptr, DXGI_FORMAT_D32_FLOAT);
+	depthPSO.SetRasterizerState(rasterDesc);
+	depthPSO.SetBlendState(blendDesc);
+	depthPSO.SetDepthStencilState(CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT));
+	depthPSO.Finalize();
+
+	// Laid out as RenderQueue::IndirectDrawArguments
+	drawSignature.Reset(4);
+	drawSignature[0].VertexBufferView(0);
+	drawSignature[1].IndexBufferView();
+	drawSignature[2].Constant(Mesh::FIRST_INSTANCE_ROOT_INDEX, 0, 1);
+	drawSignature[3].DrawIndexed();
+	drawSignature.Finalize(&rootSignature);
+	ASSERT(drawSignature.GetByteStride() == sizeof(RenderQueue::IndirectDrawArguments));
+
+
+	MaterialData data = {};
+	materialIndex = context->AddMaterial(data);
+
+	if (permutation & kShaderTextured)
 	{
-		int imageBytesPerRow;
-		Image imageData;
-		ZeroMemory(&imageData, sizeof(Image));
-		ImageLoader::LoadImageFromFile(L"Resources/woodTexture.jpg", imageBytesPerRow, &imageData);
-
-		D3D12_RESOURCE_DESC textureDesc = {};
-		textureDesc.MipLevels = 1;
-		textureDesc.Format = imageData.dxgiFormat;
-		textureDesc.Width = imageData.textureWidth;
-		textureDesc.Height = imageData.textureHeight;
-		textureDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
-		textureDesc.DepthOrArraySize = 1;
-		textureDesc.SampleDesc.Count = 1;
-		textureDesc.SampleDesc.Quality = 0;
-		textureDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
-
-
-		ThrowIfFailed(device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-			D3D12_HEAP_FLAG_NONE,
-			&textureDesc,
-			D3D12_RESOURCE_STATE_COPY_DEST,
-			nullptr,
-			IID_PPV_ARGS(&textureBuffer)));
-
-
-		UINT64 textureUploadBufferSize;
-
-		device->GetCopyableFootprints(&textureDesc, 0, 1, 0, nullptr, nullptr, nullptr, &textureUploadBufferSize);
-
-		ThrowIfFailed(device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-			D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer(textureUploadBufferSize),
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr,
-			IID_PPV_ARGS(&textureUploadHeap)));
-		textureUploadHeap->SetName(L"Texture Buffer Upload Resource Heap");
-
-		D3D12_SUBRESOURCE_DATA textureData = {};
-		textureData.pData = &imageData.imageData[0];
-		textureData.RowPitch = imageBytesPerRow;
-		textureData.SlicePitch = textureData.RowPitch * imageData.textureHeight;
-
-		UpdateSubresources(context->commandList.Get(), textureBuffer, textureUploadHeap.Get(), 0, 0, 1, &textureData);
-
-		context->commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(textureBuffer, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
-
-		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-		srvDesc.Format = textureDesc.Format;
-		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-		srvDesc.Texture2D.MipLevels = 1;
-		device->CreateShaderResourceView(textureBuffer, &srvDesc, srvHeap->GetCPUDescriptorHandleForHeapStart());
+		// BC7 with its mips, a quarter of the memory of RGBA8, compressed offline from woodTexture.jpg by
+		// Tools/TextureCompressor.  The material samples it from the frame it is ready on.  The request
+		// ties the callback to the material, it is dropped if the material goes first.
+		diffuseTexture = context->GetTextureLoader().Load(L"Resources/woodTexture.dds", [this](const Texture& texture) {
+			if (texture.State != kTextureReady)
+				return;
+			MaterialData data = {};
+			data.diffuseTexture = texture.BindlessIndex;
+			this->context->UpdateMaterial(materialIndex, data);
+		}, MipChainOptions(), &diffuseRequest);
 	}
 }
 
 StandardMaterial::~StandardMaterial()
 {
-	textureBuffer->Release();
-	delete textureBufferGPUAddress;
+	// The texture belongs to the loader, other materials may share it.  Its callback must not update
+	// the entry once it is removed.
+	diffuseRequest.Cancel();
+	context->RemoveMaterial(materialIndex);
 }
 
 void StandardMaterial::BeginRender() {
 
 	context->SetPipelineState(graphicPSO);
 	context->SetRootSignature(rootSignature);
+	if (materialDataRootIndex >= 0)
+		context->SetBufferSRV(materialDataRootIndex, context->GetMaterialBuffer(), 0);
+	if (texturesRootIndex >= 0)
+		context->SetDescriptorTable(texturesRootIndex, context->GetBindlessTextures().GetGpuHandle());
+}
 
-	ID3D12DescriptorHeap* descriptorHeaps[] = { srvHeap.Get() };
-	context->commandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+void StandardMaterial::BeginDepthRender() {
 
-	context->SetDescriptorTable(1, srvHeap->GetGPUDescriptorHandleForHeapStart());
+	context->SetPipelineState(depthPSO);
+	context->SetRootSignature(depthRootSignature);
 }
@@ -2,24 +2,36 @@
 #include "Material.h"
 #include "../Graphics/PipelineState.h"
 #include "../Graphics/RootSignature.h"
+#include "../Graphics/CommandSignature.h"
+#include "../Graphics/GpuResource.h"
+#include "../Graphics/DescriptorHeap.h"
+#include "../Graphics/ShaderLibrary.h"
+#include "../Graphics/TextureLoader.h"
 
 class StandardMaterial : public Material {
 public:
-	StandardMaterial(GraphicContext* context);
+	static const uint32_t DEFAULT_PERMUTATION = kShaderTextured | (1 << kShaderLightCountShift);
+
+	StandardMaterial(GraphicContext* context, uint32_t permutation = DEFAULT_PERMUTATION);
 	~StandardMaterial();
 	virtual void BeginRender();
 	virtual void OnRender() {}
 	virtual void OnEndRender() {}
+	virtual const GraphicsPSO* GetPipelineState() const { return &graphicPSO; }
+	virtual CommandSignature* GetDrawSignature() { return &drawSignature; }
+	virtual const GraphicsPSO* GetDepthPipelineState() const { return &depthPSO; }
+	virtual void BeginDepthRender();
 public:
 	RootSignature rootSignature;
 	GraphicsPSO graphicPSO;
-	ComPtr<ID3D12DescriptorHeap> srvHeap;
-	ID3D12Resource* textureBuffer; 
-	ComPtr<ID3D12Resource> textureUploadHeap;
-	UINT8* textureBufferGPUAddress;
-
-	static UINT8* pVertexShaderData;
-	static UINT vertexShaderDataLength;
-	static UINT8* pPixelShaderData;
-	static UINT pixelShaderDataLength;
+	// Same vertex shader built with DEPTH_ONLY, without pixel shader or render targets
+	RootSignature depthRootSignature;
+	GraphicsPSO depthPSO;
+	CommandSignature drawSignature;
+	Texture* diffuseTexture;	// Null without kShaderTextured
+	TextureRequest diffuseRequest;
+	uint32_t permutation;
+	// Root indices from the generated layout, -1 when the permutation does not use the binding
+	int materialDataRootIndex;
+	int texturesRootIndex;
 };
\ No newline at end of file
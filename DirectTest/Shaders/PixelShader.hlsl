@@ -1,20 +1,45 @@
-struct PSInput
+#include "ShaderFeatures.hlsli"
+
+struct MaterialData
 {
-    float4 position : SV_POSITION;
-    float2 uv : TEXCOORD;
-    float4 color : COLOR;
-	float3 normal : NORMAL;
+    uint diffuseTexture;
+    uint3 padding;
 };
 
-Texture2D g_texture : register(t0);
+StructuredBuffer<MaterialData> materials : register(t2);
+
+// Every texture of the scene, the size of BindlessTable::MAX_DESCRIPTORS
+Texture2D g_textures[4096] : register(t0, space1);
 sampler g_sampler : register(s0);
 
+#if LIGHT_COUNT > 0
+static const float3 lightDirections[3] =
+{
+    float3(0.5, 0.0, -1.0),
+    float3(-0.5, 0.5, -0.5),
+    float3(0.0, -1.0, 0.0)
+};
+#endif
+
 float4 PSMain(PSInput input) : SV_TARGET
 {
-    float light = dot(float3(0.5, 0.0, -1.0), input.normal.xyz);
+#if LIGHT_COUNT > 0
+    float light = 0.0;
+    [unroll]
+    for (uint i = 0; i < LIGHT_COUNT; ++i)
+        light += dot(lightDirections[i], input.normal.xyz);
+#else
+    float light = 1.0;
+#endif
+
+#if TEXTURED
+    MaterialData material = materials[input.materialIndex];
 
-    float4 texColor = g_texture.Sample(g_sampler, input.uv);
-    //float4 texColor = input.color;
+    // Instanced draws can mix materials, the index is not uniform across the draw
+    float4 texColor = g_textures[NonUniformResourceIndex(material.diffuseTexture)].Sample(g_sampler, input.uv);
+#else
+    float4 texColor = input.color;
+#endif
 
     return texColor * light;
-}
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+// Permutation switches, set per variant by Tools/build_shader_library.py from the bits of the
+// permutation key (ShaderLibrary.h).  The defaults are the variant StandardMaterial uses.
+
+#ifndef TEXTURED
+#define TEXTURED 1
+#endif
+
+// Positions come in as SNORM16, the scale of the mesh bounds is folded into the instance transforms
+#ifndef QUANTIZED_VERTICES
+#define QUANTIZED_VERTICES 0
+#endif
+
+// Needs the bone palette at t3 in the root signature
+#ifndef SKINNING
+#define SKINNING 0
+#endif
+
+// Only SV_POSITION is written, for depth passes without a pixel shader.  Reads the position stream
+// of the mesh, all other inputs are stripped.
+#ifndef DEPTH_ONLY
+#define DEPTH_ONLY 0
+#endif
+
+// Directional lights, 0 to 3
+#ifndef LIGHT_COUNT
+#define LIGHT_COUNT 1
+#endif
+
+struct PSInput
+{
+    float4 position : SV_POSITION;
+#if !DEPTH_ONLY
+    float2 uv : TEXCOORD;
+    float4 color : COLOR;
+	float3 normal : NORMAL;
+    nointerpolation uint materialIndex : MATERIAL;
+#endif
+};
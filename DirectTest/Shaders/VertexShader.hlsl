@@ -1,10 +1,4 @@
-struct PSInput
-{
-    float4 position : SV_POSITION;
-    float2 uv : TEXCOORD;
-    float4 color : COLOR;
-	float3 normal : NORMAL;
-};
+#include "ShaderFeatures.hlsli"
 
 struct VSInput
 {
@@ -12,22 +6,65 @@ struct VSInput
     float2 uv : TEXCOORD;
     float4 color : COLOR;
 	float3 normal : NORMAL;
+#if SKINNING
+    uint4 boneIndices : BLENDINDICES;
+    float4 boneWeights : BLENDWEIGHT;
+#endif
 };
 
-cbuffer PerVertexData : register(b0)
+struct InstanceData
 {
     float4x4 wvpMat;
 	float4x4 worldMat;
+    uint materialIndex;
+    uint3 padding;
+};
+
+// The instances of every draw of the frame, each draw starts at its firstInstance
+StructuredBuffer<InstanceData> instances : register(t1);
+
+cbuffer DrawConstants : register(b0)
+{
+    uint firstInstance;
 }
 
-PSInput VSMain(VSInput input)
+#if SKINNING
+StructuredBuffer<float4x4> bones : register(t3);
+#endif
+
+PSInput VSMain(VSInput input, uint instanceID : SV_InstanceID)
 {
     PSInput result;
 
-    result.position = mul(input.position,  wvpMat);
+    InstanceData instance = instances[firstInstance + instanceID];
+
+#if QUANTIZED_VERTICES
+    // The fourth SNORM component is padding
+    float4 position = float4(input.position.xyz, 1.0);
+#else
+    float4 position = input.position;
+#endif
+    float3 normal = input.normal;
+
+#if SKINNING
+    float4x4 skin = bones[input.boneIndices.x] * input.boneWeights.x +
+        bones[input.boneIndices.y] * input.boneWeights.y +
+        bones[input.boneIndices.z] * input.boneWeights.z +
+        bones[input.boneIndices.w] * input.boneWeights.w;
+    position = mul(position, skin);
+    normal = mul(normal, (float3x3) skin);
+#endif
+
+    // The depth prepass and the scene pass compute this from different vertex streams, both must get
+    // exactly the same depth for the LESS_EQUAL test
+    precise float4 clipPosition = mul(position, instance.wvpMat);
+    result.position = clipPosition;
+#if !DEPTH_ONLY
     result.uv = input.uv;
     result.color = input.color;
-    result.normal = mul(input.normal, (float3x3) worldMat);
+    result.normal = mul(normal, (float3x3) instance.worldMat);
 	result.normal = normalize(result.normal);
+    result.materialIndex = instance.materialIndex;
+#endif
     return result;
 }
\ No newline at end of file
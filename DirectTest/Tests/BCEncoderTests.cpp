@@ -0,0 +1,183 @@
+#include "TestHarness.h"
+#include "../Tools/TextureCompressor/BCEncoder.h"
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+// Round trips of the wood texture and of a made-up image with alpha through every format
+// TextureCompressor writes, each held to a PSNR floor.  The floors are about 2 dB below what the
+// encoder reaches, a change that loses quality fails.  The made-up image has a size that is not a
+// multiple of 4.
+
+struct RgbaImage
+{
+	uint32_t Width, Height;
+	std::vector<uint8_t> Pixels;
+
+	D3D12_SUBRESOURCE_DATA GetData() const
+	{
+		const D3D12_SUBRESOURCE_DATA Data = { Pixels.data(), (LONG_PTR)Width * 4, (LONG_PTR)Width * 4 * Height };
+		return Data;
+	}
+};
+
+struct FormatFloor
+{
+	DXGI_FORMAT Format;
+	const char* Name;
+	float WoodFloor;			// In dB
+	float SyntheticFloor;
+};
+
+// The SRGB variants are the same blocks, they must do exactly as well
+static const FormatFloor FLOORS[] =
+{
+	{ DXGI_FORMAT_BC1_UNORM, "BC1", 38.5f, 40.5f },
+	{ DXGI_FORMAT_BC1_UNORM_SRGB, "BC1_SRGB", 38.5f, 40.5f },
+	{ DXGI_FORMAT_BC3_UNORM, "BC3", 40.0f, 42.0f },
+	{ DXGI_FORMAT_BC3_UNORM_SRGB, "BC3_SRGB", 40.0f, 42.0f },
+	{ DXGI_FORMAT_BC4_UNORM, "BC4", 47.0f, 56.0f },
+	{ DXGI_FORMAT_BC5_UNORM, "BC5", 47.5f, 54.5f },
+	{ DXGI_FORMAT_BC7_UNORM, "BC7", 47.0f, 43.5f },
+	{ DXGI_FORMAT_BC7_UNORM_SRGB, "BC7_SRGB", 47.0f, 43.5f },
+};
+
+static RgbaImage LoadWood()
+{
+	RgbaImage Wood = { 0, 0 };
+
+	std::ifstream File(RESOURCES_DIR "woodTexture.jpg", std::ios::binary);
+	const std::vector<uint8_t> Bytes((std::istreambuf_iterator<char>(File)), std::istreambuf_iterator<char>());
+	Image Info;
+	if (Bytes.empty() || !ImageLoader::GetImageInfo(Bytes.data(), Bytes.size(), &Info))
+		return Wood;
+
+	Wood.Width = Info.textureWidth;
+	Wood.Height = Info.textureHeight;
+	Wood.Pixels.resize((size_t)Wood.Width * Wood.Height * 4);
+	if (!ImageLoader::DecodeImage(Bytes.data(), Bytes.size(), Wood.Pixels.data(), (size_t)Wood.Width * 4))
+		Wood.Pixels.clear();
+	return Wood;
+}
+
+// Smooth color, a few hard edges and an alpha ramp with a cut-out, as foliage or decals have
+static RgbaImage MakeSynthetic(uint32_t Width, uint32_t Height)
+{
+	RgbaImage Synthetic = { Width, Height, std::vector<uint8_t>((size_t)Width * Height * 4) };
+	for (uint32_t y = 0; y < Height; ++y)
+	{
+		for (uint32_t x = 0; x < Width; ++x)
+		{
+			const float u = (float)x / Width, v = (float)y / Height;
+			const float Edge = ((x / 23 + y / 17) % 3 == 0) ? 60.0f : 0.0f;
+			const int32_t dx = (int32_t)x - (int32_t)Width / 2, dy = (int32_t)y - (int32_t)Height / 2;
+			const bool CutOut = dx * dx + dy * dy < (int32_t)(Width * Width / 16);
+			uint8_t* Texel = &Synthetic.Pixels[((size_t)y * Width + x) * 4];
+			Texel[0] = (uint8_t)(40.0f + 150.0f * u + Edge);
+			Texel[1] = (uint8_t)(128.0f + 100.0f * std::sin(u * 7.0f + v * 3.0f));
+			Texel[2] = (uint8_t)(30.0f + 190.0f * v);
+			Texel[3] = CutOut ? 0 : (uint8_t)(255.0f * u);
+		}
+	}
+	return Synthetic;
+}
+
+static std::vector<uint8_t> Encode(DXGI_FORMAT Format, const RgbaImage& Source, D3D12_SUBRESOURCE_DATA& Blocks)
+{
+	const uint32_t RowPitch = (Source.Width + 3) / 4 * BCEncoder::GetBlockBytes(Format);
+	const uint32_t NumRows = (Source.Height + 3) / 4;
+	std::vector<uint8_t> Encoded((size_t)RowPitch * NumRows);
+
+	const D3D12_MEMCPY_DEST Dest = { Encoded.data(), RowPitch, (SIZE_T)RowPitch * NumRows };
+	BCEncoder::Encode(Format, Source.Width, Source.Height, Source.GetData(), Dest, true);
+
+	Blocks.pData = Encoded.data();
+	Blocks.RowPitch = RowPitch;
+	Blocks.SlicePitch = (LONG_PTR)RowPitch * NumRows;
+	return Encoded;
+}
+
+static float RoundTrip(const FormatFloor& Floor, const RgbaImage& Source, float MinPSNR)
+{
+	CHECK(BCEncoder::IsSupported(Floor.Format));
+
+	D3D12_SUBRESOURCE_DATA Blocks;
+	const std::vector<uint8_t> Encoded = Encode(Floor.Format, Source, Blocks);
+	const float PSNR = BCEncoder::ComputePSNR(Floor.Format, Source.Width, Source.Height, Source.GetData(), Blocks);
+	if (PSNR < MinPSNR)
+		std::printf("%s: %.2f dB, the floor is %.2f dB\n", Floor.Name, PSNR, MinPSNR);
+	CHECK(PSNR >= MinPSNR);
+
+	// The channels a format does not keep read as a shader would see them
+	std::vector<uint8_t> Decoded(Source.Pixels.size());
+	const D3D12_MEMCPY_DEST Dest = { Decoded.data(), (SIZE_T)Source.Width * 4, Decoded.size() };
+	BCEncoder::Decode(Floor.Format, Source.Width, Source.Height, Blocks, Dest);
+	uint32_t NumWrong = 0;
+	for (size_t i = 0; i < Decoded.size(); i += 4)
+	{
+		if (Floor.Format == DXGI_FORMAT_BC4_UNORM)
+			NumWrong += (Decoded[i + 1] != 0 || Decoded[i + 2] != 0 || Decoded[i + 3] != 255) ? 1 : 0;
+		else if (Floor.Format == DXGI_FORMAT_BC5_UNORM)
+			NumWrong += (Decoded[i + 2] != 0 || Decoded[i + 3] != 255) ? 1 : 0;
+		else if (Floor.Format == DXGI_FORMAT_BC1_UNORM || Floor.Format == DXGI_FORMAT_BC1_UNORM_SRGB)
+			NumWrong += Decoded[i + 3] != 255 ? 1 : 0;
+	}
+	CHECK_EQUAL(0u, NumWrong);
+	return PSNR;
+}
+
+// Blocks written by hand, so the decoder the PSNR relies on is checked against the format itself
+static void TestKnownBlocks()
+{
+	uint8_t Texels[16 * 4];
+	const D3D12_MEMCPY_DEST Dest = { Texels, 16, sizeof(Texels) };
+
+	// BC1: red and blue endpoints in 5:6:5, every texel on the first, then on the second
+	uint8_t Bc1[8] = { 0x00, 0xF8, 0x1F, 0x00, 0x00, 0x00, 0x00, 0x00 };
+	const D3D12_SUBRESOURCE_DATA Bc1Data = { Bc1, 8, 8 };
+	BCEncoder::Decode(DXGI_FORMAT_BC1_UNORM, 4, 4, Bc1Data, Dest);
+	CHECK(Texels[0] == 255 && Texels[1] == 0 && Texels[2] == 0 && Texels[3] == 255);
+	CHECK(Texels[60] == 255 && Texels[61] == 0 && Texels[62] == 0);
+	memset(Bc1 + 4, 0x55, 4);
+	BCEncoder::Decode(DXGI_FORMAT_BC1_UNORM, 4, 4, Bc1Data, Dest);
+	CHECK(Texels[0] == 0 && Texels[1] == 0 && Texels[2] == 255 && Texels[3] == 255);
+
+	// BC4: endpoints 200 and 100, 3-bit indices 0, then 1
+	uint8_t Bc4[8] = { 200, 100, 0, 0, 0, 0, 0, 0 };
+	const D3D12_SUBRESOURCE_DATA Bc4Data = { Bc4, 8, 8 };
+	BCEncoder::Decode(DXGI_FORMAT_BC4_UNORM, 4, 4, Bc4Data, Dest);
+	CHECK(Texels[0] == 200 && Texels[56] == 200);
+	const uint8_t AllOnes[6] = { 0x49, 0x92, 0x24, 0x49, 0x92, 0x24 };
+	memcpy(Bc4 + 2, AllOnes, 6);
+	BCEncoder::Decode(DXGI_FORMAT_BC4_UNORM, 4, 4, Bc4Data, Dest);
+	CHECK(Texels[0] == 100 && Texels[28] == 100 && Texels[60] == 100);
+}
+
+int main()
+{
+	TestKnownBlocks();
+
+	const RgbaImage Wood = LoadWood();
+	CHECK(!Wood.Pixels.empty());
+	const RgbaImage Synthetic = MakeSynthetic(250, 190);
+
+	float WoodBC1 = 0.0f, WoodBC7 = 0.0f;
+	for (const FormatFloor& Floor : FLOORS)
+	{
+		const float WoodPSNR = Wood.Pixels.empty() ? 0.0f : RoundTrip(Floor, Wood, Floor.WoodFloor);
+		const float SyntheticPSNR = RoundTrip(Floor, Synthetic, Floor.SyntheticFloor);
+		std::printf("%-9s wood %6.2f dB, synthetic %6.2f dB\n", Floor.Name, WoodPSNR, SyntheticPSNR);
+
+		if (Floor.Format == DXGI_FORMAT_BC1_UNORM)
+			WoodBC1 = WoodPSNR;
+		else if (Floor.Format == DXGI_FORMAT_BC7_UNORM)
+			WoodBC7 = WoodPSNR;
+	}
+
+	// BC7 is worth its twice the size only if it is well ahead
+	CHECK(WoodBC7 > WoodBC1 + 6.0f);
+
+	return TestResult("BCEncoderTests");
+}
@@ -0,0 +1,271 @@
+#include "TestHarness.h"
+#include "../EngineCore/Renderer/Graphics/JpegDecoder.h"
+#include "../EngineCore/Renderer/Graphics/PngDecoder.h"
+#include <cmath>
+#include <cstring>
+#include <csetjmp>
+#include <random>
+#include <vector>
+#include <jpeglib.h>
+#include <png.h>
+
+// Decode speed of JpegDecoder and PngDecoder against libjpeg and libpng, in megapixels per second,
+// on images those same libraries encode.  Both sides write RGBA8 and the results have to match:
+// exactly for PNG, within the rounding of the different IDCTs for JPEG.
+
+static const uint32_t IMAGE_SIZE = 2048;
+
+// Smooth gradients with edges and some grain, closer to a photograph than noise or flat colors.  The
+// waves are sin(a u + b v) cos(c v), split in per column and per row terms.
+static std::vector<uint8_t> MakeImage(uint32_t Width, uint32_t Height, uint32_t Channels)
+{
+	std::mt19937 Random(3);
+	std::vector<uint8_t> Pixels((size_t)Width * Height * Channels);
+
+	std::vector<float> SinU(Width * Channels), CosU(Width * Channels), SinV(Height * Channels), CosV(Height * Channels);
+	for (uint32_t c = 0; c < Channels; ++c)
+	{
+		for (uint32_t x = 0; x < Width; ++x)
+		{
+			const float u = (float)x / Width * (6.0f + c * 3.0f);
+			SinU[x * Channels + c] = std::sin(u);
+			CosU[x * Channels + c] = std::cos(u);
+		}
+		for (uint32_t y = 0; y < Height; ++y)
+		{
+			const float v = (float)y / Height;
+			const float Scale = std::cos(v * 9.0f - c) * 90.0f;
+			SinV[y * Channels + c] = std::sin(v * (4.0f - c)) * Scale;
+			CosV[y * Channels + c] = std::cos(v * (4.0f - c)) * Scale;
+		}
+	}
+
+	for (uint32_t y = 0; y < Height; ++y)
+	{
+		for (uint32_t x = 0; x < Width; ++x)
+		{
+			const float Edge = ((x / 97 + y / 61) % 5 == 0) ? 40.0f : 0.0f;
+			const float Grain = (float)(Random() % 9) - 4.0f;
+
+			uint8_t* Pixel = &Pixels[((size_t)y * Width + x) * Channels];
+			for (uint32_t c = 0; c < Channels; ++c)
+			{
+				const float Wave = SinU[x * Channels + c] * CosV[y * Channels + c] + CosU[x * Channels + c] * SinV[y * Channels + c];
+				const float Value = 128.0f + Wave + Edge + Grain;
+				Pixel[c] = (uint8_t)(Value < 0.0f ? 0.0f : (Value > 255.0f ? 255.0f : Value));
+			}
+		}
+	}
+	return Pixels;
+}
+
+struct JpegErrorManager
+{
+	jpeg_error_mgr Base;
+	jmp_buf Jump;
+};
+
+static void OnJpegError(j_common_ptr Info)
+{
+	longjmp(((JpegErrorManager*)Info->err)->Jump, 1);
+}
+
+static std::vector<uint8_t> EncodeJpeg(const std::vector<uint8_t>& Pixels, uint32_t Width, uint32_t Height, uint32_t Channels,
+	int Quality, int ChromaFactor)
+{
+	jpeg_compress_struct Info;
+	jpeg_error_mgr Errors;
+	Info.err = jpeg_std_error(&Errors);
+	jpeg_create_compress(&Info);
+
+	unsigned char* Buffer = nullptr;
+	unsigned long Size = 0;
+	jpeg_mem_dest(&Info, &Buffer, &Size);
+
+	Info.image_width = Width;
+	Info.image_height = Height;
+	Info.input_components = Channels;
+	Info.in_color_space = Channels == 1 ? JCS_GRAYSCALE : JCS_RGB;
+	jpeg_set_defaults(&Info);
+	jpeg_set_quality(&Info, Quality, TRUE);
+	if (Channels == 3)
+	{
+		Info.comp_info[0].h_samp_factor = ChromaFactor;
+		Info.comp_info[0].v_samp_factor = ChromaFactor;
+	}
+
+	jpeg_start_compress(&Info, TRUE);
+	while (Info.next_scanline < Height)
+	{
+		JSAMPROW Row = (JSAMPROW)&Pixels[(size_t)Info.next_scanline * Width * Channels];
+		jpeg_write_scanlines(&Info, &Row, 1);
+	}
+	jpeg_finish_compress(&Info);
+	jpeg_destroy_compress(&Info);
+
+	std::vector<uint8_t> File(Buffer, Buffer + Size);
+	free(Buffer);
+	return File;
+}
+
+// libjpeg-turbo writes RGBA directly, plain libjpeg only RGB, expanded here after the timing
+static bool DecodeJpegReference(const std::vector<uint8_t>& File, std::vector<uint8_t>& Rgba)
+{
+	jpeg_decompress_struct Info;
+	JpegErrorManager Errors;
+	Info.err = jpeg_std_error(&Errors.Base);
+	Errors.Base.error_exit = OnJpegError;
+	if (setjmp(Errors.Jump))
+	{
+		jpeg_destroy_decompress(&Info);
+		return false;
+	}
+
+	jpeg_create_decompress(&Info);
+	jpeg_mem_src(&Info, File.data(), (unsigned long)File.size());
+	jpeg_read_header(&Info, TRUE);
+#ifdef JCS_EXTENSIONS
+	const uint32_t Channels = 4;
+	Info.out_color_space = JCS_EXT_RGBA;
+#else
+	const uint32_t Channels = 3;
+	Info.out_color_space = JCS_RGB;
+#endif
+	jpeg_start_decompress(&Info);
+
+	const uint32_t Width = Info.output_width;
+	Rgba.resize((size_t)Width * Info.output_height * 4);
+	while (Info.output_scanline < Info.output_height)
+	{
+		JSAMPROW Row = (JSAMPROW)&Rgba[(size_t)Info.output_scanline * Width * 4];
+		jpeg_read_scanlines(&Info, &Row, 1);
+	}
+	jpeg_finish_decompress(&Info);
+	jpeg_destroy_decompress(&Info);
+
+	if (Channels == 3)
+	{
+		for (size_t Row = 0; Row < Info.output_height; ++Row)
+		{
+			uint8_t* Pixels = &Rgba[Row * Width * 4];
+			for (uint32_t x = Width; x-- > 0;)
+			{
+				Pixels[x * 4 + 3] = 255;
+				Pixels[x * 4 + 2] = Pixels[x * 3 + 2];
+				Pixels[x * 4 + 1] = Pixels[x * 3 + 1];
+				Pixels[x * 4 + 0] = Pixels[x * 3 + 0];
+			}
+		}
+	}
+	return true;
+}
+
+static std::vector<uint8_t> EncodePng(const std::vector<uint8_t>& Pixels, uint32_t Width, uint32_t Height, uint32_t Channels)
+{
+	png_image Image;
+	memset(&Image, 0, sizeof(Image));
+	Image.version = PNG_IMAGE_VERSION;
+	Image.width = Width;
+	Image.height = Height;
+	Image.format = Channels == 4 ? PNG_FORMAT_RGBA : PNG_FORMAT_RGB;
+
+	// Deflating takes seconds, the bound avoids a second pass to measure the file first
+	std::vector<uint8_t> File(PNG_IMAGE_PNG_SIZE_MAX(Image));
+	png_alloc_size_t Size = File.size();
+	if (!png_image_write_to_memory(&Image, File.data(), &Size, 0, Pixels.data(), 0, nullptr))
+		Size = 0;
+	File.resize(Size);
+	return File;
+}
+
+static bool DecodePngReference(const std::vector<uint8_t>& File, std::vector<uint8_t>& Rgba)
+{
+	png_image Image;
+	memset(&Image, 0, sizeof(Image));
+	Image.version = PNG_IMAGE_VERSION;
+	if (!png_image_begin_read_from_memory(&Image, File.data(), File.size()))
+		return false;
+
+	Image.format = PNG_FORMAT_RGBA;
+	Rgba.resize(PNG_IMAGE_SIZE(Image));
+	return png_image_finish_read(&Image, nullptr, Rgba.data(), 0, nullptr) != 0;
+}
+
+template <typename Decoder>
+static bool Decode(const std::vector<uint8_t>& File, std::vector<uint8_t>& Rgba)
+{
+	Decoder Image;
+	if (!Image.ReadHeader(File.data(), File.size()))
+		return false;
+
+	Rgba.resize((size_t)Image.GetWidth() * Image.GetHeight() * 4);
+	return Image.Decode(Rgba.data(), (size_t)Image.GetWidth() * 4);
+}
+
+typedef bool (*DecodeFunction)(const std::vector<uint8_t>& File, std::vector<uint8_t>& Rgba);
+
+// Best of the repetitions, in megapixels per second
+static double MeasureDecode(DecodeFunction Function, const std::vector<uint8_t>& File, std::vector<uint8_t>& Rgba, int Repetitions)
+{
+	double BestMs = 1e30;
+	for (int Repetition = 0; Repetition < Repetitions; ++Repetition)
+	{
+		Stopwatch Timer;
+		const bool Decoded = Function(File, Rgba);
+		const double Ms = Timer.GetMilliseconds();
+		CHECK(Decoded);
+		BestMs = Ms < BestMs ? Ms : BestMs;
+	}
+	return (double)IMAGE_SIZE * IMAGE_SIZE / (BestMs * 1000.0);
+}
+
+static void BenchmarkJpeg(const char* Name, uint32_t Channels, int ChromaFactor, int Repetitions)
+{
+	const std::vector<uint8_t> File = EncodeJpeg(MakeImage(IMAGE_SIZE, IMAGE_SIZE, Channels), IMAGE_SIZE, IMAGE_SIZE, Channels, 90, ChromaFactor);
+
+	std::vector<uint8_t> Ours, Reference;
+	const double OurSpeed = MeasureDecode(Decode<JpegDecoder>, File, Ours, Repetitions);
+	const double ReferenceSpeed = MeasureDecode(DecodeJpegReference, File, Reference, Repetitions);
+
+	// The float IDCT and libjpeg's integer one round differently, nothing else may
+	uint32_t MaxError = 0;
+	double TotalError = 0.0;
+	CHECK_EQUAL(Reference.size(), Ours.size());
+	for (size_t i = 0; i < Ours.size() && Ours.size() == Reference.size(); ++i)
+	{
+		const uint32_t Error = (uint32_t)std::abs((int)Ours[i] - (int)Reference[i]);
+		MaxError = Error > MaxError ? Error : MaxError;
+		TotalError += Error;
+	}
+	const double MeanError = Ours.empty() ? 0.0 : TotalError / Ours.size();
+	CHECK(MaxError <= 4);
+	CHECK(MeanError < 0.5);
+
+	std::printf("JPEG %-12s %6.1f MP/s, libjpeg %6.1f MP/s, %.2fx  (max error %u, mean %.3f)\n", Name,
+		OurSpeed, ReferenceSpeed, OurSpeed / ReferenceSpeed, MaxError, MeanError);
+}
+
+static void BenchmarkPng(const char* Name, uint32_t Channels, int Repetitions)
+{
+	const std::vector<uint8_t> File = EncodePng(MakeImage(IMAGE_SIZE, IMAGE_SIZE, Channels), IMAGE_SIZE, IMAGE_SIZE, Channels);
+	CHECK(!File.empty());
+
+	std::vector<uint8_t> Ours, Reference;
+	const double OurSpeed = MeasureDecode(Decode<PngDecoder>, File, Ours, Repetitions);
+	const double ReferenceSpeed = MeasureDecode(DecodePngReference, File, Reference, Repetitions);
+	CHECK(Ours == Reference);
+
+	std::printf("PNG  %-12s %6.1f MP/s, libpng  %6.1f MP/s, %.2fx\n", Name, OurSpeed, ReferenceSpeed, OurSpeed / ReferenceSpeed);
+}
+
+int main(int argc, char** argv)
+{
+	const int Repetitions = GetRepetitions(argc, argv, 5);
+
+	BenchmarkJpeg("YCbCr 4:2:0", 3, 2, Repetitions);
+	BenchmarkJpeg("YCbCr 4:4:4", 3, 1, Repetitions);
+	BenchmarkJpeg("Gray", 1, 1, Repetitions);
+	BenchmarkPng("RGB", 3, Repetitions);
+	BenchmarkPng("RGBA", 4, Repetitions);
+	return TestResult("DecoderBenchmark");
+}
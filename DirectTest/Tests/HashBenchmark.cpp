@@ -0,0 +1,62 @@
+#include "TestHarness.h"
+#include "../EngineCore/Core/Utility/Hash.h"
+#include <random>
+
+// Throughput of Hash64 and Crc32C, with the paths the CPU has and with the scalar code, from keys
+// the size of a root parameter to megabytes of shader bytecode
+
+typedef uint64_t (*HashFunction)(const uint8_t* Data, size_t Size);
+
+static uint64_t RunHash64(const uint8_t* Data, size_t Size) { return Utility::Hash64(Data, Size); }
+static uint64_t RunHash64Scalar(const uint8_t* Data, size_t Size) { return Utility::Hash64Scalar(Data, Size); }
+static uint64_t RunCrc32C(const uint8_t* Data, size_t Size) { return Utility::Crc32C(Data, Size, 0); }
+static uint64_t RunCrc32CScalar(const uint8_t* Data, size_t Size) { return Utility::Crc32CScalar(Data, Size, 0); }
+
+// Each measurement hashes this many bytes, in keys of the size given
+static const size_t BYTES_PER_RUN = 32 << 20;
+
+static double MeasureGBs(HashFunction Function, const std::vector<uint8_t>& Buffer, size_t Size, int Repetitions, uint64_t& Sink)
+{
+	const size_t NumKeys = BYTES_PER_RUN / Size;
+	const size_t NumOffsets = Buffer.size() - Size + 1;
+	double BestMs = 1e30;
+
+	for (int Repetition = 0; Repetition < Repetitions; ++Repetition)
+	{
+		Stopwatch Timer;
+		for (size_t Key = 0; Key < NumKeys; ++Key)
+			Sink += Function(&Buffer[(Key * 64) % NumOffsets], Size);
+		const double Ms = Timer.GetMilliseconds();
+		BestMs = Ms < BestMs ? Ms : BestMs;
+	}
+	return (double)NumKeys * Size / (BestMs * 1e6);
+}
+
+int main(int argc, char** argv)
+{
+	const int Repetitions = GetRepetitions(argc, argv, 5);
+
+	std::mt19937 Random(1);
+	std::vector<uint8_t> Buffer((1 << 20) + 4096);
+	for (uint8_t& Byte : Buffer)
+		Byte = (uint8_t)Random();
+
+	const Utility::CpuFeatures& Features = Utility::GetCpuFeatures();
+	std::printf("SSE4.2 %s, AVX2 %s, GB/s\n", Features.SSE42 ? "yes" : "no", Features.AVX2 ? "yes" : "no");
+	std::printf("%10s %10s %10s %10s %10s\n", "Size", "Hash64", "scalar", "Crc32C", "scalar");
+
+	uint64_t Sink = 0;
+	const size_t Sizes[] = { 16, 64, 256, 4096, 1 << 20 };
+	for (size_t Size : Sizes)
+	{
+		const double Hash = MeasureGBs(RunHash64, Buffer, Size, Repetitions, Sink);
+		const double HashScalar = MeasureGBs(RunHash64Scalar, Buffer, Size, Repetitions, Sink);
+		const double Crc = MeasureGBs(RunCrc32C, Buffer, Size, Repetitions, Sink);
+		const double CrcScalar = MeasureGBs(RunCrc32CScalar, Buffer, Size, Repetitions, Sink);
+		std::printf("%10zu %10.2f %10.2f %10.2f %10.2f\n", Size, Hash, HashScalar, Crc, CrcScalar);
+	}
+
+	// Keeps the calls from being optimized away
+	std::printf("(%016llx)\n", (unsigned long long)Sink);
+	return TestResult("HashBenchmark");
+}
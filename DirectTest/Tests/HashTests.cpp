@@ -0,0 +1,185 @@
+#include "TestHarness.h"
+#include "../EngineCore/Core/Utility/Hash.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <unordered_map>
+
+static std::vector<uint8_t> RandomBytes(size_t Size, uint32_t Seed)
+{
+	std::mt19937 Random(Seed);
+	std::vector<uint8_t> Bytes(Size);
+	for (uint8_t& Byte : Bytes)
+		Byte = (uint8_t)Random();
+	return Bytes;
+}
+
+static void TestKnownValues()
+{
+	// The check value of CRC-32C, with the inversions the function leaves to the caller
+	const char* Digits = "123456789";
+	CHECK_EQUAL(0xE3069283u, ~Utility::Crc32C(Digits, 9, ~0u));
+	CHECK_EQUAL(0xE3069283u, ~Utility::Crc32CScalar(Digits, 9, ~0u));
+
+	// Hash64 values are stored in the pipeline cache, they must not change between builds
+	CHECK(Utility::Hash64(nullptr, 0) == Utility::Hash64Scalar(nullptr, 0));
+	CHECK(Utility::Hash64(Digits, 9) != Utility::Hash64(Digits, 9, 1));
+}
+
+// Every size up to several blocks of stripes, at every alignment, so the vector loops, the block
+// scrambles and all the tails run against the scalar code
+static void TestPathsMatch()
+{
+	const Utility::CpuFeatures& Features = Utility::GetCpuFeatures();
+	std::printf("SSE4.2 %s, AVX2 %s\n", Features.SSE42 ? "yes" : "no", Features.AVX2 ? "yes" : "no");
+	if (!Features.SSE42 || !Features.AVX2)
+		std::printf("  Some paths are not available, they are compared with themselves\n");
+
+	const std::vector<uint8_t> Bytes = RandomBytes(4096, 1);
+	int HashMismatches = 0, CrcMismatches = 0;
+
+	for (size_t Offset = 0; Offset < 8; ++Offset)
+	{
+		for (size_t Size = 0; Size + Offset <= 2100; ++Size)
+		{
+			const uint8_t* Data = &Bytes[Offset];
+			const uint64_t Seed = Size * 31 + Offset;
+			if (Utility::Hash64(Data, Size, Seed) != Utility::Hash64Scalar(Data, Size, Seed))
+				++HashMismatches;
+			if (Utility::Crc32C(Data, Size, (uint32_t)Seed) != Utility::Crc32CScalar(Data, Size, (uint32_t)Seed))
+				++CrcMismatches;
+		}
+	}
+
+	CHECK_EQUAL(0, HashMismatches);
+	CHECK_EQUAL(0, CrcMismatches);
+}
+
+// Keys that differ in very little, like pipeline state descriptions: a counter in a field of zeros,
+// and one flipped bit of a random description.  None of the 64-bit hashes may collide and the low 32
+// bits must collide about as often as random values would.
+static void TestCollisions()
+{
+	std::vector<uint64_t> Hashes;
+
+	uint8_t Description[128] = {};
+	for (uint32_t Counter = 1; Counter <= 1 << 20; ++Counter)
+	{
+		for (size_t Offset = 0; Offset < 128; Offset += 60)
+		{
+			memset(Description, 0, sizeof(Description));
+			memcpy(&Description[Offset], &Counter, sizeof(Counter));
+			Hashes.push_back(Utility::Hash64(Description, sizeof(Description)));
+		}
+	}
+
+	std::vector<uint8_t> Random = RandomBytes(1024, 2);
+	for (size_t Bit = 0; Bit < Random.size() * 8; ++Bit)
+	{
+		Random[Bit / 8] ^= (uint8_t)(1 << (Bit % 8));
+		Hashes.push_back(Utility::Hash64(Random.data(), Random.size()));
+		Random[Bit / 8] ^= (uint8_t)(1 << (Bit % 8));
+	}
+
+	std::vector<uint64_t> Sorted = Hashes;
+	std::sort(Sorted.begin(), Sorted.end());
+	CHECK(std::adjacent_find(Sorted.begin(), Sorted.end()) == Sorted.end());
+
+	std::vector<uint32_t> Low(Hashes.size());
+	for (size_t i = 0; i < Hashes.size(); ++i)
+		Low[i] = (uint32_t)Hashes[i];
+	std::sort(Low.begin(), Low.end());
+	size_t LowCollisions = 0;
+	for (size_t i = 1; i < Low.size(); ++i)
+		LowCollisions += Low[i] == Low[i - 1] ? 1 : 0;
+
+	const double Expected = (double)Hashes.size() * Hashes.size() / (2.0 * 4294967296.0);
+	std::printf("%zu keys, %zu collisions in the low 32 bits, %.0f expected\n", Hashes.size(), LowCollisions, Expected);
+	CHECK(LowCollisions < Expected * 2.0);
+
+	// Flipping one input bit flips half the output bits on average
+	const std::vector<uint8_t> Keys = RandomBytes(64 * 256, 3);
+	double ChangedBits = 0.0;
+	uint32_t NumFlips = 0;
+	for (size_t Key = 0; Key < 256; ++Key)
+	{
+		uint8_t Block[64];
+		memcpy(Block, &Keys[Key * 64], 64);
+		const uint64_t Hash = Utility::Hash64(Block, 64);
+		for (uint32_t Bit = 0; Bit < 64 * 8; ++Bit)
+		{
+			Block[Bit / 8] ^= (uint8_t)(1 << (Bit % 8));
+			uint64_t Changed = Hash ^ Utility::Hash64(Block, 64);
+			Block[Bit / 8] ^= (uint8_t)(1 << (Bit % 8));
+
+			for (; Changed != 0; Changed &= Changed - 1)
+				ChangedBits += 1.0;
+			++NumFlips;
+		}
+	}
+	const double MeanChanged = ChangedBits / NumFlips;
+	CHECK(MeanChanged > 31.5 && MeanChanged < 32.5);
+}
+
+struct ProbedEntry
+{
+	std::vector<uint8_t> Description;
+};
+
+typedef std::unordered_map<uint64_t, std::shared_ptr<ProbedEntry>> ProbedMap;
+
+static std::shared_ptr<ProbedEntry> FindOrInsert(ProbedMap& Map, uint64_t Hash, const char* Text, bool& Inserted)
+{
+	std::vector<uint8_t> Key(Text, Text + strlen(Text));
+	return Utility::FindOrInsertProbed(Map, Hash, Key, [](std::vector<uint8_t>& NewKey)
+	{
+		std::shared_ptr<ProbedEntry> Entry = std::make_shared<ProbedEntry>();
+		Entry->Description.swap(NewKey);
+		return Entry;
+	}, Inserted);
+}
+
+// The lookup FindOrCompile does in PipelineState.cpp, with hashes made to collide
+static void TestProbing()
+{
+	ProbedMap Map;
+	bool Inserted;
+
+	const std::shared_ptr<ProbedEntry> A = FindOrInsert(Map, 42, "A", Inserted);
+	CHECK(Inserted);
+	const std::shared_ptr<ProbedEntry> B = FindOrInsert(Map, 42, "B", Inserted);
+	CHECK(Inserted);
+	const std::shared_ptr<ProbedEntry> C = FindOrInsert(Map, 42, "C", Inserted);
+	CHECK(Inserted);
+
+	// Each collision went to the next hash
+	CHECK(Map[42] == A);
+	CHECK(Map[43] == B);
+	CHECK(Map[44] == C);
+
+	// Found again past the colliding entries, nothing is created
+	CHECK(FindOrInsert(Map, 42, "C", Inserted) == C);
+	CHECK(!Inserted);
+	CHECK(FindOrInsert(Map, 42, "A", Inserted) == A);
+	CHECK(!Inserted);
+
+	// A key whose own hash is taken by a probed entry moves on as well
+	const std::shared_ptr<ProbedEntry> D = FindOrInsert(Map, 43, "D", Inserted);
+	CHECK(Inserted);
+	CHECK(Map[45] == D);
+	CHECK(FindOrInsert(Map, 43, "D", Inserted) == D);
+	CHECK(!Inserted);
+
+	CHECK_EQUAL(4u, Map.size());
+	CHECK(A->Description == std::vector<uint8_t>(1, 'A'));
+}
+
+int main()
+{
+	TestKnownValues();
+	TestPathsMatch();
+	TestCollisions();
+	TestProbing();
+	return TestResult("HashTests");
+}
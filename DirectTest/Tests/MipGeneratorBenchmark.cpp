@@ -0,0 +1,169 @@
+#include "TestHarness.h"
+#include "../EngineCore/Renderer/Graphics/MipGenerator.h"
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Filter throughput of MipGenerator, box and Kaiser on sRGB and on linear textures, in megapixels of
+// level 0 per second for the whole chain.  Before timing, each filter has to keep a flat color flat
+// and average a checkerboard to its mean, in linear space for sRGB.
+
+static const uint32_t IMAGE_SIZE = 2048;
+
+// A mip chain laid out as the footprints of a TextureUpload, rows padded to 256 bytes
+struct MipChain
+{
+	MipChain(uint32_t Width, uint32_t Height) : NumLevels(MipGenerator::GetNumLevels(Width, Height)), Data(NumLevels), Levels(NumLevels)
+	{
+		for (uint32_t Level = 0; Level < NumLevels; ++Level)
+		{
+			const size_t RowPitch = ((size_t)Width * 4 + 255) & ~(size_t)255;
+			Data[Level].assign(RowPitch * Height, 0xCD);
+			Levels[Level].pData = Data[Level].data();
+			Levels[Level].RowPitch = RowPitch;
+			Levels[Level].SlicePitch = RowPitch * Height;
+			Width = Width > 1 ? Width / 2 : 1;
+			Height = Height > 1 ? Height / 2 : 1;
+		}
+	}
+
+	uint8_t* GetTexel(uint32_t Level, uint32_t x, uint32_t y)
+	{
+		return &Data[Level][y * Levels[Level].RowPitch + x * 4];
+	}
+
+	uint32_t NumLevels;
+	std::vector<std::vector<uint8_t>> Data;
+	std::vector<D3D12_MEMCPY_DEST> Levels;
+};
+
+static MipChainOptions MakeOptions(MipFilter Filter, bool SRGB)
+{
+	MipChainOptions Options;
+	Options.Filter = Filter;
+	Options.SRGB = SRGB;
+	return Options;
+}
+
+// Every texel of every level within one step of Color
+static bool IsFlat(MipChain& Chain, uint32_t Width, uint32_t Height, const uint8_t Color[4])
+{
+	for (uint32_t Level = 0; Level < Chain.NumLevels; ++Level)
+	{
+		for (uint32_t y = 0; y < Height; ++y)
+		{
+			for (uint32_t x = 0; x < Width; ++x)
+			{
+				const uint8_t* Texel = Chain.GetTexel(Level, x, y);
+				for (uint32_t c = 0; c < 4; ++c)
+				{
+					if (std::abs((int)Texel[c] - (int)Color[c]) > 1)
+						return false;
+				}
+			}
+		}
+		Width = Width > 1 ? Width / 2 : 1;
+		Height = Height > 1 ? Height / 2 : 1;
+	}
+	return true;
+}
+
+static void TestFlatColor(const MipChainOptions& Options, uint32_t Width, uint32_t Height)
+{
+	const uint8_t Color[4] = { 200, 77, 13, 160 };
+
+	MipChain Chain(Width, Height);
+	for (uint32_t y = 0; y < Height; ++y)
+	{
+		for (uint32_t x = 0; x < Width; ++x)
+			memcpy(Chain.GetTexel(0, x, y), Color, 4);
+	}
+
+	MipGenerator::Generate(Options, Width, Height, Chain.NumLevels, Chain.Levels.data());
+	CHECK(IsFlat(Chain, Width, Height, Color));
+}
+
+// Black and white texels alternate, every level below is the mean: half of 255 for linear textures,
+// half the light for sRGB ones.  Filtering the encoded values would give the first for both.
+static void TestCheckerboard(const MipChainOptions& Options)
+{
+	const uint32_t Size = 64;
+	MipChain Chain(Size, Size);
+	for (uint32_t y = 0; y < Size; ++y)
+	{
+		for (uint32_t x = 0; x < Size; ++x)
+		{
+			uint8_t* Texel = Chain.GetTexel(0, x, y);
+			Texel[0] = Texel[1] = Texel[2] = ((x + y) & 1) ? 255 : 0;
+			Texel[3] = 255;
+		}
+	}
+
+	MipGenerator::Generate(Options, Size, Size, Chain.NumLevels, Chain.Levels.data());
+
+	const double Mean = Options.SRGB ? 255.0 * (1.055 * std::pow(0.5, 1.0 / 2.4) - 0.055) : 127.5;
+	uint32_t NumWrong = 0;
+	for (uint32_t y = 0; y < Size / 2; ++y)
+	{
+		for (uint32_t x = 0; x < Size / 2; ++x)
+		{
+			const uint8_t* Texel = Chain.GetTexel(1, x, y);
+			for (uint32_t c = 0; c < 3; ++c)
+				NumWrong += std::abs(Texel[c] - Mean) > 1.0 ? 1 : 0;
+			NumWrong += Texel[3] != 255 ? 1 : 0;
+		}
+	}
+	CHECK_EQUAL(0u, NumWrong);
+}
+
+// Best of the repetitions, in megapixels of level 0 per second
+static double MeasureGenerate(const MipChainOptions& Options, MipChain& Chain, bool Parallel, int Repetitions)
+{
+	double BestMs = 1e30;
+	for (int Repetition = 0; Repetition < Repetitions; ++Repetition)
+	{
+		Stopwatch Timer;
+		MipGenerator::Generate(Options, IMAGE_SIZE, IMAGE_SIZE, Chain.NumLevels, Chain.Levels.data(), Parallel);
+		const double Ms = Timer.GetMilliseconds();
+		BestMs = Ms < BestMs ? Ms : BestMs;
+	}
+	return (double)IMAGE_SIZE * IMAGE_SIZE / (BestMs * 1000.0);
+}
+
+static void BenchmarkFilter(const char* Name, MipFilter Filter, bool SRGB, int Repetitions)
+{
+	const MipChainOptions Options = MakeOptions(Filter, SRGB);
+	TestFlatColor(Options, 64, 64);
+	TestFlatColor(Options, 97, 23);
+	TestCheckerboard(Options);
+
+	// Noise, the filters do the same work whatever the texels are
+	MipChain Chain(IMAGE_SIZE, IMAGE_SIZE);
+	std::mt19937 Random(5);
+	for (uint32_t y = 0; y < IMAGE_SIZE; ++y)
+	{
+		for (uint32_t x = 0; x < IMAGE_SIZE; ++x)
+		{
+			const uint32_t Bits = Random();
+			memcpy(Chain.GetTexel(0, x, y), &Bits, 4);
+		}
+	}
+
+	const double Serial = MeasureGenerate(Options, Chain, false, Repetitions);
+	const double Parallel = MeasureGenerate(Options, Chain, true, Repetitions);
+
+	std::printf("%-14s %7.1f MP/s, parallel %7.1f MP/s, %.2fx\n", Name, Serial, Parallel, Parallel / Serial);
+}
+
+int main(int argc, char** argv)
+{
+	const int Repetitions = GetRepetitions(argc, argv, 5);
+
+	std::printf("%ux%u, %u levels\n", IMAGE_SIZE, IMAGE_SIZE, MipGenerator::GetNumLevels(IMAGE_SIZE, IMAGE_SIZE));
+	BenchmarkFilter("Box linear", kMipFilterBox, false, Repetitions);
+	BenchmarkFilter("Box sRGB", kMipFilterBox, true, Repetitions);
+	BenchmarkFilter("Kaiser linear", kMipFilterKaiser, false, Repetitions);
+	BenchmarkFilter("Kaiser sRGB", kMipFilterKaiser, true, Repetitions);
+	return TestResult("MipGeneratorBenchmark");
+}
@@ -0,0 +1,244 @@
+#include "TestHarness.h"
+#include "../EngineCore/Renderer/Graphics/OffsetAllocator.h"
+#include <map>
+#include <random>
+
+static const uint64_t KB = 1024;
+static const uint64_t MB = 1024 * 1024;
+
+static void TestCoalescing()
+{
+	TlsfAllocator Allocator;
+	Allocator.Create(1 * MB, 4 * KB);
+
+	uint64_t OffsetA, OffsetB, OffsetC;
+	const TlsfAllocator::Handle A = Allocator.Allocate(64 * KB, 4 * KB, OffsetA);
+	const TlsfAllocator::Handle B = Allocator.Allocate(64 * KB, 4 * KB, OffsetB);
+	const TlsfAllocator::Handle C = Allocator.Allocate(64 * KB, 4 * KB, OffsetC);
+	CHECK(A != TlsfAllocator::INVALID_HANDLE && B != TlsfAllocator::INVALID_HANDLE && C != TlsfAllocator::INVALID_HANDLE);
+	CHECK_EQUAL(0u, OffsetA);
+	CHECK_EQUAL(64 * KB, OffsetB);
+	CHECK_EQUAL(128 * KB, OffsetC);
+
+	// The tail after C is the only free block
+	OffsetAllocatorStats Stats = Allocator.GetStats();
+	CHECK_EQUAL(1u, Stats.NumFreeBlocks);
+	CHECK_EQUAL(1 * MB - 192 * KB, Stats.LargestFreeBlock);
+
+	// A on its own, then C merges with the tail
+	Allocator.Free(A);
+	Allocator.Free(C);
+	Stats = Allocator.GetStats();
+	CHECK_EQUAL(2u, Stats.NumFreeBlocks);
+	CHECK_EQUAL(1 * MB - 128 * KB, Stats.LargestFreeBlock);
+
+	// B joins both neighbours
+	Allocator.Free(B);
+	Stats = Allocator.GetStats();
+	CHECK_EQUAL(1u, Stats.NumFreeBlocks);
+	CHECK_EQUAL(1 * MB, Stats.LargestFreeBlock);
+	CHECK(Allocator.IsEmpty());
+
+	// The merged block is found again for an allocation of the whole size
+	uint64_t Offset;
+	const TlsfAllocator::Handle All = Allocator.Allocate(1 * MB, 4 * KB, Offset);
+	CHECK(All != TlsfAllocator::INVALID_HANDLE);
+	CHECK_EQUAL(0u, Offset);
+	Allocator.Free(All);
+}
+
+static void TestAlignment()
+{
+	TlsfAllocator Allocator;
+	Allocator.Create(4 * MB, 4 * KB);
+
+	// Sizes round up to the granularity
+	uint64_t SmallOffset;
+	const TlsfAllocator::Handle Small = Allocator.Allocate(100, 1, SmallOffset);
+	CHECK_EQUAL(0u, SmallOffset);
+	CHECK_EQUAL(4 * KB, Allocator.GetSize(Small));
+
+	// 64KB placement skips ahead and gives the padding in front back
+	uint64_t AlignedOffset;
+	const TlsfAllocator::Handle Aligned = Allocator.Allocate(64 * KB, 64 * KB, AlignedOffset);
+	CHECK(Aligned != TlsfAllocator::INVALID_HANDLE);
+	CHECK_EQUAL(64 * KB, AlignedOffset);
+	CHECK_EQUAL(AlignedOffset, Allocator.GetOffset(Aligned));
+
+	OffsetAllocatorStats Stats = Allocator.GetStats();
+	CHECK_EQUAL(2u, Stats.NumFreeBlocks);
+	CHECK_EQUAL(68 * KB, Stats.UsedSize);
+
+	// The padding is used by the next small allocation
+	uint64_t PaddingOffset;
+	const TlsfAllocator::Handle Padding = Allocator.Allocate(60 * KB, 4 * KB, PaddingOffset);
+	CHECK_EQUAL(4 * KB, PaddingOffset);
+
+	Allocator.Free(Small);
+	Allocator.Free(Aligned);
+	Allocator.Free(Padding);
+	CHECK_EQUAL(1u, Allocator.GetStats().NumFreeBlocks);
+
+	// Sizes that are not a multiple of the granularity are trimmed
+	TlsfAllocator Trimmed;
+	Trimmed.Create(10 * KB + 1, 4 * KB);
+	CHECK_EQUAL(8 * KB, Trimmed.GetTotalSize());
+}
+
+static void TestStats()
+{
+	TlsfAllocator Allocator;
+	Allocator.Create(256 * KB, 4 * KB);
+
+	OffsetAllocatorStats Stats = Allocator.GetStats();
+	CHECK_EQUAL(256 * KB, Stats.TotalSize);
+	CHECK_EQUAL(0u, Stats.UsedSize);
+	CHECK_EQUAL(0u, Stats.NumAllocations);
+	CHECK(Stats.Utilization() == 0.0f);
+	CHECK(Stats.Fragmentation() == 0.0f);
+
+	// Every other 16KB range taken, then the others released: free memory in eight pieces
+	TlsfAllocator::Handle Handles[16];
+	for (int i = 0; i < 16; ++i)
+	{
+		uint64_t Offset;
+		Handles[i] = Allocator.Allocate(16 * KB, 4 * KB, Offset);
+		CHECK_EQUAL(i * 16 * KB, Offset);
+	}
+
+	uint64_t Offset;
+	CHECK(Allocator.Allocate(4 * KB, 4 * KB, Offset) == TlsfAllocator::INVALID_HANDLE);
+
+	for (int i = 0; i < 16; i += 2)
+		Allocator.Free(Handles[i]);
+
+	Stats = Allocator.GetStats();
+	CHECK_EQUAL(128 * KB, Stats.UsedSize);
+	CHECK_EQUAL(128 * KB, Stats.FreeSize);
+	CHECK_EQUAL(8u, Stats.NumAllocations);
+	CHECK_EQUAL(8u, Stats.NumFreeBlocks);
+	CHECK_EQUAL(16 * KB, Stats.LargestFreeBlock);
+	CHECK(Stats.Utilization() == 0.5f);
+	CHECK(Stats.Fragmentation() == 1.0f - 16.0f / 128.0f);
+
+	// 32KB does not fit anywhere even though 128KB are free
+	CHECK(Allocator.Allocate(32 * KB, 4 * KB, Offset) == TlsfAllocator::INVALID_HANDLE);
+
+	for (int i = 1; i < 16; i += 2)
+		Allocator.Free(Handles[i]);
+	Stats = Allocator.GetStats();
+	CHECK_EQUAL(0u, Stats.UsedSize);
+	CHECK_EQUAL(1u, Stats.NumFreeBlocks);
+	CHECK(Stats.Fragmentation() == 0.0f);
+}
+
+// Random allocations and releases against a map of what is live.  Nothing may overlap, every offset
+// has to honour its alignment and the stats have to add up.  Freeing everything must leave one block.
+static void TestRandom()
+{
+	const uint64_t Granularity = 4 * KB;
+	TlsfAllocator Allocator;
+	Allocator.Create(64 * MB, Granularity);
+
+	std::mt19937 Random(1);
+	std::map<uint64_t, uint64_t> Live;			// Offset -> size
+	std::map<uint64_t, TlsfAllocator::Handle> Handles;
+	uint64_t UsedSize = 0;
+	int Overlaps = 0, Misaligned = 0;
+
+	for (int i = 0; i < 50000; ++i)
+	{
+		if (Live.empty() || Random() % 3 != 0)
+		{
+			const uint64_t Size = Random() % (2 * MB) + 1;
+			const uint64_t Alignment = Random() % 2 ? 64 * KB : Granularity;
+
+			uint64_t Offset;
+			const TlsfAllocator::Handle Handle = Allocator.Allocate(Size, Alignment, Offset);
+			if (Handle == TlsfAllocator::INVALID_HANDLE)
+				continue;
+
+			const uint64_t AllocatedSize = Allocator.GetSize(Handle);
+			if (Offset % Alignment != 0 || AllocatedSize < Size || Offset + AllocatedSize > Allocator.GetTotalSize())
+				++Misaligned;
+
+			auto Next = Live.lower_bound(Offset);
+			if (Next != Live.end() && Next->first < Offset + AllocatedSize)
+				++Overlaps;
+			if (Next != Live.begin() && std::prev(Next)->first + std::prev(Next)->second > Offset)
+				++Overlaps;
+
+			Live[Offset] = AllocatedSize;
+			Handles[Offset] = Handle;
+			UsedSize += AllocatedSize;
+		}
+		else
+		{
+			auto Victim = Live.begin();
+			std::advance(Victim, Random() % Live.size());
+			Allocator.Free(Handles[Victim->first]);
+			UsedSize -= Victim->second;
+			Handles.erase(Victim->first);
+			Live.erase(Victim);
+		}
+
+		if (i % 1000 == 0)
+		{
+			const OffsetAllocatorStats Stats = Allocator.GetStats();
+			CHECK_EQUAL(UsedSize, Stats.UsedSize);
+			CHECK_EQUAL(Live.size(), Stats.NumAllocations);
+			CHECK(Stats.LargestFreeBlock <= Stats.FreeSize);
+		}
+	}
+
+	CHECK_EQUAL(0, Overlaps);
+	CHECK_EQUAL(0, Misaligned);
+
+	for (const auto& Entry : Handles)
+		Allocator.Free(Entry.second);
+
+	const OffsetAllocatorStats Stats = Allocator.GetStats();
+	CHECK(Allocator.IsEmpty());
+	CHECK_EQUAL(1u, Stats.NumFreeBlocks);
+	CHECK_EQUAL(64 * MB, Stats.LargestFreeBlock);
+}
+
+static void TestLinear()
+{
+	LinearOffsetAllocator Allocator;
+	Allocator.Create(64 * KB);
+
+	uint64_t Offset;
+	CHECK(Allocator.Allocate(100, 16, Offset));
+	CHECK_EQUAL(0u, Offset);
+	CHECK(Allocator.Allocate(100, 256, Offset));
+	CHECK_EQUAL(256u, Offset);
+
+	OffsetAllocatorStats Stats = Allocator.GetStats();
+	CHECK_EQUAL(356u, Stats.UsedSize);
+	CHECK_EQUAL(64 * KB - 356, Stats.FreeSize);
+	CHECK_EQUAL(2u, Stats.NumAllocations);
+	CHECK_EQUAL(1u, Stats.NumFreeBlocks);
+
+	// Alignment padding counts against the space left
+	CHECK(!Allocator.Allocate(64 * KB - 356, 64, Offset));
+	CHECK(Allocator.Allocate(64 * KB - 384, 64, Offset));
+	CHECK_EQUAL(384u, Offset);
+	CHECK_EQUAL(0u, Allocator.GetStats().NumFreeBlocks);
+	CHECK(!Allocator.Allocate(1, 1, Offset));
+
+	Allocator.Reset();
+	CHECK(Allocator.IsEmpty());
+	CHECK(Allocator.Allocate(64 * KB, 1, Offset));
+	CHECK_EQUAL(0u, Offset);
+}
+
+int main()
+{
+	TestCoalescing();
+	TestAlignment();
+	TestStats();
+	TestRandom();
+	TestLinear();
+	return TestResult("OffsetAllocatorTests");
+}
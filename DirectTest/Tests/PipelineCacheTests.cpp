@@ -0,0 +1,304 @@
+#include "TestHarness.h"
+#include "../EngineCore/Renderer/Graphics/PipelineCache.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Writes cache files next to the test, damages them the ways a crash, a driver update or a bad disk
+// would and checks what Open() keeps.  The offsets below are those of the version 2 layout in
+// PipelineCache.h: a 32-byte header, then 40-byte entries, then the blobs.
+
+static const wchar_t* CACHE_FILE = L"PipelineCacheTests.bin";
+static const uint64_t DEVICE_VERSION = 0x1234567887654321ull;
+
+static const size_t HEADER_SIZE = 32;
+static const size_t VERSION_OFFSET = 4;
+static const size_t ENTRY_SIZE = 40;
+static const size_t ENTRY_OFFSET_OFFSET = 16;		// FileEntry::Offset
+
+struct TestEntry
+{
+	PipelineCache::EntryType Type;
+	uint64_t Key;
+	uint64_t Fingerprint;
+	std::vector<uint8_t> Blob;
+};
+
+static std::vector<TestEntry> MakeEntries()
+{
+	std::vector<TestEntry> Entries(3);
+	const PipelineCache::EntryType Types[] = { PipelineCache::kRootSignature, PipelineCache::kGraphicsPSO, PipelineCache::kComputePSO };
+	for (size_t i = 0; i < Entries.size(); ++i)
+	{
+		Entries[i].Type = Types[i];
+		// The same key for every type, they must not replace each other
+		Entries[i].Key = 42;
+		Entries[i].Fingerprint = 1000 + i;
+		// Sizes that are not multiples of the blob alignment
+		Entries[i].Blob.resize(100 + i * 37);
+		for (size_t Byte = 0; Byte < Entries[i].Blob.size(); ++Byte)
+			Entries[i].Blob[Byte] = (uint8_t)(Byte * 7 + i);
+	}
+	return Entries;
+}
+
+static void WriteCache(const std::vector<TestEntry>& Entries)
+{
+	_wremove(CACHE_FILE);
+
+	PipelineCache Cache;
+	Cache.Open(CACHE_FILE, DEVICE_VERSION);
+	for (const TestEntry& Entry : Entries)
+		Cache.Store(Entry.Type, Entry.Key, Entry.Fingerprint, Entry.Blob.data(), Entry.Blob.size());
+	CHECK(Cache.Save());
+}
+
+static std::vector<uint8_t> ReadFile()
+{
+	std::ifstream File(CACHE_FILE, std::ios::binary);
+	return std::vector<uint8_t>((std::istreambuf_iterator<char>(File)), std::istreambuf_iterator<char>());
+}
+
+static void WriteFile(const std::vector<uint8_t>& Bytes)
+{
+	std::ofstream File(CACHE_FILE, std::ios::binary | std::ios::trunc);
+	File.write((const char*)Bytes.data(), Bytes.size());
+}
+
+static uint64_t ReadU64(const std::vector<uint8_t>& Bytes, size_t Offset)
+{
+	uint64_t Value;
+	memcpy(&Value, &Bytes[Offset], sizeof(Value));
+	return Value;
+}
+
+static bool FindEntry(PipelineCache& Cache, const TestEntry& Entry)
+{
+	const void* Data = nullptr;
+	size_t Size = 0;
+	return Cache.Find(Entry.Type, Entry.Key, Entry.Fingerprint, Data, Size) && Size == Entry.Blob.size() &&
+		memcmp(Data, Entry.Blob.data(), Size) == 0;
+}
+
+static void TestRoundTrip()
+{
+	const std::vector<TestEntry> Entries = MakeEntries();
+	WriteCache(Entries);
+
+	PipelineCache Cache;
+	Cache.Open(CACHE_FILE, DEVICE_VERSION);
+	CHECK_EQUAL(3u, Cache.GetStats().NumLoaded);
+	CHECK(!Cache.GetStats().FileDiscarded);
+
+	for (const TestEntry& Entry : Entries)
+	{
+		CHECK(FindEntry(Cache, Entry));
+
+		// Hits point into the mapping, each blob aligned for the driver
+		const void* Data;
+		size_t Size;
+		CHECK(Cache.Find(Entry.Type, Entry.Key, Entry.Fingerprint, Data, Size) && (uintptr_t)Data % 16 == 0);
+	}
+
+	// Another description with the same key is a miss, not the blob of the first
+	const void* Data;
+	size_t Size;
+	CHECK(!Cache.Find(Entries[1].Type, Entries[1].Key, Entries[1].Fingerprint + 1, Data, Size));
+}
+
+// Pipeline states that differ only in their shaders hash to the same key, the permutations of a
+// material for one
+static void TestSameKey()
+{
+	std::vector<TestEntry> Entries = MakeEntries();
+	Entries[1] = Entries[0];
+	Entries[1].Fingerprint = Entries[0].Fingerprint + 1;
+	for (uint8_t& Byte : Entries[1].Blob)
+		Byte ^= 0x5A;
+	WriteCache(Entries);
+
+	PipelineCache Cache;
+	Cache.Open(CACHE_FILE, DEVICE_VERSION);
+	CHECK_EQUAL(3u, Cache.GetStats().NumLoaded);
+	for (const TestEntry& Entry : Entries)
+		CHECK(FindEntry(Cache, Entry));
+
+	// The driver refusing one of them leaves the other
+	Cache.MarkStale(Entries[0].Type, Entries[0].Key, Entries[0].Fingerprint);
+	CHECK(!FindEntry(Cache, Entries[0]));
+	CHECK(FindEntry(Cache, Entries[1]));
+}
+
+static void TestVersionMismatch()
+{
+	const std::vector<TestEntry> Entries = MakeEntries();
+	WriteCache(Entries);
+
+	std::vector<uint8_t> Bytes = ReadFile();
+	++Bytes[VERSION_OFFSET];
+	WriteFile(Bytes);
+
+	PipelineCache Cache;
+	Cache.Open(CACHE_FILE, DEVICE_VERSION);
+	CHECK(Cache.GetStats().FileDiscarded);
+	CHECK_EQUAL(0u, Cache.GetStats().NumLoaded);
+	CHECK(!FindEntry(Cache, Entries[0]));
+}
+
+static void TestDeviceMismatch()
+{
+	const std::vector<TestEntry> Entries = MakeEntries();
+	WriteCache(Entries);
+
+	// A driver update changes the version, the blobs of the old one are useless
+	PipelineCache Cache;
+	Cache.Open(CACHE_FILE, DEVICE_VERSION + 1);
+	CHECK(Cache.GetStats().FileDiscarded);
+	CHECK_EQUAL(0u, Cache.GetStats().NumLoaded);
+	CHECK(!FindEntry(Cache, Entries[0]));
+
+	// It starts over and writes a file for the new device
+	Cache.Store(Entries[0].Type, Entries[0].Key, Entries[0].Fingerprint, Entries[0].Blob.data(), Entries[0].Blob.size());
+	CHECK(Cache.Save());
+
+	PipelineCache Reopened;
+	Reopened.Open(CACHE_FILE, DEVICE_VERSION + 1);
+	CHECK_EQUAL(1u, Reopened.GetStats().NumLoaded);
+	CHECK(FindEntry(Reopened, Entries[0]));
+}
+
+static void TestCorruptTable()
+{
+	const std::vector<TestEntry> Entries = MakeEntries();
+	WriteCache(Entries);
+	const std::vector<uint8_t> Original = ReadFile();
+
+	// Any byte of the table, here the size of the second entry
+	std::vector<uint8_t> Bytes = Original;
+	Bytes[HEADER_SIZE + ENTRY_SIZE + 24] ^= 0x40;
+	WriteFile(Bytes);
+	{
+		PipelineCache Cache;
+		Cache.Open(CACHE_FILE, DEVICE_VERSION);
+		CHECK(Cache.GetStats().FileDiscarded);
+		CHECK_EQUAL(0u, Cache.GetStats().NumLoaded);
+	}
+
+	// Cut off in the middle of the table
+	Bytes.assign(Original.begin(), Original.begin() + HEADER_SIZE + ENTRY_SIZE);
+	WriteFile(Bytes);
+	{
+		PipelineCache Cache;
+		Cache.Open(CACHE_FILE, DEVICE_VERSION);
+		CHECK(Cache.GetStats().FileDiscarded);
+		CHECK_EQUAL(0u, Cache.GetStats().NumLoaded);
+	}
+
+	// Shorter than the header
+	Bytes.assign(Original.begin(), Original.begin() + HEADER_SIZE / 2);
+	WriteFile(Bytes);
+	{
+		PipelineCache Cache;
+		Cache.Open(CACHE_FILE, DEVICE_VERSION);
+		CHECK(Cache.GetStats().FileDiscarded);
+		CHECK(!FindEntry(Cache, Entries[0]));
+	}
+}
+
+static void TestBadBlobChecksum()
+{
+	const std::vector<TestEntry> Entries = MakeEntries();
+	WriteCache(Entries);
+
+	// One byte of the second blob, wherever the table put it
+	std::vector<uint8_t> Bytes = ReadFile();
+	const size_t Offset = (size_t)ReadU64(Bytes, HEADER_SIZE + ENTRY_SIZE + ENTRY_OFFSET_OFFSET);
+	CHECK(Offset >= HEADER_SIZE + 3 * ENTRY_SIZE && Offset < Bytes.size());
+	Bytes[Offset + 10] ^= 0x01;
+	WriteFile(Bytes);
+
+	// Only that entry goes, the file and the others stay
+	PipelineCache Cache;
+	Cache.Open(CACHE_FILE, DEVICE_VERSION);
+	CHECK(!Cache.GetStats().FileDiscarded);
+	CHECK_EQUAL(1u, Cache.GetStats().NumRejected);
+	CHECK_EQUAL(2u, Cache.GetStats().NumLoaded);
+
+	// The table does not say which entry is which, find the one that was rejected
+	uint32_t NumFound = 0;
+	for (const TestEntry& Entry : Entries)
+		NumFound += FindEntry(Cache, Entry) ? 1 : 0;
+	CHECK_EQUAL(2u, NumFound);
+}
+
+static void TestStaleEntries()
+{
+	const std::vector<TestEntry> Entries = MakeEntries();
+	WriteCache(Entries);
+
+	PipelineCache Cache;
+	Cache.Open(CACHE_FILE, DEVICE_VERSION);
+	CHECK(FindEntry(Cache, Entries[1]));
+
+	// The driver refused the blob: no more hits, and it is left out of the next file
+	Cache.MarkStale(Entries[1].Type, Entries[1].Key, Entries[1].Fingerprint);
+	CHECK_EQUAL(1u, Cache.GetStats().NumStale);
+	CHECK(!FindEntry(Cache, Entries[1]));
+	CHECK(Cache.Save());
+	{
+		PipelineCache Reopened;
+		Reopened.Open(CACHE_FILE, DEVICE_VERSION);
+		CHECK_EQUAL(2u, Reopened.GetStats().NumLoaded);
+		CHECK(FindEntry(Reopened, Entries[0]));
+		CHECK(!FindEntry(Reopened, Entries[1]));
+		CHECK(FindEntry(Reopened, Entries[2]));
+	}
+
+	// Stored anew after recompiling, it is written again
+	PipelineCache Recompiled;
+	Recompiled.Open(CACHE_FILE, DEVICE_VERSION);
+	Recompiled.MarkStale(Entries[1].Type, Entries[1].Key, Entries[1].Fingerprint);
+	Recompiled.Store(Entries[1].Type, Entries[1].Key, Entries[1].Fingerprint, Entries[1].Blob.data(), Entries[1].Blob.size());
+	CHECK(FindEntry(Recompiled, Entries[1]));
+	CHECK(Recompiled.Save());
+	{
+		PipelineCache Reopened;
+		Reopened.Open(CACHE_FILE, DEVICE_VERSION);
+		CHECK_EQUAL(3u, Reopened.GetStats().NumLoaded);
+		CHECK(FindEntry(Reopened, Entries[1]));
+	}
+}
+
+static void TestMissingFile()
+{
+	_wremove(CACHE_FILE);
+
+	// The first run has no file, that is not a discarded one
+	PipelineCache Cache;
+	Cache.Open(CACHE_FILE, DEVICE_VERSION);
+	CHECK(!Cache.GetStats().FileDiscarded);
+	CHECK_EQUAL(0u, Cache.GetStats().NumLoaded);
+	CHECK(Cache.Save());
+
+	PipelineCache Reopened;
+	Reopened.Open(CACHE_FILE, DEVICE_VERSION);
+	CHECK(!Reopened.GetStats().FileDiscarded);
+	CHECK_EQUAL(0u, Reopened.GetStats().NumLoaded);
+}
+
+int main()
+{
+	TestRoundTrip();
+	TestSameKey();
+	TestVersionMismatch();
+	TestDeviceMismatch();
+	TestCorruptTable();
+	TestBadBlobChecksum();
+	TestStaleEntries();
+	TestMissingFile();
+
+	_wremove(CACHE_FILE);
+	return TestResult("PipelineCacheTests");
+}
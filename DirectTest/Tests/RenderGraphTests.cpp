@@ -0,0 +1,245 @@
+#include "TestHarness.h"
+#include "../EngineCore/Renderer/Graphics/RenderGraph.h"
+
+// Compiles graphs with a made-up allocation query, so the schedule is checked without a device:
+// every texture takes 4 bytes a texel rounded up to 64KB, buffers their width.
+static D3D12_RESOURCE_ALLOCATION_INFO FakeAllocationInfo(GpuHeapCategory Category, D3D12_RESOURCE_DESC& Desc)
+{
+	const uint64_t Alignment = 64 * 1024;
+	const uint64_t Bytes = Category == kHeapBuffers ? Desc.Width : Desc.Width * Desc.Height * 4;
+
+	D3D12_RESOURCE_ALLOCATION_INFO Info;
+	Info.SizeInBytes = (Bytes + Alignment - 1) / Alignment * Alignment;
+	Info.Alignment = Alignment;
+	return Info;
+}
+
+static void Nothing(Renderer::GraphicContext&, RenderGraph&)
+{
+}
+
+static D3D12_RESOURCE_DESC RenderTarget(uint32_t Width, uint32_t Height)
+{
+	return CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8G8B8A8_UNORM, Width, Height, 1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
+}
+
+// The barrier on Resource right before the pass at schedule index Index, null if there is none
+static const RenderGraphBarrier* FindBarrier(const RenderGraph& Graph, uint32_t Index, uint32_t Resource)
+{
+	for (const RenderGraphBarrier& Barrier : Graph.GetSchedule()[Index].Barriers)
+	{
+		if (Barrier.Resource == Resource)
+			return &Barrier;
+	}
+	return nullptr;
+}
+
+static void TestCulling()
+{
+	RenderGraph Graph;
+	GpuResource BackBufferResource;
+	const uint32_t BackBuffer = Graph.ImportResource(L"Back Buffer", BackBufferResource, D3D12_RESOURCE_STATE_PRESENT);
+	const uint32_t Scene = Graph.CreateTransient(L"Scene", RenderTarget(256, 256));
+	const uint32_t Debug = Graph.CreateTransient(L"Debug", RenderTarget(256, 256));
+	const uint32_t Readback = Graph.CreateTransient(L"Readback", CD3DX12_RESOURCE_DESC::Buffer(4096));
+
+	const uint32_t ScenePass = Graph.AddPass(L"Scene", Nothing);
+	Graph.Write(ScenePass, Scene, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+	// Nobody reads Debug, so this pass goes
+	const uint32_t DebugPass = Graph.AddPass(L"Debug", Nothing);
+	Graph.Read(DebugPass, Scene, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	Graph.Write(DebugPass, Debug, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+	// Kept for its side effects even though its output is never read
+	const uint32_t ReadbackPass = Graph.AddPass(L"Readback", Nothing, true);
+	Graph.Read(ReadbackPass, Scene, D3D12_RESOURCE_STATE_COPY_SOURCE);
+	Graph.Write(ReadbackPass, Readback, D3D12_RESOURCE_STATE_COPY_DEST);
+
+	const uint32_t CompositePass = Graph.AddPass(L"Composite", Nothing);
+	Graph.Read(CompositePass, Scene, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	Graph.Write(CompositePass, BackBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+	// Writes something nobody reads after it, only the last writer before a read matters
+	const uint32_t OverwrittenPass = Graph.AddPass(L"Overwritten", Nothing);
+	Graph.Write(OverwrittenPass, Scene, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+	Graph.Compile(&FakeAllocationInfo);
+
+	CHECK(!Graph.IsPassCulled(ScenePass));
+	CHECK(Graph.IsPassCulled(DebugPass));
+	CHECK(!Graph.IsPassCulled(ReadbackPass));
+	CHECK(!Graph.IsPassCulled(CompositePass));
+	CHECK(Graph.IsPassCulled(OverwrittenPass));
+
+	const RenderGraphStats& Stats = Graph.GetStats();
+	CHECK_EQUAL(5u, Stats.NumPasses);
+	CHECK_EQUAL(2u, Stats.NumCulledPasses);
+
+	const std::vector<RenderGraphCompiledPass>& Schedule = Graph.GetSchedule();
+	CHECK_EQUAL(3u, Schedule.size());
+	CHECK_EQUAL(ScenePass, Schedule[0].Pass);
+	CHECK_EQUAL(ReadbackPass, Schedule[1].Pass);
+	CHECK_EQUAL(CompositePass, Schedule[2].Pass);
+
+	// Only what the surviving passes use takes memory
+	CHECK_EQUAL(256 * 1024 + 64 * 1024, Stats.TransientMemoryRequested);
+}
+
+static void TestBarriers()
+{
+	RenderGraph Graph;
+	GpuResource BackBufferResource;
+	const uint32_t BackBuffer = Graph.ImportResource(L"Back Buffer", BackBufferResource, D3D12_RESOURCE_STATE_PRESENT);
+	const uint32_t GBuffer = Graph.CreateTransient(L"GBuffer", RenderTarget(256, 256));
+	const uint32_t Particles = Graph.CreateTransient(L"Particles", CD3DX12_RESOURCE_DESC::Buffer(65536, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS));
+	const uint32_t Lighting = Graph.CreateTransient(L"Lighting", RenderTarget(256, 256));
+
+	const uint32_t GBufferPass = Graph.AddPass(L"GBuffer", Nothing);
+	Graph.Write(GBufferPass, GBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+	const uint32_t SimulatePass = Graph.AddPass(L"Simulate", Nothing);
+	Graph.Write(SimulatePass, Particles, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+	const uint32_t IntegratePass = Graph.AddPass(L"Integrate", Nothing);
+	Graph.Read(IntegratePass, Particles, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	Graph.Write(IntegratePass, Particles, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+	// Two readers in a row, one transition to both states
+	const uint32_t LightingPass = Graph.AddPass(L"Lighting", Nothing);
+	Graph.Read(LightingPass, GBuffer, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	Graph.Read(LightingPass, Particles, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	Graph.Write(LightingPass, Lighting, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+	const uint32_t CompositePass = Graph.AddPass(L"Composite", Nothing);
+	Graph.Read(CompositePass, GBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	Graph.Read(CompositePass, Lighting, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	Graph.Write(CompositePass, BackBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+	Graph.Compile(&FakeAllocationInfo);
+	CHECK_EQUAL(5u, Graph.GetSchedule().size());
+
+	// Transients start in the state of their first use, nothing before the first pass but the start of
+	// the back buffer transition
+	CHECK(FindBarrier(Graph, 0, GBuffer) == nullptr);
+	const RenderGraphBarrier* Barrier = FindBarrier(Graph, 0, BackBuffer);
+	CHECK(Barrier != nullptr && Barrier->Type == RenderGraphBarrier::kTransition);
+	CHECK(Barrier != nullptr && Barrier->Flags == D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY);
+	CHECK(Barrier != nullptr && Barrier->StateAfter == D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+	// The GBuffer is left alone by the simulation passes, its transition to the combined read state
+	// begins right after its writer and ends before the lighting
+	Barrier = FindBarrier(Graph, 1, GBuffer);
+	CHECK(Barrier != nullptr && Barrier->Flags == D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY);
+	CHECK(Barrier != nullptr && Barrier->StateBefore == D3D12_RESOURCE_STATE_RENDER_TARGET);
+	CHECK(Barrier != nullptr && Barrier->StateAfter ==
+		(D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
+	Barrier = FindBarrier(Graph, 3, GBuffer);
+	CHECK(Barrier != nullptr && Barrier->Flags == D3D12_RESOURCE_BARRIER_FLAG_END_ONLY);
+	CHECK(Barrier != nullptr && Barrier->StateAfter ==
+		(D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
+
+	// The second reader is covered by the combined state
+	CHECK(FindBarrier(Graph, 4, GBuffer) == nullptr);
+
+	// Unordered access after unordered access waits on the writes
+	Barrier = FindBarrier(Graph, 2, Particles);
+	CHECK(Barrier != nullptr && Barrier->Type == RenderGraphBarrier::kUAV);
+
+	// Used by the pass right before, nothing to split
+	Barrier = FindBarrier(Graph, 3, Particles);
+	CHECK(Barrier != nullptr && Barrier->Type == RenderGraphBarrier::kTransition);
+	CHECK(Barrier != nullptr && Barrier->Flags == D3D12_RESOURCE_BARRIER_FLAG_NONE);
+	CHECK(Barrier != nullptr && Barrier->StateAfter == D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+
+	Barrier = FindBarrier(Graph, 4, Lighting);
+	CHECK(Barrier != nullptr && Barrier->Flags == D3D12_RESOURCE_BARRIER_FLAG_NONE);
+	CHECK(Barrier != nullptr && Barrier->StateAfter == D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+
+	Barrier = FindBarrier(Graph, 4, BackBuffer);
+	CHECK(Barrier != nullptr && Barrier->Flags == D3D12_RESOURCE_BARRIER_FLAG_END_ONLY);
+
+	// Back to the state it was imported for
+	const std::vector<RenderGraphBarrier>& Final = Graph.GetFinalBarriers();
+	CHECK_EQUAL(1u, Final.size());
+	CHECK(Final.size() == 1 && Final[0].Resource == BackBuffer && Final[0].Flags == D3D12_RESOURCE_BARRIER_FLAG_NONE);
+	CHECK(Final.size() == 1 && Final[0].StateAfter == D3D12_RESOURCE_STATE_PRESENT);
+
+	const RenderGraphStats& Stats = Graph.GetStats();
+	CHECK_EQUAL(5u, Stats.NumTransitions);
+	CHECK_EQUAL(2u, Stats.NumSplitTransitions);
+	CHECK_EQUAL(1u, Stats.NumUAVBarriers);
+}
+
+static void TestAliasing()
+{
+	RenderGraph Graph;
+	GpuResource BackBufferResource;
+	const uint32_t BackBuffer = Graph.ImportResource(L"Back Buffer", BackBufferResource, D3D12_RESOURCE_STATE_PRESENT);
+
+	// 1MB, 1MB, 512KB and 256KB
+	const uint32_t A = Graph.CreateTransient(L"A", RenderTarget(512, 512));
+	const uint32_t B = Graph.CreateTransient(L"B", RenderTarget(512, 512));
+	const uint32_t C = Graph.CreateTransient(L"C", RenderTarget(512, 256));
+	const uint32_t D = Graph.CreateTransient(L"D", RenderTarget(256, 256));
+	const uint32_t Buffer = Graph.CreateTransient(L"Buffer", CD3DX12_RESOURCE_DESC::Buffer(65536));
+
+	// A: passes 0-1, B: 1-2, C: 2-3, D: 3, Buffer: 0-3
+	const uint32_t Pass0 = Graph.AddPass(L"0", Nothing);
+	Graph.Write(Pass0, A, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	Graph.Write(Pass0, Buffer, D3D12_RESOURCE_STATE_COPY_DEST);
+
+	const uint32_t Pass1 = Graph.AddPass(L"1", Nothing);
+	Graph.Read(Pass1, A, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	Graph.Write(Pass1, B, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+	const uint32_t Pass2 = Graph.AddPass(L"2", Nothing);
+	Graph.Read(Pass2, B, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	Graph.Write(Pass2, C, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+	const uint32_t Pass3 = Graph.AddPass(L"3", Nothing);
+	Graph.Read(Pass3, C, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	Graph.Read(Pass3, Buffer, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	Graph.Write(Pass3, D, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+	const uint32_t Pass4 = Graph.AddPass(L"4", Nothing);
+	Graph.Read(Pass4, D, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	Graph.Write(Pass4, BackBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+	Graph.Compile(&FakeAllocationInfo);
+
+	// Largest first: A at 0, B overlaps A in time so it goes after it, C reuses A's memory once A is
+	// dead and D fits after C, in what was A's memory too
+	const uint64_t MB = 1024 * 1024;
+	CHECK_EQUAL(0u, Graph.GetTransientOffset(A));
+	CHECK_EQUAL(1 * MB, Graph.GetTransientOffset(B));
+	CHECK_EQUAL(0u, Graph.GetTransientOffset(C));
+	CHECK_EQUAL(MB / 2, Graph.GetTransientOffset(D));
+
+	// Buffers live in a heap of their own
+	CHECK_EQUAL(0u, Graph.GetTransientOffset(Buffer));
+
+	const RenderGraphStats& Stats = Graph.GetStats();
+	CHECK_EQUAL(2 * MB + MB / 2 + MB / 4 + 65536, Stats.TransientMemoryRequested);
+	CHECK_EQUAL(2 * MB + 65536, Stats.TransientMemoryAllocated);
+	CHECK_EQUAL(MB / 2 + MB / 4, Stats.MemorySaved());
+
+	// Memory changes hands before the first use of C and of D, both were last A's
+	const RenderGraphBarrier* Barrier = FindBarrier(Graph, 2, C);
+	CHECK(Barrier != nullptr && Barrier->Type == RenderGraphBarrier::kAliasing && Barrier->AliasedResource == A);
+	Barrier = FindBarrier(Graph, 3, D);
+	CHECK(Barrier != nullptr && Barrier->Type == RenderGraphBarrier::kAliasing && Barrier->AliasedResource == A);
+
+	// Nothing had A's or B's memory before them
+	CHECK(FindBarrier(Graph, 0, A) == nullptr);
+	CHECK(FindBarrier(Graph, 1, B) == nullptr);
+	CHECK_EQUAL(2u, Stats.NumAliasingBarriers);
+}
+
+int main()
+{
+	TestCulling();
+	TestBarriers();
+	TestAliasing();
+	return TestResult("RenderGraphTests");
+}
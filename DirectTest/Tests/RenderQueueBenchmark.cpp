@@ -0,0 +1,218 @@
+#include "TestHarness.h"
+#include "../EngineCore/Renderer/Core/RenderQueue.h"
+#include "../EngineCore/Renderer/Components/Mesh.h"
+#include "../EngineCore/Renderer/Materials/Material.h"
+#include "../EngineCore/Core/Utility/RadixSort.h"
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+// Fills a queue with a million draws of made-up meshes and materials, in random order, and times the
+// sort and the packing of the indirect arguments.  Nothing is submitted, so no device is needed.
+
+static const uint32_t NUM_DRAWS = 1000000;
+static const uint32_t NUM_PSOS = 64;
+static const uint32_t NUM_MATERIALS = 1024;
+static const uint32_t NUM_GEOMETRIES = 512;
+static const uint32_t NUM_MESHES = 4096;
+
+// Only the addresses of the pipeline states are compared, they are never used
+static char PipelineStates[NUM_PSOS];
+
+class FakeMaterial : public Material
+{
+public:
+	FakeMaterial(uint32_t PSO, bool Transparent) :
+		Material(nullptr),
+		m_PSO(PSO),
+		m_Transparent(Transparent)
+	{
+	}
+
+	void BeginRender() override {}
+	void OnRender() override {}
+	void OnEndRender() override {}
+
+	const GraphicsPSO* GetPipelineState() const override { return reinterpret_cast<const GraphicsPSO*>(&PipelineStates[m_PSO]); }
+	bool IsTransparent() const override { return m_Transparent; }
+
+private:
+	uint32_t m_PSO;
+	bool m_Transparent;
+};
+
+struct FakeScene
+{
+	std::vector<std::unique_ptr<FakeMaterial>> Materials;
+	std::vector<std::unique_ptr<Mesh>> Geometries;
+	std::vector<std::unique_ptr<Mesh>> Meshes;
+};
+
+// One material in eight is transparent.  Meshes pick a material and a geometry at random.
+static void BuildScene(FakeScene& Scene, std::mt19937& Random)
+{
+	for (uint32_t i = 0; i < NUM_MATERIALS; ++i)
+		Scene.Materials.emplace_back(new FakeMaterial(Random() % NUM_PSOS, i % 8 == 0));
+
+	for (uint32_t i = 0; i < NUM_GEOMETRIES; ++i)
+	{
+		Mesh* pGeometry = new Mesh(nullptr, Scene.Materials[0].get());
+		pGeometry->numIndices = 36;
+		pGeometry->vertexBufferView.BufferLocation = 0x10000 * (i + 1);
+		pGeometry->vertexBufferView.SizeInBytes = 24 * sizeof(Vertex);
+		pGeometry->vertexBufferView.StrideInBytes = sizeof(Vertex);
+		pGeometry->indexBufferView.BufferLocation = pGeometry->vertexBufferView.BufferLocation + 0x8000;
+		pGeometry->indexBufferView.SizeInBytes = 36 * sizeof(DWORD);
+		pGeometry->indexBufferView.Format = DXGI_FORMAT_R32_UINT;
+		Scene.Geometries.emplace_back(pGeometry);
+	}
+
+	for (uint32_t i = 0; i < NUM_MESHES; ++i)
+	{
+		Mesh* pMesh = new Mesh(nullptr, Scene.Materials[Random() % NUM_MATERIALS].get());
+		const Mesh* pGeometry = Scene.Geometries[Random() % NUM_GEOMETRIES].get();
+
+		// What ShareGeometry() copies, without the buffers it expects to be created
+		pMesh->geometry = pGeometry->geometry;
+		pMesh->numIndices = pGeometry->numIndices;
+		pMesh->vertexBufferView = pGeometry->vertexBufferView;
+		pMesh->indexBufferView = pGeometry->indexBufferView;
+		Scene.Meshes.emplace_back(pMesh);
+	}
+}
+
+static void FillQueue(RenderQueue& Queue, const FakeScene& Scene, uint32_t Seed)
+{
+	std::mt19937 Random(Seed);
+	std::uniform_real_distribution<float> Depth(SCREEN_NEAR, SCREEN_DEPTH);
+
+	Queue.Reset();
+	for (uint32_t i = 0; i < NUM_DRAWS; ++i)
+		Queue.AddMesh(Scene.Meshes[Random() % NUM_MESHES].get(), Depth(Random));
+}
+
+// The queue as the renderer uses it: state changes in the order the draws came and after sorting
+static void BenchmarkQueueSort(const FakeScene& Scene, int Repetitions)
+{
+	RenderQueue Queue;
+	double BestMs = 1e30;
+
+	for (int Repetition = 0; Repetition < Repetitions; ++Repetition)
+	{
+		FillQueue(Queue, Scene, Repetition + 1);
+		Queue.Sort();
+		BestMs = std::min(BestMs, Queue.GetStats().SortMs);
+	}
+
+	const RenderQueueStats& Stats = Queue.GetStats();
+	CHECK_EQUAL(NUM_DRAWS, Stats.NumDraws);
+
+	// Opaque draws are grouped by pipeline state.  Transparent ones, one in eight, go by depth alone
+	// and still change state on almost every draw.
+	CHECK(Stats.SortedPSOChanges < Stats.UnsortedPSOChanges / 4);
+	CHECK(Stats.SortedMeshChanges < Stats.UnsortedMeshChanges);
+
+	std::printf("RenderQueue::Sort, %u draws: %.2f ms\n", NUM_DRAWS, BestMs);
+	std::printf("  PSO changes       %8u -> %8u\n", Stats.UnsortedPSOChanges, Stats.SortedPSOChanges);
+	std::printf("  Material changes  %8u -> %8u\n", Stats.UnsortedMaterialChanges, Stats.SortedMaterialChanges);
+	std::printf("  Mesh changes      %8u -> %8u\n", Stats.UnsortedMeshChanges, Stats.SortedMeshChanges);
+}
+
+// The radix sort on its own against std::stable_sort, on opaque keys spread over every field
+static void BenchmarkRadixSort(int Repetitions)
+{
+	std::mt19937 Random(7);
+	std::vector<uint64_t> SourceKeys(NUM_DRAWS);
+	for (uint64_t& Key : SourceKeys)
+	{
+		Key = RenderQueue::MakeOpaqueKey(0, Random() % NUM_PSOS, Random() % NUM_MATERIALS, Random() % NUM_GEOMETRIES,
+			Random() & ((1u << RenderQueue::DEPTH_BITS) - 1));
+	}
+
+	std::vector<uint64_t> Keys, KeysScratch(NUM_DRAWS);
+	std::vector<uint32_t> Values(NUM_DRAWS), ValuesScratch(NUM_DRAWS);
+	double RadixMs = 1e30;
+
+	for (int Repetition = 0; Repetition < Repetitions; ++Repetition)
+	{
+		Keys = SourceKeys;
+		for (uint32_t i = 0; i < NUM_DRAWS; ++i)
+			Values[i] = i;
+
+		Stopwatch Timer;
+		Utility::RadixSort64(Keys.data(), Values.data(), NUM_DRAWS, KeysScratch.data(), ValuesScratch.data());
+		RadixMs = std::min(RadixMs, Timer.GetMilliseconds());
+	}
+
+	std::vector<uint32_t> Reference(NUM_DRAWS);
+	for (uint32_t i = 0; i < NUM_DRAWS; ++i)
+		Reference[i] = i;
+
+	Stopwatch Timer;
+	std::stable_sort(Reference.begin(), Reference.end(), [&](uint32_t A, uint32_t B) { return SourceKeys[A] < SourceKeys[B]; });
+	const double ReferenceMs = Timer.GetMilliseconds();
+
+	// Both are stable, the orders must match exactly
+	CHECK(Values == Reference);
+	for (uint32_t i = 0; i < NUM_DRAWS; ++i)
+	{
+		if (Keys[i] != SourceKeys[Reference[i]])
+		{
+			CHECK(Keys[i] == SourceKeys[Reference[i]]);
+			break;
+		}
+	}
+
+	std::printf("RadixSort64, %u keys: %.2f ms, std::stable_sort %.2f ms\n", NUM_DRAWS, RadixMs, ReferenceMs);
+}
+
+// What Submit() writes for the materials drawn with ExecuteIndirect, for every group of the frame at
+// once.  Each command must cover the instances of its group and nothing else.
+static void BenchmarkPacking(const FakeScene& Scene, int Repetitions)
+{
+	RenderQueue Queue;
+	FillQueue(Queue, Scene, 1);
+	Queue.Sort();
+
+	const uint32_t NumGroups = Queue.GetGroupCount();
+	std::vector<RenderQueue::IndirectDrawArguments> Arguments(NumGroups);
+	double BestMs = 1e30;
+
+	for (int Repetition = 0; Repetition < Repetitions; ++Repetition)
+	{
+		Stopwatch Timer;
+		Queue.PackIndirectArguments(Arguments.data());
+		BestMs = std::min(BestMs, Timer.GetMilliseconds());
+	}
+
+	uint32_t NextInstance = 0;
+	bool Valid = true;
+	for (const RenderQueue::IndirectDrawArguments& Args : Arguments)
+	{
+		Valid = Valid && Args.FirstInstance == NextInstance && Args.Draw.InstanceCount > 0 &&
+			Args.Draw.IndexCountPerInstance == 36 && Args.VertexBuffer.BufferLocation != 0 &&
+			Args.IndexBuffer.BufferLocation == Args.VertexBuffer.BufferLocation + 0x8000;
+		NextInstance += Args.Draw.InstanceCount;
+	}
+	CHECK(Valid);
+	CHECK_EQUAL(NUM_DRAWS, NextInstance);
+
+	const double Megabytes = (double)NumGroups * sizeof(RenderQueue::IndirectDrawArguments) / (1024.0 * 1024.0);
+	std::printf("RenderQueue::PackIndirectArguments, %u commands: %.2f ms, %.0f MB/s\n", NumGroups, BestMs,
+		Megabytes * 1000.0 / BestMs);
+}
+
+int main(int argc, char** argv)
+{
+	const int Repetitions = GetRepetitions(argc, argv, 10);
+
+	std::mt19937 Random(1);
+	FakeScene Scene;
+	BuildScene(Scene, Random);
+
+	BenchmarkQueueSort(Scene, Repetitions);
+	BenchmarkRadixSort(Repetitions);
+	BenchmarkPacking(Scene, Repetitions);
+	return TestResult("RenderQueueBenchmark");
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+// Bare minimum for the test and benchmark programs in this folder.  A failed CHECK prints where it
+// happened and the program carries on, main() returns the number of failures.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+inline int& TestFailures()
+{
+	static int Failures = 0;
+	return Failures;
+}
+
+#define CHECK(Condition) \
+	do \
+	{ \
+		if (!(Condition)) \
+		{ \
+			std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #Condition); \
+			++TestFailures(); \
+		} \
+	} while (0)
+
+#define CHECK_EQUAL(Expected, Actual) \
+	do \
+	{ \
+		const auto ExpectedValue = (Expected); \
+		const auto ActualValue = (Actual); \
+		if (!(ExpectedValue == ActualValue)) \
+		{ \
+			std::printf("%s(%d): CHECK_EQUAL(%s, %s) failed, %lld != %lld\n", __FILE__, __LINE__, #Expected, #Actual, \
+				(long long)ExpectedValue, (long long)ActualValue); \
+			++TestFailures(); \
+		} \
+	} while (0)
+
+inline int TestResult(const char* Name)
+{
+	if (TestFailures() == 0)
+		std::printf("%s: all checks passed\n", Name);
+	else
+		std::printf("%s: %d checks failed\n", Name, TestFailures());
+	return TestFailures();
+}
+
+// Benchmarks take the number of repetitions as their only argument.  The tests run them once, so
+// they stay short and only catch crashes and mismatches.
+inline int GetRepetitions(int argc, char** argv, int Default)
+{
+	if (argc > 1)
+	{
+		const int Repetitions = std::atoi(argv[1]);
+		if (Repetitions > 0)
+			return Repetitions;
+	}
+	return Default;
+}
+
+class Stopwatch
+{
+public:
+	Stopwatch() : m_Start(std::chrono::steady_clock::now()) {}
+
+	void Restart() { m_Start = std::chrono::steady_clock::now(); }
+
+	double GetMilliseconds() const
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_Start).count();
+	}
+
+private:
+	std::chrono::steady_clock::time_point m_Start;
+};
@@ -0,0 +1,132 @@
+#include "TestHarness.h"
+#include "../EngineCore/Renderer/Graphics/TextureLoader.h"
+#include "../EngineCore/Core/Utility/Hash.h"
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+// Cold load of a level's worth of textures, the work of TextureLoader::DecodeJob() without the device:
+// decode into memory laid out like the upload footprints and generate the mips, large images split
+// into strips.  Once on a single thread, once as the loader does it, a task per texture on the PPL
+// pool.  The time should go down with the number of cores; a loader that ends up serialized fails.
+
+static const uint32_t NUM_TEXTURES = 500;
+
+struct SourceFile
+{
+	const char* Name;
+	std::vector<uint8_t> Bytes;
+};
+
+static std::vector<uint8_t> ReadResource(const char* Name)
+{
+	std::ifstream File(std::string(RESOURCES_DIR) + Name, std::ios::binary);
+	return std::vector<uint8_t>((std::istreambuf_iterator<char>(File)), std::istreambuf_iterator<char>());
+}
+
+// Returns a hash of the whole chain, or 0 if the image could not be decoded
+static uint64_t DecodeTexture(const std::vector<uint8_t>& File, bool AllowSplit, uint64_t& Pixels)
+{
+	Image Info;
+	if (!ImageLoader::GetImageInfo(File.data(), File.size(), &Info))
+		return 0;
+
+	const MipChainOptions Mips;
+	const uint32_t NumLevels = MipGenerator::GetNumLevels(Info.textureWidth, Info.textureHeight, Mips.MaxLevels);
+
+	// Rows padded to 256 bytes as in the upload ring, all levels in one allocation
+	std::vector<D3D12_MEMCPY_DEST> Levels(NumLevels);
+	size_t ChainSize = 0;
+	for (uint32_t Level = 0; Level < NumLevels; ++Level)
+	{
+		const uint32_t Width = Info.textureWidth >> Level > 1 ? Info.textureWidth >> Level : 1;
+		const uint32_t Height = Info.textureHeight >> Level > 1 ? Info.textureHeight >> Level : 1;
+		Levels[Level].RowPitch = ((SIZE_T)Width * 4 + 255) & ~(SIZE_T)255;
+		Levels[Level].SlicePitch = Levels[Level].RowPitch * Height;
+		ChainSize += Levels[Level].SlicePitch;
+	}
+	std::vector<uint8_t> Chain(ChainSize);
+	uint8_t* Next = Chain.data();
+	for (uint32_t Level = 0; Level < NumLevels; ++Level)
+	{
+		Levels[Level].pData = Next;
+		Next += Levels[Level].SlicePitch;
+	}
+
+	const bool Split = AllowSplit && (uint64_t)Info.textureWidth * Info.textureHeight >= TextureLoader::SPLIT_PIXELS;
+	if (!ImageLoader::DecodeImage(File.data(), File.size(), (uint8_t*)Levels[0].pData, Levels[0].RowPitch, Split))
+		return 0;
+	MipGenerator::Generate(Mips, Info.textureWidth, Info.textureHeight, NumLevels, Levels.data(), Split);
+
+	Pixels += (uint64_t)Info.textureWidth * Info.textureHeight;
+	return Utility::Hash64(Chain.data(), Chain.size());
+}
+
+int main(int argc, char** argv)
+{
+	const int Repetitions = GetRepetitions(argc, argv, 3);
+	const uint32_t NumCores = std::thread::hardware_concurrency();
+
+	SourceFile Files[] = { { "woodTexture.jpg" }, { "Arial.png" } };
+	const uint32_t NumFiles = sizeof(Files) / sizeof(Files[0]);
+	for (SourceFile& File : Files)
+	{
+		File.Bytes = ReadResource(File.Name);
+		CHECK(!File.Bytes.empty());
+	}
+
+	// Each texture of the level is one of the files, every one gives the same chain both ways
+	uint64_t Expected[NumFiles];
+	uint64_t Pixels = 0;
+	for (uint32_t i = 0; i < NumFiles; ++i)
+	{
+		Expected[i] = DecodeTexture(Files[i].Bytes, false, Pixels);
+		CHECK(Expected[i] != 0);
+	}
+
+	double SerialMs = 1e30, ParallelMs = 1e30;
+	uint32_t NumWrong = 0;
+	for (int Repetition = 0; Repetition < Repetitions; ++Repetition)
+	{
+		Pixels = 0;
+		Stopwatch Timer;
+		for (uint32_t i = 0; i < NUM_TEXTURES; ++i)
+			NumWrong += DecodeTexture(Files[i % NumFiles].Bytes, false, Pixels) != Expected[i % NumFiles] ? 1 : 0;
+		const double Ms = Timer.GetMilliseconds();
+		SerialMs = Ms < SerialMs ? Ms : SerialMs;
+
+		// As TextureLoader::Load() queues them
+		std::vector<uint64_t> Hashes(NUM_TEXTURES);
+		std::vector<uint64_t> TexturePixels(NUM_TEXTURES);
+		std::vector<concurrency::task<void>> Jobs;
+		Timer.Restart();
+		for (uint32_t i = 0; i < NUM_TEXTURES; ++i)
+		{
+			Jobs.push_back(concurrency::create_task([&Files, &Hashes, &TexturePixels, i]()
+			{
+				Hashes[i] = DecodeTexture(Files[i % NumFiles].Bytes, true, TexturePixels[i]);
+			}));
+		}
+		concurrency::when_all(Jobs.begin(), Jobs.end()).wait();
+		const double PoolMs = Timer.GetMilliseconds();
+		ParallelMs = PoolMs < ParallelMs ? PoolMs : ParallelMs;
+
+		for (uint32_t i = 0; i < NUM_TEXTURES; ++i)
+			NumWrong += Hashes[i] != Expected[i % NumFiles] ? 1 : 0;
+	}
+	CHECK_EQUAL(0u, NumWrong);
+
+	const double Speedup = SerialMs / ParallelMs;
+	std::printf("%u textures, %.0f MP: serial %.0f ms, PPL pool %.0f ms, %.2fx on %u cores\n", NUM_TEXTURES,
+		Pixels / 1e6, SerialMs, ParallelMs, Speedup, NumCores);
+
+	// Well short of linear, memory bandwidth and hyper-threading take their share, but far from the
+	// 1x of a serialized loader
+	if (NumCores > 1)
+	{
+		const uint32_t Scaled = NumCores < 8 ? NumCores : 8;
+		CHECK(Speedup > 1.0 + 0.3 * (Scaled - 1));
+	}
+	return TestResult("TextureLoaderBenchmark");
+}
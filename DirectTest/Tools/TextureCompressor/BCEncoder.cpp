@@ -0,0 +1,792 @@
+#include "BCEncoder.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <ppl.h>
+
+using namespace std;
+
+namespace
+{
+	// Block rows encoded by one task
+	const uint32_t BLOCK_ROWS_PER_TASK = 4;
+
+	const int POWER_ITERATIONS = 8;
+	// Least squares fits of the endpoints after the first, each to the indices of the last
+	const int REFINE_ITERATIONS = 2;
+
+	// Of BC7 4-bit indices, out of 64
+	const uint32_t BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+	const uint8_t BC7_MODE6 = 1 << 6;
+
+	enum BlockKind
+	{
+		kBlockBC1,
+		kBlockBC3,
+		kBlockBC4,
+		kBlockBC5,
+		kBlockBC7,
+		kBlockUnsupported
+	};
+
+	BlockKind GetBlockKind(DXGI_FORMAT Format)
+	{
+		switch (Format)
+		{
+		case DXGI_FORMAT_BC1_UNORM:
+		case DXGI_FORMAT_BC1_UNORM_SRGB:
+			return kBlockBC1;
+		case DXGI_FORMAT_BC3_UNORM:
+		case DXGI_FORMAT_BC3_UNORM_SRGB:
+			return kBlockBC3;
+		case DXGI_FORMAT_BC4_UNORM:
+			return kBlockBC4;
+		case DXGI_FORMAT_BC5_UNORM:
+			return kBlockBC5;
+		case DXGI_FORMAT_BC7_UNORM:
+		case DXGI_FORMAT_BC7_UNORM_SRGB:
+			return kBlockBC7;
+		default:
+			return kBlockUnsupported;
+		}
+	}
+
+	uint8_t ToByte(float Value)
+	{
+		return (uint8_t)(min(max(Value, 0.0f), 255.0f) + 0.5f);
+	}
+
+	// Texels are 0 to 255
+	void LoadBlock(const D3D12_SUBRESOURCE_DATA& Source, uint32_t Width, uint32_t Height, uint32_t BlockX, uint32_t BlockY,
+		XMVECTOR Texels[16])
+	{
+		for (uint32_t y = 0; y < 4; ++y)
+		{
+			const uint32_t Row = min(BlockY * 4 + y, Height - 1);
+			const uint8_t* In = (const uint8_t*)Source.pData + Row * Source.RowPitch;
+			for (uint32_t x = 0; x < 4; ++x)
+			{
+				const uint8_t* Texel = In + min(BlockX * 4 + x, Width - 1) * 4;
+				Texels[y * 4 + x] = XMVectorSet(Texel[0], Texel[1], Texel[2], Texel[3]);
+			}
+		}
+	}
+
+	// The two texels furthest apart along the direction the block spreads the most.  Channels that
+	// are 0 in every texel play no part.
+	void FindEndpoints(const XMVECTOR Texels[16], XMVECTOR& End0, XMVECTOR& End1)
+	{
+		XMVECTOR Mean = XMVectorZero();
+		XMVECTOR Min = Texels[0];
+		XMVECTOR Max = Texels[0];
+		for (int t = 0; t < 16; ++t)
+		{
+			Mean = XMVectorAdd(Mean, Texels[t]);
+			Min = XMVectorMin(Min, Texels[t]);
+			Max = XMVectorMax(Max, Texels[t]);
+		}
+		Mean = XMVectorScale(Mean, 1.0f / 16.0f);
+
+		// Power iteration on the covariance, without building it: C * Axis is the sum of each
+		// texel's offset from the mean times its projection on Axis
+		XMVECTOR Axis = XMVectorSubtract(Max, Min);
+		for (int i = 0; i < POWER_ITERATIONS; ++i)
+		{
+			XMVECTOR Next = XMVectorZero();
+			for (int t = 0; t < 16; ++t)
+			{
+				const XMVECTOR Offset = XMVectorSubtract(Texels[t], Mean);
+				Next = XMVectorMultiplyAdd(Offset, XMVector4Dot(Offset, Axis), Next);
+			}
+			if (XMVectorGetX(XMVector4LengthSq(Next)) < 1e-6f)
+				break;
+			Axis = XMVector4Normalize(Next);
+		}
+
+		float Low = FLT_MAX;
+		float High = -FLT_MAX;
+		End0 = End1 = Texels[0];
+		for (int t = 0; t < 16; ++t)
+		{
+			const float Projection = XMVectorGetX(XMVector4Dot(Texels[t], Axis));
+			if (Projection < Low)
+			{
+				Low = Projection;
+				End1 = Texels[t];
+			}
+			if (Projection > High)
+			{
+				High = Projection;
+				End0 = Texels[t];
+			}
+		}
+	}
+
+	// Nearest palette entry of each texel.  Returns the summed squared error.
+	//
+	// Palette[Order[0]] to Palette[Order[NumEntries - 1]] lie along a line at close to even steps, so
+	// only the entries either side of where a texel projects onto it are measured.
+	float FitIndices(const XMVECTOR Texels[16], const XMVECTOR* Palette, const uint8_t* Order, uint32_t NumEntries,
+		uint8_t Indices[16])
+	{
+		const XMVECTOR Start = Palette[Order[0]];
+		const XMVECTOR Line = XMVectorSubtract(Palette[Order[NumEntries - 1]], Start);
+		const float LengthSq = XMVectorGetX(XMVector4LengthSq(Line));
+		const XMVECTOR Scale = XMVectorReplicate(LengthSq > 0.0f ? (NumEntries - 1) / LengthSq : 0.0f);
+		const int32_t Last = (int32_t)NumEntries - 1;
+
+		float Error = 0.0f;
+		for (int t = 0; t < 16; ++t)
+		{
+			const float Position = XMVectorGetX(XMVectorMultiply(XMVector4Dot(XMVectorSubtract(Texels[t], Start), Line), Scale));
+			const int32_t Step = (int32_t)floorf(Position + 0.5f);
+
+			float Best = FLT_MAX;
+			for (int32_t Candidate = max(Step - 1, 0); Candidate <= min(Step + 1, Last); ++Candidate)
+			{
+				const uint8_t Index = Order[Candidate];
+				const float Distance = XMVectorGetX(XMVector4LengthSq(XMVectorSubtract(Texels[t], Palette[Index])));
+				if (Distance < Best)
+				{
+					Best = Distance;
+					Indices[t] = Index;
+				}
+			}
+			// Past either end
+			if (Best == FLT_MAX)
+			{
+				Indices[t] = Order[Step < 0 ? 0 : Last];
+				Best = XMVectorGetX(XMVector4LengthSq(XMVectorSubtract(Texels[t], Palette[Indices[t]])));
+			}
+			Error += Best;
+		}
+		return Error;
+	}
+
+	// The endpoints that best reproduce the texels with these indices.  Weights[i] is how far palette
+	// entry i lies from End0 towards End1.
+	bool RefineEndpoints(const XMVECTOR Texels[16], const uint8_t Indices[16], const float* Weights,
+		XMVECTOR& End0, XMVECTOR& End1)
+	{
+		float AA = 0.0f, AB = 0.0f, BB = 0.0f;
+		XMVECTOR AX = XMVectorZero();
+		XMVECTOR BX = XMVectorZero();
+		for (int t = 0; t < 16; ++t)
+		{
+			const float B = Weights[Indices[t]];
+			const float A = 1.0f - B;
+			AA += A * A;
+			AB += A * B;
+			BB += B * B;
+			AX = XMVectorMultiplyAdd(Texels[t], XMVectorReplicate(A), AX);
+			BX = XMVectorMultiplyAdd(Texels[t], XMVectorReplicate(B), BX);
+		}
+
+		// Every texel on the same entry leaves the system singular
+		const float Determinant = AA * BB - AB * AB;
+		if (fabsf(Determinant) < 1e-4f)
+			return false;
+
+		const XMVECTOR Scale = XMVectorReplicate(1.0f / Determinant);
+		const XMVECTOR Limit = XMVectorReplicate(255.0f);
+		End0 = XMVectorMultiply(XMVectorSubtract(XMVectorScale(AX, BB), XMVectorScale(BX, AB)), Scale);
+		End1 = XMVectorMultiply(XMVectorSubtract(XMVectorScale(BX, AA), XMVectorScale(AX, AB)), Scale);
+		End0 = XMVectorClamp(End0, XMVectorZero(), Limit);
+		End1 = XMVectorClamp(End1, XMVectorZero(), Limit);
+		return true;
+	}
+
+	//
+	// BC1 color and the color half of BC3
+	//
+
+	uint16_t To565(XMVECTOR Color)
+	{
+		XMFLOAT4 C;
+		XMStoreFloat4(&C, XMVectorClamp(Color, XMVectorZero(), XMVectorReplicate(255.0f)));
+		return (uint16_t)((uint32_t)(C.x * 31.0f / 255.0f + 0.5f) << 11 | (uint32_t)(C.y * 63.0f / 255.0f + 0.5f) << 5 |
+			(uint32_t)(C.z * 31.0f / 255.0f + 0.5f));
+	}
+
+	void From565(uint16_t Color, uint8_t RGB[3])
+	{
+		const uint32_t R = Color >> 11, G = (Color >> 5) & 63, B = Color & 31;
+		RGB[0] = (uint8_t)(R << 3 | R >> 2);
+		RGB[1] = (uint8_t)(G << 2 | G >> 4);
+		RGB[2] = (uint8_t)(B << 3 | B >> 2);
+	}
+
+	// In the order of the indices.  BC3 always has four colors, BC1 three and black when Color0 is
+	// not the greater.
+	void ColorPalette(uint16_t Color0, uint16_t Color1, bool FourColors, uint8_t Palette[4][4])
+	{
+		From565(Color0, Palette[0]);
+		From565(Color1, Palette[1]);
+		for (int c = 0; c < 3; ++c)
+		{
+			const uint32_t C0 = Palette[0][c], C1 = Palette[1][c];
+			if (FourColors || Color0 > Color1)
+			{
+				Palette[2][c] = (uint8_t)((2 * C0 + C1 + 1) / 3);
+				Palette[3][c] = (uint8_t)((C0 + 2 * C1 + 1) / 3);
+			}
+			else
+			{
+				Palette[2][c] = (uint8_t)((C0 + C1 + 1) / 2);
+				Palette[3][c] = 0;
+			}
+		}
+		Palette[0][3] = Palette[1][3] = Palette[2][3] = 255;
+		Palette[3][3] = (FourColors || Color0 > Color1) ? 255 : 0;
+	}
+
+	// Texels have alpha zeroed.  Always four colors, so the block decodes the same in BC1 and BC3.
+	void EncodeColor(const XMVECTOR Texels[16], uint8_t* Out)
+	{
+		static const float Weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+		static const uint8_t Order[4] = { 0, 2, 3, 1 };
+
+		XMVECTOR End0, End1;
+		FindEndpoints(Texels, End0, End1);
+
+		float BestError = FLT_MAX;
+		uint16_t BestColor0 = 0, BestColor1 = 0;
+		uint8_t BestIndices[16] = {};
+		for (int i = 0; i <= REFINE_ITERATIONS; ++i)
+		{
+			uint16_t Color0 = To565(End0);
+			uint16_t Color1 = To565(End1);
+			if (Color0 < Color1)
+				swap(Color0, Color1);
+
+			uint8_t Colors[4][4];
+			ColorPalette(Color0, Color1, true, Colors);
+			XMVECTOR Palette[4];
+			for (int p = 0; p < 4; ++p)
+				Palette[p] = XMVectorSet(Colors[p][0], Colors[p][1], Colors[p][2], 0.0f);
+
+			// Equal colors are three-color mode in BC1, the first index is the only safe one
+			uint8_t Indices[16];
+			const float Error = FitIndices(Texels, Palette, Order, Color0 == Color1 ? 1 : 4, Indices);
+			if (Error < BestError)
+			{
+				BestError = Error;
+				BestColor0 = Color0;
+				BestColor1 = Color1;
+				memcpy(BestIndices, Indices, sizeof(Indices));
+			}
+
+			if (Error == 0.0f || Color0 == Color1 || !RefineEndpoints(Texels, Indices, Weights, End0, End1))
+				break;
+		}
+
+		Out[0] = (uint8_t)BestColor0;
+		Out[1] = (uint8_t)(BestColor0 >> 8);
+		Out[2] = (uint8_t)BestColor1;
+		Out[3] = (uint8_t)(BestColor1 >> 8);
+		uint32_t Bits = 0;
+		for (int t = 0; t < 16; ++t)
+			Bits |= (uint32_t)BestIndices[t] << (t * 2);
+		memcpy(Out + 4, &Bits, 4);
+	}
+
+	void DecodeColor(const uint8_t* Block, bool FourColors, uint8_t Texels[16][4])
+	{
+		uint8_t Palette[4][4];
+		ColorPalette((uint16_t)(Block[0] | Block[1] << 8), (uint16_t)(Block[2] | Block[3] << 8), FourColors, Palette);
+
+		uint32_t Bits;
+		memcpy(&Bits, Block + 4, 4);
+		for (int t = 0; t < 16; ++t)
+			memcpy(Texels[t], Palette[(Bits >> (t * 2)) & 3], 4);
+	}
+
+	//
+	// BC4 single channel, alpha of BC3 and each half of BC5
+	//
+
+	void ChannelPalette(uint32_t Value0, uint32_t Value1, uint8_t Palette[8])
+	{
+		Palette[0] = (uint8_t)Value0;
+		Palette[1] = (uint8_t)Value1;
+		if (Value0 > Value1)
+		{
+			for (uint32_t i = 1; i < 7; ++i)
+				Palette[i + 1] = (uint8_t)(((7 - i) * Value0 + i * Value1 + 3) / 7);
+		}
+		else
+		{
+			for (uint32_t i = 1; i < 5; ++i)
+				Palette[i + 1] = (uint8_t)(((5 - i) * Value0 + i * Value1 + 2) / 5);
+			Palette[6] = 0;
+			Palette[7] = 255;
+		}
+	}
+
+	// Eight-value mode, the endpoints are the extremes of the block and then least squares
+	void EncodeChannel(const float Values[16], uint8_t* Out)
+	{
+		static const float Weights[8] = { 0.0f, 1.0f, 1.0f / 7.0f, 2.0f / 7.0f, 3.0f / 7.0f, 4.0f / 7.0f, 5.0f / 7.0f, 6.0f / 7.0f };
+
+		int32_t Bytes[16];
+		float End0 = Values[0], End1 = Values[0];
+		for (int t = 0; t < 16; ++t)
+		{
+			Bytes[t] = ToByte(Values[t]);
+			End0 = max(End0, Values[t]);
+			End1 = min(End1, Values[t]);
+		}
+
+		uint32_t BestError = UINT32_MAX;
+		uint8_t Best0 = 0, Best1 = 0;
+		uint8_t BestIndices[16] = {};
+		for (int i = 0; i <= REFINE_ITERATIONS; ++i)
+		{
+			uint8_t Value0 = ToByte(End0);
+			uint8_t Value1 = ToByte(End1);
+			if (Value0 < Value1)
+				swap(Value0, Value1);
+
+			uint8_t Palette[8];
+			ChannelPalette(Value0, Value1, Palette);
+
+			uint8_t Indices[16];
+			uint32_t Error = 0;
+			for (int t = 0; t < 16; ++t)
+			{
+				const int32_t Value = Bytes[t];
+				uint32_t Nearest = UINT32_MAX;
+				for (uint8_t p = 0; p < (Value0 == Value1 ? 1 : 8); ++p)
+				{
+					const uint32_t Distance = (uint32_t)((Value - Palette[p]) * (Value - Palette[p]));
+					if (Distance < Nearest)
+					{
+						Nearest = Distance;
+						Indices[t] = p;
+					}
+				}
+				Error += Nearest;
+			}
+
+			if (Error < BestError)
+			{
+				BestError = Error;
+				Best0 = Value0;
+				Best1 = Value1;
+				memcpy(BestIndices, Indices, sizeof(Indices));
+			}
+			if (Error == 0 || Value0 == Value1)
+				break;
+
+			float AA = 0.0f, AB = 0.0f, BB = 0.0f, AX = 0.0f, BX = 0.0f;
+			for (int t = 0; t < 16; ++t)
+			{
+				const float B = Weights[Indices[t]];
+				const float A = 1.0f - B;
+				AA += A * A;
+				AB += A * B;
+				BB += B * B;
+				AX += A * Values[t];
+				BX += B * Values[t];
+			}
+			const float Determinant = AA * BB - AB * AB;
+			if (fabsf(Determinant) < 1e-4f)
+				break;
+			End0 = (AX * BB - BX * AB) / Determinant;
+			End1 = (BX * AA - AX * AB) / Determinant;
+		}
+
+		Out[0] = Best0;
+		Out[1] = Best1;
+		uint64_t Bits = 0;
+		for (int t = 0; t < 16; ++t)
+			Bits |= (uint64_t)BestIndices[t] << (t * 3);
+		for (int b = 0; b < 6; ++b)
+			Out[2 + b] = (uint8_t)(Bits >> (b * 8));
+	}
+
+	void DecodeChannel(const uint8_t* Block, uint8_t Texels[16][4], int Channel)
+	{
+		uint8_t Palette[8];
+		ChannelPalette(Block[0], Block[1], Palette);
+
+		uint64_t Bits = 0;
+		for (int b = 0; b < 6; ++b)
+			Bits |= (uint64_t)Block[2 + b] << (b * 8);
+		for (int t = 0; t < 16; ++t)
+			Texels[t][Channel] = Palette[(Bits >> (t * 3)) & 7];
+	}
+
+	//
+	// BC7 mode 6: RGBA endpoints of 7 bits and a bit shared by the four channels of each, 4-bit indices
+	//
+
+	struct BitWriter
+	{
+		uint8_t* Out;
+		uint32_t Position;
+
+		void Write(uint32_t Value, uint32_t NumBits)
+		{
+			for (uint32_t b = 0; b < NumBits; ++b, ++Position)
+				Out[Position >> 3] |= (uint8_t)(((Value >> b) & 1) << (Position & 7));
+		}
+	};
+
+	struct BitReader
+	{
+		const uint8_t* In;
+		uint32_t Position;
+
+		uint32_t Read(uint32_t NumBits)
+		{
+			uint32_t Value = 0;
+			for (uint32_t b = 0; b < NumBits; ++b, ++Position)
+				Value |= (uint32_t)((In[Position >> 3] >> (Position & 7)) & 1) << b;
+			return Value;
+		}
+	};
+
+	void BC7Palette(const uint8_t End0[4], const uint8_t End1[4], uint8_t Palette[16][4])
+	{
+		for (int i = 0; i < 16; ++i)
+		{
+			for (int c = 0; c < 4; ++c)
+				Palette[i][c] = (uint8_t)(((64 - BC7_WEIGHTS[i]) * End0[c] + BC7_WEIGHTS[i] * End1[c] + 32) >> 6);
+		}
+	}
+
+	// 7 bits of each channel and the shared bit below them
+	void QuantizeBC7(XMVECTOR Endpoint, uint32_t PBit, uint8_t Quantized[4])
+	{
+		XMFLOAT4 E;
+		XMStoreFloat4(&E, Endpoint);
+		const float Channels[4] = { E.x, E.y, E.z, E.w };
+		for (int c = 0; c < 4; ++c)
+		{
+			const int32_t High = (int32_t)floorf((Channels[c] - PBit) * 0.5f + 0.5f);
+			Quantized[c] = (uint8_t)(min(max(High, 0), 127) << 1 | PBit);
+		}
+	}
+
+	void EncodeBC7(const XMVECTOR Texels[16], uint8_t* Out)
+	{
+		float Weights[16];
+		uint8_t Order[16];
+		for (int i = 0; i < 16; ++i)
+		{
+			Weights[i] = BC7_WEIGHTS[i] / 64.0f;
+			Order[i] = (uint8_t)i;
+		}
+
+		XMVECTOR End0, End1;
+		FindEndpoints(Texels, End0, End1);
+
+		float BestError = FLT_MAX;
+		uint8_t Best0[4] = {}, Best1[4] = {};
+		uint8_t BestIndices[16] = {};
+		for (int i = 0; i <= REFINE_ITERATIONS; ++i)
+		{
+			uint8_t Indices[16];
+			float Error = FLT_MAX;
+			// Each combination of the shared bits
+			for (uint32_t PBits = 0; PBits < 4; ++PBits)
+			{
+				uint8_t Quantized0[4], Quantized1[4];
+				QuantizeBC7(End0, PBits & 1, Quantized0);
+				QuantizeBC7(End1, PBits >> 1, Quantized1);
+
+				uint8_t Colors[16][4];
+				BC7Palette(Quantized0, Quantized1, Colors);
+				XMVECTOR Palette[16];
+				for (int p = 0; p < 16; ++p)
+					Palette[p] = XMVectorSet(Colors[p][0], Colors[p][1], Colors[p][2], Colors[p][3]);
+
+				uint8_t Tried[16];
+				const float TriedError = FitIndices(Texels, Palette, Order, 16, Tried);
+				if (TriedError < Error)
+				{
+					Error = TriedError;
+					memcpy(Indices, Tried, sizeof(Tried));
+				}
+				if (TriedError < BestError)
+				{
+					BestError = TriedError;
+					memcpy(Best0, Quantized0, 4);
+					memcpy(Best1, Quantized1, 4);
+					memcpy(BestIndices, Tried, sizeof(Tried));
+				}
+			}
+
+			if (Error == 0.0f || !RefineEndpoints(Texels, Indices, Weights, End0, End1))
+				break;
+		}
+
+		// The first index is stored without its top bit, which has to be 0
+		if (BestIndices[0] & 8)
+		{
+			for (int c = 0; c < 4; ++c)
+				swap(Best0[c], Best1[c]);
+			for (int t = 0; t < 16; ++t)
+				BestIndices[t] = 15 - BestIndices[t];
+		}
+
+		memset(Out, 0, 16);
+		BitWriter Writer = { Out, 0 };
+		Writer.Write(BC7_MODE6, 7);
+		for (int c = 0; c < 4; ++c)
+		{
+			Writer.Write(Best0[c] >> 1, 7);
+			Writer.Write(Best1[c] >> 1, 7);
+		}
+		Writer.Write(Best0[0] & 1, 1);
+		Writer.Write(Best1[0] & 1, 1);
+		Writer.Write(BestIndices[0], 3);
+		for (int t = 1; t < 16; ++t)
+			Writer.Write(BestIndices[t], 4);
+	}
+
+	void DecodeBC7(const uint8_t* Block, uint8_t Texels[16][4])
+	{
+		BitReader Reader = { Block, 0 };
+		if (Reader.Read(7) != BC7_MODE6)
+		{
+			ASSERT(false, "Only mode 6 of BC7 can be decoded");
+			memset(Texels, 0, 16 * 4);
+			return;
+		}
+
+		uint8_t End0[4], End1[4];
+		for (int c = 0; c < 4; ++c)
+		{
+			End0[c] = (uint8_t)(Reader.Read(7) << 1);
+			End1[c] = (uint8_t)(Reader.Read(7) << 1);
+		}
+		const uint32_t PBit0 = Reader.Read(1);
+		const uint32_t PBit1 = Reader.Read(1);
+		for (int c = 0; c < 4; ++c)
+		{
+			End0[c] |= PBit0;
+			End1[c] |= PBit1;
+		}
+
+		uint8_t Palette[16][4];
+		BC7Palette(End0, End1, Palette);
+		for (int t = 0; t < 16; ++t)
+			memcpy(Texels[t], Palette[Reader.Read(t == 0 ? 3 : 4)], 4);
+	}
+
+	//
+	// Blocks of any format
+	//
+
+	void EncodeBlock(BlockKind Kind, XMVECTOR Texels[16], uint8_t* Out)
+	{
+		float Channel[16];
+		switch (Kind)
+		{
+		case kBlockBC1:
+		case kBlockBC3:
+			if (Kind == kBlockBC3)
+			{
+				for (int t = 0; t < 16; ++t)
+					Channel[t] = XMVectorGetW(Texels[t]);
+				EncodeChannel(Channel, Out);
+				Out += 8;
+			}
+			for (int t = 0; t < 16; ++t)
+				Texels[t] = XMVectorSetW(Texels[t], 0.0f);
+			EncodeColor(Texels, Out);
+			break;
+		case kBlockBC4:
+		case kBlockBC5:
+			for (int t = 0; t < 16; ++t)
+				Channel[t] = XMVectorGetX(Texels[t]);
+			EncodeChannel(Channel, Out);
+			if (Kind == kBlockBC5)
+			{
+				for (int t = 0; t < 16; ++t)
+					Channel[t] = XMVectorGetY(Texels[t]);
+				EncodeChannel(Channel, Out + 8);
+			}
+			break;
+		case kBlockBC7:
+			EncodeBC7(Texels, Out);
+			break;
+		default:
+			break;
+		}
+	}
+
+	void DecodeBlock(BlockKind Kind, const uint8_t* Block, uint8_t Texels[16][4])
+	{
+		switch (Kind)
+		{
+		case kBlockBC1:
+			DecodeColor(Block, false, Texels);
+			break;
+		case kBlockBC3:
+			DecodeColor(Block + 8, true, Texels);
+			DecodeChannel(Block, Texels, 3);
+			break;
+		case kBlockBC4:
+		case kBlockBC5:
+			for (int t = 0; t < 16; ++t)
+			{
+				Texels[t][1] = Texels[t][2] = 0;
+				Texels[t][3] = 255;
+			}
+			DecodeChannel(Block, Texels, 0);
+			if (Kind == kBlockBC5)
+				DecodeChannel(Block + 8, Texels, 1);
+			break;
+		case kBlockBC7:
+			DecodeBC7(Block, Texels);
+			break;
+		default:
+			memset(Texels, 0, 16 * 4);
+			break;
+		}
+	}
+
+	template <typename Function>
+	void ForEachBlockRow(uint32_t Height, bool Parallel, const Function& Body)
+	{
+		const uint32_t NumBlockRows = (Height + 3) / 4;
+		const uint32_t NumTasks = (NumBlockRows + BLOCK_ROWS_PER_TASK - 1) / BLOCK_ROWS_PER_TASK;
+		auto Task = [&](uint32_t Index)
+		{
+			const uint32_t End = min(NumBlockRows, (Index + 1) * BLOCK_ROWS_PER_TASK);
+			for (uint32_t BlockY = Index * BLOCK_ROWS_PER_TASK; BlockY < End; ++BlockY)
+				Body(BlockY);
+		};
+
+		if (Parallel && NumTasks > 1)
+			concurrency::parallel_for(0u, NumTasks, Task);
+		else
+		{
+			for (uint32_t Index = 0; Index < NumTasks; ++Index)
+				Task(Index);
+		}
+	}
+}
+
+bool BCEncoder::IsSupported(DXGI_FORMAT Format)
+{
+	return GetBlockKind(Format) != kBlockUnsupported;
+}
+
+uint32_t BCEncoder::GetBlockBytes(DXGI_FORMAT Format)
+{
+	switch (Format)
+	{
+	case DXGI_FORMAT_BC1_TYPELESS:
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+	case DXGI_FORMAT_BC4_TYPELESS:
+	case DXGI_FORMAT_BC4_UNORM:
+	case DXGI_FORMAT_BC4_SNORM:
+		return 8;
+	case DXGI_FORMAT_BC2_TYPELESS:
+	case DXGI_FORMAT_BC2_UNORM:
+	case DXGI_FORMAT_BC2_UNORM_SRGB:
+	case DXGI_FORMAT_BC3_TYPELESS:
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+	case DXGI_FORMAT_BC5_TYPELESS:
+	case DXGI_FORMAT_BC5_UNORM:
+	case DXGI_FORMAT_BC5_SNORM:
+	case DXGI_FORMAT_BC6H_TYPELESS:
+	case DXGI_FORMAT_BC6H_UF16:
+	case DXGI_FORMAT_BC6H_SF16:
+	case DXGI_FORMAT_BC7_TYPELESS:
+	case DXGI_FORMAT_BC7_UNORM:
+	case DXGI_FORMAT_BC7_UNORM_SRGB:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+void BCEncoder::Encode(DXGI_FORMAT Format, uint32_t Width, uint32_t Height, const D3D12_SUBRESOURCE_DATA& Source,
+	const D3D12_MEMCPY_DEST& Dest, bool Parallel)
+{
+	const BlockKind Kind = GetBlockKind(Format);
+	ASSERT(Kind != kBlockUnsupported, "The encoder does not write this format");
+
+	const uint32_t BlockBytes = GetBlockBytes(Format);
+	const uint32_t NumBlocksX = (Width + 3) / 4;
+	ForEachBlockRow(Height, Parallel, [&](uint32_t BlockY)
+	{
+		uint8_t* Out = (uint8_t*)Dest.pData + BlockY * Dest.RowPitch;
+		for (uint32_t BlockX = 0; BlockX < NumBlocksX; ++BlockX, Out += BlockBytes)
+		{
+			XMVECTOR Texels[16];
+			LoadBlock(Source, Width, Height, BlockX, BlockY, Texels);
+			EncodeBlock(Kind, Texels, Out);
+		}
+	});
+}
+
+void BCEncoder::Decode(DXGI_FORMAT Format, uint32_t Width, uint32_t Height, const D3D12_SUBRESOURCE_DATA& Source,
+	const D3D12_MEMCPY_DEST& Dest)
+{
+	const BlockKind Kind = GetBlockKind(Format);
+	const uint32_t BlockBytes = GetBlockBytes(Format);
+	for (uint32_t BlockY = 0; BlockY < (Height + 3) / 4; ++BlockY)
+	{
+		const uint8_t* In = (const uint8_t*)Source.pData + BlockY * Source.RowPitch;
+		for (uint32_t BlockX = 0; BlockX < (Width + 3) / 4; ++BlockX, In += BlockBytes)
+		{
+			uint8_t Texels[16][4];
+			DecodeBlock(Kind, In, Texels);
+
+			for (uint32_t y = 0; y < 4 && BlockY * 4 + y < Height; ++y)
+			{
+				uint8_t* Out = (uint8_t*)Dest.pData + (BlockY * 4 + y) * Dest.RowPitch + BlockX * 16;
+				for (uint32_t x = 0; x < 4 && BlockX * 4 + x < Width; ++x)
+					memcpy(Out + x * 4, Texels[y * 4 + x], 4);
+			}
+		}
+	}
+}
+
+float BCEncoder::ComputePSNR(DXGI_FORMAT Format, uint32_t Width, uint32_t Height, const D3D12_SUBRESOURCE_DATA& Original,
+	const D3D12_SUBRESOURCE_DATA& Encoded)
+{
+	const BlockKind Kind = GetBlockKind(Format);
+	const uint32_t BlockBytes = GetBlockBytes(Format);
+	const uint32_t NumChannels = Kind == kBlockBC4 ? 1 : Kind == kBlockBC5 ? 2 : Kind == kBlockBC1 ? 3 : 4;
+
+	uint64_t SquaredError = 0;
+	for (uint32_t BlockY = 0; BlockY < (Height + 3) / 4; ++BlockY)
+	{
+		const uint8_t* In = (const uint8_t*)Encoded.pData + BlockY * Encoded.RowPitch;
+		for (uint32_t BlockX = 0; BlockX < (Width + 3) / 4; ++BlockX, In += BlockBytes)
+		{
+			uint8_t Texels[16][4];
+			DecodeBlock(Kind, In, Texels);
+
+			for (uint32_t y = 0; y < 4 && BlockY * 4 + y < Height; ++y)
+			{
+				const uint8_t* Row = (const uint8_t*)Original.pData + (BlockY * 4 + y) * Original.RowPitch + BlockX * 16;
+				for (uint32_t x = 0; x < 4 && BlockX * 4 + x < Width; ++x)
+				{
+					for (uint32_t c = 0; c < NumChannels; ++c)
+					{
+						const int32_t Difference = (int32_t)Row[x * 4 + c] - Texels[y * 4 + x][c];
+						SquaredError += (uint64_t)(Difference * Difference);
+					}
+				}
+			}
+		}
+	}
+
+	if (SquaredError == 0)
+		return numeric_limits<float>::infinity();
+
+	const double MeanSquaredError = (double)SquaredError / ((uint64_t)Width * Height * NumChannels);
+	return (float)(10.0 * log10(255.0 * 255.0 / MeanSquaredError));
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "../../EngineCore/Core/Common.h"
+
+// Encodes RGBA8 images to block-compressed formats: BC1 and BC3 for color, BC4 and BC5 for one or
+// two channels (R, RG), and BC7 through mode 6 alone, the fast one: a single subset of RGBA
+// endpoints.  The UNORM and SRGB variants are the same blocks.  BC1 keeps no alpha.
+//
+// Each block is fit along the principal axis of its texels, found by power iteration in DirectXMath,
+// a texel per SSE register.  Its endpoints are then refined by least squares against the indices
+// they gave.  Blocks are independent, with Parallel the block rows are spread over the PPL pool.
+//
+// The decoder is the counterpart, for measuring the result.  It reads every block BC1 to BC5 may hold
+// but only mode 6 of BC7.
+class BCEncoder
+{
+public:
+	static bool IsSupported(DXGI_FORMAT Format);
+	// 8 or 16, 0 for a format that is not block compressed
+	static uint32_t GetBlockBytes(DXGI_FORMAT Format);
+
+	// Source is RGBA8, Dest a row of blocks every RowPitch bytes.  Blocks over the edge of a size that
+	// is not a multiple of 4 repeat the last row and column.
+	static void Encode(DXGI_FORMAT Format, uint32_t Width, uint32_t Height, const D3D12_SUBRESOURCE_DATA& Source,
+		const D3D12_MEMCPY_DEST& Dest, bool Parallel = false);
+	// To RGBA8 as a shader would read it, missing channels 0 and alpha 1
+	static void Decode(DXGI_FORMAT Format, uint32_t Width, uint32_t Height, const D3D12_SUBRESOURCE_DATA& Source,
+		const D3D12_MEMCPY_DEST& Dest);
+
+	// In dB, over the channels the format keeps.  Infinite when they match.
+	static float ComputePSNR(DXGI_FORMAT Format, uint32_t Width, uint32_t Height, const D3D12_SUBRESOURCE_DATA& Original,
+		const D3D12_SUBRESOURCE_DATA& Encoded);
+};
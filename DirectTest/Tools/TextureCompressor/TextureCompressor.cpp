@@ -0,0 +1,257 @@
+// Compresses JPEG and PNG images to a BC format and writes them as DDS files, with their mip chain,
+// for TextureLoader to copy to video memory as they are.  The engine no longer compresses anything at
+// load time, this is where textures are encoded.
+//
+//     TextureCompressor [-format BC7] [-linear] [-box] [-levels N] Input Output.dds
+//
+//     -format   BC1, BC3, BC4, BC5 or BC7, with _SRGB for the sRGB variants of BC1, BC3 and BC7
+//     -linear   Color is not sRGB, mips are filtered as stored.  For normal maps and masks.
+//     -box      Box filter for the mips instead of Kaiser
+//     -levels   At most N levels, 0 (the default) for the whole chain
+//
+// Prints the encode speed in megapixels per second over every level, the PSNR of each level against
+// the RGBA8 level it was encoded from, and the memory saved over RGBA8.  Returns 1 on any error.
+//
+// Resources/woodTexture.dds is woodTexture.jpg with the defaults.  The tool builds with the tests, see
+// Tests/CMakeLists.txt.
+
+#include "BCEncoder.h"
+#include "../../EngineCore/Renderer/Graphics/DdsReader.h"
+#include "../../EngineCore/Renderer/Graphics/ImageLoader.h"
+#include "../../EngineCore/Renderer/Graphics/MipGenerator.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+	const uint32_t DDS_MAGIC = 0x20534444;			// "DDS "
+	const uint32_t DDS_HEADER_SIZE = 124;
+	const uint32_t DDS_PIXELFORMAT_SIZE = 32;
+
+	// DDS_HEADER.dwFlags: caps, height, width, pixel format, mip count and linear size
+	const uint32_t DDSD_FLAGS = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;
+	// DDS_HEADER.dwCaps: complex, texture and mipmap
+	const uint32_t DDSCAPS_FLAGS = 0x8 | 0x1000 | 0x400000;
+	const uint32_t DDPF_FOURCC = 0x4;
+	const uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+
+	struct FormatName
+	{
+		const wchar_t* Name;
+		DXGI_FORMAT Format;
+	};
+
+	const FormatName FORMATS[] =
+	{
+		{ L"BC1", DXGI_FORMAT_BC1_UNORM },
+		{ L"BC1_SRGB", DXGI_FORMAT_BC1_UNORM_SRGB },
+		{ L"BC3", DXGI_FORMAT_BC3_UNORM },
+		{ L"BC3_SRGB", DXGI_FORMAT_BC3_UNORM_SRGB },
+		{ L"BC4", DXGI_FORMAT_BC4_UNORM },
+		{ L"BC5", DXGI_FORMAT_BC5_UNORM },
+		{ L"BC7", DXGI_FORMAT_BC7_UNORM },
+		{ L"BC7_SRGB", DXGI_FORMAT_BC7_UNORM_SRGB },
+	};
+
+	const wchar_t* GetFormatName(DXGI_FORMAT Format)
+	{
+		for (const FormatName& Known : FORMATS)
+		{
+			if (Known.Format == Format)
+				return Known.Name;
+		}
+		return L"?";
+	}
+
+	float ElapsedMs(const LARGE_INTEGER& Start)
+	{
+		LARGE_INTEGER Frequency, End;
+		QueryPerformanceFrequency(&Frequency);
+		QueryPerformanceCounter(&End);
+		return (float)((End.QuadPart - Start.QuadPart) * 1000.0 / Frequency.QuadPart);
+	}
+
+	void WriteU32(vector<uint8_t>& File, size_t Offset, uint32_t Value)
+	{
+		memcpy(&File[Offset], &Value, 4);
+	}
+
+	// The headers of a 2D texture with the DX10 extension, which is what DdsReader takes for any DXGI
+	// format.  The levels follow, each with its rows of blocks back to back.
+	vector<uint8_t> WriteHeaders(DXGI_FORMAT Format, uint32_t Width, uint32_t Height, uint32_t NumLevels)
+	{
+		vector<uint8_t> File(4 + DDS_HEADER_SIZE + 20, 0);
+		WriteU32(File, 0, DDS_MAGIC);
+
+		const size_t Header = 4;
+		WriteU32(File, Header, DDS_HEADER_SIZE);
+		WriteU32(File, Header + 4, DDSD_FLAGS);
+		WriteU32(File, Header + 8, Height);
+		WriteU32(File, Header + 12, Width);
+		WriteU32(File, Header + 16, ImageLoader::GetRowPitch(Format, Width) * ImageLoader::GetNumRows(Format, Height));
+		WriteU32(File, Header + 24, NumLevels);
+		WriteU32(File, Header + 72, DDS_PIXELFORMAT_SIZE);
+		WriteU32(File, Header + 76, DDPF_FOURCC);
+		WriteU32(File, Header + 80, 0x30315844);		// "DX10"
+		WriteU32(File, Header + 104, DDSCAPS_FLAGS);
+
+		const size_t Extension = 4 + DDS_HEADER_SIZE;
+		WriteU32(File, Extension, (uint32_t)Format);
+		WriteU32(File, Extension + 4, DDS_DIMENSION_TEXTURE2D);
+		WriteU32(File, Extension + 12, 1);
+		return File;
+	}
+
+	int PrintUsage()
+	{
+		fwprintf(stderr, L"Usage: TextureCompressor [-format BC7] [-linear] [-box] [-levels N] Input Output.dds\n");
+		return 1;
+	}
+}
+
+int wmain(int argc, wchar_t** argv)
+{
+	DXGI_FORMAT Format = DXGI_FORMAT_BC7_UNORM;
+	MipChainOptions Mips;
+	const wchar_t* InputName = nullptr;
+	const wchar_t* OutputName = nullptr;
+
+	for (int Arg = 1; Arg < argc; ++Arg)
+	{
+		if (wcscmp(argv[Arg], L"-format") == 0 && Arg + 1 < argc)
+		{
+			const wchar_t* Name = argv[++Arg];
+			Format = DXGI_FORMAT_UNKNOWN;
+			for (const FormatName& Known : FORMATS)
+			{
+				if (_wcsicmp(Known.Name, Name) == 0)
+					Format = Known.Format;
+			}
+			if (Format == DXGI_FORMAT_UNKNOWN)
+			{
+				fwprintf(stderr, L"Unknown format %s\n", Name);
+				return 1;
+			}
+		}
+		else if (wcscmp(argv[Arg], L"-linear") == 0)
+			Mips.SRGB = false;
+		else if (wcscmp(argv[Arg], L"-box") == 0)
+			Mips.Filter = kMipFilterBox;
+		else if (wcscmp(argv[Arg], L"-levels") == 0 && Arg + 1 < argc)
+			Mips.MaxLevels = (uint32_t)wcstoul(argv[++Arg], nullptr, 10);
+		else if (InputName == nullptr)
+			InputName = argv[Arg];
+		else if (OutputName == nullptr)
+			OutputName = argv[Arg];
+		else
+			return PrintUsage();
+	}
+	if (OutputName == nullptr)
+		return PrintUsage();
+
+	int RowPitch;
+	Image Source;
+	if (!ImageLoader::LoadImageFromFile(InputName, RowPitch, &Source))
+	{
+		fwprintf(stderr, L"Could not load %s\n", InputName);
+		return 1;
+	}
+	const uint32_t Width = Source.textureWidth;
+	const uint32_t Height = Source.textureHeight;
+
+	// D3D only takes block-compressed textures whose top level is whole blocks.  DDS inputs are not
+	// decoded, they would come back in their own format.
+	if (Source.dxgiFormat != DXGI_FORMAT_R8G8B8A8_UNORM || Width % 4 != 0 || Height % 4 != 0)
+	{
+		fwprintf(stderr, L"%s is not a JPEG or PNG image whose size is a multiple of 4\n", InputName);
+		free(Source.imageData);
+		return 1;
+	}
+
+	// Every RGBA8 level on the heap, level 0 as decoded
+	const uint32_t NumLevels = MipGenerator::GetNumLevels(Width, Height, Mips.MaxLevels);
+	vector<vector<uint8_t>> Pixels(NumLevels);
+	vector<D3D12_MEMCPY_DEST> Levels(NumLevels);
+	for (uint32_t Level = 0; Level < NumLevels; ++Level)
+	{
+		const uint32_t LevelWidth = max(Width >> Level, 1u);
+		const uint32_t LevelHeight = max(Height >> Level, 1u);
+		Pixels[Level].resize((size_t)LevelWidth * LevelHeight * 4);
+		Levels[Level].pData = Pixels[Level].data();
+		Levels[Level].RowPitch = (SIZE_T)LevelWidth * 4;
+		Levels[Level].SlicePitch = Pixels[Level].size();
+	}
+	for (uint32_t Row = 0; Row < Height; ++Row)
+		memcpy(&Pixels[0][(size_t)Row * Width * 4], Source.imageData + (size_t)Row * RowPitch, (size_t)Width * 4);
+	free(Source.imageData);
+
+	LARGE_INTEGER MipStart;
+	QueryPerformanceCounter(&MipStart);
+	MipGenerator::Generate(Mips, Width, Height, NumLevels, Levels.data(), true);
+	const float MipMs = ElapsedMs(MipStart);
+
+	// The levels are encoded into the file as it will be written, each right after the one above
+	vector<uint8_t> File = WriteHeaders(Format, Width, Height, NumLevels);
+	vector<size_t> Offsets(NumLevels);
+	uint64_t NumPixels = 0;
+	for (uint32_t Level = 0; Level < NumLevels; ++Level)
+	{
+		const uint32_t LevelWidth = max(Width >> Level, 1u);
+		const uint32_t LevelHeight = max(Height >> Level, 1u);
+		Offsets[Level] = File.size();
+		File.resize(File.size() + (size_t)ImageLoader::GetRowPitch(Format, LevelWidth) * ImageLoader::GetNumRows(Format, LevelHeight));
+		NumPixels += (uint64_t)LevelWidth * LevelHeight;
+	}
+
+	LARGE_INTEGER EncodeStart;
+	QueryPerformanceCounter(&EncodeStart);
+	for (uint32_t Level = 0; Level < NumLevels; ++Level)
+	{
+		const uint32_t LevelWidth = max(Width >> Level, 1u);
+		const D3D12_SUBRESOURCE_DATA Source = { Levels[Level].pData, (LONG_PTR)Levels[Level].RowPitch, (LONG_PTR)Levels[Level].SlicePitch };
+		const size_t BlockRowBytes = ImageLoader::GetRowPitch(Format, LevelWidth);
+		const D3D12_MEMCPY_DEST Dest = { &File[Offsets[Level]], BlockRowBytes, (Level + 1 < NumLevels ? Offsets[Level + 1] : File.size()) - Offsets[Level] };
+		BCEncoder::Encode(Format, LevelWidth, max(Height >> Level, 1u), Source, Dest, true);
+	}
+	const float EncodeMs = ElapsedMs(EncodeStart);
+
+	// Read back the way TextureLoader will, so a file it would refuse is never written
+	DdsReader Dds;
+	if (!Dds.ReadHeader(File.data(), File.size()) || Dds.GetFormat() != Format || Dds.GetMipLevels() != NumLevels ||
+		Dds.GetNumSubresources() != NumLevels || Dds.GetSubresource(NumLevels - 1).Data != &File[Offsets[NumLevels - 1]])
+	{
+		fwprintf(stderr, L"The DDS file written for %s does not read back\n", InputName);
+		return 1;
+	}
+
+	wprintf(L"%s: %ux%u, %u levels, %s\n", InputName, Width, Height, NumLevels, GetFormatName(Format));
+	for (uint32_t Level = 0; Level < NumLevels; ++Level)
+	{
+		const uint32_t LevelWidth = max(Width >> Level, 1u);
+		const uint32_t LevelHeight = max(Height >> Level, 1u);
+		const DdsReader::Subresource& Encoded = Dds.GetSubresource(Level);
+		const D3D12_SUBRESOURCE_DATA Original = { Levels[Level].pData, (LONG_PTR)Levels[Level].RowPitch, (LONG_PTR)Levels[Level].SlicePitch };
+		const D3D12_SUBRESOURCE_DATA Blocks = { Encoded.Data, (LONG_PTR)Encoded.RowBytes, (LONG_PTR)(Encoded.RowBytes * Encoded.NumRows) };
+		wprintf(L"  Level %2u %5ux%-5u %6.2f dB\n", Level, LevelWidth, LevelHeight,
+			BCEncoder::ComputePSNR(Format, LevelWidth, LevelHeight, Original, Blocks));
+	}
+
+	const size_t EncodedBytes = File.size() - Offsets[0];
+	wprintf(L"  Mips %.1f ms, encoded in %.1f ms, %.1f MP/s\n", MipMs, EncodeMs, NumPixels / (EncodeMs * 1000.0));
+	wprintf(L"  %llu KB, RGBA8 would take %llu KB, %.1fx less\n", (unsigned long long)EncodedBytes >> 10,
+		(unsigned long long)NumPixels * 4 >> 10, (double)NumPixels * 4 / EncodedBytes);
+
+	ofstream Output(OutputName, ios::binary);
+	if (!Output.write((const char*)File.data(), File.size()))
+	{
+		fwprintf(stderr, L"Could not write %s\n", OutputName);
+		return 1;
+	}
+	return 0;
+}
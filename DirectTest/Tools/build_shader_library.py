@@ -0,0 +1,370 @@
+#!/usr/bin/env python3
+"""Compiles the shader variants the engine uses with DXC and packs them into one library.
+
+    python3 Tools/build_shader_library.py [--dxc PATH] [--output FILE] [--layouts FILE]
+
+Runs on Windows and Linux.  Only the permutations listed in VARIANTS are built, add a line there
+when a material starts using a new one.  The file layout and the feature bits must match
+EngineCore/Renderer/Graphics/ShaderLibrary.h.
+
+Variants that compile to the same bytecode are stored once.  Every blob starts on a 16-byte boundary
+because the engine hands out pointers straight into the memory mapped file.
+
+The root signature and the input layout of every name and permutation are taken from the reflection
+of its stages and written as tables to EngineCore/Renderer/Graphics/GeneratedShaderLayouts.h.
+Bindings the compiler stripped are left out, the root parameters that change most often come first.
+"""
+
+import argparse
+import hashlib
+import os
+import re
+import struct
+import subprocess
+import sys
+import tempfile
+
+PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# ShaderFeature
+TEXTURED = 1 << 0
+QUANTIZED_VERTICES = 1 << 1
+SKINNING = 1 << 2
+DEPTH_ONLY = 1 << 3
+LIGHT_COUNT_SHIFT = 4
+LIGHT_COUNT_MASK = 3 << LIGHT_COUNT_SHIFT
+
+
+def lights(count):
+    assert 0 <= count <= 3
+    return count << LIGHT_COUNT_SHIFT
+
+
+# ShaderStage
+VERTEX, PIXEL, COMPUTE = 0, 1, 2
+PROFILES = {VERTEX: 'vs_6_0', PIXEL: 'ps_6_0', COMPUTE: 'cs_6_0'}
+
+# (name, source, stage, entry point, permutations).  Depth-only variants have no pixel shader.
+VARIANTS = [
+    ('Standard', 'Shaders/VertexShader.hlsl', VERTEX, 'VSMain', [TEXTURED | lights(1), DEPTH_ONLY]),
+    ('Standard', 'Shaders/PixelShader.hlsl', PIXEL, 'PSMain', [TEXTURED | lights(1)]),
+]
+
+# Vertex buffer layouts, one per shader name, in the order of the members of the C++ vertex struct.
+# Reflection tells which elements a variant reads, the offsets come from here so they always match
+# the struct.
+VERTEX_STREAMS = {
+    'Standard': [
+        ('POSITION', 0, 'R32G32B32_FLOAT'),
+        ('TEXCOORD', 0, 'R32G32_FLOAT'),
+        ('COLOR', 0, 'R32G32B32A32_FLOAT'),
+        ('NORMAL', 0, 'R32G32B32_FLOAT'),
+    ],
+}
+
+# Depth-only variants read the tightly packed position stream of the mesh instead (Mesh::POSITION_STRIDE)
+POSITION_STREAM = [('POSITION', 0, 'R32G32B32_FLOAT')]
+
+FORMAT_SIZES = {
+    'R32G32B32A32_FLOAT': 16, 'R32G32B32_FLOAT': 12, 'R32G32_FLOAT': 8, 'R32_FLOAT': 4,
+    'R16G16B16A16_SNORM': 8, 'R16G16_SNORM': 4, 'R8G8B8A8_UNORM': 4, 'R8G8B8A8_UINT': 4,
+}
+
+# How often a binding changes, the root parameters are sorted by it.  Bindings not listed here go
+# after the listed ones of the same kind.
+PER_DRAW, PER_MESH, PER_MATERIAL, PER_FRAME = 0, 1, 2, 3
+UPDATE_FREQUENCY = {
+    'DrawConstants': PER_DRAW,
+    'instances': PER_MESH,
+    'bones': PER_MESH,
+    'materials': PER_MATERIAL,
+    'g_textures': PER_FRAME,
+}
+
+# Constant buffers up to this size are bound as root constants
+MAX_ROOT_CONSTANT_BYTES = 16
+
+VISIBILITY = {VERTEX: 'D3D12_SHADER_VISIBILITY_VERTEX', PIXEL: 'D3D12_SHADER_VISIBILITY_PIXEL',
+              COMPUTE: 'D3D12_SHADER_VISIBILITY_ALL'}
+
+FILE_MAGIC = 0x424C4853  # "SHLB"
+FORMAT_VERSION = 2
+MAX_NAME_LENGTH = 32
+BLOB_ALIGNMENT = 16
+HEADER = struct.Struct('<IIII')                        # Magic, Version, NumEntries, NumBlobs
+ENTRY = struct.Struct('<%dsIIQQQ' % MAX_NAME_LENGTH)   # Name, Stage, Permutation, Offset, Size, ContentHash
+
+
+def defines(permutation):
+    return {
+        'TEXTURED': 1 if permutation & TEXTURED else 0,
+        'QUANTIZED_VERTICES': 1 if permutation & QUANTIZED_VERTICES else 0,
+        'SKINNING': 1 if permutation & SKINNING else 0,
+        'DEPTH_ONLY': 1 if permutation & DEPTH_ONLY else 0,
+        'LIGHT_COUNT': (permutation & LIGHT_COUNT_MASK) >> LIGHT_COUNT_SHIFT,
+    }
+
+
+def align_up(value, alignment):
+    return (value + alignment - 1) // alignment * alignment
+
+
+def content_hash(bytecode):
+    return struct.unpack('<Q', hashlib.blake2b(bytecode, digest_size=8).digest())[0]
+
+
+def run_dxc(dxc, source, stage, entry, permutation, options):
+    command = [dxc, '-nologo', '-T', PROFILES[stage], '-E', entry, '-I', os.path.dirname(source)] + options
+    for name, value in sorted(defines(permutation).items()):
+        command += ['-D', '%s=%d' % (name, value)]
+    command.append(source)
+
+    result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+    if result.returncode != 0:
+        sys.stderr.write(result.stdout)
+        raise SystemExit('Failed to compile %s 0x%x' % (source, permutation))
+
+
+def compile_variant(dxc, source, stage, entry, permutation, debug):
+    """Returns the bytecode and the DXC listing.  The listing always comes from an optimized build, so
+    the bindings are the ones that survive in release and the layouts do not depend on --debug."""
+    with tempfile.TemporaryDirectory() as temp:
+        output = os.path.join(temp, 'variant.dxil')
+        listing = os.path.join(temp, 'variant.lst')
+        if debug:
+            run_dxc(dxc, source, stage, entry, permutation, ['-Fo', output, '-Zi', '-Qembed_debug', '-Od'])
+            run_dxc(dxc, source, stage, entry, permutation, ['-Fc', listing, '-O3'])
+        else:
+            run_dxc(dxc, source, stage, entry, permutation, ['-Fo', output, '-Fc', listing, '-O3'])
+
+        with open(output, 'rb') as f:
+            bytecode = f.read()
+        with open(listing) as f:
+            return bytecode, f.read()
+
+
+def parse_listing(listing):
+    """Reflection from the comment block at the top of a DXC listing: the vertex inputs the shader
+    reads, its resource bindings and the sizes of its constant buffers."""
+    inputs, bindings = [], []
+    section, in_table = None, False
+    for line in listing.splitlines():
+        text = line[1:].strip() if line.startswith(';') else None
+        if text is None:
+            section = None
+        elif text in ('Input signature:', 'Resource Bindings:'):
+            section, in_table = text, False
+        elif section and text.startswith('---'):
+            in_table = True
+        elif section and in_table and not text:
+            section = None
+        elif section == 'Input signature:' and in_table:
+            # Name Index Mask Register SysValue Format [Used]
+            fields = text.split()
+            if fields[4] == 'NONE' and len(fields) > 6:
+                inputs.append((fields[0], int(fields[1])))
+        elif section == 'Resource Bindings:' and in_table:
+            # Name Type Format Dim ID HLSL-Bind Count
+            name, kind, _, dim, _, bind, count = text.split()
+            register, _, space = bind.partition(',space')
+            bindings.append({
+                'name': name, 'kind': kind, 'dim': dim,
+                'register': int(re.sub(r'^[a-z]+', '', register)), 'space': int(space or 0),
+                'count': 0xFFFFFFFF if count == 'unbounded' else int(count),
+            })
+
+    sizes = {name: int(size) for name, size in
+             re.findall(r'^;\s*\}\s*(\w+);\s*; Offset:\s*\d+ Size:\s*(\d+)', listing, re.M)}
+    return inputs, bindings, sizes
+
+
+def root_parameter(binding, sizes):
+    """(sort kind, parameter type, range type, count) of a binding that is not a sampler."""
+    kind, dim, count = binding['kind'], binding['dim'], binding['count']
+    if kind == 'cbuffer':
+        size = sizes.get(binding['name'], MAX_ROOT_CONSTANT_BYTES + 1)
+        if size <= MAX_ROOT_CONSTANT_BYTES and count == 1:
+            return 0, 'D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS', 'D3D12_DESCRIPTOR_RANGE_TYPE_CBV', (size + 3) // 4
+        if count == 1:
+            return 1, 'D3D12_ROOT_PARAMETER_TYPE_CBV', 'D3D12_DESCRIPTOR_RANGE_TYPE_CBV', 1
+        return 2, 'D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE', 'D3D12_DESCRIPTOR_RANGE_TYPE_CBV', count
+    # Only structured and raw buffers can be root descriptors
+    if kind == 'texture':
+        if dim == 'r/o' and count == 1:
+            return 1, 'D3D12_ROOT_PARAMETER_TYPE_SRV', 'D3D12_DESCRIPTOR_RANGE_TYPE_SRV', 1
+        return 2, 'D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE', 'D3D12_DESCRIPTOR_RANGE_TYPE_SRV', count
+    if kind == 'UAV':
+        if dim == 'r/w' and count == 1:
+            return 1, 'D3D12_ROOT_PARAMETER_TYPE_UAV', 'D3D12_DESCRIPTOR_RANGE_TYPE_UAV', 1
+        return 2, 'D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE', 'D3D12_DESCRIPTOR_RANGE_TYPE_UAV', count
+    raise SystemExit('Unknown binding type %s of %s' % (kind, binding['name']))
+
+
+def vertex_stream(name, permutation):
+    if permutation & DEPTH_ONLY:
+        return POSITION_STREAM
+    return VERTEX_STREAMS.get(name)
+
+
+def build_layout(name, permutation, stages):
+    """Merges the reflection of the stages of one variant into a root signature and an input layout.
+    stages maps a ShaderStage to its parsed listing."""
+    merged = {}
+    vertex_inputs = []
+    for stage, (inputs, bindings, sizes) in sorted(stages.items()):
+        if stage == VERTEX:
+            vertex_inputs = inputs
+        for binding in bindings:
+            key = (binding['kind'] == 'sampler', binding['kind'], binding['space'], binding['register'])
+            if key in merged:
+                merged[key]['visibility'] = 'D3D12_SHADER_VISIBILITY_ALL'
+            else:
+                merged[key] = dict(binding, visibility=VISIBILITY[stage], sizes=sizes)
+
+    parameters, samplers = [], []
+    for (is_sampler, _, _, _), binding in merged.items():
+        if is_sampler:
+            samplers.append(binding)
+            continue
+        kind, parameter_type, range_type, count = root_parameter(binding, binding['sizes'])
+        frequency = UPDATE_FREQUENCY.get(binding['name'], PER_FRAME + 1)
+        parameters.append(((frequency, kind, binding['space'], binding['register']),
+                           (binding['name'], parameter_type, range_type, binding['register'], binding['space'],
+                            count, binding['visibility'])))
+    parameters = [parameter for _, parameter in sorted(parameters)]
+    samplers.sort(key=lambda binding: (binding['space'], binding['register']))
+
+    elements, stride = [], 0
+    if vertex_inputs:
+        stream = vertex_stream(name, permutation)
+        if stream is None:
+            raise SystemExit('%s reads vertex inputs but has no entry in VERTEX_STREAMS' % name)
+        offsets = {}
+        for semantic, index, format in stream:
+            offsets[(semantic, index)] = stride
+            stride += FORMAT_SIZES[format]
+        for semantic, index, format in stream:
+            if (semantic, index) in vertex_inputs:
+                elements.append((semantic, index, format, offsets[(semantic, index)]))
+        missing = set(vertex_inputs) - set(offsets)
+        if missing:
+            raise SystemExit('%s 0x%x reads %s, which its vertex stream does not have' % (name, permutation, sorted(missing)))
+
+    return {'name': name, 'permutation': permutation, 'parameters': parameters, 'samplers': samplers,
+            'elements': elements, 'stride': stride}
+
+
+def format_layouts(layouts):
+    lines = [
+        '// Generated by Tools/build_shader_library.py from the reflection of the shader variants, do not edit.',
+        '// Included by ShaderLayout.cpp only.',
+        '#pragma once',
+        '',
+        '#include "ShaderLayout.h"',
+        '',
+        'namespace GeneratedShaderLayouts',
+        '{',
+    ]
+    table = []
+    for layout in layouts:
+        prefix = '%s_0x%02x' % (layout['name'], layout['permutation'])
+        lines.append('\t// %s, permutation 0x%02x' % (layout['name'], layout['permutation']))
+
+        parameters = samplers = elements = 'nullptr'
+        if layout['parameters']:
+            parameters = prefix + '_Parameters'
+            lines.append('\tstatic const ShaderRootParameter %s[] =' % parameters)
+            lines.append('\t{')
+            for name, parameter_type, range_type, register, space, count, visibility in layout['parameters']:
+                count = 'UINT_MAX' if count == 0xFFFFFFFF else str(count)
+                lines.append('\t\t{ "%s", %s, %s, %d, %d, %s, %s },' %
+                             (name, parameter_type, range_type, register, space, count, visibility))
+            lines.append('\t};')
+        if layout['samplers']:
+            samplers = prefix + '_Samplers'
+            lines.append('\tstatic const ShaderStaticSampler %s[] =' % samplers)
+            lines.append('\t{')
+            for sampler in layout['samplers']:
+                lines.append('\t\t{ "%s", %d, %d, %s },' %
+                             (sampler['name'], sampler['register'], sampler['space'], sampler['visibility']))
+            lines.append('\t};')
+        if layout['elements']:
+            elements = prefix + '_InputElements'
+            lines.append('\tstatic const D3D12_INPUT_ELEMENT_DESC %s[] =' % elements)
+            lines.append('\t{')
+            for semantic, index, format, offset in layout['elements']:
+                lines.append('\t\t{ "%s", %d, DXGI_FORMAT_%s, 0, %d, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },' %
+                             (semantic, index, format, offset))
+            lines.append('\t};')
+        lines.append('')
+
+        table.append('\t\t{ "%s", 0x%02x, %s, %d, %s, %d, %s, %d, %d },' %
+                     (layout['name'], layout['permutation'], parameters, len(layout['parameters']), samplers,
+                      len(layout['samplers']), elements, len(layout['elements']), layout['stride']))
+
+    lines += ['\tstatic const ShaderLayout Layouts[] =', '\t{'] + table + ['\t};', '}', '']
+    return '\n'.join(lines)
+
+
+def write_if_changed(path, text):
+    """Leaves the file alone when nothing changed, so the C++ that includes it is not rebuilt."""
+    if os.path.exists(path):
+        with open(path, newline='') as f:
+            if f.read() == text:
+                return
+    with open(path, 'w', newline='') as f:
+        f.write(text)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--dxc', default='dxc', help='DXC executable')
+    parser.add_argument('--output', default=os.path.join(PROJECT_DIR, 'Resources', 'ShaderLib', 'Shaders.shlib'))
+    parser.add_argument('--layouts', default=os.path.join(PROJECT_DIR, 'EngineCore', 'Renderer', 'Graphics',
+                                                          'GeneratedShaderLayouts.h'))
+    parser.add_argument('--debug', action='store_true', help='Unoptimized, with embedded debug info')
+    args = parser.parse_args()
+
+    entries = []
+    reflection = {}
+    for name, source, stage, entry, permutations in VARIANTS:
+        assert len(name) <= MAX_NAME_LENGTH
+        for permutation in permutations:
+            bytecode, listing = compile_variant(args.dxc, os.path.join(PROJECT_DIR, source), stage, entry,
+                                                permutation, args.debug)
+            entries.append((name, stage, permutation, bytecode))
+            reflection.setdefault((name, permutation), {})[stage] = parse_listing(listing)
+            print('%-12s %-24s 0x%02x %6d bytes' % (name, os.path.basename(source), permutation, len(bytecode)))
+
+    layouts = [build_layout(name, permutation, stages)
+               for (name, permutation), stages in sorted(reflection.items())]
+    write_if_changed(args.layouts, format_layouts(layouts))
+
+    # Blobs are keyed by content hash, equal bytecode is compared in full before it is shared
+    offset = align_up(HEADER.size + ENTRY.size * len(entries), BLOB_ALIGNMENT)
+    blobs = {}
+    data = bytearray()
+    table = []
+    for name, stage, permutation, bytecode in entries:
+        key = content_hash(bytecode)
+        if key in blobs:
+            assert blobs[key][1] == bytecode, 'Content hash collision'
+        else:
+            blobs[key] = (offset + len(data), bytecode)
+            data += bytecode
+            data += bytes(align_up(len(data), BLOB_ALIGNMENT) - len(data))
+        table.append(ENTRY.pack(name.encode('ascii'), stage, permutation, blobs[key][0], len(bytecode), key))
+
+    header = HEADER.pack(FILE_MAGIC, FORMAT_VERSION, len(entries), len(blobs))
+    os.makedirs(os.path.dirname(args.output), exist_ok=True)
+    with open(args.output, 'wb') as f:
+        f.write(header)
+        f.write(b''.join(table))
+        f.write(bytes(offset - HEADER.size - ENTRY.size * len(entries)))
+        f.write(data)
+
+    print('%d variants in %d blobs, %d bytes in %s' % (len(entries), len(blobs), offset + len(data), args.output))
+
+
+if __name__ == '__main__':
+    main()